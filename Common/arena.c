@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "arena.h"
+
+/* Allineamento di ogni allocazione, sufficiente per double e per i tipi dei contenitori */
+#define ARENA_ALIGN 16
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t capacity;
+    /* I dati seguono l'intestazione, che occupa un multiplo di ARENA_ALIGN */
+};
+
+#define ARENA_HEADER (((sizeof(ArenaBlock) + ARENA_ALIGN - 1) / ARENA_ALIGN) * ARENA_ALIGN)
+
+static __thread Arena thread_arena;
+
+Arena *threadArena(void) {
+    return &thread_arena;
+}
+
+static char *blockData(ArenaBlock *block) {
+    return (char *)block + ARENA_HEADER;
+}
+
+static ArenaBlock *newBlock(size_t capacity) {
+    ArenaBlock *block = (ArenaBlock *)malloc(ARENA_HEADER + capacity);
+    if (block == NULL) {
+        fprintf(stderr, "Out of memory: cannot grow the query arena by %zu bytes\n", capacity);
+        exit(1);
+    }
+    block->next = NULL;
+    block->capacity = capacity;
+    return block;
+}
+
+void *arenaAlloc(Arena *arena, size_t bytes) {
+    bytes = ((bytes + ARENA_ALIGN - 1) / ARENA_ALIGN) * ARENA_ALIGN;
+
+    if (arena->current == NULL) {
+        /* Primo uso, oppure reset alla posizione iniziale: riparto dal primo blocco */
+        if (arena->first == NULL) {
+            arena->first = newBlock(bytes > ARENA_BLOCK_SIZE ? bytes : ARENA_BLOCK_SIZE);
+        }
+        arena->current = arena->first;
+        arena->used = 0;
+    }
+
+    while (arena->used + bytes > arena->current->capacity) {
+        ArenaBlock *block = arena->current;
+        if (block->next == NULL || block->next->capacity < bytes) {
+            /* Il nuovo blocco si inserisce dopo il corrente, quelli successivi restano in coda */
+            size_t capacity = 2 * block->capacity;
+            if (capacity < bytes) capacity = bytes;
+            ArenaBlock *grown = newBlock(capacity);
+            grown->next = block->next;
+            block->next = grown;
+        }
+        arena->current = block->next;
+        arena->used = 0;
+    }
+
+    void *memory = blockData(arena->current) + arena->used;
+    arena->used += bytes;
+    return memory;
+}
+
+void arenaRelease(Arena *arena) {
+    ArenaBlock *block = arena->first;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->used = 0;
+}
@@ -0,0 +1,75 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Capacità minima di un blocco dell'arena: copre le code e i contenitori di quasi tutte le query */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock ArenaBlock;
+
+/** @brief: Allocatore a puntatore crescente (bump allocator) per la memoria temporanea delle query
+ *  La memoria è una catena di blocchi che non vengono mai restituiti durante la ricerca: arenaReset
+ *  riporta indietro il puntatore e i blocchi successivi restano disponibili per le allocazioni
+ *  seguenti, quindi a regime una query non chiama mai malloc e non tocca pagine nuove.
+ */
+typedef struct {
+    ArenaBlock *first;
+    ArenaBlock *current;
+    size_t used;        /* Byte occupati nel blocco corrente */
+} Arena;
+
+/** @brief: Posizione salvata con arenaMark, a cui arenaReset riporta l'arena */
+typedef struct {
+    ArenaBlock *block;
+    size_t used;
+} ArenaMark;
+
+/**
+ * @brief Arena del thread chiamante, creata vuota al primo uso.
+ *
+ * I thread del pool di parallelFor restano attivi tra una chiamata e l'altra, quindi le loro
+ * arene, come quella del thread principale, restano allocate per tutta l'esecuzione.
+ */
+Arena *threadArena(void);
+
+/**
+ * @brief Alloca `bytes` byte allineati a 16 dall'arena.
+ *
+ * Se il blocco corrente non basta passa al successivo della catena, oppure ne aggiunge uno
+ * di capacità almeno doppia. La memoria resta valida fino al primo arenaReset ad una
+ * posizione precedente.
+ *
+ * @param arena Arena da cui allocare.
+ * @param bytes Numero di byte richiesti.
+ * @return Puntatore alla memoria (mai NULL, esce se la memoria è esaurita).
+ */
+void *arenaAlloc(Arena *arena, size_t bytes);
+
+/* Alloca dall'arena un vettore di `count` elementi di tipo `type` */
+#define ARENA_ARRAY(arena, type, count) ((type *)arenaAlloc((arena), (size_t)(count) * sizeof(type)))
+
+/**
+ * @brief Salva la posizione corrente dell'arena.
+ */
+static inline ArenaMark arenaMark(const Arena *arena) {
+    ArenaMark mark;
+    mark.block = arena->current;
+    mark.used = arena->used;
+    return mark;
+}
+
+/**
+ * @brief Libera in un colpo tutto ciò che è stato allocato dopo `mark`.
+ */
+static inline void arenaReset(Arena *arena, ArenaMark mark) {
+    arena->current = mark.block;
+    arena->used = mark.used;
+}
+
+/**
+ * @brief Restituisce tutti i blocchi dell'arena al sistema e la lascia vuota.
+ */
+void arenaRelease(Arena *arena);
+
+#endif
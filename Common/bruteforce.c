@@ -0,0 +1,39 @@
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include "bruteforce.h"
+#include "knnheap.h"
+#include "metric.h"
+#include "arena.h"
+#include "profile.h"
+
+void findKNN(const Point *points, int n, int pointIdx, int k, int *neighbors, double *distances) {
+    Arena *arena = threadArena();
+    ArenaMark mark = arenaMark(arena);
+    KNNEntry *entries = ARENA_ARRAY(arena, KNNEntry, k);
+    KNNHeap heap;
+    knnHeapInit(&heap, entries, k, DBL_MAX);
+
+    /* Il punto stesso viene escluso, degli altri tengo solo i k più vicini; le distanze sono ridotte
+       (vedi metric.h) e la distanza vera si calcola solo sui k risultati */
+    const double *target = points[pointIdx].coord;
+    for (int i = 0; i < n; i++) {
+        if (i == pointIdx) continue;
+        double distance = metricDistance(target, points[i].coord);
+        if (distance <= knnHeapWorst(&heap)) {
+            knnHeapPush(&heap, distance, i);
+        }
+    }
+
+    knnHeapSort(&heap);
+    profileCount(COUNTER_DISTANCES, n - 1);
+    profileCount(COUNTER_HEAP_INSERTS, heap.inserts);
+    for (int i = 0; i < k; i++) {
+        neighbors[i] = (i < heap.size) ? entries[i].index : -1;
+        if (distances != NULL) {
+            distances[i] = (i < heap.size) ? metricFinish(entries[i].distance) : DBL_MAX;
+        }
+    }
+
+    arenaReset(arena, mark);
+}
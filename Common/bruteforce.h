@@ -0,0 +1,22 @@
+#ifndef BRUTEFORCE_H
+#define BRUTEFORCE_H
+
+#include "point.h"
+
+/**
+ * @brief Trova per forza bruta i k vicini più prossimi di un punto del dataset.
+ *
+ * Confronta il punto `pointIdx` con tutti gli altri, escludendo sé stesso, e tiene i k più
+ * vicini in un KNNHeap, con la metrica scelta a compile time (metric.h). È il riferimento esatto
+ * dell'implementazione sequenziale e dello strumento che misura il recall della ricerca approssimata.
+ *
+ * @param points Array di punti.
+ * @param n Numero di punti.
+ * @param pointIdx Posizione nell'array del punto di cui cercare i vicini.
+ * @param k Numero di vicini da trovare.
+ * @param neighbors Array di `k` interi in cui salvare le posizioni dei vicini (-1 se mancanti).
+ * @param distances Array di `k` double in cui salvare le distanze (DBL_MAX se mancanti), oppure NULL.
+ */
+void findKNN(const Point *points, int n, int pointIdx, int k, int *neighbors, double *distances);
+
+#endif
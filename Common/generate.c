@@ -0,0 +1,173 @@
+#include <math.h>
+#include <time.h>
+#include <string.h>
+#include "generate.h"
+
+/* Cluster gaussiani della distribuzione clusters, con deviazione standard tra 0.5 e 4 */
+#define GEN_CLUSTERS 16
+#define GEN_SIGMA_MIN 0.5
+#define GEN_SIGMA_MAX 4.0
+
+/* Spessore (deviazione standard del rumore) della superficie e ampiezza delle sue onde */
+#define GEN_SHEET_NOISE 0.2
+#define GEN_SHEET_AMPLITUDE 20.0
+
+/* Distanza dal centro della distribuzione heavytail: la probabilità di superare r decresce come
+   (1 + r / scale)^-alpha, fino al raggio massimo che tiene i punti dentro il box */
+#define GEN_TAIL_ALPHA 1.0
+#define GEN_TAIL_SCALE 0.5
+#define GEN_TAIL_RADIUS 45.0
+
+/* Indice riservato ai parametri della distribuzione, fuori dagli indici dei punti */
+#define GEN_PARAMS UINT64_MAX
+
+const char *distributionName(Distribution distribution) {
+    switch (distribution) {
+        case DIST_CLUSTERS: return "clusters";
+        case DIST_MANIFOLD: return "manifold";
+        case DIST_HEAVYTAIL: return "heavytail";
+        default: return "uniform";
+    }
+}
+
+int parseDistribution(const char *name, Distribution *distribution) {
+    if (strcmp(name, "uniform") == 0) *distribution = DIST_UNIFORM;
+    else if (strcmp(name, "clusters") == 0) *distribution = DIST_CLUSTERS;
+    else if (strcmp(name, "manifold") == 0) *distribution = DIST_MANIFOLD;
+    else if (strcmp(name, "heavytail") == 0) *distribution = DIST_HEAVYTAIL;
+    else return -1;
+    return 0;
+}
+
+uint64_t splitmixHash(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/* Generatore di un punto: l'estrazione numero `draw` dipende solo da seme, indice e draw */
+typedef struct {
+    uint64_t key;
+    uint64_t draw;
+} PointRandom;
+
+static void randomInit(PointRandom *random, uint64_t seed, uint64_t index) {
+    random->key = splitmixHash(splitmixHash(seed) + index * 0x9e3779b97f4a7c15ULL);
+    random->draw = 0;
+}
+
+/* Uniforme in [0, 1), con i 53 bit della mantissa */
+static double randomUniform(PointRandom *random) {
+    uint64_t bits = splitmixHash(random->key + (++random->draw) * 0x9e3779b97f4a7c15ULL);
+    return (bits >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Normale standard con Box-Muller; 1 - u evita il logaritmo di zero */
+static double randomNormal(PointRandom *random) {
+    double u = 1.0 - randomUniform(random);
+    double v = randomUniform(random);
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static double clampBox(double x) {
+    return (x < 0.0) ? 0.0 : (x > 100.0 ? 100.0 : x);
+}
+
+/* Parametri della distribuzione, derivati dal solo seme */
+typedef struct {
+    double center[GEN_CLUSTERS][KNN_DIM];
+    double sigma[GEN_CLUSTERS];
+    double phase[KNN_DIM];
+    double frequency[KNN_DIM][2];
+    double tail_center[KNN_DIM];
+} GeneratorParams;
+
+static void paramsInit(GeneratorParams *params, uint64_t seed) {
+    PointRandom random;
+    randomInit(&random, seed, GEN_PARAMS);
+
+    for (int c = 0; c < GEN_CLUSTERS; c++) {
+        for (int d = 0; d < KNN_DIM; d++) {
+            params->center[c][d] = 15.0 + 70.0 * randomUniform(&random);
+        }
+        params->sigma[c] = GEN_SIGMA_MIN + (GEN_SIGMA_MAX - GEN_SIGMA_MIN) * randomUniform(&random);
+    }
+    for (int d = 0; d < KNN_DIM; d++) {
+        params->phase[d] = 2.0 * M_PI * randomUniform(&random);
+        for (int a = 0; a < 2; a++) {
+            /* Da 1 a 3 onde lungo ogni parametro della superficie */
+            params->frequency[d][a] = 2.0 * M_PI * (1.0 + 2.0 * randomUniform(&random)) / 100.0;
+        }
+        params->tail_center[d] = 45.0 + 10.0 * randomUniform(&random);
+    }
+}
+
+static void generateCluster(const GeneratorParams *params, PointRandom *random, double *coord) {
+    int c = (int)(randomUniform(random) * GEN_CLUSTERS);
+    for (int d = 0; d < KNN_DIM; d++) {
+        coord[d] = clampBox(params->center[c][d] + params->sigma[c] * randomNormal(random));
+    }
+}
+
+/* Le prime due coordinate sono i parametri (u, v) della superficie, le altre sue funzioni più un
+   rumore sottile; con meno di 3 dimensioni la superficie riempie lo spazio ed è la uniforme */
+static void generateSheet(const GeneratorParams *params, PointRandom *random, double *coord) {
+    for (int d = 0; d < KNN_DIM && d < 2; d++) {
+        coord[d] = 100.0 * randomUniform(random);
+    }
+    for (int d = 2; d < KNN_DIM; d++) {
+        double wave = sin(params->frequency[d][0] * coord[0] + params->phase[d]) *
+                      cos(params->frequency[d][1] * coord[1]);
+        coord[d] = clampBox(50.0 + GEN_SHEET_AMPLITUDE * wave + GEN_SHEET_NOISE * randomNormal(random));
+    }
+}
+
+/* Direzione uniforme sulla sfera e raggio con distribuzione di Pareto troncata al raggio massimo */
+static void generateTail(const GeneratorParams *params, PointRandom *random, double *coord) {
+    double direction[KNN_DIM];
+    double norm = 0.0;
+    do {
+        norm = 0.0;
+        for (int d = 0; d < KNN_DIM; d++) {
+            direction[d] = randomNormal(random);
+            norm += direction[d] * direction[d];
+        }
+    } while (norm == 0.0);
+    norm = sqrt(norm);
+
+    double truncation = 1.0 - pow(1.0 + GEN_TAIL_RADIUS / GEN_TAIL_SCALE, -GEN_TAIL_ALPHA);
+    double u = randomUniform(random) * truncation;
+    double radius = GEN_TAIL_SCALE * (pow(1.0 - u, -1.0 / GEN_TAIL_ALPHA) - 1.0);
+
+    for (int d = 0; d < KNN_DIM; d++) {
+        coord[d] = clampBox(params->tail_center[d] + radius * direction[d] / norm);
+    }
+}
+
+uint64_t generatorSeed(long long seed) {
+    return (seed >= 0) ? (uint64_t)seed : (uint64_t)time(NULL);
+}
+
+void generatePoints(Point *points, int n, int start_idx, Distribution distribution, uint64_t seed) {
+    GeneratorParams params;
+    paramsInit(&params, seed);
+
+    for (int i = 0; i < n; i++) {
+        PointRandom random;
+        randomInit(&random, seed, (uint64_t)start_idx + i);
+
+        switch (distribution) {
+            case DIST_CLUSTERS: generateCluster(&params, &random, points[i].coord); break;
+            case DIST_MANIFOLD: generateSheet(&params, &random, points[i].coord); break;
+            case DIST_HEAVYTAIL: generateTail(&params, &random, points[i].coord); break;
+            default:
+                for (int d = 0; d < KNN_DIM; d++) {
+                    points[i].coord[d] = 100.0 * randomUniform(&random);
+                }
+        }
+        points[i].original_index = start_idx + i;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+
+#include <stdint.h>
+#include "point.h"
+
+/* Distribuzione dei punti generati, tutte contenute nel box [0, 100] su ogni asse */
+typedef enum {
+    DIST_UNIFORM,   /* Uniforme nel box */
+    DIST_CLUSTERS,  /* Cluster gaussiani di ampiezza diversa */
+    DIST_MANIFOLD,  /* Superficie ondulata a 2 dimensioni, spessa poco, immersa nello spazio */
+    DIST_HEAVYTAIL  /* Nucleo molto denso con densità che decresce come una legge di potenza */
+} Distribution;
+
+/**
+ * @brief Nome della distribuzione ("uniform", "clusters", "manifold" o "heavytail").
+ */
+const char *distributionName(Distribution distribution);
+
+/**
+ * @brief Legge il nome di una distribuzione.
+ *
+ * @return 0 in caso di successo, -1 se il nome non è valido.
+ */
+int parseDistribution(const char *name, Distribution *distribution);
+
+/**
+ * @brief Genera i punti con indice da `start_idx` a `start_idx + n - 1` di un dataset riproducibile.
+ *
+ * Le coordinate di un punto dipendono solo dal seme, dalla distribuzione e dal suo indice (i numeri
+ * casuali sono un hash di seme, indice e numero dell'estrazione), quindi lo stesso seme dà gli stessi
+ * punti con qualsiasi numero di processi e in qualsiasi ordine vengano generati i blocchi. Anche i
+ * parametri della distribuzione (centri dei cluster, fasi della superficie) dipendono solo dal seme.
+ *
+ * @param points Array di punti in cui memorizzare i punti generati.
+ * @param n Numero di punti da generare.
+ * @param start_idx Indice del primo punto, assegnato a `original_index`.
+ * @param distribution Distribuzione dei punti.
+ * @param seed Seme del dataset.
+ */
+void generatePoints(Point *points, int n, int start_idx, Distribution distribution, uint64_t seed);
+
+/**
+ * @brief Finalizzatore di splitmix64: ogni bit dell'ingresso cambia metà dei bit dell'uscita.
+ *
+ * È l'hash da cui derivano le estrazioni dei punti generati; serve anche a chi vuole valori
+ * pseudo-casuali che dipendano solo da un indice, e non dal numero di processi.
+ */
+uint64_t splitmixHash(uint64_t x);
+
+/**
+ * @brief Seme da usare per `--seed`: quello richiesto, oppure l'ora corrente se è negativo.
+ *
+ * Con più processi va calcolato su uno solo e trasmesso agli altri, perché tutti generino
+ * lo stesso dataset.
+ */
+uint64_t generatorSeed(long long seed);
+
+#endif
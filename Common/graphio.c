@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include "graphio.h"
+
+/* Distanze convertite per volta durante la scrittura sequenziale */
+#define GRAPH_WRITE_CHUNK 65536
+
+void graphHeaderInit(GraphFileHeader *header, uint64_t n, int k, int with_distances) {
+    memset(header, 0, sizeof(GraphFileHeader));
+    memcpy(header->magic, GRAPH_FILE_MAGIC, 8);
+    header->version = GRAPH_FILE_VERSION;
+    header->flags = with_distances ? GRAPH_FILE_DISTANCES : 0;
+    header->n = n;
+    header->k = (uint32_t)k;
+}
+
+uint64_t graphDistanceOffset(const GraphFileHeader *header) {
+    return GRAPH_FILE_HEADER_SIZE + header->n * header->k * sizeof(int32_t);
+}
+
+void rangeHeaderInit(RangeFileHeader *header, uint64_t n, uint64_t total, int with_distances) {
+    memset(header, 0, sizeof(RangeFileHeader));
+    memcpy(header->magic, RANGE_FILE_MAGIC, 8);
+    header->version = RANGE_FILE_VERSION;
+    header->flags = with_distances ? GRAPH_FILE_DISTANCES : 0;
+    header->n = n;
+    header->total = total;
+}
+
+uint64_t rangeIndexOffset(const RangeFileHeader *header) {
+    return RANGE_FILE_HEADER_SIZE + (header->n + 1) * sizeof(uint64_t);
+}
+
+uint64_t rangeDistanceOffset(const RangeFileHeader *header) {
+    return rangeIndexOffset(header) + header->total * sizeof(int32_t);
+}
+
+void distancesToFloat(const double *distances, float *out, uint64_t count) {
+    for (uint64_t i = 0; i < count; i++) {
+        out[i] = (distances[i] == DBL_MAX) ? INFINITY : (float)distances[i];
+    }
+}
+
+int writeGraph(const char *path, int n, int k, const int *neighbors, const double *distances) {
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    GraphFileHeader header;
+    graphHeaderInit(&header, n, k, distances != NULL);
+
+    size_t count = (size_t)n * k;
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1
+          && fwrite(neighbors, sizeof(int), count, out) == count;
+
+    if (ok && distances != NULL) {
+        float *buffer = (float *)malloc(GRAPH_WRITE_CHUNK * sizeof(float));
+        for (size_t i = 0; ok && i < count; i += GRAPH_WRITE_CHUNK) {
+            size_t m = (count - i < GRAPH_WRITE_CHUNK) ? count - i : GRAPH_WRITE_CHUNK;
+            distancesToFloat(distances + i, buffer, m);
+            ok = fwrite(buffer, sizeof(float), m, out) == m;
+        }
+        free(buffer);
+    }
+
+    if (fclose(out) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "%s: write failed\n", path);
+        return -1;
+    }
+    return 0;
+}
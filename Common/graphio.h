@@ -0,0 +1,105 @@
+#ifndef GRAPHIO_H
+#define GRAPHIO_H
+
+#include <stdint.h>
+
+/*  Formato binario del grafo dei k vicini (estensione consigliata .knng), little-endian:
+
+    offset 0   char[8]   magic "KNNGRF01"
+    offset 8   uint32    versione (GRAPH_FILE_VERSION)
+    offset 12  uint32    flag: GRAPH_FILE_DISTANCES (presente la matrice delle distanze)
+    offset 16  uint64    numero di punti n
+    offset 24  uint32    numero di vicini per punto k
+    offset 28  uint32    riservato, 0
+    offset 32  int32[n][k]  indici dei vicini, riga i = punto con original_index i (-1 se mancante)
+               float32[n][k] distanze (nella metrica compilata), opzionale (infinito per i vicini mancanti)
+
+    I vicini di ogni riga sono ordinati per distanza, quindi il grafo di un k minore è il prefisso
+    di ogni riga.
+*/
+
+#define GRAPH_FILE_MAGIC "KNNGRF01"
+#define GRAPH_FILE_VERSION 1
+#define GRAPH_FILE_HEADER_SIZE 32
+
+#define GRAPH_FILE_DISTANCES 0x1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t n;
+    uint32_t k;
+    uint32_t reserved;
+} GraphFileHeader;
+
+/*  Formato binario dei risultati di una ricerca per raggio (estensione consigliata .knnr), con le
+    stesse convenzioni del grafo dei k vicini ma righe di lunghezza variabile (CSR):
+
+    offset 0   char[8]   magic "KNNRNG01"
+    offset 8   uint32    versione (RANGE_FILE_VERSION)
+    offset 12  uint32    flag: GRAPH_FILE_DISTANCES (presenti le distanze)
+    offset 16  uint64    numero di punti n
+    offset 24  uint64    numero totale di punti trovati m
+    offset 32  uint64[n + 1]  offset delle righe: la riga i è [offset[i], offset[i + 1])
+               int32[m]       indici dei punti trovati, riga i = punto con original_index i
+               float32[m]     distanze (nella metrica compilata), opzionali
+
+    Ogni riga è ordinata per distanza (a parità di distanza per indice).
+*/
+
+#define RANGE_FILE_MAGIC "KNNRNG01"
+#define RANGE_FILE_VERSION 1
+#define RANGE_FILE_HEADER_SIZE 32
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t n;
+    uint64_t total;
+} RangeFileHeader;
+
+/**
+ * @brief Prepara l'header di un grafo di `n` righe e `k` vicini.
+ */
+void graphHeaderInit(GraphFileHeader *header, uint64_t n, int k, int with_distances);
+
+/**
+ * @brief Offset in byte della matrice delle distanze.
+ */
+uint64_t graphDistanceOffset(const GraphFileHeader *header);
+
+/**
+ * @brief Prepara l'header dei risultati per raggio di `n` righe con `total` punti trovati in tutto.
+ */
+void rangeHeaderInit(RangeFileHeader *header, uint64_t n, uint64_t total, int with_distances);
+
+/**
+ * @brief Offset in byte degli indici dei punti trovati, dopo gli offset delle righe.
+ */
+uint64_t rangeIndexOffset(const RangeFileHeader *header);
+
+/**
+ * @brief Offset in byte delle distanze dei punti trovati.
+ */
+uint64_t rangeDistanceOffset(const RangeFileHeader *header);
+
+/**
+ * @brief Converte distanze double in float32, con infinito per i vicini mancanti (DBL_MAX).
+ */
+void distancesToFloat(const double *distances, float *out, uint64_t count);
+
+/**
+ * @brief Scrive su un solo processo un grafo con le righe già in ordine di indice.
+ *
+ * @param path File da creare.
+ * @param n Numero di punti.
+ * @param k Numero di vicini per punto.
+ * @param neighbors Matrice `n * k` degli indici dei vicini.
+ * @param distances Matrice `n * k` delle distanze, oppure NULL per scrivere solo gli indici.
+ * @return 0 in caso di successo, -1 in caso di errore (con il motivo stampato su stderr).
+ */
+int writeGraph(const char *path, int n, int k, const int *neighbors, const double *distances);
+
+#endif
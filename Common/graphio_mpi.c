@@ -0,0 +1,454 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include "graphio_mpi.h"
+#include "profile_mpi.h"
+
+typedef struct {
+    int row;
+    int position;
+} RowOrder;
+
+static int compareRows(const void *a, const void *b) {
+    const RowOrder *ra = (const RowOrder *)a;
+    const RowOrder *rb = (const RowOrder *)b;
+    return (ra->row > rb->row) - (ra->row < rb->row);
+}
+
+/* Ordine delle righe locali per indice crescente, come richiesto dalle viste sul file */
+static RowOrder *sortRows(int local_n, const int *rows) {
+    RowOrder *order = (RowOrder *)malloc((local_n > 0 ? local_n : 1) * sizeof(RowOrder));
+    int sorted = 1;
+    for (int i = 0; i < local_n; i++) {
+        order[i].row = rows[i];
+        order[i].position = i;
+        if (i > 0 && rows[i] < rows[i - 1]) sorted = 0;
+    }
+    if (!sorted) {
+        qsort(order, local_n, sizeof(RowOrder), compareRows);
+    }
+    return order;
+}
+
+static MPI_File createGraphFile(const char *path, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    MPI_File fh;
+    if (MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) fprintf(stderr, "%s: cannot create graph file\n", path);
+        MPI_Abort(comm, 1);
+    }
+    MPI_File_set_size(fh, 0);
+    return fh;
+}
+
+/* Scrive le righe locali (già in ordine di indice) nella matrice che inizia a `offset` */
+static void writeRows(MPI_File fh, MPI_Offset offset, MPI_Datatype etype, int k, int local_n,
+                      const int *displs, const void *data) {
+    /* La vista deve avere spiazzamenti crescenti, per questo le righe sono state ordinate */
+    MPI_Datatype row_type, file_type;
+    MPI_Type_contiguous(k, etype, &row_type);
+    MPI_Type_commit(&row_type);
+
+    if (local_n > 0) {
+        MPI_Type_create_indexed_block(local_n, 1, displs, row_type, &file_type);
+    } else {
+        MPI_Type_dup(row_type, &file_type);
+    }
+    MPI_Type_commit(&file_type);
+
+    MPI_File_set_view(fh, offset, etype, file_type, "native", MPI_INFO_NULL);
+    /* Una riga per elemento: il conteggio resta local_n anche quando local_n * k supera INT_MAX */
+    MPI_File_write_all(fh, data, local_n, row_type, MPI_STATUS_IGNORE);
+
+    MPI_Type_free(&file_type);
+    MPI_Type_free(&row_type);
+}
+
+void writeGraphMPI(const char *path, int n, int k, int local_n, const int *rows,
+                   const int *neighbors, const double *distances, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    MPI_File fh = createGraphFile(path, comm);
+
+    GraphFileHeader header;
+    graphHeaderInit(&header, n, k, distances != NULL);
+    if (rank == 0) {
+        MPI_File_write_at(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+
+    /* Ordino le righe locali per indice, spostando di conseguenza vicini e distanze */
+    RowOrder *order = sortRows(local_n, rows);
+
+    int *displs = (int *)malloc((local_n > 0 ? local_n : 1) * sizeof(int));
+    int *sorted_neighbors = (int *)malloc((local_n > 0 ? (size_t)local_n * k : 1) * sizeof(int));
+    for (int i = 0; i < local_n; i++) {
+        displs[i] = order[i].row;
+        memcpy(&sorted_neighbors[(size_t)i * k], &neighbors[(size_t)order[i].position * k], k * sizeof(int));
+    }
+
+    writeRows(fh, GRAPH_FILE_HEADER_SIZE, MPI_INT, k, local_n, displs, sorted_neighbors);
+    free(sorted_neighbors);
+
+    if (distances != NULL) {
+        float *sorted_distances = (float *)malloc((local_n > 0 ? (size_t)local_n * k : 1) * sizeof(float));
+        for (int i = 0; i < local_n; i++) {
+            distancesToFloat(&distances[(size_t)order[i].position * k], &sorted_distances[(size_t)i * k], k);
+        }
+        writeRows(fh, (MPI_Offset)graphDistanceOffset(&header), MPI_FLOAT, k, local_n, displs, sorted_distances);
+        free(sorted_distances);
+    }
+
+    MPI_File_close(&fh);
+    free(order);
+    free(displs);
+}
+
+/* Scrive `count` elementi di 4 byte nei blocchi dati da lunghezze e spiazzamenti (in byte da `offset`) */
+static void writeRangeBlocks(MPI_File fh, MPI_Offset offset, MPI_Datatype etype, int blocks, const int *lengths,
+                             const MPI_Aint *displs, const void *data, int count) {
+    MPI_Datatype file_type;
+    if (blocks > 0) {
+        MPI_Type_create_hindexed(blocks, lengths, displs, etype, &file_type);
+    } else {
+        MPI_Type_dup(etype, &file_type);
+    }
+    MPI_Type_commit(&file_type);
+
+    MPI_File_set_view(fh, offset, etype, file_type, "native", MPI_INFO_NULL);
+    MPI_File_write_all(fh, data, count, etype, MPI_STATUS_IGNORE);
+
+    MPI_Type_free(&file_type);
+}
+
+typedef struct {
+    uint64_t *rows;  /* Offset globale di ogni riga locale, nell'ordine di `rows` */
+    uint64_t *block; /* Offset delle righe del blocco del processo (block_n + 1 valori) */
+    int block_start; /* Prima riga del blocco */
+    int block_n;     /* Righe del blocco */
+    uint64_t total;  /* Punti trovati da tutte le righe */
+} RowOffsets;
+
+/* Processo che possiede la riga `row` nella divisione a blocchi delle n righe */
+static int rowOwner(int row, int n, int size) {
+    int base = n / size, remainder = n % size;
+    int split = remainder * (base + 1);
+    return (row < split) ? row / (base + 1) : remainder + (row - split) / base;
+}
+
+/* Offset globali delle righe locali senza array di n elementi: le coppie (riga, lunghezza) vanno al
+   processo del blocco della riga, che somma le lunghezze del blocco, aggiunge l'inizio del blocco
+   ottenuto con MPI_Exscan e rimanda a ogni processo gli offset delle sue righe */
+static void exchangeRowOffsets(int n, int local_n, const int *rows, const long long *offsets, RowOffsets *out,
+                               MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    int *sendcounts = (int *)calloc(size, sizeof(int));
+    int *recvcounts = (int *)malloc(size * sizeof(int));
+    int *sdispls = (int *)malloc(size * sizeof(int));
+    int *rdispls = (int *)malloc(size * sizeof(int));
+    for (int i = 0; i < local_n; i++) {
+        sendcounts[rowOwner(rows[i], n, size)]++;
+    }
+    MPI_Alltoall(sendcounts, 1, MPI_INT, recvcounts, 1, MPI_INT, comm);
+
+    int total_recv = 0;
+    for (int r = 0; r < size; r++) {
+        sdispls[r] = (r > 0) ? sdispls[r - 1] + sendcounts[r - 1] : 0;
+        rdispls[r] = total_recv;
+        total_recv += recvcounts[r];
+    }
+
+    /* Coppie (riga, lunghezza) raggruppate per processo, con la posizione di ogni riga locale */
+    int *slot = (int *)malloc((local_n > 0 ? local_n : 1) * sizeof(int));
+    int *fill = (int *)malloc(size * sizeof(int));
+    memcpy(fill, sdispls, size * sizeof(int));
+    int *pairs = (int *)malloc((local_n > 0 ? 2 * (size_t)local_n : 1) * sizeof(int));
+    for (int i = 0; i < local_n; i++) {
+        slot[i] = fill[rowOwner(rows[i], n, size)]++;
+        pairs[2 * (size_t)slot[i]] = rows[i];
+        pairs[2 * (size_t)slot[i] + 1] = (int)(offsets[i + 1] - offsets[i]);
+    }
+    free(fill);
+
+    for (int r = 0; r < size; r++) {
+        sendcounts[r] *= 2;
+        recvcounts[r] *= 2;
+        sdispls[r] *= 2;
+        rdispls[r] *= 2;
+    }
+    int *received = (int *)malloc((total_recv > 0 ? 2 * (size_t)total_recv : 1) * sizeof(int));
+    MPI_Alltoallv(pairs, sendcounts, sdispls, MPI_INT, received, recvcounts, rdispls, MPI_INT, comm);
+    profileExchange(sendcounts, recvcounts, MPI_INT, comm);
+    free(pairs);
+
+    /* Somma prefissa delle lunghezze del blocco, spostata all'inizio del blocco nel file */
+    out->block_n = n / size + (rank < n % size ? 1 : 0);
+    out->block_start = rank * (n / size) + (rank < n % size ? rank : n % size);
+    out->block = (uint64_t *)calloc((size_t)out->block_n + 1, sizeof(uint64_t));
+    for (int i = 0; i < total_recv; i++) {
+        out->block[received[2 * (size_t)i] - out->block_start + 1] = (uint64_t)received[2 * (size_t)i + 1];
+    }
+    for (int j = 0; j < out->block_n; j++) {
+        out->block[j + 1] += out->block[j];
+    }
+
+    uint64_t block_total = out->block[out->block_n], block_base = 0;
+    MPI_Exscan(&block_total, &block_base, 1, MPI_UINT64_T, MPI_SUM, comm);
+    if (rank == 0) block_base = 0;
+    MPI_Allreduce(&block_total, &out->total, 1, MPI_UINT64_T, MPI_SUM, comm);
+    for (int j = 0; j <= out->block_n; j++) {
+        out->block[j] += block_base;
+    }
+
+    /* Risposte nello stesso ordine delle coppie ricevute, con i conteggi dello scambio invertiti */
+    uint64_t *replies = (uint64_t *)malloc((total_recv > 0 ? (size_t)total_recv : 1) * sizeof(uint64_t));
+    for (int i = 0; i < total_recv; i++) {
+        replies[i] = out->block[received[2 * (size_t)i] - out->block_start];
+    }
+    free(received);
+
+    for (int r = 0; r < size; r++) {
+        sendcounts[r] /= 2;
+        recvcounts[r] /= 2;
+        sdispls[r] /= 2;
+        rdispls[r] /= 2;
+    }
+    uint64_t *answers = (uint64_t *)malloc((local_n > 0 ? local_n : 1) * sizeof(uint64_t));
+    MPI_Alltoallv(replies, recvcounts, rdispls, MPI_UINT64_T, answers, sendcounts, sdispls, MPI_UINT64_T, comm);
+    profileExchange(recvcounts, sendcounts, MPI_UINT64_T, comm);
+    free(replies);
+
+    out->rows = (uint64_t *)malloc((local_n > 0 ? local_n : 1) * sizeof(uint64_t));
+    for (int i = 0; i < local_n; i++) {
+        out->rows[i] = answers[slot[i]];
+    }
+    free(answers);
+    free(slot);
+    free(sendcounts);
+    free(recvcounts);
+    free(sdispls);
+    free(rdispls);
+}
+
+void writeRangeGraphMPI(const char *path, int n, int local_n, const int *rows, const long long *offsets,
+                        const int *indices, const double *distances, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    long long local_total = offsets[local_n] - offsets[0];
+    if (local_total > INT_MAX) {
+        fprintf(stderr, "Rank %d: %lld radius results do not fit in a single write\n", rank, local_total);
+        MPI_Abort(comm, 1);
+    }
+
+    /* Le righe sono sparse tra i processi: ognuna riceve il proprio offset dal processo del suo blocco */
+    RowOffsets row_offsets;
+    exchangeRowOffsets(n, local_n, rows, offsets, &row_offsets, comm);
+
+    MPI_File fh = createGraphFile(path, comm);
+
+    RangeFileHeader header;
+    rangeHeaderInit(&header, n, row_offsets.total, distances != NULL);
+    if (rank == 0) {
+        MPI_File_write_at(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+
+    /* Ogni processo scrive gli offset del proprio blocco, l'ultimo anche quello finale (il totale) */
+    MPI_File_write_at_all(fh, RANGE_FILE_HEADER_SIZE + (MPI_Offset)row_offsets.block_start * sizeof(uint64_t),
+                          row_offsets.block, row_offsets.block_n + (rank == size - 1 ? 1 : 0), MPI_UINT64_T,
+                          MPI_STATUS_IGNORE);
+
+    /* Un blocco per ogni riga locale non vuota, in ordine di indice, con i suoi punti impacchettati */
+    RowOrder *order = sortRows(local_n, rows);
+    int *block_lengths = (int *)malloc((local_n > 0 ? local_n : 1) * sizeof(int));
+    MPI_Aint *displs = (MPI_Aint *)malloc((local_n > 0 ? local_n : 1) * sizeof(MPI_Aint));
+    int *packed = (int *)malloc((local_total > 0 ? (size_t)local_total : 1) * sizeof(int));
+    int blocks = 0;
+    size_t p = 0;
+    for (int i = 0; i < local_n; i++) {
+        int position = order[i].position;
+        int length = (int)(offsets[position + 1] - offsets[position]);
+        if (length == 0) continue;
+        block_lengths[blocks] = length;
+        displs[blocks++] = (MPI_Aint)(row_offsets.rows[position] * sizeof(int32_t));
+        memcpy(&packed[p], &indices[offsets[position]], length * sizeof(int));
+        p += length;
+    }
+    free(row_offsets.rows);
+    free(row_offsets.block);
+
+    writeRangeBlocks(fh, (MPI_Offset)rangeIndexOffset(&header), MPI_INT, blocks, block_lengths, displs, packed,
+                     (int)local_total);
+    free(packed);
+
+    if (distances != NULL) {
+        float *packed_distances = (float *)malloc((local_total > 0 ? (size_t)local_total : 1) * sizeof(float));
+        p = 0;
+        for (int i = 0; i < local_n; i++) {
+            int position = order[i].position;
+            long long length = offsets[position + 1] - offsets[position];
+            distancesToFloat(&distances[offsets[position]], &packed_distances[p], length);
+            p += length;
+        }
+        writeRangeBlocks(fh, (MPI_Offset)rangeDistanceOffset(&header), MPI_FLOAT, blocks, block_lengths, displs,
+                         packed_distances, (int)local_total);
+        free(packed_distances);
+    }
+
+    MPI_File_close(&fh);
+    free(order);
+    free(block_lengths);
+    free(displs);
+}
+
+void printRangeSample(int n, int limit, int local_n, const int *rows, const long long *offsets,
+                      const int *indices, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    if (limit > n) limit = n;
+    if (limit <= 0) return;
+
+    /* Impacchetto solo le righe da stampare: indice, lunghezza e punti trovati */
+    long long count = 0;
+    for (int i = 0; i < local_n; i++) {
+        if (rows[i] < limit) count += 2 + (offsets[i + 1] - offsets[i]);
+    }
+    if (count > INT_MAX) {
+        fprintf(stderr, "Rank %d: too many radius results to print\n", rank);
+        MPI_Abort(comm, 1);
+    }
+
+    int *packed = (int *)malloc((count > 0 ? (size_t)count : 1) * sizeof(int));
+    size_t p = 0;
+    for (int i = 0; i < local_n; i++) {
+        if (rows[i] < limit) {
+            int length = (int)(offsets[i + 1] - offsets[i]);
+            packed[p++] = rows[i];
+            packed[p++] = length;
+            memcpy(&packed[p], &indices[offsets[i]], length * sizeof(int));
+            p += length;
+        }
+    }
+
+    int *counts = NULL, *displs = NULL, *all = NULL;
+    int sendcount = (int)count;
+    long long total = 0;
+    if (rank == 0) {
+        counts = (int *)malloc(size * sizeof(int));
+        displs = (int *)malloc(size * sizeof(int));
+    }
+    MPI_Gather(&sendcount, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+
+    if (rank == 0) {
+        for (int r = 0; r < size; r++) {
+            displs[r] = (r > 0) ? displs[r - 1] + counts[r - 1] : 0;
+            total += counts[r];
+        }
+        if (total > INT_MAX) {
+            fprintf(stderr, "Too many radius results to print\n");
+            MPI_Abort(comm, 1);
+        }
+        all = (int *)malloc((total > 0 ? (size_t)total : 1) * sizeof(int));
+    }
+    MPI_Gatherv(packed, sendcount, MPI_INT, all, counts, displs, MPI_INT, 0, comm);
+    profileGather(sendcount, total, MPI_INT, 0, comm);
+
+    if (rank == 0) {
+        /* Posizione di ogni riga nel buffer ricevuto, per stamparle in ordine di indice */
+        long long *start = (long long *)malloc((size_t)limit * sizeof(long long));
+        for (long long q = 0; q < total; q += 2 + all[q + 1]) {
+            start[all[q]] = q;
+        }
+        for (int i = 0; i < limit; i++) {
+            const int *entry = &all[start[i]];
+            printf("Point %d neighbors within radius (%d): ", i, entry[1]);
+            for (int j = 0; j < entry[1]; j++) {
+                printf("%d ", entry[2 + j]);
+            }
+            printf("\n");
+        }
+        free(start);
+        free(all);
+        free(counts);
+        free(displs);
+    }
+    free(packed);
+}
+
+void printGraphSample(int n, int limit, const int *k_values, int num_k, int k_max, int local_n,
+                      const int *rows, const int *neighbors, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    if (limit > n) limit = n;
+    if (limit <= 0) return;
+
+    /* Impacchetto solo le righe da stampare: indice seguito dai k_max vicini */
+    int count = 0;
+    for (int i = 0; i < local_n; i++) {
+        if (rows[i] < limit) count++;
+    }
+
+    int *packed = (int *)malloc((count > 0 ? (size_t)count * (k_max + 1) : 1) * sizeof(int));
+    int p = 0;
+    for (int i = 0; i < local_n; i++) {
+        if (rows[i] < limit) {
+            packed[p++] = rows[i];
+            memcpy(&packed[p], &neighbors[(size_t)i * k_max], k_max * sizeof(int));
+            p += k_max;
+        }
+    }
+
+    int *counts = NULL, *displs = NULL, *all = NULL;
+    int sendcount = count * (k_max + 1);
+    if (rank == 0) {
+        counts = (int *)malloc(size * sizeof(int));
+        displs = (int *)malloc(size * sizeof(int));
+    }
+    MPI_Gather(&sendcount, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+
+    if (rank == 0) {
+        for (int r = 0; r < size; r++) {
+            displs[r] = (r > 0) ? displs[r - 1] + counts[r - 1] : 0;
+        }
+        all = (int *)malloc((size_t)limit * (k_max + 1) * sizeof(int));
+    }
+    MPI_Gatherv(packed, sendcount, MPI_INT, all, counts, displs, MPI_INT, 0, comm);
+    profileGather(sendcount, (rank == 0) ? displs[size - 1] + counts[size - 1] : 0, MPI_INT, 0, comm);
+
+    if (rank == 0) {
+        /* Ogni punto compare una sola volta, quindi lo metto direttamente nella sua riga */
+        int *table = (int *)malloc((size_t)limit * k_max * sizeof(int));
+        for (int i = 0; i < limit; i++) {
+            int *entry = &all[(size_t)i * (k_max + 1)];
+            memcpy(&table[(size_t)entry[0] * k_max], entry + 1, k_max * sizeof(int));
+        }
+
+        for (int q = 0; q < num_k; q++) {
+            int k = k_values[q];
+            for (int i = 0; i < limit; i++) {
+                printf("Point %d nearest neighbors: ", i);
+                for (int j = 0; j < k; j++) {
+                    printf("%d ", table[(size_t)i * k_max + j]);
+                }
+                printf("\n");
+            }
+        }
+        free(table);
+        free(all);
+        free(counts);
+        free(displs);
+    }
+    free(packed);
+}
@@ -0,0 +1,80 @@
+#ifndef GRAPHIO_MPI_H
+#define GRAPHIO_MPI_H
+
+#include <mpi.h>
+#include "graphio.h"
+
+/**
+ * @brief Scrive in parallelo il grafo dei k vicini, ogni processo direttamente le proprie righe.
+ *
+ * Ogni processo imposta una vista del file indicizzata per original_index e scrive le sue righe
+ * con un'unica MPI_File_write_all (una seconda per le distanze): le righe possono essere sparse
+ * nel file, come dopo il partizionamento del k-d tree o con la distribuzione dinamica delle query,
+ * e non passano mai dal master. In caso di errore il programma viene terminato con MPI_Abort.
+ *
+ * @param path File da creare (sovrascritto se esiste).
+ * @param n Numero totale di punti.
+ * @param k Numero di vicini per punto.
+ * @param local_n Numero di righe del processo.
+ * @param rows original_index di ogni riga locale (righe distinte tra tutti i processi).
+ * @param neighbors Matrice `local_n * k` degli indici dei vicini.
+ * @param distances Matrice `local_n * k` delle distanze, oppure NULL per scrivere solo gli indici.
+ * @param comm Comunicatore.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void writeGraphMPI(const char *path, int n, int k, int local_n, const int *rows,
+                   const int *neighbors, const double *distances, MPI_Comm comm);
+
+/**
+ * @brief Scrive in parallelo i risultati di una ricerca per raggio (formato .knnr in graphio.h).
+ *
+ * La lunghezza di ogni riga va al processo che ne possiede il blocco (divisione a blocchi delle `n`
+ * righe), che ricava gli offset del blocco con una MPI_Exscan e li rimanda ai processi delle righe:
+ * nessun processo tiene array di `n` elementi. Il master scrive l'header, ogni processo gli offset del
+ * proprio blocco e poi i propri punti trovati con una MPI_File_write_all (una seconda per le distanze).
+ * In caso di errore il programma viene terminato con MPI_Abort.
+ *
+ * @param path File da creare (sovrascritto se esiste).
+ * @param n Numero totale di punti.
+ * @param local_n Numero di righe del processo.
+ * @param rows original_index di ogni riga locale (righe distinte tra tutti i processi).
+ * @param offsets Offset delle `local_n` righe locali (local_n + 1 valori).
+ * @param indices Indici dei punti trovati di tutte le righe locali.
+ * @param distances Distanze dei punti trovati, oppure NULL per scrivere solo gli indici.
+ * @param comm Comunicatore.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void writeRangeGraphMPI(const char *path, int n, int local_n, const int *rows, const long long *offsets,
+                        const int *indices, const double *distances, MPI_Comm comm);
+
+/**
+ * @brief Stampa sul master i punti trovati per raggio dai primi `limit` punti (modalità di debug).
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void printRangeSample(int n, int limit, int local_n, const int *rows, const long long *offsets,
+                      const int *indices, MPI_Comm comm);
+
+/**
+ * @brief Stampa sul master i vicini dei primi `limit` punti, per ogni k richiesto (modalità di debug).
+ *
+ * Al master arrivano solo le righe con original_index < limit, ovunque si trovino.
+ *
+ * @param n Numero totale di punti.
+ * @param limit Numero di punti da stampare.
+ * @param k_values Valori di k da stampare, ognuno come prefisso delle righe.
+ * @param num_k Numero di valori di k.
+ * @param k_max Lunghezza delle righe di `neighbors`.
+ * @param local_n Numero di righe del processo.
+ * @param rows original_index di ogni riga locale.
+ * @param neighbors Matrice `local_n * k_max` degli indici dei vicini.
+ * @param comm Comunicatore.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void printGraphSample(int n, int limit, const int *k_values, int num_k, int k_max, int local_n,
+                      const int *rows, const int *neighbors, MPI_Comm comm);
+
+#endif
@@ -0,0 +1,283 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "knnbatch.h"
+#include "metric.h"
+#include "scheduler.h"
+#include "profile.h"
+
+/* I kernel vettoriali calcolano il quadrato della distanza euclidea, le altre metriche usano quello scalare */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && KNN_METRIC == KNN_METRIC_L2
+#define KNN_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+/* Numero di punti di riferimento per tile: con 3 dimensioni le colonne (48 KB) restano in cache L2 */
+#define REF_TILE 2048
+
+/* Numero di query elaborate insieme contro lo stesso vettore di punti */
+#define QUERY_GROUP 4
+
+typedef void (*BatchKernel)(const PointBlock *queries, int qstart, int qend,
+                            const PointBlock *refs, int rstart, int rend, KNNHeap *heaps);
+
+void pointBlockAlloc(PointBlock *block, int capacity) {
+    size_t bytes = KNN_DIM * (size_t)capacity * sizeof(double) + (size_t)capacity * sizeof(int);
+    block->n = capacity;
+    block->coord[0] = (double *)malloc(bytes > 0 ? bytes : 1);
+    for (int d = 1; d < KNN_DIM; d++) {
+        block->coord[d] = block->coord[d - 1] + capacity;
+    }
+    block->index = (int *)(block->coord[KNN_DIM - 1] + capacity);
+}
+
+void pointBlockFree(PointBlock *block) {
+    free(block->coord[0]);
+    for (int d = 0; d < KNN_DIM; d++) {
+        block->coord[d] = NULL;
+    }
+    block->index = NULL;
+    block->n = 0;
+}
+
+PointBlock pointBlockView(const PointBlock *block, int begin, int end) {
+    PointBlock view;
+    view.n = end - begin;
+    for (int d = 0; d < KNN_DIM; d++) {
+        view.coord[d] = block->coord[d] + begin;
+    }
+    view.index = block->index + begin;
+    return view;
+}
+
+/* Kernel scalare: usato come fallback e per i resti dei kernel vettoriali */
+static void kernelScalar(const PointBlock *queries, int qstart, int qend,
+                         const PointBlock *refs, int rstart, int rend, KNNHeap *heaps) {
+    for (int i = qstart; i < qend; i++) {
+        double q[KNN_DIM];
+        for (int d = 0; d < KNN_DIM; d++) {
+            q[d] = queries->coord[d][i];
+        }
+        double worst = knnHeapWorst(&heaps[i]);
+        int self = queries->index[i];
+
+        for (int j = rstart; j < rend; j++) {
+            double dist = 0.0;
+            for (int d = 0; d < KNN_DIM; d++) {
+                dist = metricAdd(dist, refs->coord[d][j] - q[d], d);
+            }
+            /* La query non è vicina di sé stessa: il controllo sull'indice si fa solo sui candidati */
+            if (dist <= worst && refs->index[j] != self) {
+                knnHeapPush(&heaps[i], dist, refs->index[j]);
+                worst = knnHeapWorst(&heaps[i]);
+            }
+        }
+    }
+}
+
+#ifdef KNN_X86_KERNELS
+
+/* Kernel AVX2: QUERY_GROUP query contro 4 punti per iterazione, con le soglie tenute nei registri */
+__attribute__((target("avx2,fma")))
+static void kernelAVX2(const PointBlock *queries, int qstart, int qend,
+                       const PointBlock *refs, int rstart, int rend, KNNHeap *heaps) {
+    int i = qstart;
+    for (; i + QUERY_GROUP <= qend; i += QUERY_GROUP) {
+        __m256d q[QUERY_GROUP][KNN_DIM], worst[QUERY_GROUP];
+        for (int t = 0; t < QUERY_GROUP; t++) {
+            for (int d = 0; d < KNN_DIM; d++) {
+                q[t][d] = _mm256_set1_pd(queries->coord[d][i + t]);
+            }
+            worst[t] = _mm256_set1_pd(knnHeapWorst(&heaps[i + t]));
+        }
+
+        int j = rstart;
+        for (; j + 4 <= rend; j += 4) {
+            /* Le distanze delle query del gruppo si accumulano una coordinata alla volta */
+            __m256d acc[QUERY_GROUP];
+            for (int t = 0; t < QUERY_GROUP; t++) {
+                acc[t] = _mm256_setzero_pd();
+            }
+            for (int d = 0; d < KNN_DIM; d++) {
+                __m256d r = _mm256_loadu_pd(refs->coord[d] + j);
+                for (int t = 0; t < QUERY_GROUP; t++) {
+                    __m256d diff = _mm256_sub_pd(r, q[t][d]);
+                    acc[t] = _mm256_fmadd_pd(diff, diff, acc[t]);
+                }
+            }
+
+            for (int t = 0; t < QUERY_GROUP; t++) {
+                __m256d dist = acc[t];
+
+                /* Solo le corsie sotto la soglia passano dal contenitore (caso raro dopo i primi blocchi) */
+                int mask = _mm256_movemask_pd(_mm256_cmp_pd(dist, worst[t], _CMP_LE_OQ));
+                if (mask) {
+                    double lanes[4];
+                    _mm256_storeu_pd(lanes, dist);
+                    while (mask) {
+                        int l = __builtin_ctz(mask);
+                        mask &= mask - 1;
+                        if (refs->index[j + l] == queries->index[i + t]) continue;
+                        knnHeapPush(&heaps[i + t], lanes[l], refs->index[j + l]);
+                    }
+                    worst[t] = _mm256_set1_pd(knnHeapWorst(&heaps[i + t]));
+                }
+            }
+        }
+        kernelScalar(queries, i, i + QUERY_GROUP, refs, j, rend, heaps);
+    }
+    kernelScalar(queries, i, qend, refs, rstart, rend, heaps);
+}
+
+/* Kernel AVX-512: come AVX2 ma con 8 punti per iterazione e confronto direttamente in una maschera */
+__attribute__((target("avx512f")))
+static void kernelAVX512(const PointBlock *queries, int qstart, int qend,
+                         const PointBlock *refs, int rstart, int rend, KNNHeap *heaps) {
+    int i = qstart;
+    for (; i + QUERY_GROUP <= qend; i += QUERY_GROUP) {
+        __m512d q[QUERY_GROUP][KNN_DIM], worst[QUERY_GROUP];
+        for (int t = 0; t < QUERY_GROUP; t++) {
+            for (int d = 0; d < KNN_DIM; d++) {
+                q[t][d] = _mm512_set1_pd(queries->coord[d][i + t]);
+            }
+            worst[t] = _mm512_set1_pd(knnHeapWorst(&heaps[i + t]));
+        }
+
+        int j = rstart;
+        for (; j + 8 <= rend; j += 8) {
+            __m512d acc[QUERY_GROUP];
+            for (int t = 0; t < QUERY_GROUP; t++) {
+                acc[t] = _mm512_setzero_pd();
+            }
+            for (int d = 0; d < KNN_DIM; d++) {
+                __m512d r = _mm512_loadu_pd(refs->coord[d] + j);
+                for (int t = 0; t < QUERY_GROUP; t++) {
+                    __m512d diff = _mm512_sub_pd(r, q[t][d]);
+                    acc[t] = _mm512_fmadd_pd(diff, diff, acc[t]);
+                }
+            }
+
+            for (int t = 0; t < QUERY_GROUP; t++) {
+                __m512d dist = acc[t];
+
+                __mmask8 mask = _mm512_cmp_pd_mask(dist, worst[t], _CMP_LE_OQ);
+                if (mask) {
+                    double lanes[8];
+                    _mm512_storeu_pd(lanes, dist);
+                    unsigned int bits = mask;
+                    while (bits) {
+                        int l = __builtin_ctz(bits);
+                        bits &= bits - 1;
+                        if (refs->index[j + l] == queries->index[i + t]) continue;
+                        knnHeapPush(&heaps[i + t], lanes[l], refs->index[j + l]);
+                    }
+                    worst[t] = _mm512_set1_pd(knnHeapWorst(&heaps[i + t]));
+                }
+            }
+        }
+        kernelScalar(queries, i, i + QUERY_GROUP, refs, j, rend, heaps);
+    }
+    kernelScalar(queries, i, qend, refs, rstart, rend, heaps);
+}
+
+#endif
+
+static BatchKernel selectedKernel = NULL;
+static const char *selectedName = NULL;
+
+/* Scelgo il kernel una sola volta in base alle feature della CPU (o a KNN_KERNEL) */
+static void selectKernel(void) {
+    const char *forced = getenv("KNN_KERNEL");
+
+    selectedKernel = kernelScalar;
+    selectedName = "scalar";
+    if (forced != NULL && strcmp(forced, "scalar") == 0) return;
+
+#ifdef KNN_X86_KERNELS
+    __builtin_cpu_init();
+    int has_avx512 = __builtin_cpu_supports("avx512f");
+    int has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+    if (forced != NULL && strcmp(forced, "avx2") == 0) has_avx512 = 0;
+
+    if (has_avx512) {
+        selectedKernel = kernelAVX512;
+        selectedName = "avx512";
+    } else if (has_avx2) {
+        selectedKernel = kernelAVX2;
+        selectedName = "avx2";
+    }
+#endif
+}
+
+const char *knnBatchKernelName(void) {
+    if (selectedKernel == NULL) selectKernel();
+    return selectedName;
+}
+
+void knnBatchUpdate(const PointBlock *queries, const PointBlock *refs, KNNHeap *heaps) {
+    if (selectedKernel == NULL) selectKernel();
+    profileCount(COUNTER_DISTANCES, (long long)queries->n * refs->n);
+
+    /* Scorro i punti di riferimento a tile, così ogni tile viene riusato da tutte le query */
+    for (int rstart = 0; rstart < refs->n; rstart += REF_TILE) {
+        int rend = (rstart + REF_TILE < refs->n) ? rstart + REF_TILE : refs->n;
+        selectedKernel(queries, 0, queries->n, refs, rstart, rend, heaps);
+    }
+}
+
+void knnBatchFinalize(KNNHeap *heaps, int nq, int k, int *neighbors, double *distances) {
+    long long inserts = 0;
+    for (int i = 0; i < nq; i++) {
+        knnHeapSort(&heaps[i]);
+        inserts += heaps[i].inserts;
+        for (int j = 0; j < k; j++) {
+            int found = j < heaps[i].size;
+            neighbors[(size_t)i * k + j] = found ? heaps[i].entries[j].index : -1;
+            if (distances != NULL) {
+                distances[(size_t)i * k + j] = found ? metricFinish(heaps[i].entries[j].distance) : DBL_MAX;
+            }
+        }
+    }
+    profileCount(COUNTER_HEAP_INSERTS, inserts);
+}
+
+/* Stato condiviso dai thread di knnBatchSearch */
+typedef struct {
+    const PointBlock *queries;
+    const PointBlock *refs;
+    KNNHeap *heaps;
+} BatchTask;
+
+static void batchChunk(int begin, int end, int thread_id, void *context) {
+    (void)thread_id;
+    BatchTask *task = (BatchTask *)context;
+    PointBlock chunk = pointBlockView(task->queries, begin, end);
+    knnBatchUpdate(&chunk, task->refs, task->heaps + begin);
+}
+
+void knnBatchSearch(const PointBlock *queries, const PointBlock *refs, int k, int num_threads,
+                    int *neighbors, double *distances) {
+    int nq = queries->n;
+    KNNHeap *heaps = (KNNHeap *)malloc((nq > 0 ? nq : 1) * sizeof(KNNHeap));
+    KNNEntry *entries = (KNNEntry *)malloc((nq > 0 ? (size_t)nq * k : 1) * sizeof(KNNEntry));
+
+    for (int i = 0; i < nq; i++) {
+        knnHeapInit(&heaps[i], entries + (size_t)i * k, k, DBL_MAX);
+    }
+
+    /* Il kernel viene scelto prima di avviare i thread */
+    knnBatchKernelName();
+
+    BatchTask task;
+    task.queries = queries;
+    task.refs = refs;
+    task.heaps = heaps;
+    parallelFor(nq, DEFAULT_CHUNK_SIZE, num_threads, batchChunk, &task);
+
+    knnBatchFinalize(heaps, nq, k, neighbors, distances);
+
+    free(heaps);
+    free(entries);
+}
@@ -0,0 +1,78 @@
+#ifndef KNNBATCH_H
+#define KNNBATCH_H
+
+#include "knnheap.h"
+#include "point.h"
+
+/** @brief: Blocco di punti salvato per colonne (SoA)
+ *  Le KNN_DIM colonne di coordinate e index puntano dentro un'unica allocazione fatta da pointBlockAlloc
+ */
+typedef struct {
+    int n;
+    double *coord[KNN_DIM];
+    int *index;
+} PointBlock;
+
+/**
+ * @brief Alloca un blocco capace di contenere `capacity` punti, con n = capacity.
+ *
+ * @param block Blocco da inizializzare.
+ * @param capacity Numero di punti.
+ */
+void pointBlockAlloc(PointBlock *block, int capacity);
+
+/**
+ * @brief Libera la memoria di un blocco allocato con pointBlockAlloc.
+ */
+void pointBlockFree(PointBlock *block);
+
+/**
+ * @brief Restituisce una vista (senza copia) sui punti [begin, end) di un blocco.
+ */
+PointBlock pointBlockView(const PointBlock *block, int begin, int end);
+
+/**
+ * @brief Aggiorna i top-k di un blocco di query con un blocco di punti di riferimento.
+ *
+ * Le distanze ridotte (metric.h) vengono calcolate a tile (più query contro un vettore di punti alla
+ * volta) con il kernel migliore disponibile sulla CPU: AVX-512, AVX2 oppure scalare, l'unico
+ * compilato per le metriche diverse da L2. Ogni query ha il suo
+ * KNNHeap, che può essere aggiornato con più blocchi di riferimento successivi. Un punto di
+ * riferimento con lo stesso indice della query è la query stessa e non viene mai restituito
+ * (le query esterne al dataset possono usare indice -1).
+ *
+ * @param queries Blocco di query.
+ * @param refs Blocco di punti di riferimento.
+ * @param heaps Array di `queries->n` contenitori, uno per query, con distanze ridotte.
+ */
+void knnBatchUpdate(const PointBlock *queries, const PointBlock *refs, KNNHeap *heaps);
+
+/**
+ * @brief Ordina i top-k e scrive indici e distanze vere (la radice è calcolata solo qui).
+ *
+ * @param heaps Array di `nq` contenitori aggiornati con knnBatchUpdate.
+ * @param nq Numero di query.
+ * @param k Numero di vicini per query.
+ * @param neighbors Array di `nq * k` interi, le posizioni non riempite valgono -1.
+ * @param distances Array di `nq * k` double (può essere NULL).
+ */
+void knnBatchFinalize(KNNHeap *heaps, int nq, int k, int *neighbors, double *distances);
+
+/**
+ * @brief Ricerca esatta a forza bruta dei k vicini di tutte le query di un blocco.
+ *
+ * Equivale a knnBatchUpdate seguito da knnBatchFinalize, con i contenitori allocati internamente.
+ * Le query vengono divise in chunk tra `num_threads` thread che condividono lo stesso blocco
+ * di riferimento (vedi parallelFor).
+ */
+void knnBatchSearch(const PointBlock *queries, const PointBlock *refs, int k, int num_threads,
+                    int *neighbors, double *distances);
+
+/**
+ * @brief Nome del kernel scelto a runtime ("avx512", "avx2" o "scalar").
+ *
+ * La scelta può essere forzata con la variabile d'ambiente KNN_KERNEL.
+ */
+const char *knnBatchKernelName(void);
+
+#endif
@@ -0,0 +1,77 @@
+#include "knnheap.h"
+
+void knnHeapInit(KNNHeap *heap, KNNEntry *buffer, int k, double limit) {
+    heap->entries = buffer;
+    heap->k = k;
+    heap->size = 0;
+    heap->limit = limit;
+    heap->inserts = 0;
+}
+
+/* Riporta la proprietà di max-heap scendendo dalla posizione i */
+static void siftDown(KNNEntry *entries, int size, int i) {
+    KNNEntry item = entries[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= size) break;
+        if (child + 1 < size && knnEntryLess(entries[child].distance, entries[child].index, &entries[child + 1])) child++;
+        if (!knnEntryLess(item.distance, item.index, &entries[child])) break;
+        entries[i] = entries[child];
+        i = child;
+    }
+    entries[i] = item;
+}
+
+void knnHeapPush(KNNHeap *heap, double distance, int index) {
+    KNNEntry *entries = heap->entries;
+    if (heap->size < heap->k) {
+        if (distance > heap->limit) return;
+    } else {
+        const KNNEntry *worst = (heap->k <= KNN_HEAP_LINEAR_MAX) ? &entries[heap->size - 1] : &entries[0];
+        if (!knnEntryLess(distance, index, worst)) return;
+    }
+    heap->inserts++;
+
+    if (heap->k <= KNN_HEAP_LINEAR_MAX) {
+        /* Buffer ordinato: se pieno l'ultimo viene scartato, poi sposto in avanti i più lontani */
+        int i = (heap->size < heap->k) ? heap->size++ : heap->size - 1;
+        while (i > 0 && knnEntryLess(distance, index, &entries[i - 1])) {
+            entries[i] = entries[i - 1];
+            i--;
+        }
+        entries[i].distance = distance;
+        entries[i].index = index;
+        return;
+    }
+
+    if (heap->size < heap->k) {
+        /* Heap non pieno: inserisco in fondo e risalgo */
+        KNNEntry item = {distance, index};
+        int i = heap->size++;
+        while (i > 0) {
+            int parent = (i - 1) / 2;
+            if (!knnEntryLess(entries[parent].distance, entries[parent].index, &item)) break;
+            entries[i] = entries[parent];
+            i = parent;
+        }
+        entries[i] = item;
+    } else {
+        /* Heap pieno: il nuovo candidato sostituisce la radice (il peggiore) */
+        entries[0].distance = distance;
+        entries[0].index = index;
+        siftDown(entries, heap->size, 0);
+    }
+}
+
+void knnHeapSort(KNNHeap *heap) {
+    if (heap->k <= KNN_HEAP_LINEAR_MAX) return;
+
+    /* Heapsort: sposto ripetutamente il massimo in fondo */
+    KNNEntry *entries = heap->entries;
+    for (int end = heap->size - 1; end > 0; end--) {
+        KNNEntry tmp = entries[0];
+        entries[0] = entries[end];
+        entries[end] = tmp;
+        siftDown(entries, end, 0);
+    }
+}
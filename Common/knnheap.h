@@ -0,0 +1,71 @@
+#ifndef KNNHEAP_H
+#define KNNHEAP_H
+
+/* Sotto questa soglia di k si usa un buffer ordinato con inserimento, sopra un max-heap binario */
+#define KNN_HEAP_LINEAR_MAX 32
+
+/* Coppia (distanza, indice) di un vicino candidato */
+typedef struct {
+    double distance;
+    int index;
+} KNNEntry;
+
+/* Ordine totale dei candidati: per distanza e, a parità, per indice. Con punti duplicati o
+   equidistanti i vicini scelti non dipendono dall'ordine di visita né dalla decomposizione */
+static inline int knnEntryLess(double distance, int index, const KNNEntry *entry) {
+    return distance < entry->distance || (distance == entry->distance && index < entry->index);
+}
+
+/** @brief: Insieme limitato dei k vicini migliori
+ *  Il buffer è fornito dal chiamante (arena del thread o memoria riutilizzata), il contenitore non alloca.
+ *  Per k <= KNN_HEAP_LINEAR_MAX gli elementi sono tenuti ordinati in modo crescente,
+ *  altrimenti formano un max-heap con il peggiore in entries[0], sempre secondo knnEntryLess.
+ */
+typedef struct {
+    KNNEntry *entries;
+    int k;
+    int size;
+    double limit;   /* Solo le distanze minori o uguali a limit vengono accettate */
+    int inserts;    /* Candidati accettati da knnHeapInit in poi, per il contatore COUNTER_HEAP_INSERTS */
+} KNNHeap;
+
+/**
+ * @brief Inizializza un contenitore vuoto sopra un buffer di almeno k elementi.
+ *
+ * @param heap Contenitore da inizializzare.
+ * @param buffer Buffer di almeno `k` elementi fornito dal chiamante.
+ * @param k Numero massimo di vicini da mantenere.
+ * @param limit Distanza oltre la quale i candidati vengono scartati (DBL_MAX per nessun limite).
+ */
+void knnHeapInit(KNNHeap *heap, KNNEntry *buffer, int k, double limit);
+
+/**
+ * @brief Restituisce la distanza che un candidato non deve superare per entrare nell'insieme.
+ *
+ * Finché l'insieme non è pieno è il limite iniziale, poi la distanza del k-esimo vicino, che un
+ * candidato alla stessa distanza sostituisce solo se ha indice minore. I filtri sulle distanze e
+ * le potature dei nodi confrontano quindi con <=, e knnHeapPush decide i pareggi.
+ */
+static inline double knnHeapWorst(const KNNHeap *heap) {
+    if (heap->size < heap->k) return heap->limit;
+    return (heap->k <= KNN_HEAP_LINEAR_MAX) ? heap->entries[heap->size - 1].distance
+                                            : heap->entries[0].distance;
+}
+
+/**
+ * @brief Inserisce un candidato se precede il peggiore attuale (knnEntryLess), in O(log k).
+ *
+ * @param heap Contenitore.
+ * @param distance Distanza del candidato.
+ * @param index Indice del candidato.
+ */
+void knnHeapPush(KNNHeap *heap, double distance, int index);
+
+/**
+ * @brief Ordina gli elementi in modo crescente di distanza e, a parità, di indice.
+ *
+ * @note Dopo la chiamata il contenitore non va più usato per inserimenti, ma solo letto.
+ */
+void knnHeapSort(KNNHeap *heap);
+
+#endif
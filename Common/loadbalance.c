@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "loadbalance.h"
+
+void workQueueCreate(WorkQueue *queue, int n, int min_chunk, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &queue->size);
+
+    queue->n = n;
+    queue->min_chunk = (min_chunk > 0) ? min_chunk : 1;
+    queue->next = 0;
+
+    /* Il contatore è a 64 bit: ogni processo lo incrementa ancora una volta dopo la fine della coda,
+       quindi con n vicino a INT_MAX la somma supererebbe un int */
+    MPI_Win_allocate((rank == 0) ? sizeof(int64_t) : 0, sizeof(int64_t), MPI_INFO_NULL, comm,
+                     &queue->counter, &queue->win);
+
+    /* Il contatore va azzerato prima che qualcuno ci acceda */
+    if (rank == 0) {
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, queue->win);
+        *queue->counter = 0;
+        MPI_Win_unlock(0, queue->win);
+    }
+    MPI_Barrier(comm);
+
+    /* Un'unica epoca passiva per tutta la durata della coda */
+    MPI_Win_lock_all(0, queue->win);
+}
+
+int workQueueNext(WorkQueue *queue, int *begin, int *end) {
+    /* Il lavoro rimasto è stimato dall'ultima lettura, senza un'ulteriore operazione remota */
+    int64_t remaining = queue->n - queue->next;
+    int64_t chunk = remaining / (2 * queue->size);
+    if (chunk < queue->min_chunk) chunk = queue->min_chunk;
+
+    int64_t start;
+    MPI_Fetch_and_op(&chunk, &start, MPI_INT64_T, 0, 0, MPI_SUM, queue->win);
+    MPI_Win_flush(0, queue->win);
+
+    queue->next = start + chunk;
+    if (start >= queue->n) return 0;
+
+    *begin = (int)start;
+    *end = (start + chunk < queue->n) ? (int)(start + chunk) : queue->n;
+    return 1;
+}
+
+void workQueueFree(WorkQueue *queue) {
+    MPI_Win_unlock_all(queue->win);
+    MPI_Win_free(&queue->win);
+    queue->counter = NULL;
+}
+
+void loadStatsInit(LoadStats *stats) {
+    stats->busy = 0.0;
+    stats->idle = 0.0;
+    stats->chunks = 0;
+    stats->items = 0;
+}
+
+void reportLoadBalance(LoadStats *stats, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    double wait_start = MPI_Wtime();
+    MPI_Barrier(comm);
+    stats->idle += MPI_Wtime() - wait_start;
+
+    double local[4] = {stats->busy, stats->idle, (double)stats->chunks, (double)stats->items};
+    double *all = NULL;
+    if (rank == 0) {
+        all = (double *)malloc(4 * size * sizeof(double));
+    }
+    MPI_Gather(local, 4, MPI_DOUBLE, all, 4, MPI_DOUBLE, 0, comm);
+
+    if (rank == 0) {
+        double max_busy = 0.0, sum_busy = 0.0;
+        for (int r = 0; r < size; r++) {
+            double *row = &all[4 * r];
+            printf("Rank %d: busy %.4f s, idle %.4f s, %d chunk(s), %lld queries\n",
+                   r, row[0], row[1], (int)row[2], (long long)row[3]);
+            if (row[0] > max_busy) max_busy = row[0];
+            sum_busy += row[0];
+        }
+        double mean_busy = sum_busy / size;
+        printf("Load imbalance (max busy / mean busy): %.3f\n", (mean_busy > 0.0) ? max_busy / mean_busy : 1.0);
+        free(all);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef LOADBALANCE_H
+#define LOADBALANCE_H
+
+#include <stdint.h>
+#include <mpi.h>
+
+/** @brief: Coda di lavoro condivisa tra i processi
+ *  Il contatore della prossima query libera vive in una finestra RMA del processo 0 e viene
+ *  incrementato con MPI_Fetch_and_op, quindi nessun processo fa da master.
+ */
+typedef struct {
+    MPI_Win win;
+    int64_t *counter;   /* Memoria della finestra (solo il processo 0 ne espone un intero a 64 bit) */
+    int n;              /* Numero totale di elementi */
+    int min_chunk;      /* Dimensione minima di un chunk */
+    int size;           /* Numero di processi */
+    int64_t next;       /* Ultimo valore del contatore visto da questo processo */
+} WorkQueue;
+
+/** @brief: Tempi e lavoro svolto da un processo, per rendere visibile lo sbilanciamento */
+typedef struct {
+    double busy;        /* Secondi passati a calcolare */
+    double idle;        /* Secondi passati ad aspettare contatore, comunicazioni e altri processi */
+    int chunks;         /* Chunk di query elaborati */
+    long long items;    /* Query elaborate (comprese quelle ricevute da altri processi) */
+} LoadStats;
+
+/**
+ * @brief Crea la coda su [0, n), collettiva su `comm`.
+ *
+ * @param queue Coda da inizializzare.
+ * @param n Numero di elementi da distribuire.
+ * @param min_chunk Dimensione minima dei chunk, sotto la quale il costo del contatore non si ripaga.
+ * @param comm Comunicatore.
+ */
+void workQueueCreate(WorkQueue *queue, int n, int min_chunk, MPI_Comm comm);
+
+/**
+ * @brief Prende il prossimo chunk [begin, end) della coda.
+ *
+ * La dimensione è adattiva (guided): una frazione del lavoro che restava all'ultima lettura
+ * del contatore, divisa per il doppio dei processi e mai sotto min_chunk. I primi chunk sono
+ * quindi grandi e quelli finali piccoli, così i processi finiscono quasi insieme.
+ *
+ * @return 1 se è stato assegnato un chunk, 0 se il lavoro è finito.
+ */
+int workQueueNext(WorkQueue *queue, int *begin, int *end);
+
+/**
+ * @brief Libera la finestra della coda, collettiva.
+ */
+void workQueueFree(WorkQueue *queue);
+
+/**
+ * @brief Azzera le statistiche di un processo.
+ */
+void loadStatsInit(LoadStats *stats);
+
+/**
+ * @brief Chiude le misure e stampa sul master tempi e lavoro di ogni processo.
+ *
+ * Aspetta il processo più lento con una barriera, contando l'attesa come idle, poi raccoglie
+ * le statistiche sul master che stampa una riga per processo e lo sbilanciamento
+ * (massimo tempo di calcolo diviso per la media). Collettiva.
+ */
+void reportLoadBalance(LoadStats *stats, MPI_Comm comm);
+
+#endif
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "metric.h"
+
+/* Lato del cubo in cui vengono generati i punti, periodo di default del box */
+#define METRIC_DEFAULT_PERIOD 100.0
+
+double metric_weights[KNN_DIM];
+double metric_periods[KNN_DIM];
+
+const char *metricName(void) {
+    switch (KNN_METRIC) {
+        case KNN_METRIC_L1: return "l1";
+        case KNN_METRIC_LINF: return "linf";
+        case KNN_METRIC_WEIGHTED: return "weighted";
+        case KNN_METRIC_PERIODIC: return "periodic";
+        default: return "l2";
+    }
+}
+
+/* Legge una lista di valori positivi: uno solo per tutti gli assi, oppure uno per asse */
+static int parseAxisValues(const char *list, double *values) {
+    char *copy = strdup(list);
+    int count = 0, valid = 1;
+
+    for (char *token = strtok(copy, ","); token != NULL; token = strtok(NULL, ",")) {
+        double value = atof(token);
+        if (value <= 0.0 || count == KNN_DIM) {
+            valid = 0;
+            break;
+        }
+        values[count++] = value;
+    }
+    free(copy);
+
+    if (!valid || (count != 1 && count != KNN_DIM)) return -1;
+    for (int d = count; d < KNN_DIM; d++) {
+        values[d] = values[0];
+    }
+    return 0;
+}
+
+int metricConfigure(const char *weights, const char *periods) {
+    for (int d = 0; d < KNN_DIM; d++) {
+        metric_weights[d] = 1.0;
+        metric_periods[d] = METRIC_DEFAULT_PERIOD;
+    }
+
+    if (weights != NULL && parseAxisValues(weights, metric_weights) != 0) {
+        fprintf(stderr, "Invalid metric weights: %s (1 or %d positive values)\n", weights, KNN_DIM);
+        return -1;
+    }
+    if (periods != NULL && parseAxisValues(periods, metric_periods) != 0) {
+        fprintf(stderr, "Invalid box periods: %s (1 or %d positive values)\n", periods, KNN_DIM);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+#ifndef METRIC_H
+#define METRIC_H
+
+#include <math.h>
+#include <float.h>
+#include "point.h"
+
+/* Metriche disponibili, scelte a compile time (make metric=NOME): ogni funzione qui sotto è inline,
+   quindi i cicli sui candidati non passano mai da un puntatore a funzione */
+#define KNN_METRIC_L2       0   /* Euclidea */
+#define KNN_METRIC_L1       1   /* Manhattan */
+#define KNN_METRIC_LINF     2   /* Chebyshev, la differenza massima tra le coordinate */
+#define KNN_METRIC_WEIGHTED 3   /* Euclidea con un peso per asse (anisotropa) */
+#define KNN_METRIC_PERIODIC 4   /* Euclidea in un box periodico, con un periodo per asse */
+
+#ifndef KNN_METRIC
+#define KNN_METRIC KNN_METRIC_L2
+#endif
+
+#if KNN_METRIC < KNN_METRIC_L2 || KNN_METRIC > KNN_METRIC_PERIODIC
+#error "Unknown KNN_METRIC"
+#endif
+
+/* Le ricerche confrontano distanze "ridotte", monotone nella distanza vera e più economiche: per le
+   metriche euclidee è il quadrato (la radice si calcola solo sui risultati), per L1 e L∞ la distanza */
+#define KNN_METRIC_SQUARED (KNN_METRIC == KNN_METRIC_L2 || KNN_METRIC == KNN_METRIC_WEIGHTED || \
+                            KNN_METRIC == KNN_METRIC_PERIODIC)
+
+/* 1 se la distanza dal piano di taglio lungo un asse è un limite inferiore della distanza dai punti
+   oltre il piano; non vale nel box periodico, dove i punti oltre il piano possono essere vicini
+   passando dal bordo opposto, e la potatura usa il bounding box del nodo */
+#define KNN_METRIC_PLANE_BOUND (KNN_METRIC != KNN_METRIC_PERIODIC)
+
+/* Pesi degli assi (metrica weighted) e periodi del box (metrica periodic), impostati da metricConfigure */
+extern double metric_weights[KNN_DIM];
+extern double metric_periods[KNN_DIM];
+
+/**
+ * @brief Nome della metrica compilata ("l2", "l1", "linf", "weighted" o "periodic").
+ */
+const char *metricName(void);
+
+/**
+ * @brief Imposta i parametri della metrica da liste di valori separati da virgole.
+ *
+ * Un solo valore vale per tutti gli assi, altrimenti ne servono KNN_DIM. I pesi (default 1) devono
+ * essere positivi, come i periodi (default 100, il lato del cubo dei punti generati).
+ *
+ * @param weights Lista dei pesi, oppure NULL per il default.
+ * @param periods Lista dei periodi, oppure NULL per il default.
+ * @return 0 in caso di successo, -1 se una lista non è valida.
+ */
+int metricConfigure(const char *weights, const char *periods);
+
+/* Differenza tra due coordinate lungo un asse: nel box periodico l'immagine più vicina */
+static inline double metricWrap(double diff, int axis) {
+#if KNN_METRIC == KNN_METRIC_PERIODIC
+    double period = metric_periods[axis];
+    return diff - period * nearbyint(diff / period);
+#else
+    (void)axis;
+    return diff;
+#endif
+}
+
+/* Contributo ridotto di una differenza lungo un asse, già riportata nel box se periodica */
+static inline double metricTerm(double diff, int axis) {
+#if KNN_METRIC == KNN_METRIC_L1 || KNN_METRIC == KNN_METRIC_LINF
+    (void)axis;
+    return fabs(diff);
+#elif KNN_METRIC == KNN_METRIC_WEIGHTED
+    return metric_weights[axis] * diff * diff;
+#else
+    (void)axis;
+    return diff * diff;
+#endif
+}
+
+/* Combina la distanza ridotta accumulata con il contributo di un asse */
+static inline double metricCombine(double acc, double term) {
+#if KNN_METRIC == KNN_METRIC_LINF
+    return (term > acc) ? term : acc;
+#else
+    return acc + term;
+#endif
+}
+
+/* Aggiunge alla distanza ridotta la differenza tra due coordinate lungo un asse */
+static inline double metricAdd(double acc, double diff, int axis) {
+    return metricCombine(acc, metricTerm(metricWrap(diff, axis), axis));
+}
+
+/* Aggiunge alla distanza ridotta un limite (distanza non negativa, già periodica) lungo un asse */
+static inline double metricAddGap(double acc, double gap, int axis) {
+    return metricCombine(acc, metricTerm(gap, axis));
+}
+
+/**
+ * @brief Distanza ridotta tra due vettori di KNN_DIM coordinate.
+ */
+static inline double metricDistance(const double *a, const double *b) {
+    double acc = 0.0;
+    for (int d = 0; d < KNN_DIM; d++) {
+        acc = metricAdd(acc, a[d] - b[d], d);
+    }
+    return acc;
+}
+
+/* Distanza minima lungo un asse tra gli intervalli [alo, ahi] e [blo, bhi]; nel box periodico anche
+   girando dal bordo: le immagini traslate di un periodo distano almeno periodo - estensione dell'unione */
+static inline double metricIntervalGap(double alo, double ahi, double blo, double bhi, int axis) {
+    double below = alo - bhi, above = blo - ahi;
+    double gap = (below > above) ? below : above;
+    gap = (gap > 0.0) ? gap : 0.0;
+#if KNN_METRIC == KNN_METRIC_PERIODIC
+    double span = ((ahi > bhi) ? ahi : bhi) - ((alo < blo) ? alo : blo);
+    double around = metric_periods[axis] - span;
+    if (around < gap) gap = (around > 0.0) ? around : 0.0;
+#else
+    (void)axis;
+#endif
+    return gap;
+}
+
+/* Distanza massima lungo un asse tra un valore e i punti dell'intervallo [lo, hi] */
+static inline double metricIntervalFar(double x, double lo, double hi, int axis) {
+    double below = x - lo, above = hi - x;
+    double far = (below > above) ? below : above;
+#if KNN_METRIC == KNN_METRIC_PERIODIC
+    if (far > 0.5 * metric_periods[axis]) far = 0.5 * metric_periods[axis];
+#else
+    (void)axis;
+#endif
+    return far;
+}
+
+/* Limite inferiore ridotto dei punti oltre un piano di taglio a distanza `diff` (vedi KNN_METRIC_PLANE_BOUND) */
+static inline double metricPlaneBound(double diff, int axis) {
+    return metricTerm(diff, axis);
+}
+
+/* Distanza vera da una distanza ridotta */
+static inline double metricFinish(double reduced) {
+#if KNN_METRIC_SQUARED
+    return sqrt(reduced);
+#else
+    return reduced;
+#endif
+}
+
+/* Distanza ridotta da una distanza vera, DBL_MAX resta DBL_MAX */
+static inline double metricReduce(double distance) {
+#if KNN_METRIC_SQUARED
+    return (distance < sqrt(DBL_MAX)) ? distance * distance : DBL_MAX;
+#else
+    return distance;
+#endif
+}
+
+/* Limite in distanza ridotta che comprende ogni punto con distanza vera <= distance: il quadrato di
+   una radice può perdere qualche ulp (sqrt(6)^2 < 6), quindi il limite viene alzato di 4 epsilon */
+static inline double metricReduceLimit(double distance) {
+#if KNN_METRIC_SQUARED
+    double reduced = metricReduce(distance);
+    return (reduced < DBL_MAX / 2.0) ? reduced * (1.0 + 4.0 * DBL_EPSILON) : DBL_MAX;
+#else
+    return distance;
+#endif
+}
+
+#endif
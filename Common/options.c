@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "options.h"
+#include "metric.h"
+
+/* Valori di k di default: da 5 a 20 con step di 5 */
+static const int default_k_values[] = {5, 10, 15, 20};
+
+static void printUsage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [n] [options]\n"
+            "  -n, --points N    number of points (default 1000)\n"
+            "  -i, --input FILE  read the points from a binary dataset instead of generating them\n"
+            "  -G, --distribution D generated points: uniform, clusters, manifold or heavytail (default uniform)\n"
+            "  -X, --seed S      seed of the generated points, the same on any number of ranks (default: clock)\n"
+            "  -r, --ring        ring-pipelined brute force, each rank keeps only its block\n"
+            "  -d, --dynamic     ranks take query chunks from a shared counter instead of fixed blocks\n"
+            "  -k, --k LIST      comma-separated k values, searched once at the largest (default 5,10,15,20)\n"
+            "  -g, --no-gather   keep the results on the ranks that computed them (no text sample)\n"
+            "  -o, --output FILE write the binary kNN graph at the largest k\n"
+            "  -D, --distances   also store the neighbor distances in the graph\n"
+            "  -p, --print N     print the neighbors of the first N points as text (debug, default 0)\n"
+            "  -t, --threads T   worker threads per rank sharing the same index (default 1)\n"
+            "  -P, --precision P reference point storage: double, float32 or fixed16, re-ranked exactly (default double)\n"
+            "  -e, --eps E       approximate k-d tree search, prune nodes farther than d_k / (1 + E) (default 0)\n"
+            "  -l, --max-leaves L visit at most L k-d tree leaves per query, best bin first (default 0, no limit)\n"
+            "  -b, --backend B   local index of the k-d tree implementation: kdtree, grid or dynamic (default kdtree)\n"
+            "  -O, --order C     sort and distribute the points along a curve: none, morton or hilbert (default none)\n"
+            "  -T, --dual-tree   exact local self-join with a dual-tree traversal of the k-d tree\n"
+            "  -u, --updates F   move a fraction F of the points after building the index, then search (default 0)\n"
+            "  -S, --save-index FILE save the built k-d tree (one shard per rank) with a checksum\n"
+            "  -L, --load-index FILE load a saved k-d tree instead of reading the points and building it\n"
+            "  -s, --serve PATH  serve query batches on a Unix socket (server) or send them to it (client)\n"
+            "  -Q, --shutdown    client: stop the server after the replies\n"
+            "  -R, --radius R    find all the points within distance R instead of the k nearest\n"
+            "  -C, --range-count with --radius, only count the points within the radius\n"
+            "  -M, --max-count M stop every range count at M (default 0, no limit)\n"
+            "  -W, --weights LIST axis weights of the weighted metric, one value or one per axis (default 1)\n"
+            "  -B, --period LIST box periods of the periodic metric, one value or one per axis (default 100)\n"
+            "  -J, --report FILE write phase times and work counters of every rank as JSON\n"
+            "  -h, --help        show this message\n",
+            program);
+}
+
+/* Legge una lista di k separata da virgole, ad esempio "1,5,20" */
+static void parseKValues(const char *list, KNNOptions *opts) {
+    char *copy = strdup(list);
+    opts->num_k = 0;
+
+    for (char *token = strtok(copy, ","); token != NULL; token = strtok(NULL, ",")) {
+        int k = atoi(token);
+        if (k <= 0 || opts->num_k == KNN_MAX_K_VALUES) {
+            fprintf(stderr, "Invalid k list: %s\n", list);
+            exit(1);
+        }
+        opts->k_values[opts->num_k++] = k;
+    }
+    free(copy);
+
+    if (opts->num_k == 0) {
+        fprintf(stderr, "Invalid k list: %s\n", list);
+        exit(1);
+    }
+}
+
+void parseOptions(int argc, char *argv[], KNNOptions *opts) {
+    static struct option long_options[] = {
+        {"points",    required_argument, NULL, 'n'},
+        {"input",     required_argument, NULL, 'i'},
+        {"distribution", required_argument, NULL, 'G'},
+        {"seed",      required_argument, NULL, 'X'},
+        {"ring",      no_argument,       NULL, 'r'},
+        {"dynamic",   no_argument,       NULL, 'd'},
+        {"k",         required_argument, NULL, 'k'},
+        {"no-gather", no_argument,       NULL, 'g'},
+        {"output",    required_argument, NULL, 'o'},
+        {"distances", no_argument,       NULL, 'D'},
+        {"print",     required_argument, NULL, 'p'},
+        {"threads",   required_argument, NULL, 't'},
+        {"precision", required_argument, NULL, 'P'},
+        {"eps",       required_argument, NULL, 'e'},
+        {"max-leaves", required_argument, NULL, 'l'},
+        {"backend",   required_argument, NULL, 'b'},
+        {"order",     required_argument, NULL, 'O'},
+        {"dual-tree", no_argument,       NULL, 'T'},
+        {"updates",   required_argument, NULL, 'u'},
+        {"save-index", required_argument, NULL, 'S'},
+        {"load-index", required_argument, NULL, 'L'},
+        {"serve",     required_argument, NULL, 's'},
+        {"shutdown",  no_argument,       NULL, 'Q'},
+        {"radius",    required_argument, NULL, 'R'},
+        {"range-count", no_argument,     NULL, 'C'},
+        {"max-count", required_argument, NULL, 'M'},
+        {"weights",   required_argument, NULL, 'W'},
+        {"period",    required_argument, NULL, 'B'},
+        {"report",    required_argument, NULL, 'J'},
+        {"help",      no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    opts->n = 1000;
+    opts->input = NULL;
+    opts->distribution = DIST_UNIFORM;
+    opts->seed = -1;
+    opts->ring = 0;
+    opts->dynamic = 0;
+    opts->no_gather = 0;
+    opts->output = NULL;
+    opts->distances = 0;
+    opts->print = 0;
+    opts->threads = 1;
+    opts->precision = "double";
+    opts->eps = 0.0;
+    opts->max_leaves = 0;
+    opts->backend = "kdtree";
+    opts->order = "none";
+    opts->dual_tree = 0;
+    opts->updates = 0.0;
+    opts->save_index = NULL;
+    opts->load_index = NULL;
+    opts->serve = NULL;
+    opts->shutdown = 0;
+    opts->radius = 0.0;
+    opts->range_count = 0;
+    opts->max_count = 0;
+    opts->weights = NULL;
+    opts->periods = NULL;
+    opts->report = NULL;
+    opts->num_k = sizeof(default_k_values) / sizeof(default_k_values[0]);
+    memcpy(opts->k_values, default_k_values, sizeof(default_k_values));
+
+    int c;
+    while ((c = getopt_long(argc, argv, "n:i:G:X:k:rdgo:Dp:t:P:e:l:b:O:Tu:S:L:s:QR:CM:W:B:J:h", long_options, NULL)) != -1) {
+        switch (c) {
+            case 'n': opts->n = atoi(optarg); break;
+            case 'i': opts->input = optarg; break;
+            case 'G':
+                if (parseDistribution(optarg, &opts->distribution) != 0) {
+                    fprintf(stderr, "Invalid distribution: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'X': opts->seed = atoll(optarg); break;
+            case 'r': opts->ring = 1; break;
+            case 'd': opts->dynamic = 1; break;
+            case 'k': parseKValues(optarg, opts); break;
+            case 'g': opts->no_gather = 1; break;
+            case 'o': opts->output = optarg; break;
+            case 'D': opts->distances = 1; break;
+            case 'p': opts->print = atoi(optarg); break;
+            case 't': opts->threads = atoi(optarg); break;
+            case 'P': opts->precision = optarg; break;
+            case 'e': opts->eps = atof(optarg); break;
+            case 'l': opts->max_leaves = atoi(optarg); break;
+            case 'b': opts->backend = optarg; break;
+            case 'O': opts->order = optarg; break;
+            case 'T': opts->dual_tree = 1; break;
+            case 'u': opts->updates = atof(optarg); break;
+            case 'S': opts->save_index = optarg; break;
+            case 'L': opts->load_index = optarg; break;
+            case 's': opts->serve = optarg; break;
+            case 'Q': opts->shutdown = 1; break;
+            case 'R': opts->radius = atof(optarg); break;
+            case 'C': opts->range_count = 1; break;
+            case 'M': opts->max_count = atoi(optarg); break;
+            case 'W': opts->weights = optarg; break;
+            case 'B': opts->periods = optarg; break;
+            case 'J': opts->report = optarg; break;
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
+            default:
+                printUsage(argv[0]);
+                exit(1);
+        }
+    }
+
+    /* Compatibilità con l'uso originale: il primo argomento posizionale è il numero di punti */
+    if (optind < argc) {
+        opts->n = atoi(argv[optind]);
+    }
+
+    opts->k_max = 0;
+    for (int i = 0; i < opts->num_k; i++) {
+        if (opts->k_values[i] > opts->k_max) opts->k_max = opts->k_values[i];
+    }
+
+    if (opts->threads <= 0) {
+        fprintf(stderr, "Invalid number of threads: %d\n", opts->threads);
+        exit(1);
+    }
+
+    if (opts->print < 0) {
+        fprintf(stderr, "Invalid number of points to print: %d\n", opts->print);
+        exit(1);
+    }
+
+    if (opts->eps < 0.0 || opts->max_leaves < 0) {
+        fprintf(stderr, "Invalid approximate search parameters: eps %g, max leaves %d\n", opts->eps, opts->max_leaves);
+        exit(1);
+    }
+
+    if (opts->updates < 0.0 || opts->updates > 1.0) {
+        fprintf(stderr, "Invalid fraction of updated points: %g\n", opts->updates);
+        exit(1);
+    }
+
+    if (opts->radius < 0.0 || opts->max_count < 0) {
+        fprintf(stderr, "Invalid range search parameters: radius %g, max count %d\n", opts->radius, opts->max_count);
+        exit(1);
+    }
+
+    if (metricConfigure(opts->weights, opts->periods) != 0) {
+        exit(1);
+    }
+
+    /* Nella modalità ad anello le query sono legate al blocco posseduto, non si possono spostare */
+    if (opts->ring && opts->dynamic) {
+        fprintf(stderr, "--dynamic cannot be combined with --ring\n");
+        exit(1);
+    }
+
+    if (opts->n <= 0) {
+        fprintf(stderr, "Invalid number of points: %d\n", opts->n);
+        exit(1);
+    }
+}
+
+const char *unsupportedOption(const KNNOptions *opts, int supported) {
+    if (!(supported & OPTIONS_BRUTE_FORCE)) {
+        if (opts->ring) return "--ring";
+        if (opts->dynamic) return "--dynamic";
+        if (strcmp(opts->precision, "double") != 0) return "--precision";
+    }
+    if (!(supported & OPTIONS_KDTREE)) {
+        if (opts->eps > 0.0) return "--eps";
+        if (opts->max_leaves > 0) return "--max-leaves";
+        if (strcmp(opts->backend, "kdtree") != 0) return "--backend";
+        if (strcmp(opts->order, "none") != 0) return "--order";
+        if (opts->dual_tree) return "--dual-tree";
+        if (opts->updates > 0.0) return "--updates";
+        if (opts->save_index != NULL) return "--save-index";
+        if (opts->load_index != NULL) return "--load-index";
+        if (opts->serve != NULL) return "--serve";
+        if (opts->radius > 0.0) return "--radius";
+        if (opts->range_count) return "--range-count";
+        if (opts->max_count > 0) return "--max-count";
+    }
+    return NULL;
+}
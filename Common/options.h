@@ -0,0 +1,76 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "generate.h"
+
+/* Numero massimo di valori di k richiedibili in una sola esecuzione */
+#define KNN_MAX_K_VALUES 64
+
+/* Gruppi di opzioni supportati da un eseguibile, per unsupportedOption */
+#define OPTIONS_BRUTE_FORCE 0x1 /* --ring, --dynamic e --precision della forza bruta replicata */
+#define OPTIONS_KDTREE 0x2      /* Ricerca approssimata, backend, curve, dual-tree, aggiornamenti, indici su file,
+                                   server e ricerche per raggio del K-d Tree distribuito */
+
+/** @brief: Opzioni da riga di comando comuni a tutte le implementazioni
+ *  Ogni eseguibile usa solo i campi che supporta
+ */
+typedef struct {
+    int n;          /* Numero di punti */
+    const char *input; /* Dataset binario da leggere invece di generare i punti (NULL se assente) */
+    Distribution distribution; /* Distribuzione dei punti generati */
+    long long seed; /* Seme dei punti generati (-1 = preso dall'orologio) */
+    int ring;       /* Modalità ad anello della forza bruta distribuita */
+    int dynamic;    /* Chunk di query distribuiti a richiesta tra i processi invece che a blocchi fissi */
+    int no_gather;  /* I risultati restano sui processi che li hanno calcolati */
+    const char *output; /* File binario del grafo dei vicini (NULL per non scriverlo) */
+    int distances;  /* Scrive nel grafo anche la matrice delle distanze */
+    int print;      /* Numero di punti di cui stampare i vicini come testo (debug, default 0) */
+    int threads;    /* Thread per processo che condividono indice e dati */
+    const char *precision; /* Precisione dei punti di riferimento: double, float32 o fixed16 */
+    double eps;     /* Ricerca approssimata sul KD-Tree: un nodo si visita se più vicino di d_k / (1 + eps) */
+    int max_leaves; /* Foglie visitate al massimo per query dal KD-Tree (0 = nessun limite) */
+    const char *backend; /* Indice locale dell'implementazione K-d Tree: kdtree, grid o dynamic */
+    const char *order;  /* Curva con cui ordinare e distribuire i punti: none, morton o hilbert */
+    int dual_tree;  /* Ricerca locale del KD-Tree come self-join con la visita dual-tree */
+    double updates; /* Frazione di punti spostati dopo la costruzione dell'indice (0 = nessun aggiornamento) */
+    const char *save_index; /* File in cui salvare il KD-Tree costruito (NULL per non salvarlo) */
+    const char *load_index; /* Indice salvato da caricare al posto di leggere i punti e costruire l'albero */
+    const char *serve;  /* Socket Unix del server di query (NULL per l'esecuzione singola) */
+    int shutdown;   /* Il client chiede al server di fermarsi dopo le proprie query */
+    double radius;  /* Ricerca per raggio invece dei k vicini (0 = disattivata) */
+    int range_count; /* Con --radius conta soltanto i punti entro il raggio */
+    int max_count;  /* Valore a cui fermare i conteggi per raggio (0 = nessun limite) */
+    const char *weights; /* Pesi degli assi della metrica weighted, separati da virgole (NULL = tutti 1) */
+    const char *periods; /* Periodi del box della metrica periodic, separati da virgole (NULL = 100) */
+    const char *report; /* File JSON con i tempi delle fasi e i contatori di tutti i processi (NULL per non scriverlo) */
+    int k_values[KNN_MAX_K_VALUES]; /* Valori di k richiesti, nell'ordine della riga di comando */
+    int num_k;
+    int k_max;      /* Massimo tra i k richiesti: la ricerca viene fatta una sola volta con questo valore */
+} KNNOptions;
+
+/**
+ * @brief Legge le opzioni da riga di comando.
+ *
+ * Il numero di punti può essere passato come primo argomento posizionale (come nei Makefile,
+ * ad esempio `./kd 1000`); le altre opzioni sono flag in stile `--nome`. In caso di opzione
+ * sconosciuta stampa l'uso ed esce. I valori di k si passano come lista separata da virgole
+ * (`--k 5,10,15,20`, che è anche il default). Con `--input` il numero di punti è quello del
+ * dataset e viene impostato da chi lo legge. Il nome della distribuzione dei punti generati viene
+ * convertito qui. I parametri della metrica (pesi e periodi) vengono passati a metricConfigure.
+ *
+ * @param argc Numero di argomenti.
+ * @param argv Argomenti.
+ * @param opts Struttura in cui salvare le opzioni, inizializzata con i valori di default.
+ */
+void parseOptions(int argc, char *argv[], KNNOptions *opts);
+
+/**
+ * @brief Cerca un'opzione impostata che l'eseguibile non usa.
+ *
+ * @param opts Opzioni lette da parseOptions.
+ * @param supported Gruppi di opzioni supportati (OPTIONS_BRUTE_FORCE, OPTIONS_KDTREE).
+ * @return Il nome della prima opzione impostata fuori dai gruppi supportati, oppure NULL.
+ */
+const char *unsupportedOption(const KNNOptions *opts, int supported);
+
+#endif
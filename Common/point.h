@@ -0,0 +1,34 @@
+#ifndef POINT_H
+#define POINT_H
+
+/* Numero di coordinate dei punti, fissato a compile time (make dim=N): tutti i cicli sulle
+   coordinate hanno un numero costante di iterazioni, che il compilatore srotola e vettorizza */
+#ifndef KNN_DIM
+#define KNN_DIM 3
+#endif
+
+#if KNN_DIM < 1
+#error "KNN_DIM must be at least 1"
+#endif
+
+/** @brief: Punto a KNN_DIM dimensioni con la sua posizione nel dataset di partenza
+ *  original_index resta invariato anche quando il punto viene spostato tra processi o riordinato
+ */
+typedef struct {
+    double coord[KNN_DIM];
+    int original_index;
+} Point;
+
+/**
+ * @brief Distanza euclidea al quadrato tra due vettori di KNN_DIM coordinate.
+ */
+static inline double pointDistanceSquared(const double *a, const double *b) {
+    double sum = 0.0;
+    for (int d = 0; d < KNN_DIM; d++) {
+        double diff = a[d] - b[d];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+#endif
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pointio.h"
+
+/* Righe tenute in memoria per colonna prima di scriverle su disco */
+#define POINT_WRITER_ROWS 65536
+
+size_t pointColumnElementSize(const PointFileHeader *header, int column) {
+    if (column == POINT_COLUMN_IDS) return sizeof(int64_t);
+    return (header->flags & POINT_FILE_DOUBLE) ? sizeof(double) : sizeof(float);
+}
+
+uint64_t pointColumnOffset(const PointFileHeader *header, int column) {
+    /* Le colonne delle coordinate sono arrotondate a un multiplo di 8 byte */
+    uint64_t coord_bytes = header->count * pointColumnElementSize(header, 0);
+    uint64_t column_bytes = (coord_bytes + 7) & ~(uint64_t)7;
+    return POINT_FILE_HEADER_SIZE + (uint64_t)column * column_bytes;
+}
+
+uint32_t pointHeaderDims(const PointFileHeader *header) {
+    return (header->dims != 0) ? header->dims : 3;
+}
+
+int pointHeaderCheckAnyDim(const PointFileHeader *header, uint64_t file_size, const char *path) {
+    if (file_size < POINT_FILE_HEADER_SIZE || memcmp(header->magic, POINT_FILE_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s: not a point dataset (bad magic)\n", path);
+        return -1;
+    }
+    if (header->version != POINT_FILE_VERSION) {
+        fprintf(stderr, "%s: unsupported dataset version %u\n", path, header->version);
+        return -1;
+    }
+    uint32_t dims = pointHeaderDims(header);
+    if (dims > POINT_FILE_MAX_DIMS) {
+        fprintf(stderr, "%s: %u coordinates per point, at most %d are supported\n", path, dims, POINT_FILE_MAX_DIMS);
+        return -1;
+    }
+
+    /* La colonna degli id segue le coordinate del file, qualunque sia il loro numero */
+    int ids = (int)dims;
+    int last = (header->flags & POINT_FILE_IDS) ? ids : ids - 1;
+    size_t element = (last == ids) ? sizeof(int64_t) : pointColumnElementSize(header, 0);
+    uint64_t expected = pointColumnOffset(header, last) + header->count * element;
+    if (file_size < expected) {
+        fprintf(stderr, "%s: truncated dataset (%llu bytes, %llu expected)\n", path,
+                (unsigned long long)file_size, (unsigned long long)expected);
+        return -1;
+    }
+    return 0;
+}
+
+int pointHeaderCheck(const PointFileHeader *header, uint64_t file_size, const char *path) {
+    if (pointHeaderCheckAnyDim(header, file_size, path) != 0) return -1;
+    uint32_t dims = pointHeaderDims(header);
+    if (dims != KNN_DIM) {
+        fprintf(stderr, "%s: %u coordinates per point, this build has %d (rebuild with dim=%u)\n", path, dims,
+                KNN_DIM, dims);
+        return -1;
+    }
+    return 0;
+}
+
+void pointsFromColumns(const PointFileHeader *header, const void *const columns[KNN_DIM],
+                       uint64_t first_row, int n, Point *points) {
+    for (int d = 0; d < KNN_DIM; d++) {
+        if (header->flags & POINT_FILE_DOUBLE) {
+            const double *column = (const double *)columns[d];
+            for (int i = 0; i < n; i++) points[i].coord[d] = column[i];
+        } else {
+            const float *column = (const float *)columns[d];
+            for (int i = 0; i < n; i++) points[i].coord[d] = column[i];
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        points[i].original_index = (int)(first_row + i);
+    }
+}
+
+/* Mappa il dataset e ne controlla l'header, con o senza il vincolo sul numero di coordinate */
+static int openMapped(const char *path, PointFile *file, int any_dim) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < POINT_FILE_HEADER_SIZE) {
+        fprintf(stderr, "%s: not a point dataset (too short)\n", path);
+        close(fd);
+        return -1;
+    }
+
+    /* La mappatura resta valida anche dopo la chiusura del descrittore */
+    file->map_size = (size_t)st.st_size;
+    file->map = mmap(NULL, file->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file->map == MAP_FAILED) {
+        fprintf(stderr, "%s: mmap failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    memcpy(&file->header, file->map, sizeof(PointFileHeader));
+    int status = any_dim ? pointHeaderCheckAnyDim(&file->header, file->map_size, path)
+                         : pointHeaderCheck(&file->header, file->map_size, path);
+    if (status != 0) {
+        munmap(file->map, file->map_size);
+        return -1;
+    }
+
+    /* Le colonne vengono lette in sequenza */
+    madvise(file->map, file->map_size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+int pointFileOpen(const char *path, PointFile *file) {
+    return openMapped(path, file, 0);
+}
+
+int pointFileOpenAnyDim(const char *path, PointFile *file) {
+    return openMapped(path, file, 1);
+}
+
+const void *pointFileColumn(const PointFile *file, int column) {
+    /* La colonna degli id segue le coordinate del file, che possono essere più di KNN_DIM */
+    if (column == (int)pointHeaderDims(&file->header) && !(file->header.flags & POINT_FILE_IDS)) return NULL;
+    return (const char *)file->map + pointColumnOffset(&file->header, column);
+}
+
+void pointFileRead(const PointFile *file, uint64_t begin, uint64_t end, Point *points) {
+    size_t element = pointColumnElementSize(&file->header, 0);
+    const void *columns[KNN_DIM];
+    for (int d = 0; d < KNN_DIM; d++) {
+        columns[d] = (const char *)pointFileColumn(file, d) + begin * element;
+    }
+    pointsFromColumns(&file->header, columns, begin, (int)(end - begin), points);
+}
+
+void pointFileClose(PointFile *file) {
+    munmap(file->map, file->map_size);
+    file->map = NULL;
+    file->map_size = 0;
+}
+
+/* Scrive `size` byte all'offset indicato, gestendo le scritture parziali */
+static int writeAt(int fd, const void *data, size_t size, uint64_t offset) {
+    const char *bytes = (const char *)data;
+    while (size > 0) {
+        ssize_t done = pwrite(fd, bytes, size, (off_t)offset);
+        if (done < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        bytes += done;
+        offset += done;
+        size -= done;
+    }
+    return 0;
+}
+
+static int flushWriter(PointWriter *writer) {
+    int columns = (writer->header.flags & POINT_FILE_IDS) ? KNN_DIM + 1 : KNN_DIM;
+    for (int c = 0; c < columns; c++) {
+        size_t element = pointColumnElementSize(&writer->header, c);
+        uint64_t offset = pointColumnOffset(&writer->header, c) + writer->written * element;
+        if (writeAt(writer->fd, writer->buffer[c], writer->buffered * element, offset) != 0) {
+            perror("pointWriter");
+            return -1;
+        }
+    }
+    writer->written += writer->buffered;
+    writer->buffered = 0;
+    return 0;
+}
+
+int pointWriterOpen(PointWriter *writer, const char *path, uint64_t count, uint32_t flags) {
+    memset(&writer->header, 0, sizeof(PointFileHeader));
+    memcpy(writer->header.magic, POINT_FILE_MAGIC, 8);
+    writer->header.version = POINT_FILE_VERSION;
+    writer->header.flags = flags;
+    writer->header.count = count;
+    writer->header.dims = KNN_DIM;
+    writer->written = 0;
+    writer->buffered = 0;
+
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (writeAt(writer->fd, &writer->header, sizeof(PointFileHeader), 0) != 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        close(writer->fd);
+        return -1;
+    }
+
+    for (int c = 0; c <= POINT_COLUMN_IDS; c++) {
+        writer->buffer[c] = malloc(POINT_WRITER_ROWS * pointColumnElementSize(&writer->header, c));
+    }
+    return 0;
+}
+
+int pointWriterAppend(PointWriter *writer, const double coord[KNN_DIM], int64_t id) {
+    if (writer->written + writer->buffered >= writer->header.count) {
+        fprintf(stderr, "pointWriter: more than %llu points appended\n",
+                (unsigned long long)writer->header.count);
+        return -1;
+    }
+
+    int row = writer->buffered;
+    for (int d = 0; d < KNN_DIM; d++) {
+        if (writer->header.flags & POINT_FILE_DOUBLE) {
+            ((double *)writer->buffer[d])[row] = coord[d];
+        } else {
+            ((float *)writer->buffer[d])[row] = (float)coord[d];
+        }
+    }
+    ((int64_t *)writer->buffer[POINT_COLUMN_IDS])[row] = id;
+
+    writer->buffered++;
+    if (writer->buffered == POINT_WRITER_ROWS) {
+        return flushWriter(writer);
+    }
+    return 0;
+}
+
+int pointWriterClose(PointWriter *writer) {
+    int status = flushWriter(writer);
+
+    if (status == 0 && writer->written != writer->header.count) {
+        fprintf(stderr, "pointWriter: %llu points written, %llu declared\n",
+                (unsigned long long)writer->written, (unsigned long long)writer->header.count);
+        status = -1;
+    }
+
+    /* Il padding finale dell'ultima colonna float32 fa parte del file */
+    if (status == 0) {
+        int last = (writer->header.flags & POINT_FILE_IDS) ? POINT_COLUMN_IDS : KNN_DIM - 1;
+        uint64_t end = pointColumnOffset(&writer->header, last + 1);
+        if (last == POINT_COLUMN_IDS) {
+            end = pointColumnOffset(&writer->header, last) + writer->header.count * sizeof(int64_t);
+        }
+        if (ftruncate(writer->fd, (off_t)end) != 0) {
+            perror("pointWriter");
+            status = -1;
+        }
+    }
+
+    if (close(writer->fd) != 0) status = -1;
+    for (int c = 0; c <= POINT_COLUMN_IDS; c++) {
+        free(writer->buffer[c]);
+        writer->buffer[c] = NULL;
+    }
+    return status;
+}
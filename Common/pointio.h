@@ -0,0 +1,164 @@
+#ifndef POINTIO_H
+#define POINTIO_H
+
+#include <stdint.h>
+#include "point.h"
+
+/*  Formato binario a colonne dei dataset (estensione consigliata .knnp), little-endian:
+
+    offset 0   char[8]   magic "KNNPTS01"
+    offset 8   uint32    versione (POINT_FILE_VERSION)
+    offset 12  uint32    flag: POINT_FILE_DOUBLE (coordinate float64, altrimenti float32),
+                         POINT_FILE_IDS (presente la colonna degli id)
+    offset 16  uint64    numero di punti n
+    offset 24  uint32    coordinate per punto (0 nei file a 3 dimensioni scritti prima del campo)
+    offset 28  uint32    riservato, 0
+    offset 32  una colonna per coordinata (x, y, z, ...): n valori float32 o float64 ciascuna
+               colonna ids opzionale: n valori int64
+
+    Ogni colonna inizia ad un offset multiplo di 8 (le colonne float32 sono allineate con padding),
+    così un file mappato in memoria può essere letto direttamente come array.
+    La riga di un punto nel file è il suo original_index; gli id sono solo un'etichetta esterna.
+    Un eseguibile legge come Point solo i dataset con KNN_DIM coordinate per punto; quelli con un
+    altro numero di coordinate si leggono come vettori a dimensione runtime (vectors.h).
+*/
+
+#define POINT_FILE_MAGIC "KNNPTS01"
+#define POINT_FILE_VERSION 1
+#define POINT_FILE_HEADER_SIZE 32
+
+#define POINT_FILE_DOUBLE 0x1
+#define POINT_FILE_IDS    0x2
+
+/* Numero massimo di coordinate per punto accettato in un header */
+#define POINT_FILE_MAX_DIMS 4096
+
+/* Indici delle colonne del file: le coordinate sono le colonne da 0 a KNN_DIM - 1 */
+#define POINT_COLUMN_IDS KNN_DIM
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t count;
+    uint32_t dims;
+    uint32_t reserved;
+} PointFileHeader;
+
+/** @brief: Dataset aperto con mmap, le colonne vengono lette direttamente dalla mappatura */
+typedef struct {
+    PointFileHeader header;
+    void *map;
+    size_t map_size;
+} PointFile;
+
+/** @brief: Scrittura in streaming di un dataset, con un buffer per colonna */
+typedef struct {
+    int fd;
+    PointFileHeader header;
+    uint64_t written;       /* Righe già scritte su disco */
+    int buffered;           /* Righe nel buffer */
+    void *buffer[KNN_DIM + 1];
+} PointWriter;
+
+/**
+ * @brief Dimensione in byte di un elemento della colonna `column`.
+ */
+size_t pointColumnElementSize(const PointFileHeader *header, int column);
+
+/**
+ * @brief Offset in byte dell'inizio della colonna `column` nel file.
+ */
+uint64_t pointColumnOffset(const PointFileHeader *header, int column);
+
+/**
+ * @brief Numero di coordinate per punto dichiarato dall'header (3 nei file scritti prima del campo).
+ */
+uint32_t pointHeaderDims(const PointFileHeader *header);
+
+/**
+ * @brief Controlla magic, versione e dimensione attesa di un header, con qualsiasi numero di coordinate.
+ *
+ * @return 0 se l'header è valido, -1 altrimenti (con il motivo stampato su stderr).
+ */
+int pointHeaderCheckAnyDim(const PointFileHeader *header, uint64_t file_size, const char *path);
+
+/**
+ * @brief Controlla magic, versione, numero di coordinate e dimensione attesa di un header letto da file.
+ *
+ * @param header Header letto.
+ * @param file_size Dimensione del file in byte.
+ * @param path Nome del file, usato nei messaggi di errore.
+ * @return 0 se l'header è valido, -1 altrimenti (con il motivo stampato su stderr).
+ */
+int pointHeaderCheck(const PointFileHeader *header, uint64_t file_size, const char *path);
+
+/**
+ * @brief Converte righe consecutive lette dalle colonne del file in un array di Point.
+ *
+ * @param header Header del file.
+ * @param columns Le KNN_DIM colonne di coordinate a partire dalla riga `first_row`, nel tipo
+ *                indicato dall'header.
+ * @param first_row Riga del file del primo punto, diventa il suo original_index.
+ * @param n Numero di punti.
+ * @param points Array di `n` punti da riempire.
+ */
+void pointsFromColumns(const PointFileHeader *header, const void *const columns[KNN_DIM],
+                       uint64_t first_row, int n, Point *points);
+
+/**
+ * @brief Apre un dataset con mmap (lettura su un singolo nodo, senza buffer intermedi).
+ *
+ * @return 0 in caso di successo, -1 in caso di errore (con il motivo stampato su stderr).
+ */
+int pointFileOpen(const char *path, PointFile *file);
+
+/**
+ * @brief Come pointFileOpen, ma accetta dataset con qualsiasi numero di coordinate (pointHeaderDims).
+ *
+ * Su un dataset con un numero di coordinate diverso da KNN_DIM vanno usate solo le colonne delle
+ * coordinate, lette con vectorSetRead.
+ */
+int pointFileOpenAnyDim(const char *path, PointFile *file);
+
+/**
+ * @brief Puntatore alla colonna `column` dentro la mappatura (NULL se gli id non sono presenti).
+ */
+const void *pointFileColumn(const PointFile *file, int column);
+
+/**
+ * @brief Copia le righe [begin, end) del dataset in un array di Point.
+ */
+void pointFileRead(const PointFile *file, uint64_t begin, uint64_t end, Point *points);
+
+/**
+ * @brief Chiude la mappatura di un dataset.
+ */
+void pointFileClose(PointFile *file);
+
+/**
+ * @brief Crea un dataset di `count` punti da riempire con pointWriterAppend.
+ *
+ * Le colonne hanno posizione fissa, quindi il numero di punti deve essere noto in anticipo;
+ * ogni colonna viene scritta al suo offset quando il relativo buffer è pieno.
+ *
+ * @param flags Combinazione di POINT_FILE_DOUBLE e POINT_FILE_IDS.
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+int pointWriterOpen(PointWriter *writer, const char *path, uint64_t count, uint32_t flags);
+
+/**
+ * @brief Aggiunge un punto di KNN_DIM coordinate (l'id è ignorato se il file non ha la colonna degli id).
+ *
+ * @return 0 in caso di successo, -1 se il file è già pieno o la scrittura fallisce.
+ */
+int pointWriterAppend(PointWriter *writer, const double coord[KNN_DIM], int64_t id);
+
+/**
+ * @brief Scrive i buffer rimasti e chiude il file.
+ *
+ * @return 0 se sono stati scritti esattamente `count` punti, -1 altrimenti.
+ */
+int pointWriterClose(PointWriter *writer);
+
+#endif
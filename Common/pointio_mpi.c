@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+#include "pointio_mpi.h"
+
+MPI_Datatype createPointType(void) {
+    MPI_Datatype types[2] = {MPI_DOUBLE, MPI_INT};
+    int blocklengths[2] = {KNN_DIM, 1};
+    MPI_Aint offsets[2] = {offsetof(Point, coord), offsetof(Point, original_index)};
+
+    MPI_Datatype record, point_type;
+    MPI_Type_create_struct(2, blocklengths, offsets, types, &record);
+    MPI_Type_create_resized(record, 0, sizeof(Point), &point_type);
+    MPI_Type_free(&record);
+    MPI_Type_commit(&point_type);
+    return point_type;
+}
+
+/* Apre il dataset su tutti i processi e ne legge l'header: il master lo controlla (con o senza il
+   vincolo sul numero di coordinate) e in caso di errore termina tutti con MPI_Abort */
+static void openDataset(const char *path, MPI_Comm comm, int any_dim, MPI_File *fh, PointFileHeader *header) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    if (MPI_File_open(comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, fh) != MPI_SUCCESS) {
+        if (rank == 0) fprintf(stderr, "%s: cannot open dataset\n", path);
+        MPI_Abort(comm, 1);
+    }
+
+    /* L'header è piccolo: ogni processo lo legge, ma solo il master lo controlla */
+    MPI_Offset file_size;
+    MPI_File_get_size(*fh, &file_size);
+    MPI_File_read_at_all(*fh, 0, header, sizeof(PointFileHeader), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    /* Tutti hanno letto lo stesso header, il master controlla e riporta l'errore per tutti */
+    int valid = 1;
+    if (rank == 0) {
+        valid = any_dim ? (pointHeaderCheckAnyDim(header, (uint64_t)file_size, path) == 0)
+                        : (pointHeaderCheck(header, (uint64_t)file_size, path) == 0);
+        if (valid && header->count > INT_MAX) {
+            fprintf(stderr, "%s: too many points (%llu)\n", path, (unsigned long long)header->count);
+            valid = 0;
+        }
+    }
+    MPI_Bcast(&valid, 1, MPI_INT, 0, comm);
+    if (!valid) {
+        MPI_File_close(fh);
+        MPI_Abort(comm, 1);
+    }
+}
+
+/* Legge le righe [start, start + local_n) delle prime `dims` colonne, una dopo l'altra nel buffer
+   restituito, con una lettura collettiva per colonna */
+static char *readColumns(MPI_File fh, const PointFileHeader *header, int dims, int start, int local_n) {
+    MPI_Datatype coord_type = (header->flags & POINT_FILE_DOUBLE) ? MPI_DOUBLE : MPI_FLOAT;
+    size_t element = pointColumnElementSize(header, 0);
+    char *columns = (char *)malloc(dims * (size_t)(local_n > 0 ? local_n : 1) * element);
+
+    for (int c = 0; c < dims; c++) {
+        MPI_Offset offset = (MPI_Offset)(pointColumnOffset(header, c) + (uint64_t)start * element);
+        MPI_File_read_at_all(fh, offset, columns + (size_t)c * local_n * element, local_n, coord_type,
+                             MPI_STATUS_IGNORE);
+    }
+    return columns;
+}
+
+/* Blocco di righe del processo, la stessa divisione dei punti generati */
+static void rowBlock(int n, MPI_Comm comm, int *local_n, int *start) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    *local_n = n / size + (rank < n % size ? 1 : 0);
+    *start = 0;
+    for (int i = 0; i < rank; i++) {
+        *start += n / size + (i < n % size ? 1 : 0);
+    }
+}
+
+void readPointsMPI(const char *path, MPI_Comm comm, Point **points, int *local_n, int *n) {
+    MPI_File fh;
+    PointFileHeader header;
+    openDataset(path, comm, 0, &fh, &header);
+
+    *n = (int)header.count;
+    int start;
+    rowBlock(*n, comm, local_n, &start);
+
+    char *columns = readColumns(fh, &header, KNN_DIM, start, *local_n);
+    MPI_File_close(&fh);
+
+    size_t element = pointColumnElementSize(&header, 0);
+    *points = (Point *)malloc((*local_n > 0 ? *local_n : 1) * sizeof(Point));
+    const void *column_ptrs[KNN_DIM];
+    for (int c = 0; c < KNN_DIM; c++) {
+        column_ptrs[c] = columns + (size_t)c * *local_n * element;
+    }
+    pointsFromColumns(&header, column_ptrs, start, *local_n, *points);
+    free(columns);
+}
+
+void readVectorsMPI(const char *path, MPI_Comm comm, VectorSet *local, int *n) {
+    MPI_File fh;
+    PointFileHeader header;
+    openDataset(path, comm, 1, &fh, &header);
+
+    *n = (int)header.count;
+    int dims = (int)pointHeaderDims(&header);
+    int local_n, start;
+    rowBlock(*n, comm, &local_n, &start);
+
+    char *columns = readColumns(fh, &header, dims, start, local_n);
+    MPI_File_close(&fh);
+
+    size_t element = pointColumnElementSize(&header, 0);
+    vectorSetAlloc(local, local_n, dims, start);
+    const void **column_ptrs = (const void **)malloc(dims * sizeof(const void *));
+    for (int c = 0; c < dims; c++) {
+        column_ptrs[c] = columns + (size_t)c * local_n * element;
+    }
+    vectorsFromColumns(&header, column_ptrs, local);
+    free(column_ptrs);
+    free(columns);
+}
+
+int datasetDimsMPI(const char *path, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    /* Se l'header non si legge il valore resta KNN_DIM, e l'errore lo riporta la lettura vera */
+    int dims = KNN_DIM;
+    if (rank == 0) {
+        FILE *file = fopen(path, "rb");
+        PointFileHeader header;
+        if (file != NULL && fread(&header, sizeof(PointFileHeader), 1, file) == 1 &&
+            memcmp(header.magic, POINT_FILE_MAGIC, 8) == 0) {
+            dims = (int)pointHeaderDims(&header);
+        }
+        if (file != NULL) fclose(file);
+    }
+    MPI_Bcast(&dims, 1, MPI_INT, 0, comm);
+    return dims;
+}
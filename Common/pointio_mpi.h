@@ -0,0 +1,54 @@
+#ifndef POINTIO_MPI_H
+#define POINTIO_MPI_H
+
+#include <mpi.h>
+#include "pointio.h"
+#include "vectors.h"
+
+/**
+ * @brief Legge in parallelo la porzione di dataset assegnata a ogni processo.
+ *
+ * Il dataset viene diviso in blocchi contigui di n / size righe (le prime n % size ne hanno una
+ * in più), la stessa divisione usata per i punti generati. Ogni processo legge solo le proprie
+ * righe di ogni colonna con MPI_File_read_at_all, quindi nessun processo passa dall'intero
+ * dataset e non serve una distribuzione dal master. In caso di errore il programma viene
+ * terminato con MPI_Abort.
+ *
+ * @param path Percorso del dataset.
+ * @param comm Comunicatore dei processi che leggono.
+ * @param points Puntatore in cui salvare l'array (allocato) dei punti locali.
+ * @param local_n Numero di punti letti dal processo.
+ * @param n Numero totale di punti del dataset.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void readPointsMPI(const char *path, MPI_Comm comm, Point **points, int *local_n, int *n);
+
+/**
+ * @brief Come readPointsMPI, per un dataset con qualsiasi numero di coordinate.
+ *
+ * Ogni processo legge lo stesso blocco di righe di readPointsMPI in un insieme di vettori a dimensione
+ * runtime (vectors.h), con local->first uguale all'original_index della prima riga.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void readVectorsMPI(const char *path, MPI_Comm comm, VectorSet *local, int *n);
+
+/**
+ * @brief Numero di coordinate per punto di un dataset, letto dal master e trasmesso a tutti.
+ *
+ * Se il file non è un dataset restituisce KNN_DIM, così l'errore viene riportato dalla lettura.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+int datasetDimsMPI(const char *path, MPI_Comm comm);
+
+/**
+ * @brief Crea il MPI datatype della struct Point: KNN_DIM double seguiti dall'original_index.
+ *
+ * Il datatype segue la dimensione di compilazione e ha l'estensione di sizeof(Point), quindi
+ * può essere usato direttamente sugli array di punti. Va liberato con MPI_Type_free.
+ */
+MPI_Datatype createPointType(void);
+
+#endif
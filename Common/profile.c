@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "profile.h"
+#include "metric.h"
+
+long long profile_counters[PROFILE_COUNTERS];
+
+static double phase_time[PROFILE_PHASES];
+static double phase_start[PROFILE_PHASES];
+static int phase_used[PROFILE_PHASES];
+static double start_time;
+
+const char *profileCounterName(ProfileCounter counter) {
+    switch (counter) {
+        case COUNTER_NODES: return "nodes_visited";
+        case COUNTER_DISTANCES: return "distance_evaluations";
+        case COUNTER_HEAP_INSERTS: return "heap_inserts";
+        case COUNTER_BYTES_SENT: return "bytes_sent";
+        case COUNTER_BYTES_RECEIVED: return "bytes_received";
+        default: return "unknown";
+    }
+}
+
+static const char *phaseName(int phase) {
+    switch (phase) {
+        case PHASE_LOAD: return "load";
+        case PHASE_GATHER: return "gather";
+        case PHASE_SCATTER: return "scatter";
+        case PHASE_BUILD: return "build";
+        case PHASE_UPDATE: return "update";
+        case PHASE_SEARCH: return "search";
+        case PHASE_OUTPUT: return "output";
+        default: return "total";
+    }
+}
+
+/* Secondi dal clock monotono, lo stesso con e senza MPI */
+static double profileNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+void profileInit(void) {
+    memset(phase_time, 0, sizeof(phase_time));
+    memset(phase_used, 0, sizeof(phase_used));
+    memset(profile_counters, 0, sizeof(profile_counters));
+    start_time = profileNow();
+}
+
+void profileBegin(ProfilePhase phase) {
+    phase_start[phase] = profileNow();
+    phase_used[phase] = 1;
+}
+
+void profileEnd(ProfilePhase phase) {
+    phase_time[phase] += profileNow() - phase_start[phase];
+}
+
+void profileValues(double *values, int *used) {
+    memcpy(values, phase_time, sizeof(phase_time));
+    values[PROFILE_PHASES] = profileNow() - start_time;
+    for (int c = 0; c < PROFILE_COUNTERS; c++) {
+        values[PROFILE_PHASES + 1 + c] = (double)profile_counters[c];
+    }
+    memcpy(used, phase_used, sizeof(phase_used));
+}
+
+/* Scrive una stringa JSON tra virgolette, con l'escape di virgolette, backslash e caratteri di controllo */
+static void writeJSONString(FILE *file, const char *text) {
+    fputc('"', file);
+    for (const unsigned char *c = (const unsigned char *)text; *c != '\0'; c++) {
+        switch (*c) {
+            case '"': fputs("\\\"", file); break;
+            case '\\': fputs("\\\\", file); break;
+            case '\n': fputs("\\n", file); break;
+            case '\r': fputs("\\r", file); break;
+            case '\t': fputs("\\t", file); break;
+            default:
+                if (*c < 0x20) fprintf(file, "\\u%04x", *c);
+                else fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/* Scrive minimo, media, massimo e sbilanciamento di una misura, con `digits` decimali */
+static void writeStats(FILE *file, double min, double sum, double max, int size, int digits) {
+    double avg = sum / size;
+    fprintf(file, "\"min\": %.*f, \"avg\": %.*f, \"max\": %.*f, \"imbalance\": %.4f",
+            digits, min, digits, avg, digits, max, (avg > 0.0) ? max / avg : 1.0);
+}
+
+int profileWriteReport(const char *path, const char *program, const char *mode, int ranks, int n, int k,
+                       int threads, const int *used, const double *min, const double *sum, const double *max) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot write the profile report %s\n", path);
+        return -1;
+    }
+
+    /* Le stringhe passano tutte da writeJSONString, anche quelle che oggi sono costanti */
+    fprintf(file, "{\n  \"program\": ");
+    writeJSONString(file, program);
+    fprintf(file, ",\n  \"mode\": ");
+    writeJSONString(file, mode);
+    fprintf(file, ",\n  \"ranks\": %d,\n  \"threads\": %d,\n  \"points\": %d,\n  \"k\": %d,\n",
+            ranks, threads, n, k);
+    fprintf(file, "  \"dim\": %d,\n  \"metric\": ", KNN_DIM);
+    writeJSONString(file, metricName());
+    fprintf(file, ",\n");
+
+    fprintf(file, "  \"phases\": {\n");
+    for (int p = 0; p <= PROFILE_PHASES; p++) {
+        if (p < PROFILE_PHASES && !used[p]) continue;
+        fprintf(file, "    ");
+        writeJSONString(file, phaseName(p));
+        fprintf(file, ": {");
+        writeStats(file, min[p], sum[p], max[p], ranks, 6);
+        fprintf(file, "}%s\n", (p < PROFILE_PHASES) ? "," : "");
+    }
+    fprintf(file, "  },\n");
+
+    fprintf(file, "  \"counters\": {\n");
+    for (int c = 0; c < PROFILE_COUNTERS; c++) {
+        int v = PROFILE_PHASES + 1 + c;
+        fprintf(file, "    ");
+        writeJSONString(file, profileCounterName((ProfileCounter)c));
+        fprintf(file, ": {\"total\": %.0f, ", sum[v]);
+        writeStats(file, min[v], sum[v], max[v], ranks, 1);
+        fprintf(file, "}%s\n", (c + 1 < PROFILE_COUNTERS) ? "," : "");
+    }
+    fprintf(file, "  }\n}\n");
+
+    return (fclose(file) != 0) ? -1 : 0;
+}
+
+int profileReportLocal(const char *path, const char *program, const char *mode, int n, int k, int threads) {
+    double values[PROFILE_VALUES];
+    int used[PROFILE_PHASES];
+    profileValues(values, used);
+    return profileWriteReport(path, program, mode, 1, n, k, threads, used, values, values, values);
+}
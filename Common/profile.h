@@ -0,0 +1,100 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/* Contatori del lavoro svolto da un processo, sommati da tutti i suoi thread */
+typedef enum {
+    COUNTER_NODES,          /* Nodi dell'indice (o celle della griglia) visitati */
+    COUNTER_DISTANCES,      /* Distanze calcolate tra una query e un punto */
+    COUNTER_HEAP_INSERTS,   /* Candidati inseriti nei contenitori dei k vicini */
+    COUNTER_BYTES_SENT,     /* Byte inviati agli altri processi */
+    COUNTER_BYTES_RECEIVED, /* Byte ricevuti dagli altri processi */
+    PROFILE_COUNTERS
+} ProfileCounter;
+
+extern long long profile_counters[PROFILE_COUNTERS];
+
+/* Fasi di un'esecuzione, misurate con il clock monotono; ogni implementazione usa solo quelle che ha */
+typedef enum {
+    PHASE_LOAD,     /* Generazione o lettura dei punti (o caricamento dell'indice) */
+    PHASE_GATHER,   /* Replica dei punti su tutti i processi */
+    PHASE_SCATTER,  /* Distribuzione dei punti tra i processi (bisezione o curva) */
+    PHASE_BUILD,    /* Costruzione dell'indice locale */
+    PHASE_UPDATE,   /* Spostamento dei punti e aggiornamento dell'indice */
+    PHASE_SEARCH,   /* Ricerca dei vicini, compreso lo scambio delle query tra i processi */
+    PHASE_OUTPUT,   /* Raccolta, stampa e scrittura dei risultati */
+    PROFILE_PHASES
+} ProfilePhase;
+
+/* Misure di un processo nel report: i tempi delle fasi, il tempo totale e i contatori */
+#define PROFILE_VALUES (PROFILE_PHASES + 1 + PROFILE_COUNTERS)
+
+/**
+ * @brief Azzera tempi e contatori e fa partire il tempo totale del processo.
+ *
+ * Va chiamata all'avvio (subito dopo MPI_Init nelle implementazioni MPI).
+ */
+void profileInit(void);
+
+/**
+ * @brief Inizia a misurare una fase.
+ */
+void profileBegin(ProfilePhase phase);
+
+/**
+ * @brief Chiude la misura di una fase, sommandone la durata a quella delle misure precedenti.
+ */
+void profileEnd(ProfilePhase phase);
+
+/**
+ * @brief Misure del processo fino ad ora, nell'ordine di PROFILE_VALUES.
+ *
+ * @param values Array di PROFILE_VALUES double da riempire.
+ * @param used Array di PROFILE_PHASES interi, 1 per le fasi misurate almeno una volta.
+ */
+void profileValues(double *values, int *used);
+
+/**
+ * @brief Scrive il report JSON a partire dalle misure già ridotte tra i processi.
+ *
+ * Per ogni fase usata e per il tempo totale scrive minimo, media e massimo e lo sbilanciamento
+ * (massimo diviso media); per ogni contatore anche il totale.
+ *
+ * @param path File JSON da scrivere.
+ * @param program Nome dell'implementazione.
+ * @param mode Variante eseguita (ad esempio l'indice locale o la modalità della forza bruta).
+ * @param ranks Numero di processi.
+ * @param n Numero di punti.
+ * @param k Numero di vicini cercati.
+ * @param threads Thread per processo.
+ * @param used Fasi usate da almeno un processo.
+ * @param min, sum, max Minimo, somma e massimo di ogni misura tra i processi (PROFILE_VALUES valori).
+ * @return 0 in caso di successo, -1 se il file non può essere scritto.
+ */
+int profileWriteReport(const char *path, const char *program, const char *mode, int ranks, int n, int k,
+                       int threads, const int *used, const double *min, const double *sum, const double *max);
+
+/**
+ * @brief Scrive il report di un programma con un solo processo, nello stesso formato di profileReport.
+ *
+ * @return 0 in caso di successo, -1 se il file non può essere scritto.
+ */
+int profileReportLocal(const char *path, const char *program, const char *mode, int n, int k, int threads);
+
+/**
+ * @brief Nome del contatore nel report ("nodes_visited", "distance_evaluations", ...).
+ */
+const char *profileCounterName(ProfileCounter counter);
+
+/* Somma `value` ad un contatore. L'aggiunta è atomica, quindi le ricerche accumulano in locale e
+   chiamano questa funzione una volta per query o per blocco, mai dentro i cicli sui candidati */
+static inline void profileCount(ProfileCounter counter, long long value) {
+    __atomic_fetch_add(&profile_counters[counter], value, __ATOMIC_RELAXED);
+}
+
+/* Conta un messaggio (o la parte di una collettiva) scambiato con gli altri processi */
+static inline void profileBytes(long long sent, long long received) {
+    profileCount(COUNTER_BYTES_SENT, sent);
+    profileCount(COUNTER_BYTES_RECEIVED, received);
+}
+
+#endif
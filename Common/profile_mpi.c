@@ -0,0 +1,52 @@
+#include "profile_mpi.h"
+
+void profileExchange(const int *sendcounts, const int *recvcounts, MPI_Datatype type, MPI_Comm comm) {
+    int rank, size, type_size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    MPI_Type_size(type, &type_size);
+
+    long long sent = 0, received = 0;
+    for (int r = 0; r < size; r++) {
+        if (r == rank) continue;
+        sent += sendcounts[r];
+        received += recvcounts[r];
+    }
+    profileBytes(sent * type_size, received * type_size);
+}
+
+void profileGather(long long sendcount, long long total, MPI_Datatype type, int root, MPI_Comm comm) {
+    int rank, size, type_size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    MPI_Type_size(type, &type_size);
+
+    /* Con root < 0 ogni processo manda il proprio blocco a tutti gli altri e riceve i loro */
+    long long sent = (root < 0) ? sendcount * (size - 1) : (rank == root ? 0 : sendcount);
+    long long received = (root < 0 || rank == root) ? total - sendcount : 0;
+    profileBytes(sent * type_size, received * type_size);
+}
+
+int profileReport(const char *path, const char *program, const char *mode, int n, int k, int threads,
+                  MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    /* Una sola riduzione per operazione su tutte le misure */
+    double local[PROFILE_VALUES], min[PROFILE_VALUES], sum[PROFILE_VALUES], max[PROFILE_VALUES];
+    int local_used[PROFILE_PHASES], used[PROFILE_PHASES];
+    profileValues(local, local_used);
+
+    MPI_Reduce(local, min, PROFILE_VALUES, MPI_DOUBLE, MPI_MIN, 0, comm);
+    MPI_Reduce(local, sum, PROFILE_VALUES, MPI_DOUBLE, MPI_SUM, 0, comm);
+    MPI_Reduce(local, max, PROFILE_VALUES, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(local_used, used, PROFILE_PHASES, MPI_INT, MPI_MAX, 0, comm);
+
+    int status = 0;
+    if (rank == 0) {
+        status = profileWriteReport(path, program, mode, size, n, k, threads, used, min, sum, max);
+    }
+    MPI_Bcast(&status, 1, MPI_INT, 0, comm);
+    return status;
+}
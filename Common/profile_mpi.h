@@ -0,0 +1,47 @@
+#ifndef PROFILE_MPI_H
+#define PROFILE_MPI_H
+
+#include <mpi.h>
+#include "profile.h"
+
+/**
+ * @brief Conta i byte di uno scambio tutti-a-tutti (MPI_Alltoallv), escluso il blocco del processo stesso.
+ *
+ * @param sendcounts Elementi inviati ad ogni processo.
+ * @param recvcounts Elementi ricevuti da ogni processo.
+ * @param type Datatype degli elementi.
+ * @param comm Comunicatore dello scambio.
+ */
+void profileExchange(const int *sendcounts, const int *recvcounts, MPI_Datatype type, MPI_Comm comm);
+
+/**
+ * @brief Conta i byte di una raccolta su un processo (MPI_Gatherv) o su tutti (root < 0, MPI_Allgatherv).
+ *
+ * @param sendcount Elementi inviati dal processo.
+ * @param total Elementi raccolti in tutto, compresi quelli del processo.
+ * @param type Datatype degli elementi.
+ * @param root Processo che raccoglie, oppure -1 se raccolgono tutti.
+ * @param comm Comunicatore della raccolta.
+ */
+void profileGather(long long sendcount, long long total, MPI_Datatype type, int root, MPI_Comm comm);
+
+/**
+ * @brief Riduce le misure di tutti i processi e le scrive come JSON (profileWriteReport).
+ *
+ * Per ogni fase usata da almeno un processo, e per il tempo totale, il report contiene minimo,
+ * media e massimo tra i processi e lo sbilanciamento (massimo diviso media); per ogni contatore
+ * anche il totale. Solo il processo 0 scrive il file. Collettiva.
+ *
+ * @param path File JSON da scrivere.
+ * @param program Nome dell'implementazione.
+ * @param mode Variante eseguita (ad esempio l'indice locale o la modalità della forza bruta).
+ * @param n Numero di punti.
+ * @param k Numero di vicini cercati.
+ * @param threads Thread per processo.
+ * @param comm Comunicatore dei processi.
+ * @return 0 in caso di successo, -1 se il file non può essere scritto (su tutti i processi).
+ */
+int profileReport(const char *path, const char *program, const char *mode, int n, int k, int threads,
+                  MPI_Comm comm);
+
+#endif
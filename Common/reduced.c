@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "reduced.h"
+#include "profile.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KNN_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+/* Punti di riferimento per tile, come nei kernel in double ma con colonne più piccole */
+#define REDUCED_TILE 4096
+
+/* Massimo valore di una coordinata fixed16 */
+#define FIXED16_MAX 65535.0
+
+typedef void (*ReducedKernel)(const PointBlock *queries, const ReducedBlock *refs, int rstart, int rend,
+                              KNNHeap *heaps);
+
+const char *precisionName(Precision precision) {
+    switch (precision) {
+        case PRECISION_FLOAT: return "float32";
+        case PRECISION_FIXED16: return "fixed16";
+        default: return "double";
+    }
+}
+
+int parsePrecision(const char *name, Precision *precision) {
+    if (!strcmp(name, "double") || !strcmp(name, "float64")) *precision = PRECISION_DOUBLE;
+    else if (!strcmp(name, "float32") || !strcmp(name, "float")) *precision = PRECISION_FLOAT;
+    else if (!strcmp(name, "fixed16")) *precision = PRECISION_FIXED16;
+    else return -1;
+    return 0;
+}
+
+size_t precisionCoordSize(Precision precision) {
+    switch (precision) {
+        case PRECISION_FLOAT: return sizeof(float);
+        case PRECISION_FIXED16: return sizeof(uint16_t);
+        default: return sizeof(double);
+    }
+}
+
+void quantizerInit(Quantizer *quantizer, Precision precision, const double min[KNN_DIM], const double max[KNN_DIM]) {
+    quantizer->precision = precision;
+    double error2 = 0.0;
+
+    for (int a = 0; a < KNN_DIM; a++) {
+        double extent = max[a] - min[a];
+        quantizer->origin[a] = min[a];
+        quantizer->scale[a] = (extent > 0.0) ? extent / FIXED16_MAX : 1.0;
+
+        /* Errore massimo per coordinata: mezzo passo per fixed16, mezzo ulp per float32 */
+        double e;
+        if (precision == PRECISION_FIXED16) {
+            e = 0.5 * quantizer->scale[a];
+        } else if (precision == PRECISION_FLOAT) {
+            double largest = fmax(fabs(min[a]), fabs(max[a]));
+            e = ldexp(largest, -24);
+        } else {
+            e = 0.0;
+        }
+        error2 += e * e;
+    }
+
+    /* Piccola tolleranza per gli arrotondamenti del calcolo in double */
+    quantizer->error = sqrt(error2) * (1.0 + 1e-9);
+}
+
+void quantizeCoord(const Quantizer *quantizer, int axis, double value, void *out) {
+    if (quantizer->precision == PRECISION_FIXED16) {
+        double q = nearbyint((value - quantizer->origin[axis]) / quantizer->scale[axis]);
+        if (q < 0.0) q = 0.0;
+        if (q > FIXED16_MAX) q = FIXED16_MAX;
+        *(uint16_t *)out = (uint16_t)q;
+    } else if (quantizer->precision == PRECISION_FLOAT) {
+        *(float *)out = (float)value;
+    } else {
+        *(double *)out = value;
+    }
+}
+
+double dequantizeCoord(const Quantizer *quantizer, int axis, const void *value) {
+    if (quantizer->precision == PRECISION_FIXED16) {
+        return quantizer->origin[axis] + *(const uint16_t *)value * quantizer->scale[axis];
+    } else if (quantizer->precision == PRECISION_FLOAT) {
+        return *(const float *)value;
+    }
+    return *(const double *)value;
+}
+
+void reducedBlockAlloc(ReducedBlock *block, int capacity, int first_index, const Quantizer *quantizer) {
+    size_t coord = precisionCoordSize(quantizer->precision);
+
+    /* Ogni colonna parte da un multiplo di 32 byte, per i caricamenti vettoriali */
+    size_t column = ((size_t)capacity * coord + 31) & ~(size_t)31;
+    block->n = capacity;
+    block->first_index = first_index;
+    block->quantizer = *quantizer;
+    block->coord[0] = aligned_alloc(32, KNN_DIM * column > 0 ? KNN_DIM * column : 32);
+    for (int a = 1; a < KNN_DIM; a++) {
+        block->coord[a] = (char *)block->coord[a - 1] + column;
+    }
+}
+
+void reducedBlockFree(ReducedBlock *block) {
+    free(block->coord[0]);
+    for (int a = 0; a < KNN_DIM; a++) {
+        block->coord[a] = NULL;
+    }
+    block->n = 0;
+}
+
+void reducedBlockExpand(const ReducedBlock *block, int begin, int end, PointBlock *out) {
+    size_t coord = precisionCoordSize(block->quantizer.precision);
+    for (int i = begin; i < end; i++) {
+        for (int a = 0; a < KNN_DIM; a++) {
+            out->coord[a][i - begin] = dequantizeCoord(&block->quantizer, a,
+                                                       (const char *)block->coord[a] + (size_t)i * coord);
+        }
+        out->index[i - begin] = block->first_index + i;
+    }
+    out->n = end - begin;
+}
+
+/* Kernel scalare, per entrambe le precisioni ridotte */
+static void reducedScalar(const PointBlock *queries, const ReducedBlock *refs, int rstart, int rend,
+                          KNNHeap *heaps) {
+    const Quantizer *quant = &refs->quantizer;
+    size_t coord = precisionCoordSize(quant->precision);
+
+    for (int i = 0; i < queries->n; i++) {
+        double worst = knnHeapWorst(&heaps[i]);
+        int self = queries->index[i];
+
+        for (int j = rstart; j < rend; j++) {
+            double dist = 0.0;
+            for (int a = 0; a < KNN_DIM; a++) {
+                double diff = dequantizeCoord(quant, a, (const char *)refs->coord[a] + j * coord) - queries->coord[a][i];
+                dist += diff * diff;
+            }
+            if (dist <= worst && refs->first_index + j != self) {
+                knnHeapPush(&heaps[i], dist, refs->first_index + j);
+                worst = knnHeapWorst(&heaps[i]);
+            }
+        }
+    }
+}
+
+#ifdef KNN_X86_KERNELS
+
+/* Aggiorna il top-k di una query con 4 distanze, passando dal contenitore solo le corsie sotto soglia
+   e saltando il punto con indice `self` (la query stessa) */
+__attribute__((target("avx2,fma")))
+static inline __m256d pushLanes(__m256d dist, __m256d worst, KNNHeap *heap, int first, int self) {
+    int mask = _mm256_movemask_pd(_mm256_cmp_pd(dist, worst, _CMP_LE_OQ));
+    if (!mask) return worst;
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, dist);
+    while (mask) {
+        int l = __builtin_ctz(mask);
+        mask &= mask - 1;
+        if (first + l == self) continue;
+        knnHeapPush(heap, lanes[l], first + l);
+    }
+    return _mm256_set1_pd(knnHeapWorst(heap));
+}
+
+/* Aggiunge a `acc` il quadrato della differenza tra 4 coordinate e quella della query */
+__attribute__((target("avx2,fma")))
+static inline __m256d accumulateSquare(__m256d acc, __m256d r, __m256d q) {
+    __m256d diff = _mm256_sub_pd(r, q);
+    return _mm256_fmadd_pd(diff, diff, acc);
+}
+
+/* float32: 8 punti per iterazione, convertiti in due vettori di double */
+__attribute__((target("avx2,fma")))
+static void reducedFloatAVX2(const PointBlock *queries, const ReducedBlock *refs, int rstart, int rend,
+                             KNNHeap *heaps) {
+    int base = refs->first_index;
+
+    for (int i = 0; i < queries->n; i++) {
+        __m256d q[KNN_DIM];
+        for (int a = 0; a < KNN_DIM; a++) {
+            q[a] = _mm256_set1_pd(queries->coord[a][i]);
+        }
+        __m256d worst = _mm256_set1_pd(knnHeapWorst(&heaps[i]));
+
+        int j = rstart;
+        for (; j + 8 <= rend; j += 8) {
+            __m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+            for (int a = 0; a < KNN_DIM; a++) {
+                __m256 f = _mm256_loadu_ps((const float *)refs->coord[a] + j);
+                lo = accumulateSquare(lo, _mm256_cvtps_pd(_mm256_castps256_ps128(f)), q[a]);
+                hi = accumulateSquare(hi, _mm256_cvtps_pd(_mm256_extractf128_ps(f, 1)), q[a]);
+            }
+            worst = pushLanes(lo, worst, &heaps[i], base + j, queries->index[i]);
+            worst = pushLanes(hi, worst, &heaps[i], base + j + 4, queries->index[i]);
+        }
+
+        PointBlock single = pointBlockView(queries, i, i + 1);
+        reducedScalar(&single, refs, j, rend, &heaps[i]);
+    }
+}
+
+/* Converte 4 coordinate fixed16 in double: origin + q * scale */
+__attribute__((target("avx2,fma")))
+static inline __m256d expandFixed16(const uint16_t *q, __m256d origin, __m256d scale) {
+    __m128i packed = _mm_loadl_epi64((const __m128i *)q);
+    __m256d values = _mm256_cvtepi32_pd(_mm_cvtepu16_epi32(packed));
+    return _mm256_fmadd_pd(values, scale, origin);
+}
+
+/* fixed16: 4 punti per iterazione, dalla memoria arrivano 8 byte per colonna */
+__attribute__((target("avx2,fma")))
+static void reducedFixed16AVX2(const PointBlock *queries, const ReducedBlock *refs, int rstart, int rend,
+                               KNNHeap *heaps) {
+    const Quantizer *quant = &refs->quantizer;
+    __m256d origin[KNN_DIM], scale[KNN_DIM];
+    for (int a = 0; a < KNN_DIM; a++) {
+        origin[a] = _mm256_set1_pd(quant->origin[a]);
+        scale[a] = _mm256_set1_pd(quant->scale[a]);
+    }
+    int base = refs->first_index;
+
+    for (int i = 0; i < queries->n; i++) {
+        __m256d q[KNN_DIM];
+        for (int a = 0; a < KNN_DIM; a++) {
+            q[a] = _mm256_set1_pd(queries->coord[a][i]);
+        }
+        __m256d worst = _mm256_set1_pd(knnHeapWorst(&heaps[i]));
+
+        int j = rstart;
+        for (; j + 4 <= rend; j += 4) {
+            __m256d dist = _mm256_setzero_pd();
+            for (int a = 0; a < KNN_DIM; a++) {
+                dist = accumulateSquare(dist, expandFixed16((const uint16_t *)refs->coord[a] + j, origin[a], scale[a]),
+                                        q[a]);
+            }
+            worst = pushLanes(dist, worst, &heaps[i], base + j, queries->index[i]);
+        }
+
+        PointBlock single = pointBlockView(queries, i, i + 1);
+        reducedScalar(&single, refs, j, rend, &heaps[i]);
+    }
+}
+
+#endif
+
+static ReducedKernel selectedFloat = NULL;
+static ReducedKernel selectedFixed16 = NULL;
+static const char *selectedName = NULL;
+
+/* Scelgo i kernel una sola volta in base alle feature della CPU (o a KNN_KERNEL) */
+static void selectReducedKernels(void) {
+    const char *forced = getenv("KNN_KERNEL");
+
+    selectedFixed16 = reducedScalar;
+    selectedFloat = reducedScalar;
+    selectedName = "scalar";
+    if (forced != NULL && strcmp(forced, "scalar") == 0) return;
+
+#ifdef KNN_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        selectedFixed16 = reducedFixed16AVX2;
+        selectedFloat = reducedFloatAVX2;
+        selectedName = "avx2";
+    }
+#endif
+}
+
+const char *knnReducedKernelName(void) {
+    if (selectedName == NULL) selectReducedKernels();
+    return selectedName;
+}
+
+void knnReducedUpdate(const PointBlock *queries, const ReducedBlock *refs, KNNHeap *heaps) {
+    if (selectedFloat == NULL) selectReducedKernels();
+    ReducedKernel kernel = reducedScalar;
+    if (refs->quantizer.precision == PRECISION_FLOAT) kernel = selectedFloat;
+    if (refs->quantizer.precision == PRECISION_FIXED16) kernel = selectedFixed16;
+    profileCount(COUNTER_DISTANCES, (long long)queries->n * refs->n);
+
+    for (int rstart = 0; rstart < refs->n; rstart += REDUCED_TILE) {
+        int rend = (rstart + REDUCED_TILE < refs->n) ? rstart + REDUCED_TILE : refs->n;
+        kernel(queries, refs, rstart, rend, heaps);
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef REDUCED_H
+#define REDUCED_H
+
+#include <stdint.h>
+#include "knnbatch.h"
+
+/* Precisione con cui vengono memorizzate le coordinate dei punti di riferimento */
+typedef enum {
+    PRECISION_DOUBLE,   /* 8 byte per coordinata, ricerca esatta */
+    PRECISION_FLOAT,    /* 4 byte per coordinata (float32) */
+    PRECISION_FIXED16   /* 2 byte per coordinata, interi a 16 bit relativi al bounding box del dataset */
+} Precision;
+
+/** @brief: Parametri di quantizzazione, uguali su tutti i processi
+ *  Per fixed16 la coordinata vale origin + q * scale, per float32 origin e scale non sono usati.
+ */
+typedef struct {
+    Precision precision;
+    double origin[KNN_DIM];
+    double scale[KNN_DIM];
+    double error;       /* Massima distanza tra un punto e la sua versione ridotta */
+} Quantizer;
+
+/** @brief: Blocco di punti di riferimento in precisione ridotta, per colonne
+ *  Gli indici sono impliciti: il punto i ha indice first_index + i.
+ */
+typedef struct {
+    int n;
+    int first_index;
+    Quantizer quantizer;
+    void *coord[KNN_DIM];   /* Colonne di float o uint16_t, in un'unica allocazione */
+} ReducedBlock;
+
+/**
+ * @brief Nome della precisione ("double", "float32" o "fixed16").
+ */
+const char *precisionName(Precision precision);
+
+/**
+ * @brief Legge il nome di una precisione.
+ *
+ * @return 0 in caso di successo, -1 se il nome non è valido.
+ */
+int parsePrecision(const char *name, Precision *precision);
+
+/**
+ * @brief Dimensione in byte di una coordinata nella precisione indicata.
+ */
+size_t precisionCoordSize(Precision precision);
+
+/**
+ * @brief Prepara i parametri di quantizzazione a partire dal bounding box del dataset.
+ *
+ * @param quantizer Parametri da inizializzare.
+ * @param precision Precisione scelta.
+ * @param min Coordinate minime del dataset.
+ * @param max Coordinate massime del dataset.
+ */
+void quantizerInit(Quantizer *quantizer, Precision precision, const double min[KNN_DIM], const double max[KNN_DIM]);
+
+/**
+ * @brief Converte una coordinata sull'asse `axis` nella precisione ridotta, scrivendola in `out`.
+ */
+void quantizeCoord(const Quantizer *quantizer, int axis, double value, void *out);
+
+/**
+ * @brief Riporta in double una coordinata ridotta.
+ */
+double dequantizeCoord(const Quantizer *quantizer, int axis, const void *value);
+
+/**
+ * @brief Alloca un blocco ridotto di `capacity` punti, con n = capacity.
+ */
+void reducedBlockAlloc(ReducedBlock *block, int capacity, int first_index, const Quantizer *quantizer);
+
+/**
+ * @brief Libera un blocco allocato con reducedBlockAlloc.
+ */
+void reducedBlockFree(ReducedBlock *block);
+
+/**
+ * @brief Copia in double le coordinate ridotte dei punti [begin, end) in un PointBlock già allocato.
+ */
+void reducedBlockExpand(const ReducedBlock *block, int begin, int end, PointBlock *out);
+
+/**
+ * @brief Aggiorna i top-k di un blocco di query (in double) con un blocco ridotto.
+ *
+ * Le coordinate ridotte vengono riportate in double nei registri, quindi dalla memoria passa solo
+ * la metà (float32) o un quarto (fixed16) dei byte; le distanze calcolate sono quelle verso i punti
+ * ridotti, entro quantizer.error da quelle vere. Usa AVX2 se disponibile (KNN_KERNEL=scalar
+ * forza il kernel scalare). Come in knnBatchUpdate, il punto con lo stesso indice della query
+ * viene escluso.
+ *
+ * @param queries Blocco di query.
+ * @param refs Blocco ridotto di punti di riferimento.
+ * @param heaps Array di `queries->n` contenitori, con distanze al quadrato.
+ */
+void knnReducedUpdate(const PointBlock *queries, const ReducedBlock *refs, KNNHeap *heaps);
+
+/**
+ * @brief Nome dei kernel ridotti scelti a runtime ("avx2" o "scalar").
+ *
+ * La scelta avviene alla prima chiamata (come per knnBatchKernelName), quindi va fatta prima di
+ * avviare i thread che chiamano knnReducedUpdate. Può essere forzata con KNN_KERNEL=scalar.
+ */
+const char *knnReducedKernelName(void);
+
+#endif
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "scheduler.h"
+
+/* Deque di chunk di un thread: il proprietario estrae da tail, i ladri da head */
+typedef struct {
+    pthread_mutex_t lock;
+    int head;
+    int tail;
+} ChunkDeque;
+
+/* Un lavoro di parallelFor: i chunk di [0, n) e la funzione da eseguire */
+typedef struct {
+    ChunkDeque *deques;
+    int num_threads;
+    int n;
+    int chunk;
+    TaskFunction fn;
+    void *context;
+} Job;
+
+/* Pool persistente: i thread vengono creati alla prima chiamata che ne chiede di più e restano in
+   attesa del lavoro successivo, così non si paga la creazione ad ogni chiamata e le loro arene
+   restano allocate tra una ricerca e l'altra */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start;       /* Pubblicato un nuovo lavoro */
+    pthread_cond_t done;        /* L'ultimo thread del lavoro corrente ha finito */
+    ChunkDeque *deques;         /* Una deque per il chiamante e una per ogni thread */
+    int num_workers;            /* Thread creati, escluso il chiamante */
+    unsigned long generation;   /* Numero dei lavori pubblicati */
+    int running;                /* Thread che non hanno ancora finito il lavoro corrente */
+    int busy;                   /* Un parallelFor è in corso */
+    Job job;
+} Pool;
+
+static Pool pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                     NULL, 0, 0, 0, 0, { NULL, 0, 0, 0, NULL, NULL } };
+
+/* Argomenti di un thread del pool: il lavoro già pubblicato quando nasce non è suo */
+typedef struct {
+    int thread_id;
+    unsigned long generation;
+} Worker;
+
+static int popBottom(ChunkDeque *deque) {
+    int id = -1;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) id = --deque->tail;
+    pthread_mutex_unlock(&deque->lock);
+    return id;
+}
+
+static int stealTop(ChunkDeque *deque) {
+    int id = -1;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) id = deque->head++;
+    pthread_mutex_unlock(&deque->lock);
+    return id;
+}
+
+static void runChunk(const Job *job, int id, int thread_id) {
+    int begin = id * job->chunk;
+    int end = (begin + job->chunk < job->n) ? begin + job->chunk : job->n;
+    job->fn(begin, end, thread_id, job->context);
+}
+
+static void runJob(const Job *job, int me) {
+    for (;;) {
+        /* Prima svuoto la mia deque */
+        int id;
+        while ((id = popBottom(&job->deques[me])) >= 0) {
+            runChunk(job, id, me);
+        }
+
+        /* Poi provo a rubare, partendo dal thread successivo; i chunk non vengono mai
+           creati durante l'esecuzione, quindi un giro a vuoto significa lavoro finito */
+        int stolen = 0;
+        for (int i = 1; i < job->num_threads && !stolen; i++) {
+            int victim = (me + i) % job->num_threads;
+            if ((id = stealTop(&job->deques[victim])) >= 0) {
+                runChunk(job, id, me);
+                stolen = 1;
+            }
+        }
+        if (!stolen) break;
+    }
+}
+
+/* Ciclo di un thread del pool: aspetta un lavoro, partecipa se il suo indice è tra quelli
+   richiesti e torna ad aspettare; non termina mai, quindi la sua arena resta allocata */
+static void *workerLoop(void *arg) {
+    Worker *worker = (Worker *)arg;
+    int me = worker->thread_id;
+    unsigned long seen = worker->generation;
+    free(worker);
+
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (pool.generation == seen) {
+            pthread_cond_wait(&pool.start, &pool.lock);
+        }
+        seen = pool.generation;
+        if (me >= pool.job.num_threads) continue;
+
+        pthread_mutex_unlock(&pool.lock);
+        runJob(&pool.job, me);
+        pthread_mutex_lock(&pool.lock);
+
+        if (--pool.running == 0) pthread_cond_signal(&pool.done);
+    }
+    return NULL;
+}
+
+/* Porta il pool ad almeno `num_workers` thread, chiamata con il lock preso e nessun lavoro in
+   corso; restituisce i thread disponibili, che sono meno se pthread_create fallisce */
+static int growPool(int num_workers) {
+    if (num_workers <= pool.num_workers) return pool.num_workers;
+
+    /* Nessun thread sta usando le deque, quindi posso ricrearle tutte */
+    for (int t = 0; t <= pool.num_workers && pool.deques != NULL; t++) {
+        pthread_mutex_destroy(&pool.deques[t].lock);
+    }
+    free(pool.deques);
+    pool.deques = (ChunkDeque *)malloc((num_workers + 1) * sizeof(ChunkDeque));
+    for (int t = 0; t <= num_workers; t++) {
+        pthread_mutex_init(&pool.deques[t].lock, NULL);
+    }
+
+    while (pool.num_workers < num_workers) {
+        Worker *worker = (Worker *)malloc(sizeof(Worker));
+        worker->thread_id = pool.num_workers + 1;
+        worker->generation = pool.generation;
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, workerLoop, worker) != 0) {
+            fprintf(stderr, "Warning: cannot create worker thread %d, using %d threads\n",
+                    worker->thread_id, pool.num_workers + 1);
+            free(worker);
+            break;
+        }
+        pthread_detach(thread);
+        pool.num_workers++;
+    }
+    return pool.num_workers;
+}
+
+static void runSequential(int n, int chunk, TaskFunction fn, void *context) {
+    for (int begin = 0; begin < n; begin += chunk) {
+        fn(begin, (begin + chunk < n) ? begin + chunk : n, 0, context);
+    }
+}
+
+void parallelFor(int n, int chunk, int num_threads, TaskFunction fn, void *context) {
+    if (n <= 0) return;
+    if (chunk <= 0) chunk = DEFAULT_CHUNK_SIZE;
+
+    /* Caso sequenziale: nessun thread e nessun lock, ma stessi chunk */
+    if (num_threads <= 1) {
+        runSequential(n, chunk, fn, context);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    if (pool.busy) {
+        /* Chiamata annidata dentro fn, o concorrente da un altro thread: il pool è occupato */
+        pthread_mutex_unlock(&pool.lock);
+        runSequential(n, chunk, fn, context);
+        return;
+    }
+    pool.busy = 1;
+    int available = growPool(num_threads - 1) + 1;
+    if (num_threads > available) num_threads = available;
+
+    int num_chunks = (n + chunk - 1) / chunk;
+    Job *job = &pool.job;
+    job->deques = pool.deques;
+    job->num_threads = num_threads;
+    job->n = n;
+    job->chunk = chunk;
+    job->fn = fn;
+    job->context = context;
+
+    /* Assegno i chunk in blocchi contigui, così ogni thread parte da query vicine tra loro */
+    for (int t = 0; t < num_threads; t++) {
+        job->deques[t].head = (int)((long long)num_chunks * t / num_threads);
+        job->deques[t].tail = (int)((long long)num_chunks * (t + 1) / num_threads);
+    }
+
+    pool.running = num_threads - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    /* Il chiamante lavora come thread 0 */
+    runJob(job, 0);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.running > 0) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pool.busy = 0;
+    pthread_mutex_unlock(&pool.lock);
+}
@@ -0,0 +1,40 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/* Dimensione di default dei chunk di query distribuiti ai thread */
+#define DEFAULT_CHUNK_SIZE 64
+
+/**
+ * @brief Funzione eseguita su un intervallo [begin, end) da un thread del pool.
+ *
+ * @param begin Primo elemento dell'intervallo.
+ * @param end Elemento successivo all'ultimo.
+ * @param thread_id Indice del thread (0 è sempre il thread chiamante).
+ * @param context Puntatore passato a parallelFor.
+ */
+typedef void (*TaskFunction)(int begin, int end, int thread_id, void *context);
+
+/**
+ * @brief Esegue fn su [0, n) in parallelo con un work-stealing a chunk.
+ *
+ * L'intervallo viene diviso in chunk di `chunk` elementi, assegnati inizialmente in blocchi
+ * contigui alle deque dei thread. Ogni thread estrae chunk dal fondo della propria deque e,
+ * quando è vuota, ne ruba dalla cima di quella di un altro thread. In questo modo le query
+ * più costose non lasciano fermi i thread che hanno finito prima.
+ *
+ * I thread fanno parte di un pool persistente: vengono creati alla prima chiamata che ne richiede
+ * di più e tra una chiamata e l'altra restano in attesa su una variabile di condizione. Una chiamata
+ * annidata dentro fn, o concorrente da un altro thread, viene eseguita in modo sequenziale.
+ *
+ * @param n Numero di elementi.
+ * @param chunk Numero di elementi per chunk.
+ * @param num_threads Numero di thread (il chiamante è il thread 0; con 1 non usa il pool).
+ * @param fn Funzione da eseguire su ogni chunk.
+ * @param context Puntatore passato a fn.
+ *
+ * @note Il chiamante partecipa come thread 0, quindi con MPI_THREAD_FUNNELED solo lui
+ *       può fare chiamate MPI dentro fn.
+ */
+void parallelFor(int n, int chunk, int num_threads, TaskFunction fn, void *context);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sfc.h"
+
+const char *curveName(SFCurve curve) {
+    switch (curve) {
+        case SFC_MORTON: return "morton";
+        case SFC_HILBERT: return "hilbert";
+        default: return "none";
+    }
+}
+
+int parseCurve(const char *name, SFCurve *curve) {
+    if (strcmp(name, "none") == 0) {
+        *curve = SFC_NONE;
+    } else if (strcmp(name, "morton") == 0) {
+        *curve = SFC_MORTON;
+    } else if (strcmp(name, "hilbert") == 0) {
+        *curve = SFC_HILBERT;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+#if SFC_AXES == 3
+/* Distribuisce i 21 bit bassi di v ogni 3 bit */
+static uint64_t spreadBits(uint32_t v) {
+    uint64_t x = v & 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8)  & 0x100f00f00f00f00fULL;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2)  & 0x1249249249249249ULL;
+    return x;
+}
+
+static uint64_t interleave(const uint32_t c[3]) {
+    return (spreadBits(c[0]) << 2) | (spreadBits(c[1]) << 1) | spreadBits(c[2]);
+}
+#else
+/* Intercala i bit delle coordinate dal più significativo, il primo asse in testa ad ogni livello */
+static uint64_t interleave(const uint32_t c[SFC_AXES]) {
+    uint64_t key = 0;
+    for (int b = SFC_BITS - 1; b >= 0; b--) {
+        for (int a = 0; a < SFC_AXES; a++) {
+            key = (key << 1) | ((c[a] >> b) & 1u);
+        }
+    }
+    return key;
+}
+#endif
+
+/* Trasformazione di Skilling ("Programming the Hilbert curve", 2004): porta le coordinate nella
+   forma trasposta dell'indice di Hilbert, che intercalata dà la chiave */
+static uint64_t hilbertKey(uint32_t x[SFC_AXES]) {
+    uint32_t m = 1u << (SFC_BITS - 1);
+
+    for (uint32_t q = m; q > 1; q >>= 1) {
+        uint32_t p = q - 1;
+        for (int i = 0; i < SFC_AXES; i++) {
+            if (x[i] & q) {
+                x[0] ^= p;
+            } else {
+                uint32_t t = (x[0] ^ x[i]) & p;
+                x[0] ^= t;
+                x[i] ^= t;
+            }
+        }
+    }
+
+    /* Codifica di Gray */
+    for (int i = 1; i < SFC_AXES; i++) x[i] ^= x[i - 1];
+    uint32_t t = 0;
+    for (uint32_t q = m; q > 1; q >>= 1) {
+        if (x[SFC_AXES - 1] & q) t ^= q - 1;
+    }
+    for (int i = 0; i < SFC_AXES; i++) x[i] ^= t;
+
+    return interleave(x);
+}
+
+void computeCurveKeys(SFCurve curve, const Point *points, int n, const double min[KNN_DIM], const double max[KNN_DIM],
+                      uint64_t *keys) {
+    const double cells = (double)((1u << SFC_BITS) - 1);
+    double scale[SFC_AXES];
+    for (int a = 0; a < SFC_AXES; a++) {
+        scale[a] = (max[a] > min[a]) ? cells / (max[a] - min[a]) : 0.0;
+    }
+
+    for (int i = 0; i < n; i++) {
+        uint32_t q[SFC_AXES];
+        for (int a = 0; a < SFC_AXES; a++) {
+            double v = (points[i].coord[a] - min[a]) * scale[a];
+            if (v < 0.0) v = 0.0;
+            if (v > cells) v = cells;
+            q[a] = (uint32_t)v;
+        }
+        keys[i] = (curve == SFC_HILBERT) ? hilbertKey(q) : interleave(q);
+    }
+}
+
+void radixSortPoints(uint64_t *keys, Point *points, int n) {
+    if (n <= 1) return;
+
+    uint64_t *tmp_keys = (uint64_t *)malloc(n * sizeof(uint64_t));
+    int *perm = (int *)malloc(n * sizeof(int));
+    int *tmp_perm = (int *)malloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) perm[i] = i;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        int counts[256] = {0};
+        for (int i = 0; i < n; i++) counts[(keys[i] >> shift) & 0xff]++;
+
+        /* Passata inutile: tutte le chiavi hanno lo stesso byte */
+        if (counts[(keys[0] >> shift) & 0xff] == n) continue;
+
+        int offset = 0;
+        for (int b = 0; b < 256; b++) {
+            int c = counts[b];
+            counts[b] = offset;
+            offset += c;
+        }
+        for (int i = 0; i < n; i++) {
+            int pos = counts[(keys[i] >> shift) & 0xff]++;
+            tmp_keys[pos] = keys[i];
+            tmp_perm[pos] = perm[i];
+        }
+
+        memcpy(keys, tmp_keys, n * sizeof(uint64_t));
+        int *swap = perm;
+        perm = tmp_perm;
+        tmp_perm = swap;
+    }
+
+    /* Un solo spostamento dei punti, seguendo la permutazione finale */
+    Point *sorted = (Point *)malloc(n * sizeof(Point));
+    for (int i = 0; i < n; i++) sorted[i] = points[perm[i]];
+    memcpy(points, sorted, n * sizeof(Point));
+
+    free(sorted);
+    free(tmp_keys);
+    free(perm);
+    free(tmp_perm);
+}
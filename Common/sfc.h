@@ -0,0 +1,61 @@
+#ifndef SFC_H
+#define SFC_H
+
+#include <stdint.h>
+#include "point.h"
+
+/* Assi su cui è definita la curva: con più di 63 dimensioni non c'è un bit di chiave per ognuno */
+#define SFC_AXES (KNN_DIM < 63 ? KNN_DIM : 63)
+
+/* Bit per asse delle chiavi: con 3 dimensioni 3 * 21 = 63 bit, al più 31 perché le coordinate
+   quantizzate sono a 32 bit */
+#define SFC_BITS (63 / SFC_AXES < 31 ? 63 / SFC_AXES : 31)
+
+/* Curva con cui ordinare i punti */
+typedef enum {
+    SFC_NONE,       /* Nessun riordino */
+    SFC_MORTON,     /* Ordine Z: bit delle coordinate intercalati */
+    SFC_HILBERT     /* Curva di Hilbert: punti consecutivi sono sempre in celle adiacenti */
+} SFCurve;
+
+/**
+ * @brief Nome della curva ("none", "morton" o "hilbert").
+ */
+const char *curveName(SFCurve curve);
+
+/**
+ * @brief Legge il nome di una curva.
+ *
+ * @return 0 in caso di successo, -1 se il nome non è valido.
+ */
+int parseCurve(const char *name, SFCurve *curve);
+
+/**
+ * @brief Calcola le chiavi (SFC_AXES * SFC_BITS bit, al più 63) dei punti lungo la curva.
+ *
+ * Le prime SFC_AXES coordinate vengono quantizzate a SFC_BITS bit all'interno del box [min, max], che deve essere
+ * lo stesso su tutti i processi perché le chiavi siano confrontabili.
+ *
+ * @param curve SFC_MORTON o SFC_HILBERT.
+ * @param points Array di punti.
+ * @param n Numero di punti.
+ * @param min Coordinate minime del box.
+ * @param max Coordinate massime del box.
+ * @param keys Array di `n` chiavi in cui salvare il risultato.
+ */
+void computeCurveKeys(SFCurve curve, const Point *points, int n, const double min[KNN_DIM], const double max[KNN_DIM],
+                      uint64_t *keys);
+
+/**
+ * @brief Ordina i punti per chiave con un radix sort LSD stabile (8 bit per passata).
+ *
+ * Le passate in cui tutte le chiavi hanno lo stesso byte vengono saltate; le chiavi vengono
+ * ordinate insieme ad una permutazione e i punti sono spostati una sola volta alla fine.
+ *
+ * @param keys Chiavi dei punti, riordinate.
+ * @param points Punti, riordinati con le chiavi.
+ * @param n Numero di punti.
+ */
+void radixSortPoints(uint64_t *keys, Point *points, int n);
+
+#endif
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include "vectors.h"
+#include "knnheap.h"
+#include "arena.h"
+#include "profile.h"
+
+void vectorSetAlloc(VectorSet *set, int n, int dim, int first) {
+    set->dim = dim;
+    set->n = n;
+    set->first = first;
+    set->coord = (double *)malloc(((size_t)n * dim > 0 ? (size_t)n * dim : 1) * sizeof(double));
+    if (set->coord == NULL) {
+        fprintf(stderr, "Out of memory: cannot allocate %d vectors of %d coordinates\n", n, dim);
+        exit(1);
+    }
+}
+
+void vectorSetFree(VectorSet *set) {
+    free(set->coord);
+    set->coord = NULL;
+    set->n = 0;
+}
+
+void vectorsFromColumns(const PointFileHeader *header, const void *const *columns, VectorSet *set) {
+    int dim = set->dim;
+    for (int d = 0; d < dim; d++) {
+        if (header->flags & POINT_FILE_DOUBLE) {
+            const double *column = (const double *)columns[d];
+            for (int i = 0; i < set->n; i++) set->coord[(size_t)i * dim + d] = column[i];
+        } else {
+            const float *column = (const float *)columns[d];
+            for (int i = 0; i < set->n; i++) set->coord[(size_t)i * dim + d] = column[i];
+        }
+    }
+}
+
+void vectorSetRead(const PointFile *file, uint64_t begin, uint64_t end, VectorSet *set) {
+    int dim = (int)pointHeaderDims(&file->header);
+    vectorSetAlloc(set, (int)(end - begin), dim, (int)begin);
+
+    size_t element = pointColumnElementSize(&file->header, 0);
+    const void **columns = (const void **)malloc(dim * sizeof(const void *));
+    for (int d = 0; d < dim; d++) {
+        columns[d] = (const char *)pointFileColumn(file, d) + begin * element;
+    }
+    vectorsFromColumns(&file->header, columns, set);
+    free(columns);
+}
+
+void vectorFindKNN(const VectorSet *points, const double *query, int self, int k, int *neighbors,
+                   double *distances) {
+    Arena *arena = threadArena();
+    ArenaMark mark = arenaMark(arena);
+    KNNEntry *entries = ARENA_ARRAY(arena, KNNEntry, k);
+    KNNHeap heap;
+    knnHeapInit(&heap, entries, k, DBL_MAX);
+
+    int dim = points->dim;
+    long long evaluated = 0;
+    for (int i = 0; i < points->n; i++) {
+        int index = points->first + i;
+        if (index == self) continue;
+        evaluated++;
+        double distance = vectorDistance(query, &points->coord[(size_t)i * dim], dim);
+        if (distance <= knnHeapWorst(&heap)) {
+            knnHeapPush(&heap, distance, index);
+        }
+    }
+
+    knnHeapSort(&heap);
+    profileCount(COUNTER_DISTANCES, evaluated);
+    profileCount(COUNTER_HEAP_INSERTS, heap.inserts);
+    for (int i = 0; i < k; i++) {
+        neighbors[i] = (i < heap.size) ? entries[i].index : -1;
+        if (distances != NULL) {
+            distances[i] = (i < heap.size) ? metricFinish(entries[i].distance) : DBL_MAX;
+        }
+    }
+
+    arenaReset(arena, mark);
+}
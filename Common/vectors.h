@@ -0,0 +1,75 @@
+#ifndef VECTORS_H
+#define VECTORS_H
+
+#include "pointio.h"
+#include "metric.h"
+
+/* Metriche disponibili per i vettori a dimensione runtime: weighted e periodic hanno un parametro
+   per ognuno dei KNN_DIM assi della build, che non corrispondono alle coordinate di questi vettori */
+#define VECTOR_METRIC_SUPPORTED (KNN_METRIC == KNN_METRIC_L2 || KNN_METRIC == KNN_METRIC_L1 || \
+                                 KNN_METRIC == KNN_METRIC_LINF)
+
+/** @brief: Punti con un numero di coordinate noto solo a runtime, per i dataset il cui numero di
+ *  coordinate è diverso da KNN_DIM (ad esempio feature a 16-64 dimensioni). Le coordinate di un punto
+ *  sono contigue, da coord[i * dim], e il punto i ha original_index first + i. I cicli sulle
+ *  coordinate sono cicli semplici sulla dimensione runtime, senza i kernel specializzati di KNN_DIM.
+ */
+typedef struct {
+    int dim;
+    int n;
+    int first;
+    double *coord;
+} VectorSet;
+
+/**
+ * @brief Alloca un insieme di `n` vettori di `dim` coordinate, con original_index da `first`.
+ */
+void vectorSetAlloc(VectorSet *set, int n, int dim, int first);
+
+/**
+ * @brief Libera le coordinate di un insieme di vettori.
+ */
+void vectorSetFree(VectorSet *set);
+
+/**
+ * @brief Converte righe consecutive lette dalle colonne del file in un insieme di vettori già allocato.
+ *
+ * @param header Header del file, con set->dim coordinate per punto.
+ * @param columns Le set->dim colonne di coordinate dalla riga set->first, nel tipo indicato dall'header.
+ * @param set Insieme da riempire con le sue set->n righe.
+ */
+void vectorsFromColumns(const PointFileHeader *header, const void *const *columns, VectorSet *set);
+
+/**
+ * @brief Legge le righe [begin, end) di un dataset aperto con pointFileOpenAnyDim (alloca `set`).
+ */
+void vectorSetRead(const PointFile *file, uint64_t begin, uint64_t end, VectorSet *set);
+
+/**
+ * @brief Distanza ridotta (vedi metric.h) tra due vettori di `dim` coordinate.
+ */
+static inline double vectorDistance(const double *a, const double *b, int dim) {
+    double acc = 0.0;
+    for (int d = 0; d < dim; d++) {
+        acc = metricCombine(acc, metricTerm(a[d] - b[d], 0));
+    }
+    return acc;
+}
+
+/**
+ * @brief Trova per forza bruta i k vicini più prossimi di un vettore tra quelli di `points`.
+ *
+ * È findKNN (bruteforce.h) con la dimensione runtime: tiene i k più vicini in un KNNHeap, ordinati per
+ * (distanza, original_index), ed esclude il vettore con original_index `self`.
+ *
+ * @param points Vettori di riferimento.
+ * @param query Coordinate della query (points->dim valori).
+ * @param self original_index da escludere, oppure -1.
+ * @param k Numero di vicini da trovare.
+ * @param neighbors Array di `k` interi in cui salvare gli original_index dei vicini (-1 se mancanti).
+ * @param distances Array di `k` double in cui salvare le distanze (DBL_MAX se mancanti), oppure NULL.
+ */
+void vectorFindKNN(const VectorSet *points, const double *query, int self, int k, int *neighbors,
+                   double *distances);
+
+#endif
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#include "pointio.h"
+
+/*  Conversione in streaming di una nuvola di punti testuale nel formato binario a colonne.
+    Il file di ingresso viene letto due volte (conteggio e scrittura) senza mai tenerlo in memoria:
+    - CSV / XYZ: una riga per punto, le prime KNN_DIM colonne numeriche sono le coordinate (separatori
+      virgola, punto e virgola o spazi); una prima riga non numerica è trattata come intestazione
+    - PLY: ascii o binary_little_endian, con l'elemento vertex come primo elemento; le coordinate
+      sono le proprietà x, y, z, nx, ny, nz (fino a 6 dimensioni), altrimenti le prime KNN_DIM
+      proprietà diverse da id
+*/
+
+/* Numero massimo di proprietà lette da un vertice PLY */
+#define PLY_MAX_PROPERTIES 64
+
+/* Nomi delle proprietà PLY usate come coordinate fino a 6 dimensioni (posizione e normale) */
+static const char *ply_coord_names[] = {"x", "y", "z", "nx", "ny", "nz"};
+#define PLY_NAMED_COORDS 6
+
+typedef enum { FORMAT_TEXT, FORMAT_PLY } InputFormat;
+
+typedef struct {
+    int ascii;
+    long long count;
+    int num_properties;
+    int size[PLY_MAX_PROPERTIES];       /* Byte di ogni proprietà nel formato binario */
+    char type[PLY_MAX_PROPERTIES][16];
+    char name[PLY_MAX_PROPERTIES][64];
+    int column[KNN_DIM + 1];            /* Indice della proprietà di ogni coordinata e dell'id (-1 se assente) */
+    int record_size;
+} PLYHeader;
+
+static void printUsage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s INPUT OUTPUT [options]\n"
+            "  INPUT is a .csv, .xyz (or .txt/.pts) or .ply point cloud, OUTPUT the binary dataset\n"
+            "  -f, --float32     store the coordinates as float32 (default float64)\n"
+            "  -d, --ids         keep an id column (the text column after the coordinates, or the PLY property \"id\")\n"
+            "  -h, --help        show this message\n",
+            program);
+}
+
+/* Legge fino a `max` numeri da una riga, saltando separatori; restituisce quanti ne ha trovati */
+static int parseNumbers(const char *line, double *values, int max) {
+    int count = 0;
+    const char *p = line;
+    while (count < max) {
+        while (*p == ' ' || *p == '\t' || *p == ',' || *p == ';') p++;
+        if (*p == '\0' || *p == '\n' || *p == '\r' || *p == '#') break;
+        char *end;
+        double value = strtod(p, &end);
+        if (end == p) return -1;
+        values[count++] = value;
+        p = end;
+    }
+    return count;
+}
+
+static int isBlank(const char *line) {
+    while (*line == ' ' || *line == '\t' || *line == '\r' || *line == '\n') line++;
+    return *line == '\0' || *line == '#';
+}
+
+/* Dimensione in byte di un tipo PLY, 0 se sconosciuto */
+static int plyTypeSize(const char *type) {
+    if (!strcmp(type, "char") || !strcmp(type, "uchar") || !strcmp(type, "int8") || !strcmp(type, "uint8")) return 1;
+    if (!strcmp(type, "short") || !strcmp(type, "ushort") || !strcmp(type, "int16") || !strcmp(type, "uint16")) return 2;
+    if (!strcmp(type, "int") || !strcmp(type, "uint") || !strcmp(type, "int32") || !strcmp(type, "uint32")) return 4;
+    if (!strcmp(type, "float") || !strcmp(type, "float32")) return 4;
+    if (!strcmp(type, "double") || !strcmp(type, "float64")) return 8;
+    return 0;
+}
+
+/* Converte in double una proprietà binaria little-endian */
+static double plyValue(const unsigned char *data, const char *type) {
+    if (!strcmp(type, "char") || !strcmp(type, "int8")) return *(const int8_t *)data;
+    if (!strcmp(type, "uchar") || !strcmp(type, "uint8")) return *data;
+
+    int16_t s; uint16_t us; int32_t i; uint32_t ui; float f; double d;
+    if (!strcmp(type, "short") || !strcmp(type, "int16")) { memcpy(&s, data, 2); return s; }
+    if (!strcmp(type, "ushort") || !strcmp(type, "uint16")) { memcpy(&us, data, 2); return us; }
+    if (!strcmp(type, "int") || !strcmp(type, "int32")) { memcpy(&i, data, 4); return i; }
+    if (!strcmp(type, "uint") || !strcmp(type, "uint32")) { memcpy(&ui, data, 4); return ui; }
+    if (!strcmp(type, "float") || !strcmp(type, "float32")) { memcpy(&f, data, 4); return f; }
+    memcpy(&d, data, 8);
+    return d;
+}
+
+/* Legge l'header PLY, lasciando il file posizionato sul primo vertice */
+static int readPLYHeader(FILE *in, PLYHeader *ply) {
+    char line[1024];
+    int in_vertex = 0, seen_element = 0;
+
+    memset(ply, 0, sizeof(PLYHeader));
+    for (int c = 0; c <= POINT_COLUMN_IDS; c++) ply->column[c] = -1;
+
+    if (fgets(line, sizeof(line), in) == NULL || strncmp(line, "ply", 3) != 0) {
+        fprintf(stderr, "Not a PLY file\n");
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char word[64], arg1[64], arg2[64];
+        int fields = sscanf(line, "%63s %63s %63s", word, arg1, arg2);
+        if (fields <= 0) continue;
+
+        if (!strcmp(word, "end_header")) {
+            /* Coordinate per nome, oppure le prime proprietà diverse da id */
+            int next = 0;
+            for (int d = 0; d < KNN_DIM; d++) {
+                if (KNN_DIM <= PLY_NAMED_COORDS) {
+                    for (int p = 0; p < ply->num_properties; p++) {
+                        if (!strcmp(ply->name[p], ply_coord_names[d])) ply->column[d] = p;
+                    }
+                } else {
+                    while (next < ply->num_properties && !strcmp(ply->name[next], "id")) next++;
+                    if (next < ply->num_properties) ply->column[d] = next++;
+                }
+                if (ply->column[d] < 0) {
+                    fprintf(stderr, "PLY vertex has no property for coordinate %d (%s)\n", d,
+                            (KNN_DIM <= PLY_NAMED_COORDS) ? ply_coord_names[d] : "too few properties");
+                    return -1;
+                }
+            }
+            return 0;
+        } else if (!strcmp(word, "format") && fields >= 2) {
+            if (!strcmp(arg1, "ascii")) {
+                ply->ascii = 1;
+            } else if (strcmp(arg1, "binary_little_endian") != 0) {
+                fprintf(stderr, "Unsupported PLY format: %s\n", arg1);
+                return -1;
+            }
+        } else if (!strcmp(word, "element") && fields >= 3) {
+            in_vertex = !strcmp(arg1, "vertex");
+            if (in_vertex && seen_element) {
+                fprintf(stderr, "PLY vertex must be the first element\n");
+                return -1;
+            }
+            if (in_vertex) ply->count = atoll(arg2);
+            seen_element = 1;
+        } else if (!strcmp(word, "property") && in_vertex) {
+            if (!strcmp(arg1, "list") || fields < 3) {
+                fprintf(stderr, "Unsupported PLY vertex property: %s", line);
+                return -1;
+            }
+            int size = plyTypeSize(arg1);
+            if (size == 0 || ply->num_properties == PLY_MAX_PROPERTIES) {
+                fprintf(stderr, "Unsupported PLY vertex property: %s", line);
+                return -1;
+            }
+
+            int p = ply->num_properties++;
+            ply->size[p] = size;
+            strcpy(ply->type[p], arg1);
+            strcpy(ply->name[p], arg2);
+            ply->record_size += size;
+
+            if (!strcmp(arg2, "id")) ply->column[POINT_COLUMN_IDS] = p;
+        }
+    }
+
+    fprintf(stderr, "PLY header without end_header\n");
+    return -1;
+}
+
+/* Legge il prossimo vertice PLY in values[0..KNN_DIM] (le coordinate, poi l'id) */
+static int readPLYVertex(FILE *in, const PLYHeader *ply, char **line, size_t *capacity, double *values) {
+    double props[PLY_MAX_PROPERTIES];
+
+    if (ply->ascii) {
+        do {
+            if (getline(line, capacity, in) < 0) return -1;
+        } while (isBlank(*line));
+        if (parseNumbers(*line, props, ply->num_properties) != ply->num_properties) return -1;
+    } else {
+        unsigned char record[PLY_MAX_PROPERTIES * 8];
+        if (fread(record, 1, ply->record_size, in) != (size_t)ply->record_size) return -1;
+        int offset = 0;
+        for (int p = 0; p < ply->num_properties; p++) {
+            props[p] = plyValue(record + offset, ply->type[p]);
+            offset += ply->size[p];
+        }
+    }
+
+    for (int c = 0; c <= POINT_COLUMN_IDS; c++) {
+        values[c] = (ply->column[c] >= 0) ? props[ply->column[c]] : 0.0;
+    }
+    return 0;
+}
+
+/* Legge il prossimo punto di un file CSV/XYZ; `first` indica se è ancora possibile un'intestazione */
+static int readTextPoint(FILE *in, char **line, size_t *capacity, int *first, double *values, long long *line_no) {
+    for (;;) {
+        if (getline(line, capacity, in) < 0) return 1;
+        (*line_no)++;
+        if (isBlank(*line)) continue;
+
+        int count = parseNumbers(*line, values, KNN_DIM + 1);
+        if (count >= KNN_DIM) {
+            if (count == KNN_DIM) values[KNN_DIM] = 0.0;
+            *first = 0;
+            return 0;
+        }
+        if (*first) {
+            *first = 0;
+            continue;
+        }
+        fprintf(stderr, "Line %lld: expected at least %d numeric columns\n", *line_no, KNN_DIM);
+        return -1;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static struct option long_options[] = {
+        {"float32", no_argument, NULL, 'f'},
+        {"ids",     no_argument, NULL, 'd'},
+        {"help",    no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    uint32_t flags = POINT_FILE_DOUBLE;
+    int c;
+    while ((c = getopt_long(argc, argv, "fdh", long_options, NULL)) != -1) {
+        switch (c) {
+            case 'f': flags &= ~POINT_FILE_DOUBLE; break;
+            case 'd': flags |= POINT_FILE_IDS; break;
+            case 'h': printUsage(argv[0]); return 0;
+            default: printUsage(argv[0]); return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const char *input = argv[optind];
+    const char *output = argv[optind + 1];
+    const char *ext = strrchr(input, '.');
+    InputFormat format = (ext != NULL && !strcmp(ext, ".ply")) ? FORMAT_PLY : FORMAT_TEXT;
+
+    FILE *in = fopen(input, "rb");
+    if (in == NULL) {
+        perror(input);
+        return 1;
+    }
+
+    char *line = NULL;
+    size_t capacity = 0;
+    long long count = 0, line_no = 0;
+    double values[KNN_DIM + 1];
+    PLYHeader ply;
+
+    /* Primo passaggio: il numero di punti serve per sapere dove iniziano le colonne */
+    if (format == FORMAT_PLY) {
+        if (readPLYHeader(in, &ply) != 0) return 1;
+        count = ply.count;
+        if ((flags & POINT_FILE_IDS) && ply.column[POINT_COLUMN_IDS] < 0) {
+            fprintf(stderr, "%s: no \"id\" vertex property\n", input);
+            return 1;
+        }
+    } else {
+        int first = 1, status;
+        while ((status = readTextPoint(in, &line, &capacity, &first, values, &line_no)) == 0) count++;
+        if (status < 0) return 1;
+        rewind(in);
+    }
+
+    if (count <= 0) {
+        fprintf(stderr, "%s: no points\n", input);
+        return 1;
+    }
+
+    /* Secondo passaggio: scrittura in streaming */
+    PointWriter writer;
+    if (pointWriterOpen(&writer, output, (uint64_t)count, flags) != 0) return 1;
+
+    int first = 1;
+    line_no = 0;
+    for (long long i = 0; i < count; i++) {
+        int status = (format == FORMAT_PLY) ? readPLYVertex(in, &ply, &line, &capacity, values)
+                                            : readTextPoint(in, &line, &capacity, &first, values, &line_no);
+        if (status != 0) {
+            fprintf(stderr, "%s: unexpected end of data after %lld points\n", input, i);
+            pointWriterClose(&writer);
+            return 1;
+        }
+        if (pointWriterAppend(&writer, values, (int64_t)values[KNN_DIM]) != 0) {
+            pointWriterClose(&writer);
+            return 1;
+        }
+    }
+
+    free(line);
+    fclose(in);
+    if (pointWriterClose(&writer) != 0) return 1;
+
+    printf("%lld points of %d coordinates written to %s (%s%s)\n", count, KNN_DIM, output,
+           (flags & POINT_FILE_DOUBLE) ? "float64" : "float32", (flags & POINT_FILE_IDS) ? ", ids" : "");
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include "dynamic.h"
+#include "arena.h"
+#include "profile.h"
+
+/* Capacità del livello i */
+static long long levelCapacity(int level) {
+    return (long long)DYNAMIC_BUFFER_SIZE << level;
+}
+
+static int compareEntries(const void *a, const void *b) {
+    int ia = ((const DynamicEntry *)a)->id;
+    int ib = ((const DynamicEntry *)b)->id;
+    return (ia > ib) - (ia < ib);
+}
+
+static void clearLevel(DynamicLevel *level) {
+    if (level->tree != NULL) freeKDTree(level->tree);
+    free(level->entries);
+    level->tree = NULL;
+    level->entries = NULL;
+    level->dead = 0;
+}
+
+/* Costruisce l'albero di un livello (vuoto) sui punti dati, che vengono riordinati */
+static void buildLevel(DynamicLevel *level, Point *points, int n) {
+    if (n == 0) return;
+    level->tree = buildKDTree(points, n);
+    level->dead = 0;
+
+    /* Indice per id delle posizioni nelle foglie, per trovare in O(log n) il punto da cancellare */
+    level->entries = (DynamicEntry *)malloc(n * sizeof(DynamicEntry));
+    for (int i = 0; i < n; i++) {
+        level->entries[i].id = level->tree->index[i];
+        level->entries[i].slot = i;
+    }
+    qsort(level->entries, n, sizeof(DynamicEntry), compareEntries);
+}
+
+/* Accoda in out i punti vivi di un livello, restituisce quanti sono */
+static int collectLevel(const DynamicLevel *level, Point *out) {
+    const KDTree *t = level->tree;
+    if (t == NULL) return 0;
+
+    int count = 0;
+    for (int i = 0; i < t->n; i++) {
+        if (t->removed != NULL && t->removed[i]) continue;
+        for (int d = 0; d < KNN_DIM; d++) {
+            out[count].coord[d] = t->coord[d][i];
+        }
+        out[count].original_index = t->index[i];
+        count++;
+    }
+    return count;
+}
+
+static int levelLive(const DynamicLevel *level) {
+    return (level->tree != NULL) ? level->tree->n - level->dead : 0;
+}
+
+DynamicKDTree *buildDynamicKDTree(Point *points, int n) {
+    DynamicKDTree *tree = (DynamicKDTree *)calloc(1, sizeof(DynamicKDTree));
+    tree->buffer = (Point *)malloc(DYNAMIC_BUFFER_SIZE * sizeof(Point));
+    tree->n = n;
+
+    /* Tutti i punti iniziali vanno nel primo livello abbastanza capiente */
+    int level = 0;
+    while (level < DYNAMIC_MAX_LEVELS - 1 && levelCapacity(level) < n) level++;
+    buildLevel(&tree->levels[level], points, n);
+    return tree;
+}
+
+void freeDynamicKDTree(DynamicKDTree *tree) {
+    for (int i = 0; i < DYNAMIC_MAX_LEVELS; i++) {
+        clearLevel(&tree->levels[i]);
+    }
+    free(tree->buffer);
+    free(tree);
+}
+
+void dynamicInsert(DynamicKDTree *tree, Point point) {
+    tree->n++;
+    if (tree->buffer_n < DYNAMIC_BUFFER_SIZE) {
+        tree->buffer[tree->buffer_n++] = point;
+        return;
+    }
+
+    /* Buffer pieno: cerco il primo livello j che contiene buffer, nuovo punto e livelli 0..j */
+    long long total = tree->buffer_n + 1;
+    int target = 0;
+    for (; target < DYNAMIC_MAX_LEVELS - 1; target++) {
+        total += levelLive(&tree->levels[target]);
+        if (total <= levelCapacity(target)) break;
+    }
+    if (target == DYNAMIC_MAX_LEVELS - 1) {
+        total = tree->buffer_n + 1;
+        for (int i = 0; i < DYNAMIC_MAX_LEVELS; i++) total += levelLive(&tree->levels[i]);
+    }
+
+    /* Fondo i punti vivi e ricostruisco un solo albero */
+    Point *merged = (Point *)malloc(total * sizeof(Point));
+    int count = 0;
+    for (int i = 0; i < tree->buffer_n; i++) merged[count++] = tree->buffer[i];
+    merged[count++] = point;
+    for (int i = 0; i <= target; i++) {
+        count += collectLevel(&tree->levels[i], merged + count);
+        clearLevel(&tree->levels[i]);
+    }
+    tree->buffer_n = 0;
+
+    buildLevel(&tree->levels[target], merged, count);
+    tree->rebuilds++;
+    tree->rebuilt_points += count;
+    free(merged);
+}
+
+int dynamicRemove(DynamicKDTree *tree, int id) {
+    /* Nel buffer l'ordine non conta: sposto l'ultimo punto al posto di quello cancellato */
+    for (int i = 0; i < tree->buffer_n; i++) {
+        if (tree->buffer[i].original_index == id) {
+            tree->buffer[i] = tree->buffer[--tree->buffer_n];
+            tree->n--;
+            return 0;
+        }
+    }
+
+    for (int l = 0; l < DYNAMIC_MAX_LEVELS; l++) {
+        DynamicLevel *level = &tree->levels[l];
+        if (level->tree == NULL) continue;
+
+        DynamicEntry key = {id, 0};
+        DynamicEntry *entry = (DynamicEntry *)bsearch(&key, level->entries, level->tree->n,
+                                                      sizeof(DynamicEntry), compareEntries);
+        if (entry == NULL) continue;
+
+        /* Un punto spostato può avere una copia già cancellata in un livello e quella viva in un altro */
+        KDTree *t = level->tree;
+        if (t->removed == NULL) t->removed = (unsigned char *)calloc(t->n, 1);
+        if (t->removed[entry->slot]) continue;
+
+        t->removed[entry->slot] = 1;
+        level->dead++;
+        tree->n--;
+
+        /* Più di metà del livello è cancellata: lo ricostruisco con i soli punti vivi */
+        if (level->dead * 2 > t->n) {
+            int live = t->n - level->dead;
+            Point *points = (Point *)malloc((live > 0 ? live : 1) * sizeof(Point));
+            collectLevel(level, points);
+            clearLevel(level);
+            if (live > 0) {
+                buildLevel(level, points, live);
+                tree->rebuilds++;
+                tree->rebuilt_points += live;
+            }
+            free(points);
+        }
+        return 0;
+    }
+    return -1;
+}
+
+int dynamicKNearestNeighbors(const DynamicKDTree *tree, Point target, int k, double maxDistance,
+                             const KDSearchParams *params, int *neighbors, double *distances) {
+    double maxReduced = metricReduceLimit(maxDistance);
+
+    Arena *arena = threadArena();
+    ArenaMark mark = arenaMark(arena);
+    KNNEntry *entries = ARENA_ARRAY(arena, KNNEntry, k);
+    KNNHeap heap;
+    knnHeapInit(&heap, entries, k, maxReduced);
+
+    /* Prima i livelli più grandi, che contengono la maggior parte dei vicini */
+    int leaves = 0;
+    for (int l = DYNAMIC_MAX_LEVELS - 1; l >= 0; l--) {
+        if (tree->levels[l].tree != NULL) {
+            leaves += kdTreeUpdateHeap(tree->levels[l].tree, target, params, &heap);
+        }
+    }
+
+    /* Il buffer è piccolo e senza indice: lo scorro tutto */
+    for (int i = 0; i < tree->buffer_n; i++) {
+        const Point *p = &tree->buffer[i];
+        double dist = metricDistance(p->coord, target.coord);
+        if (dist <= knnHeapWorst(&heap) && p->original_index != target.original_index) {
+            knnHeapPush(&heap, dist, p->original_index);
+        }
+    }
+    knnHeapSort(&heap);
+    profileCount(COUNTER_DISTANCES, tree->buffer_n);
+    profileCount(COUNTER_HEAP_INSERTS, heap.inserts);
+
+    for (int i = 0; i < k; i++) {
+        if (i < heap.size) {
+            neighbors[i] = entries[i].index;
+            distances[i] = metricFinish(entries[i].distance);
+        } else {
+            neighbors[i] = -1;
+            distances[i] = DBL_MAX;
+        }
+    }
+
+    arenaReset(arena, mark);
+    return leaves;
+}
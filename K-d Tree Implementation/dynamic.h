@@ -0,0 +1,85 @@
+#ifndef DYNAMIC_H
+#define DYNAMIC_H
+
+#include "util.h"
+
+/* Punti inseriti tenuti in un buffer senza indice prima di finire in un albero */
+#define DYNAMIC_BUFFER_SIZE 256
+
+/* Numero massimo di livelli: il livello i contiene al più DYNAMIC_BUFFER_SIZE << i punti */
+#define DYNAMIC_MAX_LEVELS 24
+
+/** @brief: Posizione di un punto nelle foglie dell'albero di un livello, ordinate per id */
+typedef struct {
+    int id;
+    int slot;
+} DynamicEntry;
+
+/** @brief: Un livello del metodo logaritmico: un KD-Tree statico e i suoi id ordinati */
+typedef struct {
+    KDTree *tree;           /* NULL se il livello è vuoto */
+    DynamicEntry *entries;  /* tree->n coppie (id, posizione) ordinate per id */
+    int dead;               /* Punti del livello cancellati (tombstone in tree->removed) */
+} DynamicLevel;
+
+/** @brief: KD-Tree dinamico con il metodo logaritmico (Bentley-Saxe)
+ *  I punti sono divisi tra un buffer di al più DYNAMIC_BUFFER_SIZE punti e alcuni KD-Tree statici
+ *  di capacità crescente. Un inserimento va nel buffer; quando il buffer è pieno viene fuso con i
+ *  livelli più piccoli nel primo livello che li contiene tutti, quindi ogni punto viene ricostruito
+ *  O(log n) volte in tutto. Una cancellazione marca il punto come tombstone e il livello viene
+ *  ricostruito solo quando più di metà dei suoi punti è cancellata.
+ */
+typedef struct {
+    int n;                  /* Punti vivi */
+    Point *buffer;        /* DYNAMIC_BUFFER_SIZE posti */
+    int buffer_n;
+    DynamicLevel levels[DYNAMIC_MAX_LEVELS];
+    int rebuilds;           /* Alberi costruiti dopo quello iniziale */
+    long long rebuilt_points; /* Punti inseriti in quegli alberi */
+} DynamicKDTree;
+
+/**
+ * @brief Costruisce un KD-Tree dinamico con tutti i punti in un solo livello.
+ *
+ * @param points Array di punti, viene riordinato come da buildKDTree.
+ * @param n Numero di punti.
+ * @return Puntatore all'albero creato.
+ */
+DynamicKDTree *buildDynamicKDTree(Point *points, int n);
+
+/**
+ * @brief Libera l'albero dinamico e tutti i suoi livelli.
+ */
+void freeDynamicKDTree(DynamicKDTree *tree);
+
+/**
+ * @brief Inserisce un punto.
+ *
+ * Il punto va nel buffer; se il buffer è pieno, buffer e livelli 0..j-1 vengono fusi (solo i
+ * punti vivi) nel primo livello j abbastanza capiente, che viene ricostruito.
+ */
+void dynamicInsert(DynamicKDTree *tree, Point point);
+
+/**
+ * @brief Cancella il punto con un dato original_index.
+ *
+ * Nel buffer il punto viene rimosso subito, in un livello viene marcato come cancellato; quando
+ * più di metà dei punti di un livello è cancellata il livello viene ricostruito con i soli vivi.
+ *
+ * @return 0 se il punto è stato cancellato, -1 se non c'è.
+ */
+int dynamicRemove(DynamicKDTree *tree, int id);
+
+/**
+ * @brief Trova i k vicini di un punto su tutti i livelli e sul buffer.
+ *
+ * Stessa semantica di findKNearestNeighborsApprox: un solo contenitore di vicini viene aggiornato
+ * da tutti i livelli, dal più grande, quindi il k-esimo vicino trovato pota anche i successivi.
+ * Nella ricerca approssimata il limite di foglie vale per ogni livello.
+ *
+ * @return Numero di foglie visitate.
+ */
+int dynamicKNearestNeighbors(const DynamicKDTree *tree, Point target, int k, double maxDistance,
+                             const KDSearchParams *params, int *neighbors, double *distances);
+
+#endif
@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "grid.h"
+#include "scheduler.h"
+#include "arena.h"
+#include "profile.h"
+
+/* Le distanze da celle e anelli sono ridotte di questo fattore relativo, in modo che gli errori di
+   arrotondamento nell'assegnazione dei punti alle celle non facciano scartare un vicino vero */
+#define GRID_BOUND_SLACK (1.0 - 1e-9)
+
+/* Coordinate del target della ricerca: tutte quelle del punto, e almeno GRID_AXES */
+#define GRID_TARGET_COORDS (KNN_DIM > GRID_AXES ? KNN_DIM : GRID_AXES)
+
+/* Assi della griglia che sono anche assi dei punti, gli unici che contano nelle distanze */
+#define GRID_METRIC_AXES (KNN_DIM < GRID_AXES ? KNN_DIM : GRID_AXES)
+
+/* Coordinata di un punto lungo un asse della griglia, 0 sugli assi che il punto non ha */
+static double getCoord(const Point *p, int axis) {
+    return (axis < KNN_DIM) ? p->coord[axis] : 0.0;
+}
+
+/* Cella lungo un asse di una coordinata, limitata alla griglia */
+static int cellCoord(const UniformGrid *grid, int axis, double value) {
+    double c = floor((value - grid->origin[axis]) * grid->inv_size[axis]);
+    if (c < 0.0) return 0;
+    if (c >= grid->dims[axis]) return grid->dims[axis] - 1;
+    return (int)c;
+}
+
+static int cellOf(const UniformGrid *grid, const Point *p) {
+    int ix = cellCoord(grid, 0, getCoord(p, 0));
+    int iy = cellCoord(grid, 1, getCoord(p, 1));
+    int iz = cellCoord(grid, 2, getCoord(p, 2));
+    return (iz * grid->dims[1] + iy) * grid->dims[0] + ix;
+}
+
+/* Sceglie il numero di celle per asse: lato uguale su tutti gli assi "pieni", gli assi più sottili
+   di una cella (o degeneri) ne hanno una sola e il lato viene ricalcolato sugli altri */
+static void chooseDimensions(const double extent[GRID_AXES], int n, int dims[GRID_AXES]) {
+    int active[GRID_AXES];
+    for (int a = 0; a < GRID_AXES; a++) active[a] = (extent[a] > 0.0);
+
+    double side = 0.0;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        int d = 0;
+        double volume = 1.0;
+        for (int a = 0; a < GRID_AXES; a++) {
+            if (active[a]) {
+                d++;
+                volume *= extent[a];
+            }
+        }
+        if (d == 0) break;
+
+        side = pow(volume * GRID_POINTS_PER_CELL / (n > 0 ? n : 1), 1.0 / d);
+        for (int a = 0; a < GRID_AXES; a++) {
+            if (active[a] && extent[a] < side) {
+                active[a] = 0;
+                changed = 1;
+            }
+        }
+    }
+
+    for (int a = 0; a < GRID_AXES; a++) {
+        dims[a] = active[a] ? (int)ceil(extent[a] / side) : 1;
+        if (dims[a] < 1) dims[a] = 1;
+    }
+}
+
+/* Counting sort: ogni blocco contiguo di punti ha il proprio istogramma delle celle */
+typedef struct {
+    const UniformGrid *grid;
+    const Point *points;
+    int num_blocks;
+    int *cell_of;       /* Cella di ogni punto, calcolata nella prima passata */
+    int *counts;        /* num_blocks * num_cells: conteggi, poi offset di scrittura */
+} GridBuild;
+
+static void blockRange(const GridBuild *build, int block, int *begin, int *end) {
+    *begin = (int)((long long)block * build->grid->n / build->num_blocks);
+    *end = (int)((long long)(block + 1) * build->grid->n / build->num_blocks);
+}
+
+static void countBlock(int begin, int end, int thread_id, void *context) {
+    (void)thread_id;
+    GridBuild *build = (GridBuild *)context;
+    int num_cells = build->grid->num_cells;
+
+    for (int b = begin; b < end; b++) {
+        int *counts = &build->counts[(size_t)b * num_cells];
+        int first, last;
+        blockRange(build, b, &first, &last);
+        for (int i = first; i < last; i++) {
+            int cell = cellOf(build->grid, &build->points[i]);
+            build->cell_of[i] = cell;
+            counts[cell]++;
+        }
+    }
+}
+
+static void scatterBlock(int begin, int end, int thread_id, void *context) {
+    (void)thread_id;
+    GridBuild *build = (GridBuild *)context;
+    const UniformGrid *grid = build->grid;
+
+    for (int b = begin; b < end; b++) {
+        int *offsets = &build->counts[(size_t)b * grid->num_cells];
+        int first, last;
+        blockRange(build, b, &first, &last);
+        for (int i = first; i < last; i++) {
+            int pos = offsets[build->cell_of[i]]++;
+            for (int d = 0; d < KNN_DIM; d++) {
+                grid->coord[d][pos] = build->points[i].coord[d];
+            }
+            grid->index[pos] = build->points[i].original_index;
+        }
+    }
+}
+
+UniformGrid *buildUniformGrid(const Point *points, int n, int num_threads) {
+    double min[GRID_AXES] = {0.0, 0.0, 0.0}, max[GRID_AXES] = {0.0, 0.0, 0.0};
+    for (int a = 0; a < GRID_AXES; a++) {
+        for (int i = 0; i < n; i++) {
+            double c = getCoord(&points[i], a);
+            if (i == 0 || c < min[a]) min[a] = c;
+            if (i == 0 || c > max[a]) max[a] = c;
+        }
+    }
+
+    double extent[GRID_AXES];
+    int dims[GRID_AXES], cyclic[GRID_AXES];
+    for (int a = 0; a < GRID_AXES; a++) {
+        extent[a] = max[a] - min[a];
+        cyclic[a] = 0;
+#if KNN_METRIC == KNN_METRIC_PERIODIC
+        /* I vicini di un punto vicino al bordo sono oltre il bordo opposto: se i punti coprono quasi
+           tutto il periodo le celle lo dividono intero, così gli anelli li raggiungono subito */
+        if (a < KNN_DIM && extent[a] > 0.5 * metric_periods[a] && extent[a] <= metric_periods[a]) {
+            extent[a] = metric_periods[a];
+            cyclic[a] = 1;
+        }
+#endif
+    }
+    chooseDimensions(extent, n, dims);
+    int num_cells = dims[0] * dims[1] * dims[2];
+
+    /* Un'unica allocazione: header, offset delle celle e poi le colonne dei punti */
+    size_t bytes = sizeof(UniformGrid)
+                 + KNN_DIM * (size_t)n * sizeof(double)
+                 + (size_t)n * sizeof(int)
+                 + ((size_t)num_cells + 1) * sizeof(int);
+    char *block = (char *)malloc(bytes);
+
+    UniformGrid *grid = (UniformGrid *)block;
+    grid->n = n;
+    grid->num_cells = num_cells;
+    for (int a = 0; a < GRID_AXES; a++) {
+        grid->dims[a] = dims[a];
+        grid->origin[a] = min[a];
+        grid->cell_size[a] = (extent[a] > 0.0) ? extent[a] / dims[a] : 1.0;
+        grid->inv_size[a] = (extent[a] > 0.0) ? dims[a] / extent[a] : 0.0;
+        grid->cyclic[a] = cyclic[a];
+    }
+    grid->coord[0] = (double *)(block + sizeof(UniformGrid));
+    for (int d = 1; d < KNN_DIM; d++) {
+        grid->coord[d] = grid->coord[d - 1] + n;
+    }
+    grid->index = (int *)(grid->coord[KNN_DIM - 1] + n);
+    grid->cell_start = grid->index + n;
+
+    /* Un blocco di punti per thread, così i conteggi non dipendono da come vengono rubati i chunk */
+    GridBuild build;
+    build.grid = grid;
+    build.points = points;
+    build.num_blocks = (n >= num_threads * DEFAULT_CHUNK_SIZE) ? num_threads : 1;
+    build.cell_of = (int *)malloc((n > 0 ? n : 1) * sizeof(int));
+    build.counts = (int *)calloc((size_t)build.num_blocks * num_cells, sizeof(int));
+
+    parallelFor(build.num_blocks, 1, num_threads, countBlock, &build);
+
+    /* Offset di scrittura: per ogni cella i blocchi si susseguono nell'ordine dell'array */
+    int running = 0;
+    for (int c = 0; c < num_cells; c++) {
+        grid->cell_start[c] = running;
+        for (int b = 0; b < build.num_blocks; b++) {
+            int *count = &build.counts[(size_t)b * num_cells + c];
+            int value = *count;
+            *count = running;
+            running += value;
+        }
+    }
+    grid->cell_start[num_cells] = running;
+
+    parallelFor(build.num_blocks, 1, num_threads, scatterBlock, &build);
+
+    free(build.cell_of);
+    free(build.counts);
+    return grid;
+}
+
+void freeUniformGrid(UniformGrid *grid) {
+    free(grid);
+}
+
+/* Stato della ricerca ad anelli */
+typedef struct {
+    const UniformGrid *grid;
+    double target[GRID_TARGET_COORDS];
+    double cell_target[GRID_AXES]; /* Target per celle e limiti: sugli assi ciclici riportato nel periodo */
+    int self;           /* original_index del target, escluso dai risultati */
+    int center[GRID_AXES];
+    KNNHeap *heap;
+    double scale;       /* 1 + eps in distanza ridotta */
+    int max_cells;      /* 0 = nessun limite */
+    int cells;          /* Celle non vuote visitate */
+    long long distances; /* Distanze calcolate */
+} GridSearch;
+
+/* Distanza minima (ridotta) tra il target e una cella; le celle sul bordo della griglia
+   si estendono oltre il bordo, perché contengono anche i punti limitati dentro la griglia.
+   Sugli assi ciclici non c'è bordo e la cella può avere indice fuori da [0, dims) */
+static double cellDistance(const GridSearch *search, const int cell[GRID_AXES]) {
+    const UniformGrid *grid = search->grid;
+    double sum = 0.0;
+    for (int a = 0; a < GRID_METRIC_AXES; a++) {
+        double low = grid->origin[a] + cell[a] * grid->cell_size[a];
+        double high = grid->origin[a] + (cell[a] + 1) * grid->cell_size[a];
+        double t = search->cell_target[a], gap = 0.0;
+        if (grid->cyclic[a] || (cell[a] > 0 && t < low) || (cell[a] < grid->dims[a] - 1 && t > high)) {
+            gap = metricIntervalGap(t, t, low, high, a);
+        }
+        sum = metricAddGap(sum, gap, a);
+    }
+    return sum * GRID_BOUND_SLACK;
+}
+
+/* Distanza minima (ridotta) tra il target e le celle fuori dal cubo [center - r, center + r]:
+   un punto non visitato è oltre una delle facce del cubo che non coincidono col bordo della griglia,
+   cioè tra quella faccia e il bordo. Nel box periodico la distanza gira anche dal bordo opposto, e
+   metricIntervalGap la limita a periodo - estensione dell'intervallo tra target e bordo; sugli assi
+   ciclici i punti non visitati sono nell'arco che va da una faccia all'altra passando dal bordo */
+static double ringDistance(const GridSearch *search, int r) {
+    const UniformGrid *grid = search->grid;
+    double best = DBL_MAX;
+    for (int a = 0; a < GRID_METRIC_AXES; a++) {
+        int lo = search->center[a] - r, hi = search->center[a] + r;
+        double t = search->cell_target[a], size = grid->cell_size[a];
+        if (grid->cyclic[a]) {
+            if (2 * r + 1 >= grid->dims[a]) continue;
+            double arc_low = grid->origin[a] + (hi + 1) * size;
+            double arc_high = grid->origin[a] + (lo + grid->dims[a]) * size;
+            double gap = metricIntervalGap(t, t, arc_low, arc_high, a);
+            if (metricPlaneBound(gap, a) < best) best = metricPlaneBound(gap, a);
+            continue;
+        }
+        if (lo > 0) {
+            double gap = metricIntervalGap(t, t, grid->origin[a], grid->origin[a] + lo * size, a);
+            if (metricPlaneBound(gap, a) < best) best = metricPlaneBound(gap, a);
+        }
+        if (hi < grid->dims[a] - 1) {
+            double gap = metricIntervalGap(t, t, grid->origin[a] + (hi + 1) * size,
+                                           grid->origin[a] + grid->dims[a] * size, a);
+            if (metricPlaneBound(gap, a) < best) best = metricPlaneBound(gap, a);
+        }
+    }
+    return best * GRID_BOUND_SLACK;
+}
+
+/* Visita la cella con coordinate `cell`, che sugli assi ciclici possono uscire da [0, dims) */
+static void visitCell(GridSearch *search, const int cell[GRID_AXES]) {
+    const UniformGrid *grid = search->grid;
+    int wrapped[GRID_AXES];
+    for (int a = 0; a < GRID_AXES; a++) {
+        wrapped[a] = grid->cyclic[a] ? (cell[a] + grid->dims[a]) % grid->dims[a] : cell[a];
+    }
+    int id = (wrapped[2] * grid->dims[1] + wrapped[1]) * grid->dims[0] + wrapped[0];
+    int start = grid->cell_start[id], end = grid->cell_start[id + 1];
+    if (start == end) return;
+    if (search->max_cells > 0 && search->cells >= search->max_cells) return;
+
+    /* Salto le celle più lontane del vicino peggiore */
+    if (cellDistance(search, cell) * search->scale > knnHeapWorst(search->heap)) return;
+
+    search->distances += end - start;
+    for (int i = start; i < end; i++) {
+        double dist = 0.0;
+        for (int d = 0; d < KNN_DIM; d++) {
+            dist = metricAdd(dist, grid->coord[d][i] - search->target[d], d);
+        }
+        if (dist <= knnHeapWorst(search->heap) && grid->index[i] != search->self) {
+            knnHeapPush(search->heap, dist, grid->index[i]);
+        }
+    }
+    search->cells++;
+}
+
+/* Spostamenti dalla cella centrale lungo un asse, limitati a [-r, r]: sugli assi ciclici i dims
+   spostamenti distinti attorno a 0, altrimenti quelli che restano dentro la griglia */
+static void offsetRange(const GridSearch *search, int a, int r, int *lo, int *hi) {
+    const UniformGrid *grid = search->grid;
+    if (grid->cyclic[a]) {
+        *lo = -((grid->dims[a] - 1) / 2);
+        *hi = grid->dims[a] / 2;
+    } else {
+        *lo = -search->center[a];
+        *hi = grid->dims[a] - 1 - search->center[a];
+    }
+    if (*lo < -r) *lo = -r;
+    if (*hi > r) *hi = r;
+}
+
+/* Visita le celle a distanza di Chebyshev esattamente r dalla cella centrale */
+static void visitRing(GridSearch *search, int r) {
+    const int *c = search->center;
+    int lo[GRID_AXES], hi[GRID_AXES];
+    for (int a = 0; a < GRID_AXES; a++) {
+        offsetRange(search, a, r, &lo[a], &hi[a]);
+    }
+
+    for (int oz = lo[2]; oz <= hi[2]; oz++) {
+        for (int oy = lo[1]; oy <= hi[1]; oy++) {
+            /* Sulle facce in z e y tutta la riga appartiene all'anello, altrimenti solo gli estremi in x */
+            if (oz == -r || oz == r || oy == -r || oy == r) {
+                for (int ox = lo[0]; ox <= hi[0]; ox++) {
+                    int cell[GRID_AXES] = {c[0] + ox, c[1] + oy, c[2] + oz};
+                    visitCell(search, cell);
+                }
+            } else {
+                int cell[GRID_AXES] = {c[0] - r, c[1] + oy, c[2] + oz};
+                if (lo[0] == -r) visitCell(search, cell);
+                cell[0] = c[0] + r;
+                if (r > 0 && hi[0] == r) visitCell(search, cell);
+            }
+        }
+    }
+}
+
+int gridKNearestNeighbors(const UniformGrid *grid, Point target, int k, double maxDistance,
+                          const KDSearchParams *params, int *neighbors, double *distances) {
+    double maxReduced = metricReduceLimit(maxDistance);
+
+    Arena *arena = threadArena();
+    ArenaMark mark = arenaMark(arena);
+    KNNEntry *entries = ARENA_ARRAY(arena, KNNEntry, k);
+    KNNHeap heap;
+    knnHeapInit(&heap, entries, k, maxReduced);
+
+    GridSearch search;
+    search.grid = grid;
+    for (int a = 0; a < GRID_TARGET_COORDS; a++) {
+        search.target[a] = getCoord(&target, a);
+    }
+    search.self = target.original_index;
+    search.heap = &heap;
+    search.scale = kdSearchIsExact(params) ? 1.0 : metricReduce(1.0 + params->eps);
+    search.max_cells = kdSearchIsExact(params) ? 0 : params->max_leaves;
+    search.cells = 0;
+    search.distances = 0;
+
+    int max_ring = 0;
+    for (int a = 0; a < GRID_AXES; a++) {
+        double t = search.target[a];
+        if (grid->cyclic[a]) {
+            double period = grid->dims[a] * grid->cell_size[a];
+            t -= period * floor((t - grid->origin[a]) / period);
+        }
+        search.cell_target[a] = t;
+        search.center[a] = cellCoord(grid, a, t);
+        int reach = (search.center[a] > grid->dims[a] - 1 - search.center[a])
+                  ? search.center[a] : grid->dims[a] - 1 - search.center[a];
+        if (grid->cyclic[a]) reach = grid->dims[a] / 2;
+        if (reach > max_ring) max_ring = reach;
+    }
+
+    for (int r = 0; grid->n > 0 && r <= max_ring; r++) {
+        visitRing(&search, r);
+        if (search.max_cells > 0 && search.cells >= search.max_cells) break;
+
+        /* Mi fermo quando anche le celle dell'anello successivo sono più lontane del vicino peggiore */
+        if (ringDistance(&search, r) * search.scale > knnHeapWorst(&heap)) break;
+    }
+
+    knnHeapSort(&heap);
+    profileCount(COUNTER_NODES, search.cells);
+    profileCount(COUNTER_DISTANCES, search.distances);
+    profileCount(COUNTER_HEAP_INSERTS, heap.inserts);
+    for (int i = 0; i < k; i++) {
+        if (i < heap.size) {
+            neighbors[i] = entries[i].index;
+            distances[i] = metricFinish(entries[i].distance);
+        } else {
+            neighbors[i] = -1;
+            distances[i] = DBL_MAX;
+        }
+    }
+
+    arenaReset(arena, mark);
+    return search.cells;
+}
@@ -0,0 +1,75 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include "util.h"
+
+/* Numero medio di punti per cella con cui viene scelta la dimensione delle celle */
+#define GRID_POINTS_PER_CELL 4
+
+/* Assi su cui sono definite le celle: i primi 3, anche con più dimensioni (la distanza da una cella
+   sui primi assi resta un limite inferiore di quella completa); con meno di 3 dimensioni gli assi
+   mancanti hanno una sola cella */
+#define GRID_AXES 3
+
+/** @brief: Griglia uniforme di celle sul bounding box dei punti, allocata in un unico blocco
+ *  I punti sono ordinati per cella (counting sort) e salvati per colonne; i punti della cella c
+ *  sono nell'intervallo [cell_start[c], cell_start[c + 1]). La cella (ix, iy, iz) ha indice
+ *  (iz * dims[1] + iy) * dims[0] + ix.
+ */
+typedef struct {
+    int n;              /* Numero di punti */
+    int dims[GRID_AXES];        /* Numero di celle lungo ogni asse */
+    int num_cells;
+    double origin[GRID_AXES];   /* Angolo minimo del bounding box */
+    double cell_size[GRID_AXES];
+    double inv_size[GRID_AXES]; /* 1 / cell_size, 0 sugli assi degeneri */
+    int cyclic[GRID_AXES];      /* Asse che copre un periodo intero del box periodico: le celle si richiudono */
+    int *cell_start;            /* num_cells + 1 offset */
+    double *coord[KNN_DIM];     /* Coordinate dei punti in ordine di cella, una colonna per asse */
+    int *index;         /* original_index dei punti nello stesso ordine */
+} UniformGrid;
+
+/**
+ * @brief Costruisce una griglia uniforme sui punti.
+ *
+ * Il lato delle celle è scelto dal bounding box e da n in modo da avere in media
+ * GRID_POINTS_PER_CELL punti per cella (gli assi con estensione nulla hanno una sola cella).
+ * Con la metrica periodic un asse su cui i punti coprono più di mezzo periodo diventa ciclico: le
+ * celle dividono l'intero periodo e la ricerca ad anelli prosegue oltre il bordo opposto.
+ * I punti vengono distribuiti nelle celle con un counting sort parallelo: ogni thread conta e poi
+ * copia un blocco contiguo di punti, quindi l'ordine dentro una cella è quello dell'array.
+ *
+ * @param points Array di punti (non viene modificato).
+ * @param n Numero di punti.
+ * @param num_threads Numero di thread della costruzione.
+ * @return Puntatore alla griglia creata.
+ */
+UniformGrid *buildUniformGrid(const Point *points, int n, int num_threads);
+
+/**
+ * @brief Libera la memoria occupata da una griglia.
+ */
+void freeUniformGrid(UniformGrid *grid);
+
+/**
+ * @brief Trova i k vicini più prossimi di un punto visitando la griglia ad anelli.
+ *
+ * Si parte dalla cella del target (o dalla più vicina, se il target è fuori dalla griglia) e si
+ * visitano gli anelli di celle a distanza di Chebyshev crescente, saltando le celle più lontane
+ * del k-esimo vicino. Ci si ferma quando tutte le celle non ancora visitate distano più del
+ * k-esimo vicino. Con parametri approssimati la distanza viene divisa per 1 + eps e `max_leaves`
+ * limita le celle non vuote visitate. Stessa interfaccia di findKNearestNeighborsApprox.
+ *
+ * @param grid Puntatore alla griglia.
+ * @param target Il punto di riferimento per cui trovare i vicini più prossimi.
+ * @param k Numero di vicini più prossimi da trovare.
+ * @param maxDistance Raggio entro cui cercare i vicini (DBL_MAX per nessun limite).
+ * @param params Parametri della ricerca approssimata, oppure NULL per la ricerca esatta.
+ * @param neighbors Array in cui verranno memorizzati gli indici dei k vicini più prossimi.
+ * @param distances Array in cui verranno memorizzate le distanze corrispondenti.
+ * @return Numero di celle non vuote visitate.
+ */
+int gridKNearestNeighbors(const UniformGrid *grid, Point target, int k, double maxDistance,
+                          const KDSearchParams *params, int *neighbors, double *distances);
+
+#endif
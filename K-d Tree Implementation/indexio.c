@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "indexio.h"
+
+#define CHECKSUM_PRIME1 0x9E3779B185EBCA87ULL
+#define CHECKSUM_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define CHECKSUM_PRIME3 0x165667B19E3779F9ULL
+
+static uint64_t rotateLeft(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t checksumRound(uint64_t acc, uint64_t word) {
+    acc += word * CHECKSUM_PRIME2;
+    return rotateLeft(acc, 31) * CHECKSUM_PRIME1;
+}
+
+uint64_t indexChecksum(const void *data, size_t bytes) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t lane[4] = {CHECKSUM_PRIME1 + CHECKSUM_PRIME2, CHECKSUM_PRIME2, 0, -CHECKSUM_PRIME1};
+
+    /* I 4 accumulatori non dipendono l'uno dall'altro, quindi le moltiplicazioni si sovrappongono */
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        for (int l = 0; l < 4; l++) {
+            uint64_t word;
+            memcpy(&word, p + i + 8 * l, sizeof(word));
+            lane[l] = checksumRound(lane[l], word);
+        }
+    }
+
+    uint64_t h = rotateLeft(lane[0], 1) + rotateLeft(lane[1], 7) + rotateLeft(lane[2], 12) + rotateLeft(lane[3], 18);
+    h += (uint64_t)bytes;
+    for (; i < bytes; i++) {
+        h = rotateLeft(h ^ (p[i] * CHECKSUM_PRIME3), 11) * CHECKSUM_PRIME1;
+    }
+
+    /* Rimescolamento finale, ogni bit dell'ingresso influenza tutti quelli dell'uscita */
+    h ^= h >> 33;
+    h *= CHECKSUM_PRIME2;
+    h ^= h >> 29;
+    h *= CHECKSUM_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+void indexShardInit(IndexShard *shard, const KDTree *tree) {
+    shard->offset = 0;
+    shard->bytes = kdTreePayloadSize(tree->n, tree->levels);
+    shard->checksum = indexChecksum(tree->nodes, shard->bytes);
+    shard->count = (uint32_t)tree->n;
+    shard->levels = (uint32_t)tree->levels;
+}
+
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + INDEX_FILE_ALIGNMENT - 1) / INDEX_FILE_ALIGNMENT * INDEX_FILE_ALIGNMENT;
+}
+
+uint64_t indexFileLayout(IndexFileHeader *header, IndexShard *shards, int num_shards) {
+    memcpy(header->magic, INDEX_FILE_MAGIC, 8);
+    header->version = INDEX_FILE_VERSION;
+    header->shards = (uint32_t)num_shards;
+    header->count = 0;
+
+    uint64_t offset = INDEX_FILE_HEADER_SIZE + (uint64_t)num_shards * sizeof(IndexShard);
+    for (int s = 0; s < num_shards; s++) {
+        offset = alignOffset(offset);
+        shards[s].offset = offset;
+        offset += shards[s].bytes;
+        header->count += shards[s].count;
+    }
+    header->table_checksum = indexChecksum(shards, (size_t)num_shards * sizeof(IndexShard));
+    return offset;
+}
+
+int indexTableCheck(const IndexFileHeader *header, const IndexShard *shards, uint64_t file_size,
+                    const char *path) {
+    uint64_t table_end = INDEX_FILE_HEADER_SIZE + (uint64_t)header->shards * sizeof(IndexShard);
+    if (file_size < table_end ||
+        header->table_checksum != indexChecksum(shards, (size_t)header->shards * sizeof(IndexShard))) {
+        fprintf(stderr, "%s: corrupted shard table\n", path);
+        return -1;
+    }
+
+    uint64_t total = 0;
+    for (uint32_t s = 0; s < header->shards; s++) {
+        const IndexShard *shard = &shards[s];
+        if (shard->levels > 30 || shard->bytes != kdTreePayloadSize((int)shard->count, (int)shard->levels) ||
+            shard->offset % INDEX_FILE_ALIGNMENT != 0 || shard->offset + shard->bytes > file_size) {
+            fprintf(stderr, "%s: invalid or truncated shard %u\n", path, s);
+            return -1;
+        }
+        total += shard->count;
+    }
+    if (total != header->count) {
+        fprintf(stderr, "%s: shards hold %llu points, %llu expected\n", path,
+                (unsigned long long)total, (unsigned long long)header->count);
+        return -1;
+    }
+    return 0;
+}
+
+/* Scrive `size` byte all'offset indicato, gestendo le scritture parziali */
+static int writeAt(int fd, const void *data, size_t size, uint64_t offset) {
+    const char *bytes = (const char *)data;
+    while (size > 0) {
+        ssize_t done = pwrite(fd, bytes, size, (off_t)offset);
+        if (done < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        bytes += done;
+        offset += done;
+        size -= done;
+    }
+    return 0;
+}
+
+int saveKDTree(const char *path, const KDTree *tree) {
+    IndexFileHeader header;
+    IndexShard shard;
+    indexShardInit(&shard, tree);
+    uint64_t file_size = indexFileLayout(&header, &shard, 1);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    int status = writeAt(fd, &header, sizeof(header), 0);
+    if (status == 0) status = writeAt(fd, &shard, sizeof(shard), INDEX_FILE_HEADER_SIZE);
+    if (status == 0) status = writeAt(fd, tree->nodes, shard.bytes, shard.offset);
+    if (status == 0) status = ftruncate(fd, (off_t)file_size);
+    if (close(fd) != 0) status = -1;
+    if (status != 0) {
+        fprintf(stderr, "%s: write failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int indexFileOpen(const char *path, IndexFile *file) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < INDEX_FILE_HEADER_SIZE) {
+        fprintf(stderr, "%s: not an index file (too short)\n", path);
+        close(fd);
+        return -1;
+    }
+
+    /* La mappatura resta valida anche dopo la chiusura del descrittore */
+    file->map_size = (size_t)st.st_size;
+    file->map = mmap(NULL, file->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file->map == MAP_FAILED) {
+        fprintf(stderr, "%s: mmap failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    memcpy(&file->header, file->map, sizeof(IndexFileHeader));
+    file->shards = (const IndexShard *)((const char *)file->map + INDEX_FILE_HEADER_SIZE);
+    if (memcmp(file->header.magic, INDEX_FILE_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s: not an index file (bad magic)\n", path);
+    } else if (file->header.version != INDEX_FILE_VERSION) {
+        fprintf(stderr, "%s: unsupported index version %u\n", path, file->header.version);
+    } else if (indexTableCheck(&file->header, file->shards, file->map_size, path) == 0) {
+        return 0;
+    }
+    munmap(file->map, file->map_size);
+    return -1;
+}
+
+KDTree *indexFileTree(const IndexFile *file, int shard, const char *path) {
+    if (shard < 0 || (uint32_t)shard >= file->header.shards) {
+        fprintf(stderr, "%s: no shard %d (%u shards)\n", path, shard, file->header.shards);
+        return NULL;
+    }
+
+    /* Il checksum legge tutto lo shard, che così è anche già nella page cache per la ricerca */
+    const IndexShard *desc = &file->shards[shard];
+    char *payload = (char *)file->map + desc->offset;
+    if (indexChecksum(payload, desc->bytes) != desc->checksum) {
+        fprintf(stderr, "%s: checksum mismatch in shard %d\n", path, shard);
+        return NULL;
+    }
+
+    KDTree *tree = (KDTree *)malloc(sizeof(KDTree));
+    kdTreeLayout(tree, payload, (int)desc->count, (int)desc->levels);
+    return tree;
+}
+
+void indexFileClose(IndexFile *file) {
+    munmap(file->map, file->map_size);
+    file->map = NULL;
+    file->map_size = 0;
+}
@@ -0,0 +1,114 @@
+#ifndef INDEXIO_H
+#define INDEXIO_H
+
+#include <stdint.h>
+#include "util.h"
+
+/*  Formato binario di un KD-Tree salvato (estensione consigliata .knni), little-endian:
+
+    offset 0   char[8]   magic "KNNIDX01"
+    offset 8   uint32    versione (INDEX_FILE_VERSION)
+    offset 12  uint32    numero di shard S (uno per processo che ha salvato l'indice)
+    offset 16  uint64    numero totale di punti
+    offset 24  uint64    checksum della tabella degli shard
+    offset 32  S descrittori di 32 byte: uint64 offset, uint64 byte, uint64 checksum,
+               uint32 punti dello shard, uint32 livelli interni del suo albero
+    poi i dati di ogni shard, ad un offset multiplo di INDEX_FILE_ALIGNMENT
+
+    I dati di uno shard sono esattamente la parte del blocco di buildKDTree che segue la struct
+    KDTree (nodi, bounding box, colonne delle coordinate e indici, vedi kdTreePayloadSize): la disposizione
+    dipende solo dal numero di punti e di livelli, quindi uno shard letto o mappato si usa così
+    com'è, senza correggere puntatori. Il file è legato alla struct KDNode di questa versione e a
+    KNN_DIM: con un'altra dimensione la dimensione degli shard non torna e il file viene rifiutato.
+*/
+
+#define INDEX_FILE_MAGIC "KNNIDX01"
+#define INDEX_FILE_VERSION 1
+#define INDEX_FILE_HEADER_SIZE 32
+
+/* Allineamento dei dati di ogni shard, una pagina: ogni shard può essere mappato da solo */
+#define INDEX_FILE_ALIGNMENT 4096
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t shards;
+    uint64_t count;
+    uint64_t table_checksum;
+} IndexFileHeader;
+
+typedef struct {
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t checksum;
+    uint32_t count;
+    uint32_t levels;
+} IndexShard;
+
+/** @brief: Indice aperto con mmap, gli alberi degli shard puntano direttamente nella mappatura */
+typedef struct {
+    IndexFileHeader header;
+    const IndexShard *shards;   /* Tabella degli shard, dentro la mappatura */
+    void *map;
+    size_t map_size;
+} IndexFile;
+
+/**
+ * @brief Checksum a 64 bit di un buffer, a blocchi di 32 byte su 4 accumulatori indipendenti
+ *        (sul modello di xxHash64), così la verifica procede alla velocità della lettura.
+ */
+uint64_t indexChecksum(const void *data, size_t bytes);
+
+/**
+ * @brief Descrittore di uno shard per un albero (l'offset va impostato da chi scrive il file).
+ */
+void indexShardInit(IndexShard *shard, const KDTree *tree);
+
+/**
+ * @brief Calcola gli offset degli shard e l'header di un file con `num_shards` shard.
+ *
+ * @return Dimensione totale del file in byte.
+ */
+uint64_t indexFileLayout(IndexFileHeader *header, IndexShard *shards, int num_shards);
+
+/**
+ * @brief Controlla magic, versione, tabella degli shard e dimensione di un file d'indice.
+ *
+ * @param header Header letto.
+ * @param shards Tabella letta (header->shards descrittori).
+ * @param file_size Dimensione del file in byte.
+ * @param path Nome del file, usato nei messaggi di errore.
+ * @return 0 se il file è valido, -1 altrimenti (con il motivo stampato su stderr).
+ */
+int indexTableCheck(const IndexFileHeader *header, const IndexShard *shards, uint64_t file_size,
+                    const char *path);
+
+/**
+ * @brief Salva un albero come indice con un solo shard.
+ *
+ * @return 0 in caso di successo, -1 in caso di errore (con il motivo stampato su stderr).
+ */
+int saveKDTree(const char *path, const KDTree *tree);
+
+/**
+ * @brief Apre un indice con mmap (un singolo nodo) e ne controlla header e tabella.
+ *
+ * @return 0 in caso di successo, -1 in caso di errore (con il motivo stampato su stderr).
+ */
+int indexFileOpen(const char *path, IndexFile *file);
+
+/**
+ * @brief Albero di uno shard, con i dati nella mappatura dopo averne verificato il checksum.
+ *
+ * L'albero va liberato con freeKDTree (che libera solo la struct) prima di indexFileClose.
+ *
+ * @return Puntatore all'albero, NULL se lo shard non esiste o è corrotto.
+ */
+KDTree *indexFileTree(const IndexFile *file, int shard, const char *path);
+
+/**
+ * @brief Chiude la mappatura di un indice.
+ */
+void indexFileClose(IndexFile *file);
+
+#endif
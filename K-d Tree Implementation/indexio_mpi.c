@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "indexio_mpi.h"
+
+/* I dati degli shard hanno dimensione multipla di 8 byte: li trasferisco a parole di 8 byte, così
+   un solo conteggio int basta per shard fino a 16 GB */
+static MPI_Datatype wordType(void) {
+    MPI_Datatype word;
+    MPI_Type_contiguous(8, MPI_BYTE, &word);
+    MPI_Type_commit(&word);
+    return word;
+}
+
+void saveKDTreeMPI(const char *path, const KDTree *tree, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    IndexShard local;
+    indexShardInit(&local, tree);
+    IndexShard *shards = (IndexShard *)malloc(size * sizeof(IndexShard));
+    MPI_Allgather(&local, sizeof(IndexShard), MPI_BYTE, shards, sizeof(IndexShard), MPI_BYTE, comm);
+
+    IndexFileHeader header;
+    uint64_t file_size = indexFileLayout(&header, shards, size);
+
+    MPI_File fh;
+    if (MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) fprintf(stderr, "%s: cannot create index file\n", path);
+        MPI_Abort(comm, 1);
+    }
+    MPI_File_set_size(fh, (MPI_Offset)file_size);
+
+    if (rank == 0) {
+        MPI_File_write_at(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+        MPI_File_write_at(fh, INDEX_FILE_HEADER_SIZE, shards, size * sizeof(IndexShard), MPI_BYTE,
+                          MPI_STATUS_IGNORE);
+    }
+
+    MPI_Datatype word = wordType();
+    MPI_File_write_at_all(fh, (MPI_Offset)shards[rank].offset, tree->nodes, (int)(local.bytes / 8), word,
+                          MPI_STATUS_IGNORE);
+    MPI_Type_free(&word);
+
+    MPI_File_close(&fh);
+    free(shards);
+}
+
+KDTree *loadKDTreeMPI(const char *path, MPI_Comm comm, int *n) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    MPI_File fh;
+    if (MPI_File_open(comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) fprintf(stderr, "%s: cannot open index file\n", path);
+        MPI_Abort(comm, 1);
+    }
+
+    /* Header e tabella sono piccoli: ogni processo li legge, il master li controlla per tutti */
+    IndexFileHeader header;
+    MPI_Offset file_size;
+    MPI_File_get_size(fh, &file_size);
+    MPI_File_read_at_all(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    int valid = 1;
+    if (rank == 0) {
+        if (file_size < INDEX_FILE_HEADER_SIZE || memcmp(header.magic, INDEX_FILE_MAGIC, 8) != 0) {
+            fprintf(stderr, "%s: not an index file (bad magic)\n", path);
+            valid = 0;
+        } else if (header.version != INDEX_FILE_VERSION) {
+            fprintf(stderr, "%s: unsupported index version %u\n", path, header.version);
+            valid = 0;
+        } else if (header.shards != (uint32_t)size || header.count > INT_MAX) {
+            fprintf(stderr, "%s: index with %u shards and %llu points, run it with %u processes\n", path,
+                    header.shards, (unsigned long long)header.count, header.shards);
+            valid = 0;
+        }
+    }
+    MPI_Bcast(&valid, 1, MPI_INT, 0, comm);
+    if (!valid) {
+        MPI_File_close(&fh);
+        MPI_Abort(comm, 1);
+    }
+
+    IndexShard *shards = (IndexShard *)malloc(size * sizeof(IndexShard));
+    MPI_File_read_at_all(fh, INDEX_FILE_HEADER_SIZE, shards, size * sizeof(IndexShard), MPI_BYTE,
+                         MPI_STATUS_IGNORE);
+    if (rank == 0) {
+        valid = (indexTableCheck(&header, shards, (uint64_t)file_size, path) == 0);
+    }
+    MPI_Bcast(&valid, 1, MPI_INT, 0, comm);
+    if (!valid) {
+        MPI_File_close(&fh);
+        MPI_Abort(comm, 1);
+    }
+
+    /* Lo shard viene letto direttamente dopo la struct, nello stesso blocco di buildKDTree */
+    const IndexShard *own = &shards[rank];
+    char *block = (char *)malloc(sizeof(KDTree) + own->bytes);
+    KDTree *tree = (KDTree *)block;
+    kdTreeLayout(tree, block + sizeof(KDTree), (int)own->count, (int)own->levels);
+
+    MPI_Datatype word = wordType();
+    MPI_File_read_at_all(fh, (MPI_Offset)own->offset, tree->nodes, (int)(own->bytes / 8), word, MPI_STATUS_IGNORE);
+    MPI_Type_free(&word);
+    MPI_File_close(&fh);
+
+    /* Ogni processo verifica il proprio shard, basta un errore per fermare tutti */
+    int ok = (indexChecksum(tree->nodes, own->bytes) == own->checksum), all_ok;
+    if (!ok) fprintf(stderr, "%s: checksum mismatch in shard %d\n", path, rank);
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_LAND, comm);
+    if (!all_ok) MPI_Abort(comm, 1);
+
+    *n = (int)header.count;
+    free(shards);
+    return tree;
+}
@@ -0,0 +1,38 @@
+#ifndef INDEXIO_MPI_H
+#define INDEXIO_MPI_H
+
+#include <mpi.h>
+#include "indexio.h"
+
+/**
+ * @brief Salva in parallelo i KD-Tree locali in un unico file d'indice, uno shard per processo.
+ *
+ * I descrittori degli shard vengono raccolti con MPI_Allgather, così ogni processo calcola da solo
+ * gli offset; il master scrive header e tabella e ogni processo scrive il proprio shard con
+ * un'unica MPI_File_write_at_all. In caso di errore il programma viene terminato con MPI_Abort.
+ *
+ * @param path File da creare (sovrascritto se esiste).
+ * @param tree Albero locale, costruito da buildKDTree.
+ * @param comm Comunicatore, il rank r scrive lo shard r.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void saveKDTreeMPI(const char *path, const KDTree *tree, MPI_Comm comm);
+
+/**
+ * @brief Legge in parallelo un indice salvato da saveKDTreeMPI, lo shard r sul rank r.
+ *
+ * Il file deve avere tanti shard quanti sono i processi. Ogni processo legge il proprio shard con
+ * MPI_File_read_at_all direttamente nel blocco di un KD-Tree e ne verifica il checksum; l'albero
+ * si libera con freeKDTree. In caso di errore il programma viene terminato con MPI_Abort.
+ *
+ * @param path Percorso dell'indice.
+ * @param comm Comunicatore dei processi che leggono.
+ * @param n Numero totale di punti dell'indice.
+ * @return Albero dei punti posseduti dal processo.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+KDTree *loadKDTreeMPI(const char *path, MPI_Comm comm, int *n);
+
+#endif
@@ -5,174 +5,532 @@
 #include <time.h>
 #include <float.h>
 #include <string.h>
+#include <stdint.h>
 #include "util.h"
+#include "vectortree.h"
+#include "partition.h"
+#include "options.h"
+#include "pointio_mpi.h"
+#include "graphio_mpi.h"
+#include "indexio_mpi.h"
+#include "server.h"
+#include "profile_mpi.h"
 
+/* Spostamento massimo di un punto aggiornato, come frazione dell'estensione globale lungo ogni asse */
+#define UPDATE_DISPLACEMENT 0.02
+
+/* Estrazioni per punto: la scelta del punto e uno spostamento per asse (almeno 4, come in 3D) */
+#define UPDATE_STREAMS (KNN_DIM + 1 > 4 ? KNN_DIM + 1 : 4)
+
+/* Valore in [0, 1) associato al punto id e al numero di estrazione stream: gli aggiornamenti dipendono
+   solo dall'original_index, non dal numero di processi */
+static double hashUnit(int id, int stream) {
+    return (splitmixHash((uint64_t)id * UPDATE_STREAMS + stream + 0x9e3779b97f4a7c15ULL) >> 11) * 0x1.0p-53;
+}
+
+/* Sposta una frazione dei punti di al più UPDATE_DISPLACEMENT volte l'estensione globale, restando
+   nel bounding box globale; restituisce il numero di punti locali spostati */
+static int movePoints(Point *points, int n, double fraction, const BoundingBox *boxes, int size,
+                      unsigned char *moved) {
+    double lo[KNN_DIM], hi[KNN_DIM];
+    for (int a = 0; a < KNN_DIM; a++) {
+        lo[a] = DBL_MAX;
+        hi[a] = -DBL_MAX;
+        for (int r = 0; r < size; r++) {
+            if (boxes[r].min[a] < lo[a]) lo[a] = boxes[r].min[a];
+            if (boxes[r].max[a] > hi[a]) hi[a] = boxes[r].max[a];
+        }
+    }
+
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        int id = points[i].original_index;
+        moved[i] = hashUnit(id, 0) < fraction;
+        if (!moved[i]) continue;
+
+        double *coord = points[i].coord;
+        for (int a = 0; a < KNN_DIM; a++) {
+            double c = coord[a] + (2.0 * hashUnit(id, 1 + a) - 1.0) * UPDATE_DISPLACEMENT * (hi[a] - lo[a]);
+            coord[a] = (c < lo[a]) ? lo[a] : (c > hi[a]) ? hi[a] : c;
+        }
+        count++;
+    }
+    return count;
+}
+
+
+/* Dataset con un numero di coordinate diverso da KNN_DIM: ogni processo tiene il proprio blocco di
+   righe come vettori a dimensione runtime (vectors.h) in un VectorTree, e le query girano sull'anello */
+static void vectorKNN(const KNNOptions *opts, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    VectorSet local;
+    int n;
+    profileBegin(PHASE_LOAD);
+    readVectorsMPI(opts->input, comm, &local, &n);
+    profileEnd(PHASE_LOAD);
+
+    if (rank == 0) {
+        printf("Local index: runtime-dimension kdtree (%d coordinates, this build has %d), queries passed around a ring\n",
+               local.dim, KNN_DIM);
+    }
+
+    int k_max = opts->k_max;
+    int *knn_results = (int *)malloc(((size_t)local.n * k_max > 0 ? (size_t)local.n * k_max : 1) * sizeof(int));
+    double *distances = (double *)malloc(((size_t)local.n * k_max > 0 ? (size_t)local.n * k_max : 1) * sizeof(double));
+
+    LoadStats stats;
+    loadStatsInit(&stats);
+    profileBegin(PHASE_SEARCH);
+    double busy_start = MPI_Wtime();
+    vectorTreeRingKNN(&local, n, k_max, opts->threads, comm, knn_results, distances);
+    stats.busy = MPI_Wtime() - busy_start;
+    stats.chunks = 1;
+    stats.items = local.n;
+    profileEnd(PHASE_SEARCH);
+    reportLoadBalance(&stats, comm);
+
+    int *result_index = (int *)malloc((local.n > 0 ? local.n : 1) * sizeof(int));
+    for (int i = 0; i < local.n; i++) {
+        result_index[i] = local.first + i;
+    }
+
+    profileBegin(PHASE_OUTPUT);
+    if (opts->output != NULL) {
+        double write_start = MPI_Wtime();
+        writeGraphMPI(opts->output, n, k_max, local.n, result_index, knn_results, opts->distances ? distances : NULL,
+                      comm);
+        if (rank == 0) {
+            printf("kNN graph (k = %d) written to %s in %.3f s\n", k_max, opts->output, MPI_Wtime() - write_start);
+        }
+    }
+    if (opts->print > 0 && !opts->no_gather) {
+        printGraphSample(n, opts->print, opts->k_values, opts->num_k, k_max, local.n, result_index, knn_results, comm);
+    }
+    profileEnd(PHASE_OUTPUT);
+
+    if (opts->report != NULL) {
+        profileReport(opts->report, "kdtree", "kdtree", n, k_max, opts->threads, comm);
+    }
+
+    free(knn_results);
+    free(distances);
+    free(result_index);
+    vectorSetFree(&local);
+}
 
 int main(int argc, char *argv[]) {
     int rank, size;
-    int n = 1000;
-    int k_min = 5, k_max = 20, k_step = 5;
     
-    MPI_Init(&argc, &argv);
+    /* Solo il thread principale fa chiamate MPI, i thread di ricerca condividono l'albero */
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     
-    if (argc > 1) {
-        n = atoi(argv[1]);
+    KNNOptions opts;
+    parseOptions(argc, argv, &opts);
+    int n = opts.n;
+    profileInit();
+    
+    /* Le opzioni della forza bruta replicata non hanno effetto sul K-d Tree */ 
+    const char *unsupported = unsupportedOption(&opts, OPTIONS_KDTREE);
+    if (unsupported != NULL) {
+        if (rank == 0) fprintf(stderr, "%s is not supported by the k-d tree implementation\n", unsupported);
+        MPI_Finalize();
+        return 1;
     }
     
-    int local_n = n / size;
-    int remainder = n % size;
+    IndexBackend backend;
+    if (parseIndexBackend(opts.backend, &backend) != 0) {
+        if (rank == 0) fprintf(stderr, "Invalid backend: %s\n", opts.backend);
+        MPI_Finalize();
+        return 1;
+    }
     
-    if (rank < remainder) {
-        local_n++;
+    SFCurve curve;
+    if (parseCurve(opts.order, &curve) != 0) {
+        if (rank == 0) fprintf(stderr, "Invalid order: %s\n", opts.order);
+        MPI_Finalize();
+        return 1;
     }
     
-    /* Calcolo dell'indice di inizio di ogni processo */
-    int start_idx = 0;
-    for (int i = 0; i < rank; i++) {
-        start_idx += (i < remainder) ? (n / size + 1) : (n / size);
+    /* Solo il KD-Tree compatto ha un formato su file */ 
+    if ((opts.save_index != NULL || opts.load_index != NULL) && backend != INDEX_KDTREE) {
+        if (rank == 0) fprintf(stderr, "--save-index and --load-index need --backend kdtree\n");
+        MPI_Finalize();
+        return 1;
     }
     
-    MPI_Datatype point_type;
-    MPI_Datatype types[4] = {MPI_DOUBLE, MPI_DOUBLE, MPI_DOUBLE, MPI_INT};
-    int blocklengths[4] = {1, 1, 1, 1};
-    MPI_Aint offsets[4];
+    /* Le ricerche per raggio usano i conteggi dei sotto-alberi del KD-Tree compatto */ 
+    if (opts.radius > 0.0 && (backend != INDEX_KDTREE || opts.serve != NULL)) {
+        if (rank == 0) fprintf(stderr, "--radius needs --backend kdtree and cannot be combined with --serve\n");
+        MPI_Finalize();
+        return 1;
+    }
     
-    offsets[0] = offsetof(Point3D, x);
-    offsets[1] = offsetof(Point3D, y);
-    offsets[2] = offsetof(Point3D, z);
-    offsets[3] = offsetof(Point3D, original_index);
+    /* Con --range-count non ci sono punti trovati da scrivere o stampare */ 
+    if (opts.range_count && (opts.output != NULL || opts.print > 0)) {
+        if (rank == 0) fprintf(stderr, "--output and --print need the points found, not available with --range-count\n");
+        MPI_Finalize();
+        return 1;
+    }
     
-    MPI_Type_create_struct(4, blocklengths, offsets, types, &point_type);
-    MPI_Type_commit(&point_type);
+    if (opts.threads > 1 && provided < MPI_THREAD_FUNNELED) {
+        if (rank == 0) fprintf(stderr, "MPI does not support threads, running with 1 thread per rank\n");
+        opts.threads = 1;
+    }
     
-    /* Generazione parallela dei punti */ 
-    Point3D *local_points = (Point3D *)malloc(local_n * sizeof(Point3D));
-    generatePoints(local_points, local_n, start_idx);
+    /* Un dataset con un numero di coordinate diverso da KNN_DIM si cerca con il VectorTree, che ha solo
+       la ricerca esatta dei k vicini e le metriche senza parametri per asse */ 
+    if (opts.input != NULL && opts.load_index == NULL) {
+        int dims = datasetDimsMPI(opts.input, MPI_COMM_WORLD);
+        if (dims != KNN_DIM) {
+            const char *option = NULL;
+            if (backend != INDEX_KDTREE) option = "--backend";
+            else if (curve != SFC_NONE) option = "--order";
+            else if (opts.eps > 0.0 || opts.max_leaves > 0) option = opts.eps > 0.0 ? "--eps" : "--max-leaves";
+            else if (opts.dual_tree) option = "--dual-tree";
+            else if (opts.updates > 0.0) option = "--updates";
+            else if (opts.save_index != NULL) option = "--save-index";
+            else if (opts.serve != NULL) option = "--serve";
+            else if (opts.radius > 0.0) option = "--radius";
+            if (option != NULL || !VECTOR_METRIC_SUPPORTED) {
+                if (rank == 0) {
+                    if (option != NULL) {
+                        fprintf(stderr, "%s is not supported with %d coordinates per point (this build has %d, rebuild with dim=%d)\n",
+                                option, dims, KNN_DIM, dims);
+                    } else {
+                        fprintf(stderr, "%d coordinates per point need the l2, l1 or linf metric, this build uses %s (or rebuild with dim=%d)\n",
+                                dims, metricName(), dims);
+                    }
+                }
+                MPI_Finalize();
+                return 1;
+            }
+            vectorKNN(&opts, MPI_COMM_WORLD);
+            MPI_Finalize();
+            return 0;
+        }
+    }
     
-    int *recvcounts = NULL;
-    int *displs = NULL;
-    Point3D *all_points = NULL;
+    MPI_Datatype point_type = createPointType();
     
-    if (rank == 0) {
-        recvcounts = (int *)malloc(size * sizeof(int));
-        displs = (int *)malloc(size * sizeof(int));
-        
-        /* Il master riceve il numero di punti generati da ogni processo */ 
-        MPI_Gather(&local_n, 1, MPI_INT, recvcounts, 1, MPI_INT, 0, MPI_COMM_WORLD);
-        
-        /* Organizzazione dei blocchi */ 
-        displs[0] = 0;
-        for (int i = 1; i < size; i++) {
-            displs[i] = displs[i-1] + recvcounts[i-1];
+    Point *local_points;
+    int local_n;
+    SpatialIndex *local_index;
+    
+    /* Con --eps o --max-leaves la ricerca rinuncia all'esattezza in cambio di meno nodi visitati */ 
+    KDSearchParams params;
+    params.eps = opts.eps;
+    params.max_leaves = opts.max_leaves;
+    
+    if (opts.load_index != NULL) {
+        /* Job di sola ricerca: ogni processo legge il proprio shard di un indice già costruito, che
+           contiene anche i suoi punti nell'ordine delle foglie; lettura e partizionamento dei punti
+           e costruzione dell'albero vengono saltati */ 
+        double load_start = MPI_Wtime();
+        profileBegin(PHASE_LOAD);
+        KDTree *tree = loadKDTreeMPI(opts.load_index, MPI_COMM_WORLD, &n);
+        local_n = tree->n;
+        local_points = (Point *)malloc((local_n > 0 ? local_n : 1) * sizeof(Point));
+        for (int i = 0; i < local_n; i++) {
+            for (int d = 0; d < KNN_DIM; d++) {
+                local_points[i].coord[d] = tree->coord[d][i];
+            }
+            local_points[i].original_index = tree->index[i];
         }
+        local_index = spatialIndexFromTree(tree);
+        profileEnd(PHASE_LOAD);
         
-        /* Alloco lo spazio per il dataset intero */ 
-        all_points = (Point3D *)malloc(n * sizeof(Point3D));
+        double load_time = MPI_Wtime() - load_start, max_load_time;
+        MPI_Reduce(&load_time, &max_load_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (rank == 0) {
+            printf("Local index: kdtree, loaded from %s in %.3f s\n", opts.load_index, max_load_time);
+        }
     } else {
-        /* Anche gli altri processi inviano il loro numero di punti, ma non salvano nulla */ 
-        MPI_Gather(&local_n, 1, MPI_INT, NULL, 0, MPI_INT, 0, MPI_COMM_WORLD);
-    }
+        profileBegin(PHASE_LOAD);
+        if (opts.input != NULL) {
+            /* Lettura parallela del dataset: ogni processo legge solo il proprio blocco di righe */ 
+            readPointsMPI(opts.input, MPI_COMM_WORLD, &local_points, &local_n, &n);
+        } else {
+            local_n = n / size;
+            int remainder = n % size;
+        
+            if (rank < remainder) {
+                local_n++;
+            }
+        
+            /* Calcolo dell'indice di inizio di ogni processo */
+            int start_idx = 0;
+            for (int i = 0; i < rank; i++) {
+                start_idx += (i < remainder) ? (n / size + 1) : (n / size);
+            }
+        
+            /* Generazione parallela dei punti: il seme è quello del processo 0, e ogni punto dipende
+               solo dal seme e dal proprio indice, quindi il dataset non cambia con il numero di processi */ 
+            uint64_t seed = generatorSeed(opts.seed);
+            MPI_Bcast(&seed, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+            local_points = (Point *)malloc(local_n * sizeof(Point));
+            generatePoints(local_points, local_n, start_idx, opts.distribution, seed);
+            if (rank == 0) {
+                printf("Generated %d points: %s distribution, seed %llu\n", n, distributionName(opts.distribution),
+                       (unsigned long long)seed);
+            }
+        }
+        profileEnd(PHASE_LOAD);
     
-    /* Tutti i processi quindi inviano i punti generati per formare l'intero dataset */ 
-    MPI_Gatherv(local_points, local_n, point_type, 
-                all_points, recvcounts, displs, point_type, 0, MPI_COMM_WORLD);
+        /* Partizionamento dello spazio: al termine ogni processo possiede i punti di una regione
+           disgiunta e nessuno deve mai tenere in memoria l'intero dataset */ 
+        double partition_start = MPI_Wtime();
+        profileBegin(PHASE_SCATTER);
+        if (curve == SFC_NONE) {
+            partitionPoints(&local_points, NULL, &local_n, point_type, MPI_COMM_WORLD);
+        } else {
+            /* In alternativa ogni processo prende un tratto contiguo della curva, con i punti in quell'ordine:
+               query consecutive sono vicine nello spazio e riusano gli stessi nodi e celle in cache
+               (il KD-Tree riporta poi le query nell'ordine delle sue foglie, che è altrettanto locale) */ 
+            sortPointsByCurve(&local_points, &local_n, curve, point_type, MPI_COMM_WORLD);
+        }
+        profileEnd(PHASE_SCATTER);
+        if (rank == 0) {
+            printf("Decomposition: %s in %.3f s\n", (curve == SFC_NONE) ? "recursive bisection" : curveName(curve),
+                   MPI_Wtime() - partition_start);
+        }
     
-    /* Il master quindi costruisce il KD tree del dataset */  
-    KDNode *global_kdTree = NULL;
-    if (rank == 0) {
-        global_kdTree = buildKDTree(all_points, 0, n, 0);
+        /* Costruzione dell'indice (KD-Tree o griglia) sul sotto-insieme di punti posseduto, una sola volta per tutti i k */ 
+        double build_start = MPI_Wtime();
+        profileBegin(PHASE_BUILD);
+        local_index = buildSpatialIndex(backend, local_points, local_n, opts.threads);
+        profileEnd(PHASE_BUILD);
+        double build_time = MPI_Wtime() - build_start, max_build_time;
+        MPI_Reduce(&build_time, &max_build_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (rank == 0) {
+            printf("Local index: %s, built in %.3f s\n", indexBackendName(backend), max_build_time);
+        }
+        
+        /* A parità di punti il costo della ricerca dei k vicini può cambiare da una regione all'altra:
+           una ricerca pilota su un campione lo misura e, se è sbilanciato, la bisezione viene ripetuta
+           pesando ogni punto con il costo misurato del suo processo */ 
+        if (curve == SFC_NONE && size > 1 && opts.serve == NULL && opts.radius == 0.0) {
+            double balance_start = MPI_Wtime(), imbalance;
+            profileBegin(PHASE_SCATTER);
+            int rebalanced = balancePartition(&local_points, &local_n, &local_index, backend, opts.k_max, opts.threads,
+                                              &params, BALANCE_THRESHOLD, point_type, MPI_COMM_WORLD, &imbalance);
+            profileEnd(PHASE_SCATTER);
+            if (rank == 0) {
+                printf("Measured search cost imbalance: %.3f, %s in %.3f s\n", imbalance,
+                       rebalanced ? "bisection reweighted by cost" : "partition kept", MPI_Wtime() - balance_start);
+            }
+        }
     }
     
-    /* Preparazione per la distribuzione delle porzioni di punti ai processi */ 
-    int *sendcounts = NULL;
-    int *senddispls = NULL;
-    Point3D *local_dataset = NULL;
-    int local_dataset_size;
+    /* Ogni processo rende noto a tutti il bounding box dei punti che possiede, 
+       in modo da inoltrare le query solo dove serve */ 
+    BoundingBox local_box;
+    computeBoundingBox(local_points, local_n, &local_box);
+    BoundingBox *boxes = (BoundingBox *)malloc(size * sizeof(BoundingBox));
+    profileBegin(PHASE_SCATTER);
+    MPI_Allgather(&local_box, 2 * KNN_DIM, MPI_DOUBLE, boxes, 2 * KNN_DIM, MPI_DOUBLE, MPI_COMM_WORLD);
+    profileGather(2 * KNN_DIM, 2 * KNN_DIM * size, MPI_DOUBLE, -1, MPI_COMM_WORLD);
+    profileEnd(PHASE_SCATTER);
     
-    if (rank == 0) {
-        sendcounts = (int *)malloc(size * sizeof(int));
-        senddispls = (int *)malloc(size * sizeof(int));
+    /* Con --updates una frazione dei punti cambia posizione dopo la costruzione: ogni punto spostato
+       passa al processo che possiede la sua nuova regione, poi il KD-Tree e la griglia vengono
+       ricostruiti da zero, mentre l'indice dinamico cancella e reinserisce solo i punti spostati */ 
+    if (opts.updates > 0.0) {
+        unsigned char *moved = (unsigned char *)malloc((local_n > 0 ? local_n : 1) * sizeof(unsigned char));
+        long long local_moved = movePoints(local_points, local_n, opts.updates, boxes, size, moved);
         
-        /* Calcolo della dimensione dei punti locali */ 
-        local_dataset_size = n;
-        int base_size = local_dataset_size / size;
-        int extra = local_dataset_size % size;
+        double update_start = MPI_Wtime();
+        profileBegin(PHASE_UPDATE);
+        DynamicKDTree *dynamic = local_index->dynamic;
+        long long rebuilt_before = (dynamic != NULL) ? dynamic->rebuilt_points : 0;
+        if (dynamic != NULL) {
+            for (int i = 0; i < local_n; i++) {
+                if (moved[i]) dynamicRemove(dynamic, local_points[i].original_index);
+            }
+        }
+        
+        int num_arrived;
+        long long local_migrated = migrateMovedPoints(&local_points, &local_n, moved, boxes, point_type,
+                                                      MPI_COMM_WORLD, &num_arrived);
+        computeBoundingBox(local_points, local_n, &local_box);
+        MPI_Allgather(&local_box, 2 * KNN_DIM, MPI_DOUBLE, boxes, 2 * KNN_DIM, MPI_DOUBLE, MPI_COMM_WORLD);
+        profileGather(2 * KNN_DIM, 2 * KNN_DIM * size, MPI_DOUBLE, -1, MPI_COMM_WORLD);
+        
+        long long local_rebuilt;
+        if (dynamic != NULL) {
+            for (int i = local_n - num_arrived; i < local_n; i++) {
+                dynamicInsert(dynamic, local_points[i]);
+            }
+            local_rebuilt = dynamic->rebuilt_points - rebuilt_before;
+        } else {
+            freeSpatialIndex(local_index);
+            local_index = buildSpatialIndex(backend, local_points, local_n, opts.threads);
+            local_rebuilt = local_n;
+        }
+        profileEnd(PHASE_UPDATE);
+        double update_time = MPI_Wtime() - update_start, max_update_time;
         
-        for (int i = 0; i < size; i++) {
-            /* Se il numero dei punti non è divisibile, un processo ne riceve uno in più */ 
-            sendcounts[i] = base_size + (i < extra ? 1 : 0);
-            senddispls[i] = (i > 0 ? senddispls[i-1] + sendcounts[i-1] : 0);
+        long long local_counts[3] = {local_moved, local_migrated, local_rebuilt}, counts[3];
+        MPI_Reduce(local_counts, counts, 3, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&update_time, &max_update_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (rank == 0) {
+            printf("Updates: %lld points moved, %lld migrated to another rank, applied in %.3f s (%s, %lld points rebuilt)\n",
+                   counts[0], counts[1], max_update_time, (dynamic != NULL) ? "incremental" : "full rebuild", counts[2]);
         }
+        free(moved);
     }
     
-    /* Distribuzione della quantità di punti di cui ogni processo si occupa */ 
-    MPI_Bcast(&local_dataset_size, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    
-    /* Alloco i vari dataset locali di ogni processo */ 
-    local_dataset = (Point3D *)malloc(local_dataset_size * sizeof(Point3D));
+    /* L'indice salvato riflette i punti dopo gli eventuali aggiornamenti */ 
+    if (opts.save_index != NULL) {
+        double save_start = MPI_Wtime();
+        profileBegin(PHASE_OUTPUT);
+        saveKDTreeMPI(opts.save_index, local_index->tree, MPI_COMM_WORLD);
+        profileEnd(PHASE_OUTPUT);
+        if (rank == 0) {
+            printf("Index saved to %s in %.3f s\n", opts.save_index, MPI_Wtime() - save_start);
+        }
+    }
     
-    if (rank == 0) {
-        /* Il master invia ai processi le porzioni di punti */ 
-        MPI_Scatterv(all_points, sendcounts, senddispls, point_type,
-                     local_dataset, local_dataset_size, point_type, 
-                     0, MPI_COMM_WORLD);
-    } else {
-        /* I processi ricevono i punti */ 
-        MPI_Scatterv(NULL, NULL, NULL, point_type,
-                     local_dataset, local_dataset_size, point_type, 
-                     0, MPI_COMM_WORLD);
+    /* Ricerca dei KNN: le query sono i punti posseduti, inoltrate se necessario agli altri processi */ 
+    if (rank == 0 && !kdSearchIsExact(&params)) {
+        printf("Approximate search: eps = %g, max leaves per query = %d\n", params.eps, params.max_leaves);
     }
     
-    /* Come prima, i KNN vengono calcolati da 5 a 20, con uno step di 5 */ 
-    for (int k = k_min; k <= k_max; k += k_step) {
-        /* Alloco la memoria per i risultati */ 
-        int **knn_results = (int **)malloc(local_n * sizeof(int *));
-        double **distances = (double **)malloc(local_n * sizeof(double *));
+    /* Con --serve i processi restano attivi con l'indice costruito (o caricato) e rispondono ai batch
+       di query inviati dai client sul socket, invece di cercare i vicini di tutti i punti */ 
+    if (opts.serve != NULL) {
+        profileBegin(PHASE_SEARCH);
+        serveQueries(opts.serve, local_index, boxes, opts.threads, &params, point_type, MPI_COMM_WORLD);
+        profileEnd(PHASE_SEARCH);
+    } else if (opts.radius > 0.0) {
+        /* Con --radius ogni punto cerca tutti i punti entro la distanza data, in un CSR senza
+           allocazioni per query; con --range-count ne conta soltanto il numero */ 
+        int *counts = (int *)malloc((local_n > 0 ? local_n : 1) * sizeof(int));
+        RangeCSR result;
+        double search_start = MPI_Wtime();
+        profileBegin(PHASE_SEARCH);
+        if (opts.range_count) {
+            distributedRangeCount(local_index->tree, local_points, local_n, opts.radius, opts.max_count, opts.threads,
+                                  boxes, point_type, MPI_COMM_WORLD, counts);
+        } else {
+            distributedRadiusSearch(local_index->tree, local_points, local_n, opts.radius, opts.threads, boxes,
+                                    point_type, MPI_COMM_WORLD, &result);
+            for (int i = 0; i < local_n; i++) {
+                counts[i] = (int)(result.offsets[i + 1] - result.offsets[i]);
+            }
+        }
+        profileEnd(PHASE_SEARCH);
+        double search_time = MPI_Wtime() - search_start, max_search_time;
         
+        long long local_pairs = 0, pairs;
+        int local_max = 0, max_per_point;
         for (int i = 0; i < local_n; i++) {
-            knn_results[i] = (int *)malloc(k * sizeof(int));
-            distances[i] = (double *)malloc(k * sizeof(double));
+            local_pairs += counts[i];
+            if (counts[i] > local_max) local_max = counts[i];
         }
+        MPI_Reduce(&local_pairs, &pairs, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&local_max, &max_per_point, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&search_time, &max_search_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (rank == 0) {
+            printf("%s (r = %g", opts.range_count ? "Range count" : "Radius search", opts.radius);
+            if (opts.range_count && opts.max_count > 0) printf(", max count %d", opts.max_count);
+            printf("): %lld pairs, %.2f per point (max %d), in %.3f s\n", pairs, (double)pairs / n, max_per_point,
+                   max_search_time);
+        }
+        free(counts);
         
-        /* Costruzione dei KD-Tree locali */ 
-        KDNode *local_kdTree = buildKDTree(local_dataset, 0, local_dataset_size, 0);
-        
-        /* Ricerca dei KNN */ 
-        for (int i = 0; i < local_n; i++) {
-            findKNearestNeighbors(local_kdTree, local_points[i], k, knn_results[i], distances[i]);
-            /* Print dei risultati */ 
-            printf("Point %d nearest neighbors: ", local_points[i].original_index);
-            for (int j = 0; j < k; j++) {
-                printf("%d ", knn_results[i][j]);
+        /* Come per il grafo dei k vicini, ogni processo scrive le proprie righe del CSR nel file */ 
+        if (!opts.range_count) {
+            int *result_index = (int *)malloc((local_n > 0 ? local_n : 1) * sizeof(int));
+            for (int i = 0; i < local_n; i++) {
+                result_index[i] = local_points[i].original_index;
+            }
+            
+            profileBegin(PHASE_OUTPUT);
+            if (opts.output != NULL) {
+                double write_start = MPI_Wtime();
+                writeRangeGraphMPI(opts.output, n, local_n, result_index, result.offsets, result.indices,
+                                   opts.distances ? result.distances : NULL, MPI_COMM_WORLD);
+                if (rank == 0) {
+                    printf("Radius graph written to %s in %.3f s\n", opts.output, MPI_Wtime() - write_start);
+                }
             }
-            printf("\n");
+            if (opts.print > 0 && !opts.no_gather) {
+                printRangeSample(n, opts.print, local_n, result_index, result.offsets, result.indices, MPI_COMM_WORLD);
+            }
+            profileEnd(PHASE_OUTPUT);
+            
+            free(result_index);
+            freeRangeCSR(&result);
+        }
+    } else {
+        /* La ricerca viene fatta una sola volta con il k massimo: i vicini sono ordinati per distanza,
+           quindi quelli di ogni k richiesto sono un prefisso della riga */ 
+        int k_max = opts.k_max;
+        int *knn_results = (int *)malloc((size_t)local_n * k_max * sizeof(int));
+        double *distances = (double *)malloc((size_t)local_n * k_max * sizeof(double));
+        
+        /* Con --dual-tree la ricerca locale esatta scende insieme nell'albero delle query e in quello dei punti,
+           che sono lo stesso KD-Tree: le query locali sono proprio i punti nell'ordine delle foglie */ 
+        int dual_tree = opts.dual_tree && backend == INDEX_KDTREE && kdSearchIsExact(&params);
+        if (rank == 0 && opts.dual_tree) {
+            printf("Local self-join: %s\n", dual_tree ? "dual-tree traversal" : "single-tree search (needs --backend kdtree and an exact search)");
         }
         
-        /* Ennesimo clean up */ 
-        freeKDTree(local_kdTree);
+        LoadStats stats;
+        loadStatsInit(&stats);
+        profileBegin(PHASE_SEARCH);
+        distributedKNN(local_index, local_points, local_n, k_max, opts.threads, &params, dual_tree, boxes, point_type,
+                       MPI_COMM_WORLD, knn_results, distances, &stats);
+        profileEnd(PHASE_SEARCH);
+        
+        /* Con dati non uniformi le query inoltrate non sono equilibrate: tempi e query risolte di ogni processo */ 
+        reportLoadBalance(&stats, MPI_COMM_WORLD);
         
+        /* original_index delle query locali: dopo il partizionamento le righe sono sparse tra i processi */ 
+        int *result_index = (int *)malloc((local_n > 0 ? local_n : 1) * sizeof(int));
         for (int i = 0; i < local_n; i++) {
-            free(knn_results[i]);
-            free(distances[i]);
+            result_index[i] = local_points[i].original_index;
         }
+        
+        /* Ogni processo scrive le proprie righe del grafo alla loro posizione nel file */ 
+        profileBegin(PHASE_OUTPUT);
+        if (opts.output != NULL) {
+            double write_start = MPI_Wtime();
+            writeGraphMPI(opts.output, n, k_max, local_n, result_index, knn_results,
+                          opts.distances ? distances : NULL, MPI_COMM_WORLD);
+            if (rank == 0) {
+                printf("kNN graph (k = %d) written to %s in %.3f s\n", k_max, opts.output, MPI_Wtime() - write_start);
+            }
+        }
+        
+        /* Stampa testuale di debug, in ordine di indice: solo i primi punti arrivano al master */ 
+        if (opts.print > 0 && !opts.no_gather) {
+            printGraphSample(n, opts.print, opts.k_values, opts.num_k, k_max, local_n, result_index, knn_results,
+                             MPI_COMM_WORLD);
+        }
+        profileEnd(PHASE_OUTPUT);
+        
         free(knn_results);
         free(distances);
+        free(result_index);
     }
     
+    /* Tempi delle fasi e contatori di tutti i processi, ridotti su min/media/max */ 
+    if (opts.report != NULL) {
+        profileReport(opts.report, "kdtree", indexBackendName(backend), n, opts.k_max, opts.threads, MPI_COMM_WORLD);
+    }
+    
+    /* Ennesimo clean up */ 
+    freeSpatialIndex(local_index);
+    
     /* Giga enormico clean up */
-    free(local_dataset);
     free(local_points);
-    
-    if (rank == 0) {
-        freeKDTree(global_kdTree);
-        free(all_points);
-        free(recvcounts);
-        free(displs);
-        free(sendcounts);
-        free(senddispls);
-    }
+    free(boxes);
     
     MPI_Type_free(&point_type);
     MPI_Finalize();
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "util.h"
+#include "options.h"
+#include "pointio.h"
+#include "graphio.h"
+#include "serveproto.h"
+
+/* Query per richiesta: tante richieste piccole, che il server raccoglie in micro-batch */
+#define CLIENT_REQUEST_POINTS 64
+
+/* Query di prova con cui si controlla che il server abbia gli stessi punti del client */
+#define CLIENT_PROBE_POINTS 16
+
+/* Blocco di query inviato da una connessione */
+typedef struct {
+    const char *path;
+    const Point *points;
+    int begin, end;
+    int k;
+    int self_ids;   /* Le query sono punti del server: il loro id li esclude dai propri vicini */
+    int *neighbors;
+    double *distances;
+    int requests;
+    int failed;
+} ClientTask;
+
+static double elapsed(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static int connectServer(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Controlla che alcune query sparse nel dataset siano sul server con lo stesso id: cercate come punti
+   esterni, il loro vicino più vicino dev'essere il punto stesso a distanza 0. Altrimenti il server ha
+   un altro dataset (un altro seme o file) e gli id escluderebbero punti estranei */
+static int sameDataset(const char *path, const Point *points, int n) {
+    int count = (n < CLIENT_PROBE_POINTS) ? n : CLIENT_PROBE_POINTS;
+    if (count == 0) return 1;
+    int fd = connectServer(path);
+    if (fd < 0) return 0;
+
+    ServeRequestHeader header;
+    memcpy(header.magic, SERVE_REQUEST_MAGIC, 4);
+    header.flags = 0;
+    header.k = 1;
+    header.count = (uint32_t)count;
+
+    char *payload = (char *)malloc(serveRequestPayload(count));
+    double *coords = (double *)payload;
+    int32_t *ids = (int32_t *)(coords + KNN_DIM * (size_t)count);
+    const Point *probe[CLIENT_PROBE_POINTS];
+    for (int i = 0; i < count; i++) {
+        probe[i] = &points[(long long)n * i / count];
+        memcpy(&coords[KNN_DIM * (size_t)i], probe[i]->coord, KNN_DIM * sizeof(double));
+        ids[i] = -1;
+    }
+
+    ServeReplyHeader reply;
+    int32_t reply_idx[CLIENT_PROBE_POINTS];
+    double reply_dist[CLIENT_PROBE_POINTS];
+    int same = writeFull(fd, &header, sizeof(header)) == 0 &&
+               writeFull(fd, payload, serveRequestPayload(count)) == 0 &&
+               readFull(fd, &reply, sizeof(reply)) == 0 && reply.status == 0 && reply.count == (uint32_t)count &&
+               readFull(fd, reply_idx, count * sizeof(int32_t)) == 0 &&
+               readFull(fd, reply_dist, count * sizeof(double)) == 0;
+    for (int i = 0; same && i < count; i++) {
+        same = reply_idx[i] == probe[i]->original_index && reply_dist[i] == 0.0;
+    }
+
+    free(payload);
+    close(fd);
+    return same;
+}
+
+/* Ogni connessione invia le sue richieste una alla volta, aspettando la risposta */
+static void *clientThread(void *arg) {
+    ClientTask *task = (ClientTask *)arg;
+    int fd = connectServer(task->path);
+    if (fd < 0) {
+        task->failed = 1;
+        return NULL;
+    }
+
+    char *payload = (char *)malloc(serveRequestPayload(CLIENT_REQUEST_POINTS));
+    int32_t *reply_idx = (int32_t *)malloc((size_t)CLIENT_REQUEST_POINTS * task->k * sizeof(int32_t));
+    for (int first = task->begin; first < task->end && !task->failed; first += CLIENT_REQUEST_POINTS) {
+        int count = (task->end - first < CLIENT_REQUEST_POINTS) ? task->end - first : CLIENT_REQUEST_POINTS;
+
+        ServeRequestHeader header;
+        memcpy(header.magic, SERVE_REQUEST_MAGIC, 4);
+        header.flags = 0;
+        header.k = (uint32_t)task->k;
+        header.count = (uint32_t)count;
+
+        /* Solo le query che sono punti del server si escludono con il loro id, le altre sono esterne */
+        double *coords = (double *)payload;
+        int32_t *ids = (int32_t *)(coords + KNN_DIM * (size_t)count);
+        for (int i = 0; i < count; i++) {
+            memcpy(&coords[KNN_DIM * (size_t)i], task->points[first + i].coord, KNN_DIM * sizeof(double));
+            ids[i] = task->self_ids ? task->points[first + i].original_index : -1;
+        }
+
+        ServeReplyHeader reply;
+        if (writeFull(fd, &header, sizeof(header)) != 0 ||
+            writeFull(fd, payload, serveRequestPayload(count)) != 0 ||
+            readFull(fd, &reply, sizeof(reply)) != 0 || reply.status != 0 || reply.count != (uint32_t)count ||
+            readFull(fd, reply_idx, (size_t)count * task->k * sizeof(int32_t)) != 0 ||
+            readFull(fd, &task->distances[(size_t)first * task->k], (size_t)count * task->k * sizeof(double)) != 0) {
+            task->failed = 1;
+            break;
+        }
+        for (size_t j = 0; j < (size_t)count * task->k; j++) {
+            task->neighbors[(size_t)first * task->k + j] = reply_idx[j];
+        }
+        task->requests++;
+    }
+
+    free(payload);
+    free(reply_idx);
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    KNNOptions opts;
+    parseOptions(argc, argv, &opts);
+    if (opts.serve == NULL) {
+        fprintf(stderr, "The socket of the server is needed: --serve PATH\n");
+        return 1;
+    }
+    int n = opts.n;
+    int k = opts.k_max;
+
+    /* Le query sono i punti di un dataset o punti generati, con la riga come id */
+    Point *points;
+    if (opts.input != NULL) {
+        PointFile file;
+        if (pointFileOpen(opts.input, &file) != 0) return 1;
+        if (file.header.count > INT_MAX) {
+            fprintf(stderr, "%s: too many points (%llu)\n", opts.input, (unsigned long long)file.header.count);
+            pointFileClose(&file);
+            return 1;
+        }
+        n = (int)file.header.count;
+        points = (Point *)malloc(n * sizeof(Point));
+        pointFileRead(&file, 0, n, points);
+        pointFileClose(&file);
+    } else {
+        uint64_t seed = generatorSeed(opts.seed);
+        points = (Point *)malloc(n * sizeof(Point));
+        generatePoints(points, n, 0, opts.distribution, seed);
+        printf("Generated %d points: %s distribution, seed %llu\n", n, distributionName(opts.distribution),
+               (unsigned long long)seed);
+    }
+
+    /* Se il server ha gli stessi punti ogni query esclude sé stessa, altrimenti sono tutte punti esterni */
+    int self_ids = sameDataset(opts.serve, points, n);
+    if (!self_ids) {
+        printf("The server holds other points (another seed or file): the queries are sent as external points\n");
+    }
+
+    int *neighbors = (int *)malloc((size_t)n * k * sizeof(int));
+    double *distances = (double *)malloc((size_t)n * k * sizeof(double));
+
+    /* Una connessione per thread, ognuna con un blocco contiguo di query */
+    int connections = opts.threads;
+    pthread_t *threads = (pthread_t *)malloc(connections * sizeof(pthread_t));
+    ClientTask *tasks = (ClientTask *)calloc(connections, sizeof(ClientTask));
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < connections; t++) {
+        tasks[t].path = opts.serve;
+        tasks[t].points = points;
+        tasks[t].begin = (int)((long long)n * t / connections);
+        tasks[t].end = (int)((long long)n * (t + 1) / connections);
+        tasks[t].k = k;
+        tasks[t].self_ids = self_ids;
+        tasks[t].neighbors = neighbors;
+        tasks[t].distances = distances;
+        pthread_create(&threads[t], NULL, clientThread, &tasks[t]);
+    }
+
+    int requests = 0, failed = 0;
+    for (int t = 0; t < connections; t++) {
+        pthread_join(threads[t], NULL);
+        requests += tasks[t].requests;
+        failed |= tasks[t].failed;
+    }
+    double total = elapsed(&start);
+
+    if (failed) {
+        fprintf(stderr, "%s: some requests failed\n", opts.serve);
+    } else {
+        printf("Sent %d queries in %d requests over %d connections in %.3f s (%.0f queries/s)\n",
+               n, requests, connections, total, n / total);
+        if (opts.output != NULL && writeGraph(opts.output, n, k, neighbors, opts.distances ? distances : NULL) == 0) {
+            printf("kNN graph (k = %d) written to %s\n", k, opts.output);
+        }
+    }
+
+    /* Richiesta di arresto: il server risponde quando ha terminato le richieste in coda */
+    if (opts.shutdown) {
+        int fd = connectServer(opts.serve);
+        if (fd >= 0) {
+            ServeRequestHeader header;
+            ServeReplyHeader reply;
+            memcpy(header.magic, SERVE_REQUEST_MAGIC, 4);
+            header.flags = SERVE_SHUTDOWN;
+            header.k = 0;
+            header.count = 0;
+            if (writeFull(fd, &header, sizeof(header)) == 0 && readFull(fd, &reply, sizeof(reply)) == 0) {
+                printf("Server stopped\n");
+            }
+            close(fd);
+        }
+    }
+
+    free(threads);
+    free(tasks);
+    free(neighbors);
+    free(distances);
+    free(points);
+    return failed;
+}
@@ -0,0 +1,889 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <limits.h>
+#include <mpi.h>
+#include "util.h"
+#include "partition.h"
+#include "scheduler.h"
+#include "arena.h"
+#include "profile.h"
+#include "profile_mpi.h"
+
+/* Numero massimo di passi di bisezione per trovare il valore di split */
+#define MAX_SPLIT_ITERATIONS 64
+
+/* Campioni per processo con cui il sample sort sceglie gli splitter */
+#define SAMPLE_SORT_OVERSAMPLING 32
+
+/* La ricerca pilota di balancePartition usa un punto locale ogni BALANCE_SAMPLE_STRIDE */
+#define BALANCE_SAMPLE_STRIDE 16
+
+static double getCoord(const Point *p, int axis) {
+    return p->coord[axis];
+}
+
+void computeBoundingBox(const Point *points, int n, BoundingBox *box) {
+    for (int a = 0; a < KNN_DIM; a++) {
+        box->min[a] = DBL_MAX;
+        box->max[a] = -DBL_MAX;
+    }
+    for (int i = 0; i < n; i++) {
+        for (int a = 0; a < KNN_DIM; a++) {
+            double c = getCoord(&points[i], a);
+            if (c < box->min[a]) box->min[a] = c;
+            if (c > box->max[a]) box->max[a] = c;
+        }
+    }
+}
+
+double boxDistance(const BoundingBox *box, Point target) {
+    if (box->min[0] > box->max[0]) return DBL_MAX;
+
+    double sum = 0.0;
+    for (int a = 0; a < KNN_DIM; a++) {
+        double c = getCoord(&target, a);
+        sum = metricAddGap(sum, metricIntervalGap(c, c, box->min[a], box->max[a], a), a);
+    }
+    return metricFinish(sum);
+}
+
+/* Cerca il valore di split in modo che i punti del gruppo con coordinata minore pesino circa `target`
+   (senza pesi ogni punto vale 1, quindi le somme sono conteggi esatti) */
+static double findSplitValue(const Point *points, const double *weights, int n, int axis, double lo, double hi,
+                             double target, MPI_Comm comm) {
+    double split = hi;
+    for (int iter = 0; iter < MAX_SPLIT_ITERATIONS; iter++) {
+        double mid = lo + (hi - lo) / 2.0;
+        if (mid <= lo || mid >= hi) break;
+
+        double local_count = 0.0, count = 0.0;
+        for (int i = 0; i < n; i++) {
+            if (getCoord(&points[i], axis) < mid) local_count += (weights != NULL) ? weights[i] : 1.0;
+        }
+        MPI_Allreduce(&local_count, &count, 1, MPI_DOUBLE, MPI_SUM, comm);
+
+        if (count == target) return mid;
+        if (count < target) {
+            lo = mid;
+        } else {
+            hi = mid;
+            split = mid;
+        }
+    }
+    return split;
+}
+
+/* Suddivide `count` punti in `parts` blocchi quasi uguali, ruotando il resto in base al rank */
+static void splitEvenly(int count, int parts, int rank, int *sendcounts) {
+    int base = count / parts;
+    int extra = count % parts;
+    for (int j = 0; j < parts; j++) {
+        sendcounts[j] = base + (((j - rank % parts + parts) % parts) < extra ? 1 : 0);
+    }
+}
+
+void partitionPoints(Point **points, double **weights, int *n, MPI_Datatype point_type, MPI_Comm comm) {
+    MPI_Comm current;
+    MPI_Comm_dup(comm, &current);
+
+    int size, rank;
+    MPI_Comm_size(current, &size);
+
+    while (size > 1) {
+        MPI_Comm_rank(current, &rank);
+
+        /* Bounding box globale del gruppo: i massimi vengono negati per usare una sola riduzione */
+        BoundingBox box;
+        computeBoundingBox(*points, *n, &box);
+        double local_ext[2 * KNN_DIM], global_ext[2 * KNN_DIM];
+        for (int a = 0; a < KNN_DIM; a++) {
+            local_ext[a] = box.min[a];
+            local_ext[KNN_DIM + a] = -box.max[a];
+        }
+        MPI_Allreduce(local_ext, global_ext, 2 * KNN_DIM, MPI_DOUBLE, MPI_MIN, current);
+
+        double local_total = 0.0, total = 0.0;
+        for (int i = 0; i < *n; i++) {
+            local_total += (weights != NULL) ? (*weights)[i] : 1.0;
+        }
+        MPI_Allreduce(&local_total, &total, 1, MPI_DOUBLE, MPI_SUM, current);
+
+        /* Divido lungo l'asse con l'estensione maggiore */
+        int axis = 0;
+        double best_extent = -1.0;
+        for (int a = 0; a < KNN_DIM; a++) {
+            double extent = -global_ext[KNN_DIM + a] - global_ext[a];
+            if (extent > best_extent) {
+                best_extent = extent;
+                axis = a;
+            }
+        }
+
+        int left_ranks = size / 2;
+        double target = (weights != NULL) ? total * left_ranks / size : floor(total * left_ranks / size);
+        double *wts = (weights != NULL) ? *weights : NULL;
+        double split = (total > 0)
+            ? findSplitValue(*points, wts, *n, axis, global_ext[axis], -global_ext[KNN_DIM + axis], target, current)
+            : 0.0;
+
+        /* Riordino i punti locali: prima quelli a sinistra dello split, poi quelli a destra */
+        Point *pts = *points;
+        int nleft = 0;
+        for (int i = 0; i < *n; i++) {
+            if (getCoord(&pts[i], axis) < split) {
+                Point tmp = pts[i];
+                pts[i] = pts[nleft];
+                pts[nleft] = tmp;
+                if (wts != NULL) {
+                    double w = wts[i];
+                    wts[i] = wts[nleft];
+                    wts[nleft] = w;
+                }
+                nleft++;
+            }
+        }
+
+        /* I punti di sinistra vanno distribuiti sui primi left_ranks processi, gli altri sul resto */
+        int *sendcounts = (int *)malloc(size * sizeof(int));
+        int *recvcounts = (int *)malloc(size * sizeof(int));
+        int *sdispls = (int *)malloc(size * sizeof(int));
+        int *rdispls = (int *)malloc(size * sizeof(int));
+
+        splitEvenly(nleft, left_ranks, rank, sendcounts);
+        splitEvenly(*n - nleft, size - left_ranks, rank, sendcounts + left_ranks);
+
+        MPI_Alltoall(sendcounts, 1, MPI_INT, recvcounts, 1, MPI_INT, current);
+
+        int new_n = 0;
+        for (int j = 0; j < size; j++) {
+            sdispls[j] = (j > 0) ? sdispls[j-1] + sendcounts[j-1] : 0;
+            rdispls[j] = new_n;
+            new_n += recvcounts[j];
+        }
+
+        Point *received = (Point *)malloc((new_n > 0 ? new_n : 1) * sizeof(Point));
+        MPI_Alltoallv(pts, sendcounts, sdispls, point_type,
+                      received, recvcounts, rdispls, point_type, current);
+        profileExchange(sendcounts, recvcounts, point_type, current);
+
+        /* I pesi seguono i propri punti, con gli stessi conteggi */
+        if (wts != NULL) {
+            double *received_weights = (double *)malloc((new_n > 0 ? new_n : 1) * sizeof(double));
+            MPI_Alltoallv(wts, sendcounts, sdispls, MPI_DOUBLE,
+                          received_weights, recvcounts, rdispls, MPI_DOUBLE, current);
+            profileExchange(sendcounts, recvcounts, MPI_DOUBLE, current);
+            free(wts);
+            *weights = received_weights;
+        }
+
+        free(pts);
+        *points = received;
+        *n = new_n;
+
+        free(sendcounts);
+        free(recvcounts);
+        free(sdispls);
+        free(rdispls);
+
+        /* Ogni metà prosegue la partizione in modo indipendente */
+        MPI_Comm next;
+        MPI_Comm_split(current, rank < left_ranks ? 0 : 1, rank, &next);
+        MPI_Comm_free(&current);
+        current = next;
+        MPI_Comm_size(current, &size);
+    }
+
+    MPI_Comm_free(&current);
+}
+
+static int compareKeys(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+void sortPointsByCurve(Point **points, int *n, SFCurve curve, MPI_Datatype point_type, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    /* Bounding box globale: i massimi vengono negati per usare una sola riduzione */
+    BoundingBox box;
+    computeBoundingBox(*points, *n, &box);
+    double local_ext[2 * KNN_DIM], global_ext[2 * KNN_DIM];
+    for (int a = 0; a < KNN_DIM; a++) {
+        local_ext[a] = box.min[a];
+        local_ext[KNN_DIM + a] = -box.max[a];
+    }
+    MPI_Allreduce(local_ext, global_ext, 2 * KNN_DIM, MPI_DOUBLE, MPI_MIN, comm);
+    double min[KNN_DIM], max[KNN_DIM];
+    for (int a = 0; a < KNN_DIM; a++) {
+        min[a] = global_ext[a];
+        max[a] = -global_ext[KNN_DIM + a];
+    }
+
+    uint64_t *keys = (uint64_t *)malloc((*n > 0 ? *n : 1) * sizeof(uint64_t));
+    computeCurveKeys(curve, *points, *n, min, max, keys);
+    radixSortPoints(keys, *points, *n);
+
+    if (size == 1) {
+        free(keys);
+        return;
+    }
+
+    /* Campioni regolari delle chiavi locali già ordinate */
+    int num_samples = (*n < SAMPLE_SORT_OVERSAMPLING) ? *n : SAMPLE_SORT_OVERSAMPLING;
+    uint64_t samples[SAMPLE_SORT_OVERSAMPLING];
+    for (int s = 0; s < num_samples; s++) {
+        samples[s] = keys[(long long)(2 * s + 1) * *n / (2 * num_samples)];
+    }
+
+    int *sample_counts = (int *)malloc(size * sizeof(int));
+    int *sample_displs = (int *)malloc(size * sizeof(int));
+    MPI_Allgather(&num_samples, 1, MPI_INT, sample_counts, 1, MPI_INT, comm);
+    int total_samples = 0;
+    for (int r = 0; r < size; r++) {
+        sample_displs[r] = total_samples;
+        total_samples += sample_counts[r];
+    }
+
+    uint64_t *all_samples = (uint64_t *)malloc((total_samples > 0 ? total_samples : 1) * sizeof(uint64_t));
+    MPI_Allgatherv(samples, num_samples, MPI_UINT64_T, all_samples, sample_counts, sample_displs, MPI_UINT64_T,
+                   comm);
+    profileGather(num_samples, total_samples, MPI_UINT64_T, -1, comm);
+    qsort(all_samples, total_samples, sizeof(uint64_t), compareKeys);
+
+    /* Il processo r riceve le chiavi in [splitter r - 1, splitter r) */
+    int *sendcounts = (int *)calloc(size, sizeof(int));
+    int *recvcounts = (int *)malloc(size * sizeof(int));
+    int *sdispls = (int *)malloc(size * sizeof(int));
+    int *rdispls = (int *)malloc(size * sizeof(int));
+
+    int begin = 0;
+    for (int r = 0; r < size; r++) {
+        int end = *n;
+        if (r < size - 1 && total_samples > 0) {
+            uint64_t splitter = all_samples[(long long)(r + 1) * total_samples / size];
+            int lo = begin, hi = *n;
+            while (lo < hi) {
+                int mid = lo + (hi - lo) / 2;
+                if (keys[mid] < splitter) lo = mid + 1;
+                else hi = mid;
+            }
+            end = lo;
+        }
+        sendcounts[r] = end - begin;
+        begin = end;
+    }
+
+    MPI_Alltoall(sendcounts, 1, MPI_INT, recvcounts, 1, MPI_INT, comm);
+
+    int new_n = 0;
+    for (int r = 0; r < size; r++) {
+        sdispls[r] = (r > 0) ? sdispls[r - 1] + sendcounts[r - 1] : 0;
+        rdispls[r] = new_n;
+        new_n += recvcounts[r];
+    }
+
+    Point *received = (Point *)malloc((new_n > 0 ? new_n : 1) * sizeof(Point));
+    uint64_t *received_keys = (uint64_t *)malloc((new_n > 0 ? new_n : 1) * sizeof(uint64_t));
+    MPI_Alltoallv(*points, sendcounts, sdispls, point_type, received, recvcounts, rdispls, point_type, comm);
+    profileExchange(sendcounts, recvcounts, point_type, comm);
+    MPI_Alltoallv(keys, sendcounts, sdispls, MPI_UINT64_T, received_keys, recvcounts, rdispls, MPI_UINT64_T, comm);
+    profileExchange(sendcounts, recvcounts, MPI_UINT64_T, comm);
+
+    /* Arrivano size tratti già ordinati: li riordino insieme con un'altra passata di radix sort */
+    radixSortPoints(received_keys, received, new_n);
+
+    free(*points);
+    *points = received;
+    *n = new_n;
+
+    free(received_keys);
+    free(keys);
+    free(all_samples);
+    free(sample_counts);
+    free(sample_displs);
+    free(sendcounts);
+    free(recvcounts);
+    free(sdispls);
+    free(rdispls);
+}
+
+int boxOwner(const BoundingBox *boxes, int size, Point p) {
+    int best = 0;
+    double best_dist = DBL_MAX;
+    for (int r = 0; r < size; r++) {
+        double d = boxDistance(&boxes[r], p);
+        if (d == 0.0) return r;
+        if (d < best_dist) {
+            best_dist = d;
+            best = r;
+        }
+    }
+    return best;
+}
+
+/* Un punto spostato resta sul processo corrente se è ancora nel suo box */
+static int ownerOf(const BoundingBox *boxes, int size, int rank, Point p) {
+    if (boxDistance(&boxes[rank], p) == 0.0) return rank;
+    return boxOwner(boxes, size, p);
+}
+
+int migrateMovedPoints(Point **points, int *n, const unsigned char *moved, const BoundingBox *boxes,
+                       MPI_Datatype point_type, MPI_Comm comm, int *num_arrived) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    int *sendcounts = (int *)calloc(size, sizeof(int));
+    int *recvcounts = (int *)malloc(size * sizeof(int));
+    int *sdispls = (int *)malloc(size * sizeof(int));
+    int *rdispls = (int *)malloc(size * sizeof(int));
+
+    /* Solo i punti spostati vengono scambiati (anche con sé stessi), gli altri restano dove sono */
+    Point *pts = *points;
+    int *owner = (int *)malloc((*n > 0 ? *n : 1) * sizeof(int));
+    int kept = 0, migrated = 0;
+    for (int i = 0; i < *n; i++) {
+        if (!moved[i]) {
+            kept++;
+            continue;
+        }
+        owner[i] = ownerOf(boxes, size, rank, pts[i]);
+        sendcounts[owner[i]]++;
+        if (owner[i] != rank) migrated++;
+    }
+
+    MPI_Alltoall(sendcounts, 1, MPI_INT, recvcounts, 1, MPI_INT, comm);
+
+    int total_send = 0, total_recv = 0;
+    for (int r = 0; r < size; r++) {
+        sdispls[r] = total_send;
+        rdispls[r] = total_recv;
+        total_send += sendcounts[r];
+        total_recv += recvcounts[r];
+    }
+
+    Point *send = (Point *)malloc((total_send > 0 ? total_send : 1) * sizeof(Point));
+    int *fill = (int *)malloc(size * sizeof(int));
+    memcpy(fill, sdispls, size * sizeof(int));
+    for (int i = 0; i < *n; i++) {
+        if (moved[i]) send[fill[owner[i]]++] = pts[i];
+    }
+
+    /* Nuovo array: prima i punti rimasti fermi, in coda quelli arrivati */
+    int new_n = kept + total_recv;
+    Point *result = (Point *)malloc((new_n > 0 ? new_n : 1) * sizeof(Point));
+    kept = 0;
+    for (int i = 0; i < *n; i++) {
+        if (!moved[i]) result[kept++] = pts[i];
+    }
+    MPI_Alltoallv(send, sendcounts, sdispls, point_type,
+                  result + kept, recvcounts, rdispls, point_type, comm);
+    profileExchange(sendcounts, recvcounts, point_type, comm);
+
+    free(pts);
+    *points = result;
+    *n = new_n;
+    *num_arrived = total_recv;
+
+    free(send);
+    free(fill);
+    free(owner);
+    free(sendcounts);
+    free(recvcounts);
+    free(sdispls);
+    free(rdispls);
+    return migrated;
+}
+
+/* Fonde due liste ordinate di k vicini mantenendo le k più vicine in (idx, dist), nell'ordine per
+   distanza e indice dei contenitori: i pareggi non dipendono da quale processo ha trovato il punto */
+static void mergeNeighbors(int *idx, double *dist, const int *cand_idx, const double *cand_dist,
+                           int k, int *tmp_idx, double *tmp_dist) {
+    int a = 0, b = 0;
+    for (int i = 0; i < k; i++) {
+        if (b >= k || (a < k && (dist[a] < cand_dist[b] || (dist[a] == cand_dist[b] && idx[a] <= cand_idx[b])))) {
+            tmp_idx[i] = idx[a];
+            tmp_dist[i] = dist[a];
+            a++;
+        } else {
+            tmp_idx[i] = cand_idx[b];
+            tmp_dist[i] = cand_dist[b];
+            b++;
+        }
+    }
+    memcpy(idx, tmp_idx, k * sizeof(int));
+    memcpy(dist, tmp_dist, k * sizeof(double));
+}
+
+/* Query risolte dai thread sull'indice locale, condiviso in sola lettura */
+typedef struct {
+    const SpatialIndex *index;
+    const Point *queries;
+    const double *radius;   /* NULL per la ricerca senza limite */
+    const KDSearchParams *params;
+    int k;
+    int *neighbors;
+    double *distances;
+} LocalSearch;
+
+static void localSearchChunk(int begin, int end, int thread_id, void *context) {
+    (void)thread_id;
+    LocalSearch *task = (LocalSearch *)context;
+    int k = task->k;
+
+    for (int i = begin; i < end; i++) {
+        double radius = (task->radius != NULL) ? task->radius[i] : DBL_MAX;
+        spatialIndexSearch(task->index, task->queries[i], k, radius, task->params,
+                           &task->neighbors[(size_t)i * k], &task->distances[(size_t)i * k]);
+    }
+}
+
+/* Le query sono esattamente i punti del KD-Tree locale, nell'ordine delle sue foglie
+   (come dopo buildKDTree sui punti posseduti): si può usare il self-join dual-tree */
+static int isTreeOrder(const KDTree *tree, const Point *queries, int nq) {
+    if (tree == NULL || tree->n != nq) return 0;
+    for (int i = 0; i < nq; i++) {
+        if (queries[i].original_index != tree->index[i]) return 0;
+    }
+    return 1;
+}
+
+void distributedKNN(const SpatialIndex *index, const Point *queries, int nq, int k, int num_threads,
+                    const KDSearchParams *params, int dual_tree, const BoundingBox *boxes, MPI_Datatype point_type,
+                    MPI_Comm comm, int *neighbors, double *distances, LoadStats *stats) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    /* Tutto il tempo fuori dalle collettive è calcolo, quello dentro è attesa degli altri processi */
+    double start_time = MPI_Wtime();
+    double idle = 0.0, wait_start;
+
+    /* Prima fase: ricerca sull'indice locale, con le query divise tra i thread. Se richiesto e se le
+       query sono i punti del KD-Tree, la ricerca esatta è un self-join e usa la visita dual-tree */
+    if (dual_tree && index->backend == INDEX_KDTREE && kdSearchIsExact(params) &&
+        isTreeOrder(index->tree, queries, nq)) {
+        dualTreeKNN(index->tree, index->tree, k, num_threads, neighbors, distances);
+    } else {
+        LocalSearch local;
+        local.index = index;
+        local.queries = queries;
+        local.radius = NULL;
+        local.params = params;
+        local.k = k;
+        local.neighbors = neighbors;
+        local.distances = distances;
+        parallelFor(nq, DEFAULT_CHUNK_SIZE, num_threads, localSearchChunk, &local);
+    }
+
+    /* Seconda fase: conto le query da inoltrare ad ogni processo, cioè quelle per cui
+       il bounding box remoto non è più lontano della k-esima distanza trovata finora
+       (ridotta di 1 + eps nella ricerca approssimata): a pari distanza vince l'indice minore */
+    double slack = kdSearchIsExact(params) ? 1.0 : 1.0 + params->eps;
+
+    /* Conteggi e scratch per query stanno nell'arena del thread, liberata in blocco alla fine; i buffer
+       degli scambi (O(nq * k)) sono allocati a parte, perché l'arena non restituisce mai i suoi blocchi */
+    Arena *arena = threadArena();
+    ArenaMark mark = arenaMark(arena);
+    int *sendcounts = ARENA_ARRAY(arena, int, size);
+    memset(sendcounts, 0, size * sizeof(int));
+    int *recvcounts = ARENA_ARRAY(arena, int, size);
+    int *sdispls = ARENA_ARRAY(arena, int, size);
+    int *rdispls = ARENA_ARRAY(arena, int, size);
+
+    for (int i = 0; i < nq; i++) {
+        for (int r = 0; r < size; r++) {
+            if (r != rank && boxDistance(&boxes[r], queries[i]) * slack <= distances[(size_t)i * k + k - 1]) {
+                sendcounts[r]++;
+            }
+        }
+    }
+
+    wait_start = MPI_Wtime();
+    MPI_Alltoall(sendcounts, 1, MPI_INT, recvcounts, 1, MPI_INT, comm);
+    idle += MPI_Wtime() - wait_start;
+
+    int total_send = 0, total_recv = 0;
+    for (int r = 0; r < size; r++) {
+        sdispls[r] = total_send;
+        rdispls[r] = total_recv;
+        total_send += sendcounts[r];
+        total_recv += recvcounts[r];
+    }
+
+    /* Impacchetto le query con il loro original_index, che serve al processo remoto per non
+       restituire il punto stesso; il raggio corrente viaggia in un array separato e la posizione
+       locale della query resta qui per la fusione */
+    Point *send_queries = (Point *)malloc((total_send > 0 ? total_send : 1) * sizeof(Point));
+    double *send_radius = (double *)malloc((total_send > 0 ? total_send : 1) * sizeof(double));
+    int *send_position = (int *)malloc((total_send > 0 ? total_send : 1) * sizeof(int));
+    int *fill = ARENA_ARRAY(arena, int, size);
+    memcpy(fill, sdispls, size * sizeof(int));
+
+    for (int i = 0; i < nq; i++) {
+        for (int r = 0; r < size; r++) {
+            double radius = distances[(size_t)i * k + k - 1];
+            if (r != rank && boxDistance(&boxes[r], queries[i]) * slack <= radius) {
+                send_queries[fill[r]] = queries[i];
+                send_radius[fill[r]] = radius;
+                send_position[fill[r]] = i;
+                fill[r]++;
+            }
+        }
+    }
+
+    Point *recv_queries = (Point *)malloc((total_recv > 0 ? total_recv : 1) * sizeof(Point));
+    double *recv_radius = (double *)malloc((total_recv > 0 ? total_recv : 1) * sizeof(double));
+
+    wait_start = MPI_Wtime();
+    MPI_Alltoallv(send_queries, sendcounts, sdispls, point_type,
+                  recv_queries, recvcounts, rdispls, point_type, comm);
+    profileExchange(sendcounts, recvcounts, point_type, comm);
+    MPI_Alltoallv(send_radius, sendcounts, sdispls, MPI_DOUBLE,
+                  recv_radius, recvcounts, rdispls, MPI_DOUBLE, comm);
+    profileExchange(sendcounts, recvcounts, MPI_DOUBLE, comm);
+    idle += MPI_Wtime() - wait_start;
+
+    /* Terza fase: rispondo alle query ricevute cercando entro il raggio del mittente */
+    int *reply_idx = (int *)malloc((total_recv > 0 ? (size_t)total_recv * k : 1) * sizeof(int));
+    double *reply_dist = (double *)malloc((total_recv > 0 ? (size_t)total_recv * k : 1) * sizeof(double));
+
+    LocalSearch remote;
+    remote.index = index;
+    remote.queries = recv_queries;
+    remote.radius = recv_radius;
+    remote.params = params;
+    remote.k = k;
+    remote.neighbors = reply_idx;
+    remote.distances = reply_dist;
+    parallelFor(total_recv, DEFAULT_CHUNK_SIZE, num_threads, localSearchChunk, &remote);
+    free(send_queries);
+    free(send_radius);
+    free(recv_queries);
+    free(recv_radius);
+
+    /* Le risposte tornano indietro con la stessa disposizione delle richieste, scalata di k */
+    for (int r = 0; r < size; r++) {
+        sendcounts[r] *= k;
+        recvcounts[r] *= k;
+        sdispls[r] *= k;
+        rdispls[r] *= k;
+    }
+
+    int *cand_idx = (int *)malloc((total_send > 0 ? (size_t)total_send * k : 1) * sizeof(int));
+    double *cand_dist = (double *)malloc((total_send > 0 ? (size_t)total_send * k : 1) * sizeof(double));
+
+    wait_start = MPI_Wtime();
+    MPI_Alltoallv(reply_idx, recvcounts, rdispls, MPI_INT,
+                  cand_idx, sendcounts, sdispls, MPI_INT, comm);
+    profileExchange(recvcounts, sendcounts, MPI_INT, comm);
+    MPI_Alltoallv(reply_dist, recvcounts, rdispls, MPI_DOUBLE,
+                  cand_dist, sendcounts, sdispls, MPI_DOUBLE, comm);
+    profileExchange(recvcounts, sendcounts, MPI_DOUBLE, comm);
+    idle += MPI_Wtime() - wait_start;
+    free(reply_idx);
+    free(reply_dist);
+
+    /* Ultima fase: fusione dei candidati remoti con i risultati locali */
+    int *tmp_idx = ARENA_ARRAY(arena, int, k);
+    double *tmp_dist = ARENA_ARRAY(arena, double, k);
+
+    for (int s = 0; s < total_send; s++) {
+        int i = send_position[s];
+        mergeNeighbors(&neighbors[(size_t)i * k], &distances[(size_t)i * k], &cand_idx[(size_t)s * k], &cand_dist[(size_t)s * k],
+                       k, tmp_idx, tmp_dist);
+    }
+    free(send_position);
+    free(cand_idx);
+    free(cand_dist);
+
+    if (stats != NULL) {
+        stats->busy += MPI_Wtime() - start_time - idle;
+        stats->idle += idle;
+        stats->chunks += (nq + DEFAULT_CHUNK_SIZE - 1) / DEFAULT_CHUNK_SIZE
+                       + (total_recv + DEFAULT_CHUNK_SIZE - 1) / DEFAULT_CHUNK_SIZE;
+        stats->items += nq + total_recv;
+    }
+
+    arenaReset(arena, mark);
+}
+
+int balancePartition(Point **points, int *n, SpatialIndex **index, IndexBackend backend, int k, int num_threads,
+                     const KDSearchParams *params, double threshold, MPI_Datatype point_type, MPI_Comm comm,
+                     double *imbalance) {
+    int size;
+    MPI_Comm_size(comm, &size);
+
+    BoundingBox local_box;
+    computeBoundingBox(*points, *n, &local_box);
+    BoundingBox *boxes = (BoundingBox *)malloc(size * sizeof(BoundingBox));
+    MPI_Allgather(&local_box, 2 * KNN_DIM, MPI_DOUBLE, boxes, 2 * KNN_DIM, MPI_DOUBLE, comm);
+    profileGather(2 * KNN_DIM, 2 * KNN_DIM * size, MPI_DOUBLE, -1, comm);
+
+    /* Ricerca pilota su un campione regolare: i contatori di nodi e distanze misurano il lavoro del
+       processo, comprese le query del campione inoltrate dagli altri, senza dipendere dai tempi */
+    int sample_n = (*n + BALANCE_SAMPLE_STRIDE - 1) / BALANCE_SAMPLE_STRIDE;
+    Point *sample = (Point *)malloc((sample_n > 0 ? sample_n : 1) * sizeof(Point));
+    for (int i = 0; i < sample_n; i++) {
+        sample[i] = (*points)[(size_t)i * BALANCE_SAMPLE_STRIDE];
+    }
+    int *neighbors = (int *)malloc((sample_n > 0 ? (size_t)sample_n * k : 1) * sizeof(int));
+    double *distances = (double *)malloc((sample_n > 0 ? (size_t)sample_n * k : 1) * sizeof(double));
+
+    long long work_before = profile_counters[COUNTER_NODES] + profile_counters[COUNTER_DISTANCES];
+    distributedKNN(*index, sample, sample_n, k, num_threads, params, 0, boxes, point_type, comm,
+                   neighbors, distances, NULL);
+    long long work_after = profile_counters[COUNTER_NODES] + profile_counters[COUNTER_DISTANCES];
+    free(sample);
+    free(neighbors);
+    free(distances);
+    free(boxes);
+
+    /* Ogni processo campiona la stessa frazione dei propri punti, quindi il suo lavoro misurato è
+       proporzionale a quello della ricerca completa */
+    double cost = (double)(work_after - work_before);
+    double max_cost, sum_cost;
+    MPI_Allreduce(&cost, &max_cost, 1, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(&cost, &sum_cost, 1, MPI_DOUBLE, MPI_SUM, comm);
+    *imbalance = (sum_cost > 0.0) ? max_cost * size / sum_cost : 1.0;
+    if (*imbalance <= threshold) return 0;
+
+    /* Ogni punto pesa il costo medio per punto del processo che lo possiede: la bisezione sposta
+       i confini finché le due metà di ogni livello hanno lo stesso costo stimato */
+    double point_cost = (*n > 0) ? cost / *n : 0.0;
+    double *weights = (double *)malloc((*n > 0 ? *n : 1) * sizeof(double));
+    for (int i = 0; i < *n; i++) {
+        weights[i] = point_cost;
+    }
+    partitionPoints(points, &weights, n, point_type, comm);
+    free(weights);
+
+    freeSpatialIndex(*index);
+    *index = buildSpatialIndex(backend, *points, *n, num_threads);
+    return 1;
+}
+
+/* Query inoltrate agli altri processi da una ricerca per raggio */
+typedef struct {
+    int *sendcounts, *recvcounts, *sdispls, *rdispls;
+    int total_send, total_recv;
+    int *send_position;     /* Query locale di ogni query inviata */
+    Point *recv_queries;
+} RangeExchange;
+
+/* Invia ogni query (con `forward[i]` diverso da 0) ai processi il cui box interseca la sfera */
+static void exchangeRangeQueries(const Point *queries, int nq, const int *forward, double radius,
+                                 const BoundingBox *boxes, MPI_Datatype point_type, MPI_Comm comm,
+                                 RangeExchange *ex) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    ex->sendcounts = (int *)calloc(size, sizeof(int));
+    ex->recvcounts = (int *)malloc(size * sizeof(int));
+    ex->sdispls = (int *)malloc(size * sizeof(int));
+    ex->rdispls = (int *)malloc(size * sizeof(int));
+
+    for (int i = 0; i < nq; i++) {
+        if (forward != NULL && !forward[i]) continue;
+        for (int r = 0; r < size; r++) {
+            if (r != rank && boxDistance(&boxes[r], queries[i]) <= radius) {
+                ex->sendcounts[r]++;
+            }
+        }
+    }
+    MPI_Alltoall(ex->sendcounts, 1, MPI_INT, ex->recvcounts, 1, MPI_INT, comm);
+
+    ex->total_send = 0;
+    ex->total_recv = 0;
+    for (int r = 0; r < size; r++) {
+        ex->sdispls[r] = ex->total_send;
+        ex->rdispls[r] = ex->total_recv;
+        ex->total_send += ex->sendcounts[r];
+        ex->total_recv += ex->recvcounts[r];
+    }
+
+    Point *send_queries = (Point *)malloc((ex->total_send > 0 ? ex->total_send : 1) * sizeof(Point));
+    ex->send_position = (int *)malloc((ex->total_send > 0 ? ex->total_send : 1) * sizeof(int));
+    int *fill = (int *)malloc(size * sizeof(int));
+    memcpy(fill, ex->sdispls, size * sizeof(int));
+
+    for (int i = 0; i < nq; i++) {
+        if (forward != NULL && !forward[i]) continue;
+        for (int r = 0; r < size; r++) {
+            if (r != rank && boxDistance(&boxes[r], queries[i]) <= radius) {
+                send_queries[fill[r]] = queries[i];
+                ex->send_position[fill[r]] = i;
+                fill[r]++;
+            }
+        }
+    }
+
+    ex->recv_queries = (Point *)malloc((ex->total_recv > 0 ? ex->total_recv : 1) * sizeof(Point));
+    MPI_Alltoallv(send_queries, ex->sendcounts, ex->sdispls, point_type,
+                  ex->recv_queries, ex->recvcounts, ex->rdispls, point_type, comm);
+    profileExchange(ex->sendcounts, ex->recvcounts, point_type, comm);
+
+    free(send_queries);
+    free(fill);
+}
+
+static void freeRangeExchange(RangeExchange *ex) {
+    free(ex->sendcounts);
+    free(ex->recvcounts);
+    free(ex->sdispls);
+    free(ex->rdispls);
+    free(ex->send_position);
+    free(ex->recv_queries);
+}
+
+void distributedRadiusSearch(const KDTree *tree, const Point *queries, int nq, double radius, int num_threads,
+                             const BoundingBox *boxes, MPI_Datatype point_type, MPI_Comm comm, RangeCSR *result) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    /* Prima fase: ricerca sul KD-Tree locale */
+    RangeCSR local;
+    radiusSearchBatch(tree, queries, nq, radius, num_threads, &local);
+
+    /* Seconda fase: le query raggiungono i processi il cui box interseca la sfera, che le risolvono */
+    RangeExchange ex;
+    exchangeRangeQueries(queries, nq, NULL, radius, boxes, point_type, comm, &ex);
+
+    RangeCSR remote;
+    radiusSearchBatch(tree, ex.recv_queries, ex.total_recv, radius, num_threads, &remote);
+
+    /* Conteggi e spiazzamenti di MPI_Alltoallv sono int, come nella scrittura del CSR */
+    if (remote.offsets[ex.total_recv] > INT_MAX) {
+        fprintf(stderr, "Rank %d: %lld radius results for other ranks do not fit in a single exchange\n", rank,
+                remote.offsets[ex.total_recv]);
+        MPI_Abort(comm, 1);
+    }
+
+    /* Le lunghezze delle righe tornano con la disposizione delle richieste; i punti trovati per un
+       processo sono le sue righe consecutive del CSR remoto, quindi bastano i loro totali */
+    int *reply_len = (int *)malloc((ex.total_recv > 0 ? ex.total_recv : 1) * sizeof(int));
+    for (int s = 0; s < ex.total_recv; s++) {
+        reply_len[s] = (int)(remote.offsets[s + 1] - remote.offsets[s]);
+    }
+    int *cand_len = (int *)malloc((ex.total_send > 0 ? ex.total_send : 1) * sizeof(int));
+    MPI_Alltoallv(reply_len, ex.recvcounts, ex.rdispls, MPI_INT,
+                  cand_len, ex.sendcounts, ex.sdispls, MPI_INT, comm);
+    profileExchange(ex.recvcounts, ex.sendcounts, MPI_INT, comm);
+
+    int *reply_counts = (int *)malloc(size * sizeof(int));
+    int *reply_displs = (int *)malloc(size * sizeof(int));
+    int *cand_counts = (int *)malloc(size * sizeof(int));
+    int *cand_displs = (int *)malloc(size * sizeof(int));
+    long long total_cand = 0;
+    for (int r = 0; r < size; r++) {
+        reply_displs[r] = (int)remote.offsets[ex.rdispls[r]];
+        reply_counts[r] = (int)(remote.offsets[ex.rdispls[r] + ex.recvcounts[r]] - reply_displs[r]);
+        long long count = 0;
+        for (int s = ex.sdispls[r]; s < ex.sdispls[r] + ex.sendcounts[r]; s++) {
+            count += cand_len[s];
+        }
+        if (total_cand + count > INT_MAX) {
+            fprintf(stderr, "Rank %d: too many remote radius results to receive in a single exchange\n", rank);
+            MPI_Abort(comm, 1);
+        }
+        cand_counts[r] = (int)count;
+        cand_displs[r] = (int)total_cand;
+        total_cand += count;
+    }
+
+    int *cand_idx = (int *)malloc((total_cand > 0 ? (size_t)total_cand : 1) * sizeof(int));
+    double *cand_dist = (double *)malloc((total_cand > 0 ? (size_t)total_cand : 1) * sizeof(double));
+    MPI_Alltoallv(remote.indices, reply_counts, reply_displs, MPI_INT,
+                  cand_idx, cand_counts, cand_displs, MPI_INT, comm);
+    profileExchange(reply_counts, cand_counts, MPI_INT, comm);
+    MPI_Alltoallv(remote.distances, reply_counts, reply_displs, MPI_DOUBLE,
+                  cand_dist, cand_counts, cand_displs, MPI_DOUBLE, comm);
+    profileExchange(reply_counts, cand_counts, MPI_DOUBLE, comm);
+
+    /* Ultima fase: ogni riga del risultato ha prima i punti locali e poi quelli remoti */
+    int *lengths = (int *)malloc((nq > 0 ? nq : 1) * sizeof(int));
+    for (int i = 0; i < nq; i++) {
+        lengths[i] = (int)(local.offsets[i + 1] - local.offsets[i]);
+    }
+    for (int s = 0; s < ex.total_send; s++) {
+        lengths[ex.send_position[s]] += cand_len[s];
+    }
+    rangeCSRInit(result, nq, lengths);
+
+    for (int i = 0; i < nq; i++) {
+        long long first = local.offsets[i];
+        lengths[i] = (int)(local.offsets[i + 1] - first);
+        memcpy(result->indices + result->offsets[i], local.indices + first, lengths[i] * sizeof(int));
+        memcpy(result->distances + result->offsets[i], local.distances + first, lengths[i] * sizeof(double));
+    }
+    long long cand = 0;
+    for (int s = 0; s < ex.total_send; s++) {
+        int i = ex.send_position[s];
+        long long dest = result->offsets[i] + lengths[i];
+        memcpy(result->indices + dest, cand_idx + cand, cand_len[s] * sizeof(int));
+        memcpy(result->distances + dest, cand_dist + cand, cand_len[s] * sizeof(double));
+        lengths[i] += cand_len[s];
+        cand += cand_len[s];
+    }
+    if (size > 1) {
+        sortRangeRows(result, num_threads);
+    }
+
+    free(lengths);
+    free(cand_idx);
+    free(cand_dist);
+    free(reply_counts);
+    free(reply_displs);
+    free(cand_counts);
+    free(cand_displs);
+    free(reply_len);
+    free(cand_len);
+    freeRangeCSR(&remote);
+    freeRangeCSR(&local);
+    freeRangeExchange(&ex);
+}
+
+void distributedRangeCount(const KDTree *tree, const Point *queries, int nq, double radius, int max_count,
+                           int num_threads, const BoundingBox *boxes, MPI_Datatype point_type, MPI_Comm comm,
+                           int *counts) {
+    rangeCountBatch(tree, queries, nq, radius, max_count, num_threads, counts);
+
+    /* Le query che hanno già raggiunto max_count in locale non vengono inoltrate */
+    int *forward = (int *)malloc((nq > 0 ? nq : 1) * sizeof(int));
+    for (int i = 0; i < nq; i++) {
+        forward[i] = (max_count <= 0 || counts[i] < max_count);
+    }
+
+    RangeExchange ex;
+    exchangeRangeQueries(queries, nq, forward, radius, boxes, point_type, comm, &ex);
+
+    int *reply = (int *)malloc((ex.total_recv > 0 ? ex.total_recv : 1) * sizeof(int));
+    rangeCountBatch(tree, ex.recv_queries, ex.total_recv, radius, max_count, num_threads, reply);
+
+    int *cand = (int *)malloc((ex.total_send > 0 ? ex.total_send : 1) * sizeof(int));
+    MPI_Alltoallv(reply, ex.recvcounts, ex.rdispls, MPI_INT,
+                  cand, ex.sendcounts, ex.sdispls, MPI_INT, comm);
+    profileExchange(ex.recvcounts, ex.sendcounts, MPI_INT, comm);
+
+    /* Ogni parte è già fermata a max_count, quindi la somma lo supera solo se il totale lo supera */
+    for (int s = 0; s < ex.total_send; s++) {
+        counts[ex.send_position[s]] += cand[s];
+    }
+    if (max_count > 0) {
+        for (int i = 0; i < nq; i++) {
+            if (counts[i] > max_count) counts[i] = max_count;
+        }
+    }
+
+    free(forward);
+    free(reply);
+    free(cand);
+    freeRangeExchange(&ex);
+}
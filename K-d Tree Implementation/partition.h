@@ -0,0 +1,215 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <mpi.h>
+#include "spatial.h"
+#include "sfc.h"
+#include "loadbalance.h"
+#include "range.h"
+
+/* Sbilanciamento del costo misurato (massimo diviso media) oltre il quale balancePartition ripartiziona */
+#define BALANCE_THRESHOLD 1.05
+
+/** @brief: Bounding box allineato agli assi dei punti posseduti da un processo
+ *  Un box vuoto ha min = DBL_MAX e max = -DBL_MAX
+ */
+typedef struct {
+    double min[KNN_DIM];
+    double max[KNN_DIM];
+} BoundingBox;
+
+/**
+ * @brief Calcola il bounding box di un insieme di punti.
+ *
+ * @param points Array di punti.
+ * @param n Numero di punti (se 0 il box risultante è vuoto).
+ * @param box Bounding box in cui salvare il risultato.
+ */
+void computeBoundingBox(const Point *points, int n, BoundingBox *box);
+
+/**
+ * @brief Distanza minima, nella metrica compilata (metric.h), tra un punto e un bounding box.
+ *
+ * @param box Bounding box di riferimento.
+ * @param target Punto di cui calcolare la distanza.
+ * @return 0 se il punto è interno al box, DBL_MAX se il box è vuoto.
+ */
+double boxDistance(const BoundingBox *box, Point target);
+
+/**
+ * @brief Partiziona lo spazio tra i processi con split ricorsivi sulla mediana.
+ *
+ * Ad ogni livello il gruppo di processi sceglie l'asse con estensione maggiore e cerca,
+ * tramite bisezione con MPI_Allreduce, il valore che lascia a sinistra una frazione di punti
+ * proporzionale al numero di processi della metà sinistra. I punti vengono scambiati con
+ * MPI_Alltoallv e il comunicatore viene diviso in due, fino ad avere un solo processo per gruppo.
+ * Alla fine ogni processo possiede una regione disgiunta dello spazio con circa n/p punti.
+ * Con i pesi la frazione è quella del peso totale invece del numero di punti.
+ *
+ * @param points Puntatore all'array dei punti locali, viene riallocato con i punti posseduti.
+ * @param weights Puntatore all'array dei pesi dei punti locali, riallocato insieme ai punti,
+ *                oppure NULL per dividere i punti in parti uguali.
+ * @param n Puntatore al numero di punti locali, aggiornato con il numero di punti posseduti.
+ * @param point_type MPI datatype della struct Point.
+ * @param comm Comunicatore dei processi che partecipano alla partizione.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void partitionPoints(Point **points, double **weights, int *n, MPI_Datatype point_type, MPI_Comm comm);
+
+/**
+ * @brief Ordina i punti lungo una curva space-filling con un sample sort distribuito.
+ *
+ * Alternativa a partitionPoints: le chiavi (Morton o Hilbert, 63 bit) sono calcolate sul bounding
+ * box globale e ogni processo ordina le proprie con un radix sort. Da ogni processo vengono presi
+ * SAMPLE_SORT_OVERSAMPLING campioni regolari, raccolti da tutti con MPI_Allgatherv, e i size - 1
+ * splitter dividono la curva in intervalli contigui che vengono scambiati con MPI_Alltoallv.
+ * Alla fine ogni processo possiede un tratto della curva, in ordine, e i punti portano con sé
+ * l'original_index per riportare i risultati agli id originali.
+ *
+ * @param points Puntatore all'array dei punti locali, viene riallocato con i punti posseduti.
+ * @param n Puntatore al numero di punti locali, aggiornato con il numero di punti posseduti.
+ * @param curve SFC_MORTON o SFC_HILBERT.
+ * @param point_type MPI datatype della struct Point.
+ * @param comm Comunicatore dei processi.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void sortPointsByCurve(Point **points, int *n, SFCurve curve, MPI_Datatype point_type, MPI_Comm comm);
+
+/**
+ * @brief Processo a cui spetta un punto: il primo il cui box lo contiene, altrimenti quello col box più vicino.
+ *
+ * Dipende solo dai box, quindi tutti i processi assegnano un punto allo stesso proprietario.
+ */
+int boxOwner(const BoundingBox *boxes, int size, Point p);
+
+/**
+ * @brief Ridistribuisce i punti le cui coordinate sono cambiate.
+ *
+ * Ogni punto spostato va al processo il cui bounding box lo contiene (il processo corrente se
+ * possibile, altrimenti quello di boxOwner);
+ * gli scambi avvengono con un solo MPI_Alltoallv e i punti non spostati restano fermi. Dopo la
+ * chiamata i box vanno ricalcolati, perché un punto può essere finito fuori da tutti i box.
+ *
+ * @param points Puntatore all'array dei punti locali, già con le nuove coordinate; viene
+ *               riallocato con prima i punti non spostati e poi quelli arrivati.
+ * @param n Puntatore al numero di punti locali, aggiornato.
+ * @param moved Array di `*n` flag: 1 per i punti spostati.
+ * @param boxes Bounding box di tutti i processi prima dello spostamento.
+ * @param point_type MPI datatype della struct Point.
+ * @param comm Comunicatore dei processi.
+ * @param num_arrived Numero di punti spostati ora posseduti dal processo (gli ultimi dell'array),
+ *                    compresi quelli che non hanno cambiato processo.
+ * @return Numero di punti locali spostati che sono passati ad un altro processo.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+int migrateMovedPoints(Point **points, int *n, const unsigned char *moved, const BoundingBox *boxes,
+                       MPI_Datatype point_type, MPI_Comm comm, int *num_arrived);
+
+/**
+ * @brief Ricerca distribuita ed esatta dei k vicini più prossimi.
+ *
+ * Ogni query viene prima risolta sull'indice locale (KD-Tree, griglia o KD-Tree dinamico); poi viene inoltrata soltanto ai processi
+ * il cui bounding box è più vicino della k-esima distanza corrente. I processi remoti cercano
+ * nel proprio indice partendo da quel raggio e restituiscono i loro candidati, che vengono
+ * fusi con i risultati locali. Entrambe le fasi di ricerca dividono le query tra `num_threads`
+ * thread che condividono l'indice in sola lettura, con un work-stealing a chunk.
+ * Con parametri approssimati entrambe le fasi usano la ricerca best-bin-first e una query viene
+ * inoltrata solo ai bounding box più vicini di d_k / (1 + eps).
+ * Con `dual_tree`, se le query sono i punti del KD-Tree locale nell'ordine delle foglie (il self-join
+ * di tutti i punti) e la ricerca è esatta, la prima fase usa dualTreeKNN invece di una ricerca per
+ * query. Il punto con lo stesso original_index della query non viene mai restituito.
+ *
+ * @param index Indice costruito sui punti posseduti dal processo.
+ * @param queries Punti di cui trovare i vicini.
+ * @param nq Numero di query locali.
+ * @param k Numero di vicini da trovare.
+ * @param num_threads Numero di thread di ricerca del processo.
+ * @param params Parametri della ricerca approssimata, oppure NULL per la ricerca esatta.
+ * @param dual_tree Se diverso da 0, la ricerca locale esatta del self-join usa dualTreeKNN.
+ * @param boxes Bounding box di tutti i processi (indicizzati per rank in `comm`).
+ * @param point_type MPI datatype della struct Point.
+ * @param comm Comunicatore dei processi.
+ * @param neighbors Array di `nq * k` interi in cui salvare gli indici dei vicini.
+ * @param distances Array di `nq * k` double in cui salvare le distanze dei vicini.
+ * @param stats Se non NULL, vi vengono sommati il tempo di ricerca (busy), il tempo bloccato nelle
+ *              collettive (idle) e le query risolte, comprese quelle ricevute.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void distributedKNN(const SpatialIndex *index, const Point *queries, int nq, int k, int num_threads,
+                    const KDSearchParams *params, int dual_tree, const BoundingBox *boxes, MPI_Datatype point_type,
+                    MPI_Comm comm, int *neighbors, double *distances, LoadStats *stats);
+
+/**
+ * @brief Ribilancia la bisezione ricorsiva in base al costo misurato della ricerca dei k vicini.
+ *
+ * Con lo stesso numero di punti i processi possono avere costi di ricerca diversi (regioni sul bordo
+ * dei cluster, query inoltrate a più processi). Una ricerca pilota distribuita su un punto locale
+ * ogni BALANCE_SAMPLE_STRIDE misura il lavoro di ogni processo con i contatori di nodi visitati e
+ * distanze calcolate, che non dipendono dal rumore dei tempi. Se il massimo supera la media di più
+ * di `threshold`, ogni punto riceve come peso il costo medio per punto del suo processo, la
+ * bisezione viene ripetuta sui pesi con partitionPoints e l'indice locale viene ricostruito.
+ *
+ * @param points Puntatore all'array dei punti locali, riallocato se i punti vengono ridistribuiti.
+ * @param n Puntatore al numero di punti locali.
+ * @param index Puntatore all'indice locale, ricostruito se i punti vengono ridistribuiti.
+ * @param backend Tipo dell'indice locale.
+ * @param k Numero di vicini della ricerca.
+ * @param num_threads Numero di thread di ricerca del processo.
+ * @param params Parametri della ricerca approssimata, oppure NULL per la ricerca esatta.
+ * @param threshold Sbilanciamento (massimo costo diviso per la media) oltre il quale ripartizionare.
+ * @param point_type MPI datatype della struct Point.
+ * @param comm Comunicatore dei processi.
+ * @param imbalance Sbilanciamento misurato dalla ricerca pilota.
+ * @return 1 se i punti sono stati ridistribuiti, 0 altrimenti.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+int balancePartition(Point **points, int *n, SpatialIndex **index, IndexBackend backend, int k, int num_threads,
+                     const KDSearchParams *params, double threshold, MPI_Datatype point_type, MPI_Comm comm,
+                     double *imbalance);
+
+/**
+ * @brief Ricerca distribuita di tutti i punti entro un raggio.
+ *
+ * Ogni query viene risolta sul KD-Tree locale con radiusSearchBatch e inoltrata soltanto ai processi
+ * il cui bounding box interseca la sfera di centro la query e raggio `radius`. I processi remoti
+ * rispondono con le lunghezze delle righe e i punti trovati, che vengono accodati a quelli locali;
+ * ogni riga del risultato è ordinata per distanza. Il punto con lo stesso original_index della
+ * query non viene mai restituito.
+ *
+ * @param tree KD-Tree dei punti posseduti dal processo.
+ * @param queries Punti da cercare.
+ * @param nq Numero di query locali.
+ * @param radius Raggio della ricerca (distanza <= radius).
+ * @param num_threads Numero di thread di ricerca del processo.
+ * @param boxes Bounding box di tutti i processi (indicizzati per rank in `comm`).
+ * @param point_type MPI datatype della struct Point.
+ * @param comm Comunicatore dei processi.
+ * @param result CSR con una riga per query (allocato dalla funzione, da liberare con freeRangeCSR).
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void distributedRadiusSearch(const KDTree *tree, const Point *queries, int nq, double radius, int num_threads,
+                             const BoundingBox *boxes, MPI_Datatype point_type, MPI_Comm comm, RangeCSR *result);
+
+/**
+ * @brief Conteggio distribuito dei punti entro un raggio.
+ *
+ * Come distributedRadiusSearch, ma ogni processo restituisce solo il numero di punti. Con
+ * `max_count` i conteggi si fermano a quel valore e una query che lo raggiunge già sul processo
+ * locale non viene inoltrata.
+ *
+ * @param max_count Valore a cui fermare ogni conteggio, 0 per i conteggi completi.
+ * @param counts Array di `nq` interi da riempire.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void distributedRangeCount(const KDTree *tree, const Point *queries, int nq, double radius, int max_count,
+                           int num_threads, const BoundingBox *boxes, MPI_Datatype point_type, MPI_Comm comm,
+                           int *counts);
+
+#endif
@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include "range.h"
+#include "scheduler.h"
+
+/* Passi dello shell sort (sequenza di Ciura), le righe corte finiscono con l'insertion sort */
+static const int shell_gaps[] = {701, 301, 132, 57, 23, 10, 4, 1};
+
+void rangeCSRInit(RangeCSR *csr, int rows, const int *lengths) {
+    csr->rows = rows;
+    csr->offsets = (long long *)malloc(((size_t)rows + 1) * sizeof(long long));
+    csr->offsets[0] = 0;
+    for (int i = 0; i < rows; i++) {
+        csr->offsets[i + 1] = csr->offsets[i] + lengths[i];
+    }
+    long long total = csr->offsets[rows];
+    csr->indices = (int *)malloc((total > 0 ? total : 1) * sizeof(int));
+    csr->distances = (double *)malloc((total > 0 ? total : 1) * sizeof(double));
+}
+
+void freeRangeCSR(RangeCSR *csr) {
+    free(csr->offsets);
+    free(csr->indices);
+    free(csr->distances);
+    csr->offsets = NULL;
+    csr->indices = NULL;
+    csr->distances = NULL;
+    csr->rows = 0;
+}
+
+static int pairBefore(double da, int ia, double db, int ib) {
+    return da < db || (da == db && ia < ib);
+}
+
+/* Shell sort in place sui due array paralleli di una riga */
+static void sortRow(int *indices, double *distances, long long len) {
+    for (size_t g = 0; g < sizeof(shell_gaps) / sizeof(shell_gaps[0]); g++) {
+        long long gap = shell_gaps[g];
+        for (long long i = gap; i < len; i++) {
+            int idx = indices[i];
+            double dist = distances[i];
+            long long j = i;
+            while (j >= gap && pairBefore(dist, idx, distances[j - gap], indices[j - gap])) {
+                indices[j] = indices[j - gap];
+                distances[j] = distances[j - gap];
+                j -= gap;
+            }
+            indices[j] = idx;
+            distances[j] = dist;
+        }
+    }
+}
+
+static void sortRowsChunk(int begin, int end, int thread_id, void *context) {
+    (void)thread_id;
+    RangeCSR *csr = (RangeCSR *)context;
+    for (int i = begin; i < end; i++) {
+        long long first = csr->offsets[i];
+        sortRow(csr->indices + first, csr->distances + first, csr->offsets[i + 1] - first);
+    }
+}
+
+void sortRangeRows(RangeCSR *csr, int num_threads) {
+    parallelFor(csr->rows, DEFAULT_CHUNK_SIZE, num_threads, sortRowsChunk, csr);
+}
+
+/* Query di una passata divise tra i thread */
+typedef struct {
+    const KDTree *tree;
+    const Point *queries;
+    double radius;
+    int max_count;
+    int *counts;        /* Prima passata: conteggi */
+    RangeCSR *result;   /* Seconda passata: punti trovati */
+} RangeTask;
+
+static void countChunk(int begin, int end, int thread_id, void *context) {
+    (void)thread_id;
+    RangeTask *task = (RangeTask *)context;
+    for (int i = begin; i < end; i++) {
+        task->counts[i] = kdTreeRangeCount(task->tree, task->queries[i], task->radius, task->max_count);
+    }
+}
+
+static void fillChunk(int begin, int end, int thread_id, void *context) {
+    (void)thread_id;
+    RangeTask *task = (RangeTask *)context;
+    RangeCSR *csr = task->result;
+    for (int i = begin; i < end; i++) {
+        long long first = csr->offsets[i];
+        kdTreeRadiusSearch(task->tree, task->queries[i], task->radius, csr->indices + first, csr->distances + first);
+        sortRow(csr->indices + first, csr->distances + first, csr->offsets[i + 1] - first);
+    }
+}
+
+void rangeCountBatch(const KDTree *tree, const Point *queries, int nq, double radius, int max_count,
+                     int num_threads, int *counts) {
+    RangeTask task = {tree, queries, radius, max_count, counts, NULL};
+    parallelFor(nq, DEFAULT_CHUNK_SIZE, num_threads, countChunk, &task);
+}
+
+void radiusSearchBatch(const KDTree *tree, const Point *queries, int nq, double radius, int num_threads,
+                       RangeCSR *result) {
+    int *counts = (int *)malloc((nq > 0 ? nq : 1) * sizeof(int));
+    rangeCountBatch(tree, queries, nq, radius, 0, num_threads, counts);
+    rangeCSRInit(result, nq, counts);
+    free(counts);
+
+    RangeTask task = {tree, queries, radius, 0, NULL, result};
+    parallelFor(nq, DEFAULT_CHUNK_SIZE, num_threads, fillChunk, &task);
+}
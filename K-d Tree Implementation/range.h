@@ -0,0 +1,59 @@
+#ifndef RANGE_H
+#define RANGE_H
+
+#include "util.h"
+
+/** @brief: Risultati di lunghezza variabile di più query in formato CSR
+ *  I punti trovati dalla query i sono indices[offsets[i] .. offsets[i + 1]) con le distanze nelle
+ *  stesse posizioni di distances: tre allocazioni in tutto, qualunque sia il numero di query.
+ */
+typedef struct {
+    int rows;
+    long long *offsets;     /* rows + 1 offset */
+    int *indices;           /* original_index dei punti trovati */
+    double *distances;      /* Distanze nella metrica compilata */
+} RangeCSR;
+
+/**
+ * @brief Alloca un CSR con le lunghezze di riga date (gli offset sono la loro somma prefissa).
+ */
+void rangeCSRInit(RangeCSR *csr, int rows, const int *lengths);
+
+/**
+ * @brief Libera gli array di un CSR.
+ */
+void freeRangeCSR(RangeCSR *csr);
+
+/**
+ * @brief Ordina ogni riga per distanza crescente (a parità di distanza per indice), senza allocazioni.
+ */
+void sortRangeRows(RangeCSR *csr, int num_threads);
+
+/**
+ * @brief Ricerca per raggio di più query, con i risultati in un CSR.
+ *
+ * Due passate parallele sulle query: la prima conta i punti di ogni query con kdTreeRangeCount
+ * (che non visita i sotto-alberi interni alla sfera), la somma prefissa dei conteggi dà gli
+ * offset, e la seconda scrive i punti al loro posto con kdTreeRadiusSearch. Le righe sono ordinate
+ * per distanza.
+ *
+ * @param tree Puntatore all'albero KD.
+ * @param queries Punti da cercare.
+ * @param nq Numero di query.
+ * @param radius Raggio della ricerca (distanza <= radius).
+ * @param num_threads Numero di thread della ricerca.
+ * @param result CSR da riempire (allocato dalla funzione, da liberare con freeRangeCSR).
+ */
+void radiusSearchBatch(const KDTree *tree, const Point *queries, int nq, double radius, int num_threads,
+                       RangeCSR *result);
+
+/**
+ * @brief Conteggio dei punti entro il raggio per più query, in parallelo.
+ *
+ * @param max_count Valore a cui fermare ogni conteggio, 0 per i conteggi completi.
+ * @param counts Array di `nq` interi da riempire.
+ */
+void rangeCountBatch(const KDTree *tree, const Point *queries, int nq, double radius, int max_count,
+                     int num_threads, int *counts);
+
+#endif
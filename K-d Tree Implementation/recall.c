@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <float.h>
+#include <time.h>
+#include "spatial.h"
+#include "bruteforce.h"
+#include "options.h"
+#include "pointio.h"
+#include "indexio.h"
+
+/* Numero massimo di query, prese a intervalli regolari nel dataset, su cui misurare il recall */
+#define RECALL_QUERIES 1000
+
+static double elapsed(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+    KNNOptions opts;
+    parseOptions(argc, argv, &opts);
+    int n = opts.n;
+    int k_max = opts.k_max;
+
+    IndexBackend backend;
+    if (parseIndexBackend(opts.backend, &backend) != 0) {
+        fprintf(stderr, "Invalid backend: %s\n", opts.backend);
+        return 1;
+    }
+
+    if ((opts.save_index != NULL || opts.load_index != NULL) && backend != INDEX_KDTREE) {
+        fprintf(stderr, "--save-index and --load-index need --backend kdtree\n");
+        return 1;
+    }
+
+    Point *points;
+    SpatialIndex *index;
+    IndexFile index_file;
+    struct timespec start;
+    double build_time;
+
+    if (opts.load_index != NULL) {
+        /* Indice mappato da file (un solo shard con tutto il dataset): i punti del riferimento
+           si ricavano dalle sue colonne, riportati nell'ordine originale */
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (indexFileOpen(opts.load_index, &index_file) != 0) return 1;
+        KDTree *tree = indexFileTree(&index_file, 0, opts.load_index);
+        if (tree == NULL || index_file.header.shards != 1) {
+            fprintf(stderr, "%s: recall needs an index with a single shard\n", opts.load_index);
+            return 1;
+        }
+        build_time = elapsed(&start);
+
+        n = tree->n;
+        points = (Point *)malloc(n * sizeof(Point));
+        for (int i = 0; i < n; i++) {
+            int id = tree->index[i];
+            if (id < 0 || id >= n) {
+                fprintf(stderr, "%s: point id %d out of range\n", opts.load_index, id);
+                return 1;
+            }
+            for (int d = 0; d < KNN_DIM; d++) {
+                points[id].coord[d] = tree->coord[d][i];
+            }
+            points[id].original_index = id;
+        }
+        index = spatialIndexFromTree(tree);
+    } else {
+        if (opts.input != NULL) {
+            PointFile file;
+            if (pointFileOpen(opts.input, &file) != 0) return 1;
+            if (file.header.count > INT_MAX) {
+                fprintf(stderr, "%s: too many points (%llu)\n", opts.input, (unsigned long long)file.header.count);
+                pointFileClose(&file);
+                return 1;
+            }
+            n = (int)file.header.count;
+            points = (Point *)malloc(n * sizeof(Point));
+            pointFileRead(&file, 0, n, points);
+            pointFileClose(&file);
+        } else {
+            points = (Point *)malloc(n * sizeof(Point));
+            generatePoints(points, n, 0, opts.distribution, generatorSeed(opts.seed));
+        }
+
+        /* La costruzione del KD-Tree riordina i punti, il riferimento lavora sull'ordine originale */
+        Point *index_points = (Point *)malloc(n * sizeof(Point));
+        memcpy(index_points, points, n * sizeof(Point));
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        index = buildSpatialIndex(backend, index_points, n, opts.threads);
+        build_time = elapsed(&start);
+        free(index_points);
+
+        if (opts.save_index != NULL && saveKDTree(opts.save_index, index->tree) != 0) return 1;
+    }
+
+    KDSearchParams exact = {0.0, 0};
+    KDSearchParams approx;
+    approx.eps = opts.eps;
+    approx.max_leaves = opts.max_leaves;
+
+    int nq = (n < RECALL_QUERIES) ? n : RECALL_QUERIES;
+    int *reference = (int *)malloc((size_t)nq * k_max * sizeof(int));
+    int *results = (int *)malloc((size_t)nq * k_max * sizeof(int));
+    double *distances = (double *)malloc(k_max * sizeof(double));
+
+    /* Riferimento esatto per forza bruta */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < nq; i++) {
+        int q = (int)((long long)i * n / nq);
+        findKNN(points, n, q, k_max, &reference[(size_t)i * k_max], NULL);
+    }
+    double brute_time = elapsed(&start);
+
+    /* Ricerca esatta sull'indice, per avere il costo di base: come findKNN, l'indice esclude la query stessa */
+    long long exact_leaves = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < nq; i++) {
+        int q = (int)((long long)i * n / nq);
+        exact_leaves += spatialIndexSearch(index, points[q], k_max, DBL_MAX, &exact,
+                                           &results[(size_t)i * k_max], distances);
+    }
+    double exact_time = elapsed(&start);
+
+    /* Ricerca approssimata con i parametri richiesti */
+    long long approx_leaves = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < nq; i++) {
+        int q = (int)((long long)i * n / nq);
+        approx_leaves += spatialIndexSearch(index, points[q], k_max, DBL_MAX, &approx,
+                                            &results[(size_t)i * k_max], distances);
+    }
+    double approx_time = elapsed(&start);
+
+    printf("Recall of the %s search on %d of %d points (eps = %g, max leaves = %d), index %s in %.3f s\n",
+           indexBackendName(backend), nq, n, approx.eps, approx.max_leaves,
+           (opts.load_index != NULL) ? "mapped and verified" : "built", build_time);
+
+    /* Recall@k: frazione dei k vicini esatti presenti tra i primi k restituiti */
+    for (int v = 0; v < opts.num_k; v++) {
+        int k = opts.k_values[v];
+        long long hits = 0, total = 0;
+        for (int i = 0; i < nq; i++) {
+            const int *ref = &reference[(size_t)i * k_max];
+            const int *res = &results[(size_t)i * k_max];
+            for (int a = 0; a < k; a++) {
+                if (ref[a] < 0) continue;
+                total++;
+                for (int b = 0; b < k; b++) {
+                    if (res[b] == ref[a]) {
+                        hits++;
+                        break;
+                    }
+                }
+            }
+        }
+        printf("k = %d: recall %.4f\n", k, total > 0 ? (double)hits / total : 1.0);
+    }
+
+    /* Per il KD-Tree i bucket visitati sono foglie, per la griglia celle non vuote */
+    printf("Time per query: brute force %.2f us, exact %.2f us (%.1f buckets), approximate %.2f us (%.1f buckets)\n",
+           brute_time / nq * 1e6, exact_time / nq * 1e6, (double)exact_leaves / nq,
+           approx_time / nq * 1e6, (double)approx_leaves / nq);
+
+    freeSpatialIndex(index);
+    if (opts.load_index != NULL) indexFileClose(&index_file);
+    free(reference);
+    free(results);
+    free(distances);
+    free(points);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "point.h"
+#include "serveproto.h"
+
+size_t serveRequestPayload(uint32_t count) {
+    return (size_t)count * (KNN_DIM * sizeof(double) + sizeof(int32_t));
+}
+
+int readFull(int fd, void *data, size_t size) {
+    char *bytes = (char *)data;
+    while (size > 0) {
+        ssize_t done = read(fd, bytes, size);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) return -1;
+        bytes += done;
+        size -= done;
+    }
+    return 0;
+}
+
+int writeFull(int fd, const void *data, size_t size) {
+    const char *bytes = (const char *)data;
+    while (size > 0) {
+        /* MSG_NOSIGNAL: un client che chiude la connessione non deve terminare il server */
+        ssize_t done = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (done < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        bytes += done;
+        size -= done;
+    }
+    return 0;
+}
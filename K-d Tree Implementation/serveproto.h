@@ -0,0 +1,64 @@
+#ifndef SERVEPROTO_H
+#define SERVEPROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*  Protocollo binario del server di query (socket Unix di tipo stream), little-endian.
+
+    Richiesta:  char[4] "KNNQ", uint32 flag, uint32 k, uint32 numero di query q
+                q x D float64   coordinate di ogni query (D = KNN_DIM del server)
+                q int32         id da escludere dai vicini di ogni query (-1 per un punto esterno)
+    Risposta:   char[4] "KNNR", int32 stato (0, oppure -1 per una richiesta non valida), uint32 k, uint32 q
+                int32[q][k]     indici dei vicini, ordinati per distanza (-1 se mancanti)
+                float64[q][k]   distanze nella metrica del server (DBL_MAX se mancanti)
+
+    Una connessione può inviare più richieste, le risposte arrivano nello stesso ordine. Con il flag
+    SERVE_SHUTDOWN (e q = 0) il server risponde, termina le richieste in corso e si ferma.
+*/
+
+#define SERVE_REQUEST_MAGIC "KNNQ"
+#define SERVE_REPLY_MAGIC "KNNR"
+
+#define SERVE_SHUTDOWN 0x1
+
+/* Limiti di una singola richiesta, oltre i quali il server la rifiuta */
+#define SERVE_MAX_K 1024
+#define SERVE_MAX_QUERIES (1 << 20)
+/* Limite su q x k, cioè sulle righe di vicini della risposta (12 byte ognuna) */
+#define SERVE_MAX_RESULTS (1 << 24)
+
+typedef struct {
+    char magic[4];
+    uint32_t flags;
+    uint32_t k;
+    uint32_t count;
+} ServeRequestHeader;
+
+typedef struct {
+    char magic[4];
+    int32_t status;
+    uint32_t k;
+    uint32_t count;
+} ServeReplyHeader;
+
+/**
+ * @brief Byte che seguono l'header di una richiesta di `count` query.
+ */
+size_t serveRequestPayload(uint32_t count);
+
+/**
+ * @brief Legge esattamente `size` byte, ripetendo le letture parziali.
+ *
+ * @return 0 in caso di successo, -1 in caso di errore o di connessione chiusa.
+ */
+int readFull(int fd, void *data, size_t size);
+
+/**
+ * @brief Scrive esattamente `size` byte, ripetendo le scritture parziali.
+ *
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+int writeFull(int fd, const void *data, size_t size);
+
+#endif
@@ -0,0 +1,573 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "arena.h"
+
+/* Stato condiviso da tutti i processi durante il servizio */
+typedef struct {
+    const SpatialIndex *index;
+    const BoundingBox *boxes;
+    int num_threads;
+    const KDSearchParams *params;
+    MPI_Datatype point_type;
+    MPI_Comm comm;
+} ServeContext;
+
+/* Connessione di un client, letta a pezzi senza bloccarsi */
+typedef struct {
+    int fd;                     /* -1 se lo slot è libero */
+    int closing;                /* Il client ha chiuso: si chiude dopo le risposte in sospeso */
+    int pending;                /* Richieste in coda di questa connessione */
+    ServeRequestHeader header;
+    size_t header_have;
+    char *payload;
+    size_t payload_have;
+    size_t payload_size;
+    char *out;                  /* Risposte da inviare: i byte in [out_sent, out_have) */
+    size_t out_sent;
+    size_t out_have;
+    size_t out_capacity;
+    int failed;                 /* Errore di scrittura: le risposte successive vengono scartate */
+    int invalid;                /* Richiesta non valida: l'errore parte dopo le risposte in sospeso */
+} Connection;
+
+/* Richiesta completa in attesa della ricerca */
+typedef struct {
+    int connection;
+    int k;
+    int count;
+    char *payload;              /* Coordinate e id come arrivati dal socket */
+    double arrival;
+} PendingRequest;
+
+/* Coda FIFO delle richieste, nell'ordine di arrivo */
+typedef struct {
+    PendingRequest *items;
+    int head, tail, capacity;
+    long long queries;          /* Query delle richieste in coda */
+} RequestQueue;
+
+static void queuePush(RequestQueue *queue, PendingRequest request) {
+    if (queue->head > 0 && queue->tail == queue->capacity) {
+        memmove(queue->items, queue->items + queue->head, (queue->tail - queue->head) * sizeof(PendingRequest));
+        queue->tail -= queue->head;
+        queue->head = 0;
+    }
+    if (queue->tail == queue->capacity) {
+        queue->capacity = (queue->capacity > 0) ? 2 * queue->capacity : 64;
+        queue->items = (PendingRequest *)realloc(queue->items, queue->capacity * sizeof(PendingRequest));
+    }
+    queue->items[queue->tail++] = request;
+    queue->queries += request.count;
+}
+
+static void closeConnection(Connection *conn) {
+    close(conn->fd);
+    free(conn->payload);
+    free(conn->out);
+    memset(conn, 0, sizeof(Connection));
+    conn->fd = -1;
+}
+
+static size_t connectionBacklog(const Connection *conn) {
+    return conn->out_have - conn->out_sent;
+}
+
+/* Una connessione chiusa dal client si chiude quando non ha più richieste in coda né risposte da inviare */
+static void closeIfDone(Connection *conn) {
+    if (conn->fd >= 0 && conn->closing && conn->pending == 0 && (conn->failed || connectionBacklog(conn) == 0)) {
+        closeConnection(conn);
+    }
+}
+
+/* Accoda dei byte di risposta alla connessione, senza inviarli */
+static void connectionWrite(Connection *conn, const void *data, size_t size) {
+    if (conn->failed) return;
+    if (conn->out_sent > 0 && conn->out_have + size > conn->out_capacity) {
+        memmove(conn->out, conn->out + conn->out_sent, connectionBacklog(conn));
+        conn->out_have -= conn->out_sent;
+        conn->out_sent = 0;
+    }
+    if (conn->out_have + size > conn->out_capacity) {
+        size_t capacity = (conn->out_capacity > 0) ? conn->out_capacity : 4096;
+        while (capacity < conn->out_have + size) capacity *= 2;
+        conn->out = (char *)realloc(conn->out, capacity);
+        conn->out_capacity = capacity;
+    }
+    memcpy(conn->out + conn->out_have, data, size);
+    conn->out_have += size;
+}
+
+/* Invia quanto il socket accetta senza bloccarsi; un errore chiude la connessione appena possibile */
+static void connectionFlush(Connection *conn) {
+    while (!conn->failed && connectionBacklog(conn) > 0) {
+        /* MSG_NOSIGNAL: un client che chiude la connessione non deve terminare il server */
+        ssize_t done = send(conn->fd, conn->out + conn->out_sent, connectionBacklog(conn),
+                            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (done < 0 && errno == EINTR) continue;
+        if (done < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (done <= 0) {
+            conn->failed = 1;
+            conn->closing = 1;
+            break;
+        }
+        conn->out_sent += done;
+    }
+    if (connectionBacklog(conn) == 0 || conn->failed) {
+        conn->out_sent = conn->out_have = 0;
+    }
+    closeIfDone(conn);
+}
+
+/* Le query del batch sono divise per proprietario, ognuna risolta da distributedKNN sul processo
+   il cui box la contiene; il master raccoglie le righe nella posizione del batch */
+static void searchBatch(const ServeContext *ctx, const Point *batch, int count, int k,
+                        int *neighbors, double *distances) {
+    int rank, size;
+    MPI_Comm_rank(ctx->comm, &rank);
+    MPI_Comm_size(ctx->comm, &size);
+
+    /* I buffer grandi quanto il batch sono allocati a parte: l'arena non restituisce mai i suoi blocchi,
+       e una sola richiesta grande ne occuperebbe la memoria per tutta la vita del server */
+    Point *own = (Point *)malloc((count > 0 ? count : 1) * sizeof(Point));
+    int *position = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+    int nl = 0;
+    for (int i = 0; i < count; i++) {
+        if (boxOwner(ctx->boxes, size, batch[i]) == rank) {
+            own[nl] = batch[i];
+            position[nl++] = i;
+        }
+    }
+
+    int *own_idx = (int *)malloc((nl > 0 ? (size_t)nl * k : 1) * sizeof(int));
+    double *own_dist = (double *)malloc((nl > 0 ? (size_t)nl * k : 1) * sizeof(double));
+    distributedKNN(ctx->index, own, nl, k, ctx->num_threads, ctx->params, 0, ctx->boxes, ctx->point_type,
+                   ctx->comm, own_idx, own_dist, NULL);
+    free(own);
+
+    /* Solo i conteggi per processo stanno nell'arena del thread */
+    Arena *arena = threadArena();
+    ArenaMark mark = arenaMark(arena);
+
+    int *counts = NULL, *displs = NULL, *row_counts = NULL, *row_displs = NULL;
+    int *all_position = NULL, *all_idx = NULL;
+    double *all_dist = NULL;
+    if (rank == 0) {
+        counts = ARENA_ARRAY(arena, int, size);
+        displs = ARENA_ARRAY(arena, int, size);
+        row_counts = ARENA_ARRAY(arena, int, size);
+        row_displs = ARENA_ARRAY(arena, int, size);
+        all_position = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+        all_idx = (int *)malloc((count > 0 ? (size_t)count * k : 1) * sizeof(int));
+        all_dist = (double *)malloc((count > 0 ? (size_t)count * k : 1) * sizeof(double));
+    }
+    MPI_Gather(&nl, 1, MPI_INT, counts, 1, MPI_INT, 0, ctx->comm);
+    if (rank == 0) {
+        for (int r = 0, total = 0; r < size; r++) {
+            displs[r] = total;
+            row_counts[r] = counts[r] * k;
+            row_displs[r] = total * k;
+            total += counts[r];
+        }
+    }
+    MPI_Gatherv(position, nl, MPI_INT, all_position, counts, displs, MPI_INT, 0, ctx->comm);
+    MPI_Gatherv(own_idx, nl * k, MPI_INT, all_idx, row_counts, row_displs, MPI_INT, 0, ctx->comm);
+    MPI_Gatherv(own_dist, nl * k, MPI_DOUBLE, all_dist, row_counts, row_displs, MPI_DOUBLE, 0, ctx->comm);
+
+    if (rank == 0) {
+        for (int i = 0; i < count; i++) {
+            memcpy(&neighbors[(size_t)all_position[i] * k], &all_idx[(size_t)i * k], k * sizeof(int));
+            memcpy(&distances[(size_t)all_position[i] * k], &all_dist[(size_t)i * k], k * sizeof(double));
+        }
+    }
+
+    free(position);
+    free(own_idx);
+    free(own_dist);
+    free(all_position);
+    free(all_idx);
+    free(all_dist);
+    arenaReset(arena, mark);
+}
+
+/* Il master annuncia il prossimo batch (numero di query e k, oppure -1 per l'arresto). È un
+   MPI_Ibcast perché gli altri processi lo aspettano con MPI_Test, e i due lati devono usare la
+   stessa forma della collettiva */
+static void announceBatch(int meta[2], MPI_Comm comm) {
+    MPI_Request request;
+    MPI_Ibcast(meta, 2, MPI_INT, 0, comm, &request);
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+}
+
+/* Gli altri processi aspettano l'annuncio senza occupare un core: un MPI_Bcast bloccante gira in
+   polling finché il master non riceve richieste, quindi controllo l'MPI_Ibcast con MPI_Test e dormo
+   tra un controllo e l'altro, raddoppiando la pausa fino a SERVE_IDLE_SLEEP_US */
+static void awaitBatch(int meta[2], MPI_Comm comm) {
+    MPI_Request request;
+    MPI_Ibcast(meta, 2, MPI_INT, 0, comm, &request);
+    long sleep_us = 10;
+    for (;;) {
+        int done;
+        MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+        if (done) return;
+        struct timespec pause = {0, sleep_us * 1000};
+        nanosleep(&pause, NULL);
+        sleep_us *= 2;
+        if (sleep_us > SERVE_IDLE_SLEEP_US) sleep_us = SERVE_IDLE_SLEEP_US;
+    }
+}
+
+/* Accoda la risposta di errore di una connessione che non ha più richieste in coda */
+static void writeError(Connection *conn) {
+    ServeReplyHeader reply;
+    memcpy(reply.magic, SERVE_REPLY_MAGIC, 4);
+    reply.status = -1;
+    reply.k = 0;
+    reply.count = 0;
+    connectionWrite(conn, &reply, sizeof(reply));
+    conn->invalid = 0;
+}
+
+/* Risponde con un errore e chiude la connessione. Le risposte vanno nell'ordine delle richieste,
+   quindi se quelle precedenti aspettano ancora il loro batch l'errore parte dopo l'ultima */
+static void replyError(Connection *conn) {
+    conn->closing = 1;
+    conn->invalid = 1;
+    if (conn->pending == 0) writeError(conn);
+    connectionFlush(conn);
+}
+
+/* Legge tutto ciò che è disponibile su una connessione, accodando le richieste complete.
+   Restituisce 1 se è arrivata la richiesta di arresto */
+static int readConnection(Connection *conn, int slot, RequestQueue *queue, int *shutdown_fd) {
+    for (;;) {
+        char *target;
+        size_t want;
+        if (conn->header_have < sizeof(ServeRequestHeader)) {
+            target = (char *)&conn->header + conn->header_have;
+            want = sizeof(ServeRequestHeader) - conn->header_have;
+        } else {
+            target = conn->payload + conn->payload_have;
+            want = conn->payload_size - conn->payload_have;
+        }
+
+        ssize_t done = (want > 0) ? recv(conn->fd, target, want, MSG_DONTWAIT) : 0;
+        if (want > 0) {
+            if (done < 0 && errno == EINTR) continue;
+            if (done < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+            if (done <= 0) {
+                conn->closing = 1;
+                closeIfDone(conn);
+                return 0;
+            }
+        }
+
+        if (conn->header_have < sizeof(ServeRequestHeader)) {
+            conn->header_have += done;
+            if (conn->header_have < sizeof(ServeRequestHeader)) continue;
+
+            /* Header completo: controllo la richiesta e preparo il buffer per le query */
+            const ServeRequestHeader *h = &conn->header;
+            if (memcmp(h->magic, SERVE_REQUEST_MAGIC, 4) != 0) {
+                replyError(conn);
+                return 0;
+            }
+            if (h->flags & SERVE_SHUTDOWN) {
+                *shutdown_fd = conn->fd;
+                conn->header_have = 0;
+                return 1;
+            }
+            if (h->k == 0 || h->k > SERVE_MAX_K || h->count > SERVE_MAX_QUERIES ||
+                (uint64_t)h->count * h->k > SERVE_MAX_RESULTS) {
+                replyError(conn);
+                return 0;
+            }
+            conn->payload_size = serveRequestPayload(h->count);
+            conn->payload = (char *)malloc(conn->payload_size > 0 ? conn->payload_size : 1);
+            conn->payload_have = 0;
+        } else {
+            conn->payload_have += done;
+        }
+
+        if (conn->payload_have == conn->payload_size) {
+            PendingRequest request;
+            request.connection = slot;
+            request.k = (int)conn->header.k;
+            request.count = (int)conn->header.count;
+            request.payload = conn->payload;
+            request.arrival = MPI_Wtime();
+            queuePush(queue, request);
+            conn->pending++;
+            conn->payload = NULL;
+            conn->header_have = 0;
+        }
+    }
+}
+
+/* Toglie dalla coda un micro-batch, lo risolve con tutti i processi e risponde alle sue richieste */
+static int dispatchBatch(const ServeContext *ctx, RequestQueue *queue, Connection *connections) {
+    /* Richieste in ordine di arrivo finché il batch resta entro SERVE_BATCH_QUERIES (almeno una) */
+    int first = queue->head, last = queue->head;
+    int count = 0, k = 0;
+    while (last < queue->tail && (last == first || count + queue->items[last].count <= SERVE_BATCH_QUERIES)) {
+        count += queue->items[last].count;
+        if (queue->items[last].k > k) k = queue->items[last].k;
+        last++;
+    }
+
+    /* Batch e risultati sono allocati a parte e liberati subito, come in searchBatch */
+    Point *batch = (Point *)malloc((count > 0 ? count : 1) * sizeof(Point));
+    for (int r = first, q = 0; r < last; r++) {
+        const PendingRequest *request = &queue->items[r];
+        const double *coords = (const double *)request->payload;
+        const int32_t *ids = (const int32_t *)(coords + KNN_DIM * (size_t)request->count);
+        for (int i = 0; i < request->count; i++, q++) {
+            memcpy(batch[q].coord, &coords[KNN_DIM * (size_t)i], sizeof(batch[q].coord));
+            batch[q].original_index = ids[i];
+        }
+    }
+
+    int meta[2] = {count, k};
+    announceBatch(meta, ctx->comm);
+    MPI_Bcast(batch, count, ctx->point_type, 0, ctx->comm);
+
+    int *neighbors = (int *)malloc((count > 0 ? (size_t)count * k : 1) * sizeof(int));
+    double *distances = (double *)malloc((count > 0 ? (size_t)count * k : 1) * sizeof(double));
+    searchBatch(ctx, batch, count, k, neighbors, distances);
+    free(batch);
+
+    /* Ogni richiesta riceve il prefisso delle righe al proprio k */
+    for (int r = first, q = 0; r < last; r++) {
+        PendingRequest *request = &queue->items[r];
+        Connection *conn = &connections[request->connection];
+        int rk = request->k, rc = request->count;
+
+        ServeReplyHeader reply;
+        memcpy(reply.magic, SERVE_REPLY_MAGIC, 4);
+        reply.status = 0;
+        reply.k = (uint32_t)rk;
+        reply.count = (uint32_t)rc;
+
+        int32_t *reply_idx = (int32_t *)malloc(((size_t)rc * rk > 0 ? (size_t)rc * rk : 1) * sizeof(int32_t));
+        double *reply_dist = (double *)malloc(((size_t)rc * rk > 0 ? (size_t)rc * rk : 1) * sizeof(double));
+        for (int i = 0; i < rc; i++, q++) {
+            for (int j = 0; j < rk; j++) {
+                reply_idx[(size_t)i * rk + j] = neighbors[(size_t)q * k + j];
+                reply_dist[(size_t)i * rk + j] = distances[(size_t)q * k + j];
+            }
+        }
+
+        /* La risposta va nel buffer della connessione e parte quanto il socket ne accetta: un client
+           che non legge si tiene le sue risposte in sospeso, senza bloccare il master e gli altri */
+        connectionWrite(conn, &reply, sizeof(reply));
+        connectionWrite(conn, reply_idx, (size_t)rc * rk * sizeof(int32_t));
+        connectionWrite(conn, reply_dist, (size_t)rc * rk * sizeof(double));
+        free(reply_idx);
+        free(reply_dist);
+        free(request->payload);
+
+        conn->pending--;
+        queue->queries -= rc;
+        if (conn->pending == 0 && conn->invalid) writeError(conn);
+        connectionFlush(conn);
+    }
+    queue->head = last;
+
+    free(neighbors);
+    free(distances);
+    return count;
+}
+
+/* Ciclo del master: socket, lettura delle richieste e micro-batching */
+static void serveMaster(const char *path, const ServeContext *ctx) {
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    /* Si rimuove solo il socket lasciato da un server precedente, mai un altro file */
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "%s: exists and is not a socket\n", path);
+            MPI_Abort(ctx->comm, 1);
+        }
+        unlink(path);
+    }
+
+    if (listen_fd < 0 || strlen(path) >= sizeof(addr.sun_path) ||
+        bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, SERVE_MAX_CONNECTIONS) != 0) {
+        fprintf(stderr, "%s: cannot listen: %s\n", path, strerror(errno));
+        MPI_Abort(ctx->comm, 1);
+    }
+    printf("Serving k-NN queries on %s\n", path);
+    fflush(stdout);
+
+    Connection connections[SERVE_MAX_CONNECTIONS];
+    for (int c = 0; c < SERVE_MAX_CONNECTIONS; c++) {
+        memset(&connections[c], 0, sizeof(Connection));
+        connections[c].fd = -1;
+    }
+    RequestQueue queue = {NULL, 0, 0, 0, 0};
+    int stopping = 0, shutdown_fd = -1;
+    long long served = 0, requests = 0, batches = 0;
+
+    for (;;) {
+        /* Un batch parte se è pieno, se la prima richiesta ha aspettato abbastanza o se ci si ferma */
+        double now = MPI_Wtime();
+        while (queue.head < queue.tail &&
+               (stopping || queue.queries >= SERVE_BATCH_QUERIES ||
+                now >= queue.items[queue.head].arrival + SERVE_BATCH_WAIT_MS * 1e-3)) {
+            int before = queue.head;
+            served += dispatchBatch(ctx, &queue, connections);
+            requests += queue.head - before;
+            batches++;
+            now = MPI_Wtime();
+        }
+        if (stopping) break;
+
+        int timeout = -1;
+        if (queue.head < queue.tail) {
+            double wait = queue.items[queue.head].arrival + SERVE_BATCH_WAIT_MS * 1e-3 - now;
+            timeout = (wait > 0.0) ? (int)(wait * 1e3) + 1 : 0;
+        }
+
+        struct pollfd fds[SERVE_MAX_CONNECTIONS + 1];
+        int slots[SERVE_MAX_CONNECTIONS + 1];
+        int nfds = 0;
+        fds[nfds].fd = listen_fd;
+        fds[nfds].events = POLLIN;
+        slots[nfds++] = -1;
+        for (int c = 0; c < SERVE_MAX_CONNECTIONS; c++) {
+            Connection *conn = &connections[c];
+            if (conn->fd < 0) continue;
+            short events = 0;
+            if (!conn->closing && connectionBacklog(conn) < SERVE_OUTPUT_LIMIT) events |= POLLIN;
+            if (connectionBacklog(conn) > 0) events |= POLLOUT;
+            if (events == 0) continue;
+            fds[nfds].fd = conn->fd;
+            fds[nfds].events = events;
+            slots[nfds++] = c;
+        }
+        if (poll(fds, nfds, timeout) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (int f = 1; f < nfds && !stopping; f++) {
+            Connection *conn = &connections[slots[f]];
+            if ((fds[f].events & POLLOUT) && (fds[f].revents & (POLLOUT | POLLHUP | POLLERR))) {
+                connectionFlush(conn);
+            }
+            if (conn->fd >= 0 && (fds[f].events & POLLIN) && (fds[f].revents & (POLLIN | POLLHUP | POLLERR))) {
+                stopping = readConnection(conn, slots[f], &queue, &shutdown_fd);
+            }
+        }
+
+        /* Nuove connessioni, rifiutate se tutti gli slot sono occupati */
+        if (!stopping && (fds[0].revents & POLLIN)) {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd >= 0) {
+                int slot = -1;
+                for (int c = 0; c < SERVE_MAX_CONNECTIONS && slot < 0; c++) {
+                    if (connections[c].fd < 0) slot = c;
+                }
+                if (slot < 0) {
+                    close(fd);
+                } else {
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    connections[slot].fd = fd;
+                }
+            }
+        }
+    }
+
+    /* Fine del servizio per tutti i processi, poi confermo l'arresto al client che l'ha chiesto */
+    int meta[2] = {-1, 0};
+    announceBatch(meta, ctx->comm);
+    for (int c = 0; c < SERVE_MAX_CONNECTIONS; c++) {
+        if (connections[c].fd >= 0 && connections[c].fd == shutdown_fd) {
+            ServeReplyHeader reply;
+            memcpy(reply.magic, SERVE_REPLY_MAGIC, 4);
+            reply.status = 0;
+            reply.k = 0;
+            reply.count = 0;
+            connectionWrite(&connections[c], &reply, sizeof(reply));
+            connectionFlush(&connections[c]);
+        }
+    }
+
+    /* Le risposte ancora nei buffer hanno SERVE_DRAIN_MS per partire, poi le connessioni si chiudono */
+    double deadline = MPI_Wtime() + SERVE_DRAIN_MS * 1e-3;
+    for (;;) {
+        struct pollfd fds[SERVE_MAX_CONNECTIONS];
+        int slots[SERVE_MAX_CONNECTIONS];
+        int nfds = 0;
+        for (int c = 0; c < SERVE_MAX_CONNECTIONS; c++) {
+            if (connections[c].fd >= 0 && !connections[c].failed && connectionBacklog(&connections[c]) > 0) {
+                fds[nfds].fd = connections[c].fd;
+                fds[nfds].events = POLLOUT;
+                slots[nfds++] = c;
+            }
+        }
+        double left = deadline - MPI_Wtime();
+        if (nfds == 0 || left <= 0.0) break;
+        if (poll(fds, nfds, (int)(left * 1e3) + 1) < 0 && errno != EINTR) break;
+        for (int f = 0; f < nfds; f++) {
+            if (fds[f].revents) connectionFlush(&connections[slots[f]]);
+        }
+    }
+
+    for (int c = 0; c < SERVE_MAX_CONNECTIONS; c++) {
+        if (connections[c].fd >= 0) closeConnection(&connections[c]);
+    }
+    for (int r = queue.head; r < queue.tail; r++) free(queue.items[r].payload);
+    free(queue.items);
+    close(listen_fd);
+    unlink(path);
+
+    printf("Served %lld queries in %lld requests and %lld batches (%.1f queries per batch)\n",
+           served, requests, batches, batches > 0 ? (double)served / batches : 0.0);
+}
+
+void serveQueries(const char *path, const SpatialIndex *index, const BoundingBox *boxes, int num_threads,
+                  const KDSearchParams *params, MPI_Datatype point_type, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    ServeContext ctx;
+    ctx.index = index;
+    ctx.boxes = boxes;
+    ctx.num_threads = num_threads;
+    ctx.params = params;
+    ctx.point_type = point_type;
+    ctx.comm = comm;
+
+    if (rank == 0) {
+        serveMaster(path, &ctx);
+        return;
+    }
+
+    /* Gli altri processi ricevono i batch dal master finché il numero di query non è negativo */
+    for (;;) {
+        int meta[2];
+        awaitBatch(meta, comm);
+        if (meta[0] < 0) break;
+
+        int count = meta[0], k = meta[1];
+        Point *batch = (Point *)malloc((count > 0 ? count : 1) * sizeof(Point));
+        MPI_Bcast(batch, count, point_type, 0, comm);
+        searchBatch(&ctx, batch, count, k, NULL, NULL);
+        free(batch);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <mpi.h>
+#include "partition.h"
+#include "serveproto.h"
+
+/* Query accumulate prima di avviare una ricerca, anche se la finestra di attesa non è scaduta */
+#define SERVE_BATCH_QUERIES 4096
+
+/* Attesa massima in millisecondi dall'arrivo della prima richiesta in coda all'avvio della ricerca */
+#define SERVE_BATCH_WAIT_MS 2
+
+/* Connessioni aperte contemporaneamente al massimo */
+#define SERVE_MAX_CONNECTIONS 64
+
+/* Byte di risposte non ancora inviati oltre i quali non si leggono altre richieste dalla connessione */
+#define SERVE_OUTPUT_LIMIT (64 << 20)
+
+/* Attesa massima in millisecondi per consegnare le risposte in sospeso dopo l'arresto */
+#define SERVE_DRAIN_MS 1000
+
+/* Pausa massima in microsecondi tra due controlli dei processi che aspettano il prossimo batch */
+#define SERVE_IDLE_SLEEP_US 1000
+
+/**
+ * @brief Risponde alle richieste di query arrivate su un socket Unix finché un client non chiede l'arresto.
+ *
+ * Il master accetta le connessioni e legge le richieste (protocollo in serveproto.h) senza
+ * bloccarsi su un singolo client: le connessioni non sono bloccanti e le risposte che un client
+ * non legge restano nel buffer della sua connessione, inviate quando il socket torna scrivibile.
+ * Da una connessione con più di SERVE_OUTPUT_LIMIT byte in attesa non si leggono altre richieste. Le richieste in coda vengono raccolte in micro-batch: la
+ * ricerca parte quando le query in coda sono almeno SERVE_BATCH_QUERIES oppure quando la prima
+ * richiesta aspetta da SERVE_BATCH_WAIT_MS millisecondi, così le richieste piccole e vicine nel
+ * tempo condividono una sola ricerca distribuita. Il batch viene inviato a tutti con MPI_Bcast;
+ * ogni processo prende le query che cadono nel proprio box (boxOwner) e le risolve con
+ * distributedKNN, al k più grande del batch, e il master raccoglie i risultati e risponde a ogni
+ * richiesta col prefisso di k vicini che ha chiesto. Tra un batch e l'altro gli altri processi
+ * aspettano l'annuncio con MPI_Test e pause crescenti fino a SERVE_IDLE_SLEEP_US, così non tengono
+ * occupato un core mentre il server è inattivo, al costo di quella latenza sul batch successivo.
+ *
+ * @param path Percorso del socket (un socket esistente viene sostituito, qualsiasi altro file è un errore).
+ * @param index Indice dei punti posseduti dal processo.
+ * @param boxes Bounding box di tutti i processi.
+ * @param num_threads Numero di thread di ricerca del processo.
+ * @param params Parametri della ricerca approssimata, oppure NULL per la ricerca esatta.
+ * @param point_type MPI datatype della struct Point.
+ * @param comm Comunicatore dei processi, il rank 0 gestisce il socket.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void serveQueries(const char *path, const SpatialIndex *index, const BoundingBox *boxes, int num_threads,
+                  const KDSearchParams *params, MPI_Datatype point_type, MPI_Comm comm);
+
+#endif
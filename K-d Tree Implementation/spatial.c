@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <string.h>
+#include "spatial.h"
+
+const char *indexBackendName(IndexBackend backend) {
+    switch (backend) {
+        case INDEX_GRID: return "grid";
+        case INDEX_DYNAMIC: return "dynamic";
+        default: return "kdtree";
+    }
+}
+
+int parseIndexBackend(const char *name, IndexBackend *backend) {
+    if (strcmp(name, "kdtree") == 0) {
+        *backend = INDEX_KDTREE;
+    } else if (strcmp(name, "grid") == 0) {
+        *backend = INDEX_GRID;
+    } else if (strcmp(name, "dynamic") == 0) {
+        *backend = INDEX_DYNAMIC;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+SpatialIndex *buildSpatialIndex(IndexBackend backend, Point *points, int n, int num_threads) {
+    SpatialIndex *index = (SpatialIndex *)malloc(sizeof(SpatialIndex));
+    index->backend = backend;
+    index->tree = NULL;
+    index->grid = NULL;
+    index->dynamic = NULL;
+
+    if (backend == INDEX_GRID) {
+        index->grid = buildUniformGrid(points, n, num_threads);
+    } else if (backend == INDEX_DYNAMIC) {
+        index->dynamic = buildDynamicKDTree(points, n);
+    } else {
+        index->tree = buildKDTree(points, n);
+    }
+    return index;
+}
+
+SpatialIndex *spatialIndexFromTree(KDTree *tree) {
+    SpatialIndex *index = (SpatialIndex *)malloc(sizeof(SpatialIndex));
+    index->backend = INDEX_KDTREE;
+    index->tree = tree;
+    index->grid = NULL;
+    index->dynamic = NULL;
+    return index;
+}
+
+void freeSpatialIndex(SpatialIndex *index) {
+    if (index->tree != NULL) freeKDTree(index->tree);
+    if (index->grid != NULL) freeUniformGrid(index->grid);
+    if (index->dynamic != NULL) freeDynamicKDTree(index->dynamic);
+    free(index);
+}
+
+int spatialIndexSearch(const SpatialIndex *index, Point target, int k, double maxDistance,
+                       const KDSearchParams *params, int *neighbors, double *distances) {
+    if (index->backend == INDEX_GRID) {
+        return gridKNearestNeighbors(index->grid, target, k, maxDistance, params, neighbors, distances);
+    }
+    if (index->backend == INDEX_DYNAMIC) {
+        return dynamicKNearestNeighbors(index->dynamic, target, k, maxDistance, params, neighbors, distances);
+    }
+    return findKNearestNeighborsApprox(index->tree, target, k, maxDistance, params, neighbors, distances);
+}
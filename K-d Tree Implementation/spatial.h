@@ -0,0 +1,66 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include "util.h"
+#include "grid.h"
+#include "dynamic.h"
+
+/* Struttura dati usata per i punti posseduti da ogni processo */
+typedef enum {
+    INDEX_KDTREE,   /* KD-Tree compatto, adatto a qualunque distribuzione */
+    INDEX_GRID,     /* Griglia uniforme, per nuvole dense e abbastanza uniformi */
+    INDEX_DYNAMIC   /* KD-Tree dinamico, aggiornabile con inserimenti e cancellazioni */
+} IndexBackend;
+
+/** @brief: Indice spaziale con un'unica interfaccia di ricerca
+ *  Solo il campo del backend scelto è valido, gli altri sono NULL.
+ */
+typedef struct {
+    IndexBackend backend;
+    KDTree *tree;
+    UniformGrid *grid;
+    DynamicKDTree *dynamic;
+} SpatialIndex;
+
+/**
+ * @brief Nome del backend ("kdtree", "grid" o "dynamic").
+ */
+const char *indexBackendName(IndexBackend backend);
+
+/**
+ * @brief Legge il nome di un backend.
+ *
+ * @return 0 in caso di successo, -1 se il nome non è valido.
+ */
+int parseIndexBackend(const char *name, IndexBackend *backend);
+
+/**
+ * @brief Costruisce l'indice scelto sui punti.
+ *
+ * @param backend Struttura dati da costruire.
+ * @param points Array di punti, il KD-Tree lo riordina durante la costruzione.
+ * @param n Numero di punti.
+ * @param num_threads Thread usati dalla costruzione (solo la griglia costruisce in parallelo).
+ * @return Puntatore all'indice creato.
+ */
+SpatialIndex *buildSpatialIndex(IndexBackend backend, Point *points, int n, int num_threads);
+
+/**
+ * @brief Indice KD-Tree su un albero già costruito (ad esempio caricato da file), che ne diventa proprietario.
+ */
+SpatialIndex *spatialIndexFromTree(KDTree *tree);
+
+/**
+ * @brief Libera l'indice e la struttura dati sottostante.
+ */
+void freeSpatialIndex(SpatialIndex *index);
+
+/**
+ * @brief Ricerca dei k vicini sull'indice, con la stessa semantica di findKNearestNeighborsApprox.
+ *
+ * @return Numero di foglie (KD-Tree, anche dinamico) o di celle non vuote (griglia) visitate.
+ */
+int spatialIndexSearch(const SpatialIndex *index, Point target, int k, double maxDistance,
+                       const KDSearchParams *params, int *neighbors, double *distances);
+
+#endif
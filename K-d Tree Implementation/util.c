@@ -5,154 +5,739 @@
 #include <time.h>
 #include <float.h>
 #include <string.h>
+#include "scheduler.h"
+#include "arena.h"
+#include "profile.h"
 
-int compareX(const void *a, const void *b) {
-    Point3D *p1 = (Point3D *)a;
-    Point3D *p2 = (Point3D *)b;
-    return (p1->x > p2->x) - (p1->x < p2->x);
+double calculateDistance(Point p1, Point p2) {
+    return metricFinish(metricDistance(p1.coord, p2.coord));
 }
 
-int compareY(const void *a, const void *b) {
-    Point3D *p1 = (Point3D *)a;
-    Point3D *p2 = (Point3D *)b;
-    return (p1->y > p2->y) - (p1->y < p2->y);
+static double getCoord(const Point *p, int axis) {
+    return p->coord[axis];
 }
 
-int compareZ(const void *a, const void *b) {
-    Point3D *p1 = (Point3D *)a;
-    Point3D *p2 = (Point3D *)b;
-    return (p1->z > p2->z) - (p1->z < p2->z);
+/* Distanza ridotta (vedi metric.h) tra il punto i dell'albero (colonne) e un vettore di coordinate */
+static inline double treeDistance(const KDTree *tree, int i, const double *target) {
+    double sum = 0.0;
+    for (int d = 0; d < KNN_DIM; d++) {
+        sum = metricAdd(sum, tree->coord[d][i] - target[d], d);
+    }
+    return sum;
+}
+
+/* Distanza minima (ridotta) tra due bounding box */
+static double boxPairDistance(const double *a, const double *b) {
+    double sum = 0.0;
+    for (int d = 0; d < KNN_DIM; d++) {
+        sum = metricAddGap(sum, metricIntervalGap(a[d], a[KNN_DIM + d], b[d], b[KNN_DIM + d], d), d);
+    }
+    return sum;
 }
 
-int compareNeighbors(const void *a, const void *b) {
-    NearestNeighbor *n1 = (NearestNeighbor *)a;
-    NearestNeighbor *n2 = (NearestNeighbor *)b;
-    return (n1->distance > n2->distance) - (n1->distance < n2->distance);
+/* Distanza minima (ridotta) tra un punto e un bounding box */
+static double pointBoxDistance(const double *p, const double *box) {
+    double sum = 0.0;
+    for (int d = 0; d < KNN_DIM; d++) {
+        sum = metricAddGap(sum, metricIntervalGap(p[d], p[d], box[d], box[KNN_DIM + d], d), d);
+    }
+    return sum;
 }
 
-double calculateDistance(Point3D p1, Point3D p2) {
-    return sqrt(pow(p2.x - p1.x, 2) + 
-                pow(p2.y - p1.y, 2) + 
-                pow(p2.z - p1.z, 2));
+/* Limite inferiore (ridotto) della distanza tra il target e i punti del figlio `child`, che sta oltre
+   il piano di taglio a distanza axisDiff: la distanza dal piano, o il box del figlio se la metrica
+   non la ammette come limite */
+static inline double farBound(const KDTree *tree, const double *target, double axisDiff, int axis, int child) {
+    if (KNN_METRIC_PLANE_BOUND) return metricPlaneBound(axisDiff, axis);
+    return pointBoxDistance(target, &tree->bounds[KD_BOX_STRIDE * child]);
 }
 
-KDNode* buildKDTree(Point3D *points, int start, int end, int depth) {
-    if (start >= end) return NULL;
+/* Asse lungo cui i punti di [start, end) sono più sparsi (a parità il primo) */
+static int widestAxis(const Point *points, int start, int end) {
+    if (end <= start) return 0;
 
-    /* Seleziono l'asse corrente in base alla profondità */ 
-    int axis = depth % 3;
-    
-    /* Ordinamento dei punti in base all'asse corrente (0 -> x) (1 -> y) (2 -> z) */ 
-    switch (axis) {
-        case 0: qsort(points + start, end - start, sizeof(Point3D), compareX); break;
-        case 1: qsort(points + start, end - start, sizeof(Point3D), compareY); break;
-        case 2: qsort(points + start, end - start, sizeof(Point3D), compareZ); break;
+    double min[KNN_DIM], max[KNN_DIM];
+    for (int a = 0; a < KNN_DIM; a++) {
+        min[a] = max[a] = points[start].coord[a];
     }
+    for (int i = start + 1; i < end; i++) {
+        for (int a = 0; a < KNN_DIM; a++) {
+            double c = points[i].coord[a];
+            if (c < min[a]) min[a] = c;
+            if (c > max[a]) max[a] = c;
+        }
+    }
+
+    int axis = 0;
+    for (int a = 1; a < KNN_DIM; a++) {
+        if (max[a] - min[a] > max[axis] - min[axis]) axis = a;
+    }
+    return axis;
+}
+
+/* Quickselect (come std::nth_element): dopo la chiamata points[nth] è il punto che avrebbe
+   quella posizione nell'ordinamento lungo `axis`, quelli prima sono <= e quelli dopo >= */
+static void selectNth(Point *points, int start, int end, int nth, int axis) {
+    int lo = start, hi = end - 1;
 
-    /* Trovo l'indice del punto mediano che diventa la radice corrente */ 
+    while (hi > lo) {
+        /* Pivot scelto come mediana di tre per evitare il caso peggiore su dati ordinati */
+        double a = getCoord(&points[lo], axis);
+        double b = getCoord(&points[lo + (hi - lo) / 2], axis);
+        double c = getCoord(&points[hi], axis);
+        double pivot = (a < b) ? ((b < c) ? b : (a < c ? c : a))
+                               : ((a < c) ? a : (b < c ? c : b));
+
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (getCoord(&points[i], axis) < pivot) i++;
+            while (getCoord(&points[j], axis) > pivot) j--;
+            if (i <= j) {
+                Point tmp = points[i];
+                points[i] = points[j];
+                points[j] = tmp;
+                i++;
+                j--;
+            }
+        }
+
+        /* Continuo solo nella parte che contiene nth */
+        if (nth <= j) hi = j;
+        else if (nth >= i) lo = i;
+        else break;
+    }
+}
+
+static void buildNode(KDTree *tree, Point *points, int node, int start, int end, int depth) {
+    if (depth == tree->levels) return;
+
+    /* Taglio lungo l'asse di massima estensione dei punti del nodo: con molte dimensioni
+       l'alternanza degli assi lascerebbe celle molto allungate */
+    int axis = widestAxis(points, start, end);
     int mid = start + (end - start) / 2;
 
-    /* Creo il nodo e lo inserisco nell'albero */ 
-    KDNode *node = (KDNode *)malloc(sizeof(KDNode));
-    node->point = points[mid];
-    node->depth = depth;
+    /* Porto la mediana in posizione mid senza ordinare tutto l'intervallo */
+    selectNth(points, start, end, mid, axis);
 
-    /* In modo ricorsivo richiamo la funzione in modo da generare i sottoalberi */
-    node->left = buildKDTree(points, start, mid, depth + 1);
-    node->right = buildKDTree(points, mid + 1, end, depth + 1);
+    tree->nodes[node].split = (end > start) ? getCoord(&points[mid], axis) : 0.0;
+    tree->nodes[node].axis = axis;
 
-    return node;
+    buildNode(tree, points, 2 * node + 1, start, mid, depth + 1);
+    buildNode(tree, points, 2 * node + 2, mid, end, depth + 1);
 }
 
-void freeKDTree(KDNode *node) {
-    if (node == NULL) return;
-    freeKDTree(node->left);
-    freeKDTree(node->right);
-    free(node);
+/* Bounding box di ogni nodo: le foglie dai loro punti, i nodi interni come unione dei figli */
+static void buildBounds(KDTree *tree, int node, int start, int end, int depth) {
+    double *box = &tree->bounds[KD_BOX_STRIDE * node];
+
+    if (depth == tree->levels) {
+        for (int a = 0; a < KNN_DIM; a++) {
+            box[a] = DBL_MAX;
+            box[KNN_DIM + a] = -DBL_MAX;
+        }
+        for (int i = start; i < end; i++) {
+            for (int a = 0; a < KNN_DIM; a++) {
+                double c = tree->coord[a][i];
+                if (c < box[a]) box[a] = c;
+                if (c > box[KNN_DIM + a]) box[KNN_DIM + a] = c;
+            }
+        }
+        return;
+    }
+
+    int mid = start + (end - start) / 2;
+    buildBounds(tree, 2 * node + 1, start, mid, depth + 1);
+    buildBounds(tree, 2 * node + 2, mid, end, depth + 1);
+
+    const double *left = &tree->bounds[KD_BOX_STRIDE * (2 * node + 1)];
+    const double *right = &tree->bounds[KD_BOX_STRIDE * (2 * node + 2)];
+    for (int a = 0; a < KNN_DIM; a++) {
+        int b = KNN_DIM + a;
+        box[a] = (left[a] < right[a]) ? left[a] : right[a];
+        box[b] = (left[b] > right[b]) ? left[b] : right[b];
+    }
 }
 
-void findKNearestNeighbors(KDNode *root, Point3D target, int k, int *neighbors, double *distances) {                  
-    /* Questa parte è come prima */
-    NearestNeighbor *nearestNeighbors = (NearestNeighbor *)malloc(k * sizeof(NearestNeighbor));
-    for (int i = 0; i < k; i++) {
-        nearestNeighbors[i].distance = DBL_MAX;
-        nearestNeighbors[i].index = -1;
-    }
-    /* Per migliorare le performance, stavolta viene fatto in modo ricorsivo */ 
-    void searchKNN(KDNode *node) {
-        if (node == NULL) return;
-
-        /* Calcolo la distanza del target al punto corrente */
-        double dist = calculateDistance(target, node->point);
-        
-        /* Se il punto corrente è più vicino, ri ordino i vicini in modo che l'ultimo nodo nell'array
-           sia il punto più lontano dei vicini 
-        */   
-        if (dist < nearestNeighbors[k-1].distance) {
-            nearestNeighbors[k-1].distance = dist;
-            nearestNeighbors[k-1].index = node->point.original_index;
-            
-            qsort(nearestNeighbors, k, sizeof(NearestNeighbor), compareNeighbors);
-        }
-
-        /* Determino l'asse di confronto per il nodo corrente */
-        int axis = node->depth % 3;
-        double axisDiff = 0.0;
-        double axisDist = 0.0;
-        
-        /* Scelgo dove spostarmi in base all'asse corrente
-           e calcolo la distanza dal nodo target al nodo corrente 
-        */ 
-        switch (axis) {
-            case 0: 
-                axisDiff = target.x - node->point.x; 
-                axisDist = fabs(axisDiff);
-                break;
-            case 1: 
-                axisDiff = target.y - node->point.y; 
-                axisDist = fabs(axisDiff);
-                break;
-            case 2: 
-                axisDiff = target.z - node->point.z; 
-                axisDist = fabs(axisDiff);
-                break;
-        }
-
-        /* Se la distanza è negativa, significa che il nodo target si trova nel sotto-albero sinistro
-           altrimenti nel sotto-albero destro 
-        */
-        KDNode *nearerSubtree = (axisDiff < 0) ? node->left : node->right;
-        KDNode *furtherSubtree = (axisDiff < 0) ? node->right : node->left;
-
-        /* Quindi mi sposto nel sotto-albero più vicino e richiamo la funzione in modo ricorsivo */
-        searchKNN(nearerSubtree);
-
-        /* Se la distanza corrente è più vicina della distanza salvata più lontana
-           significa che ci possono essere dei vicini più vicini, quindi ispeziono anche l'altro 
-        */
-        if (axisDist < nearestNeighbors[k-1].distance) {
-            searchKNN(furtherSubtree);
-        }
-    }
-
-    /* Quindi alla fine richiamo la funzione ricorsiva partendo dalla radice */
-    searchKNN(root);
-
-    /* Salvo i risultati ottenuti nei relativi array */ 
+size_t kdTreePayloadSize(int n, int levels) {
+    int num_nodes = (1 << levels) - 1;
+    int num_boxes = 2 * num_nodes + 1;
+    size_t bytes = num_nodes * sizeof(KDNode)
+                 + KD_BOX_STRIDE * (size_t)num_boxes * sizeof(double)
+                 + KNN_DIM * (size_t)n * sizeof(double)
+                 + (size_t)n * sizeof(int);
+    return (bytes + 7) & ~(size_t)7;
+}
+
+void kdTreeLayout(KDTree *tree, void *payload, int n, int levels) {
+    int num_nodes = (1 << levels) - 1;
+    int num_boxes = 2 * num_nodes + 1;
+    tree->n = n;
+    tree->levels = levels;
+    tree->num_nodes = num_nodes;
+    tree->nodes = (KDNode *)payload;
+    tree->bounds = (double *)(tree->nodes + num_nodes);
+    tree->coord[0] = tree->bounds + KD_BOX_STRIDE * (size_t)num_boxes;
+    for (int d = 1; d < KNN_DIM; d++) {
+        tree->coord[d] = tree->coord[d - 1] + n;
+    }
+    tree->index = (int *)(tree->coord[KNN_DIM - 1] + n);
+    tree->removed = NULL;
+}
+
+KDTree* buildKDTree(Point *points, int n) {
+    /* Numero di livelli interni necessari per avere foglie con al più KD_BUCKET_SIZE punti: con le
+       divisioni dispari la metà destra ha un punto in più, quindi conta l'arrotondamento per eccesso */
+    int levels = 0;
+    while ((((long long)n + (1LL << levels) - 1) >> levels) > KD_BUCKET_SIZE) levels++;
+
+    /* Un'unica allocazione: header, nodi interni, bounding box e poi le coordinate SoA delle foglie */
+    char *block = (char *)malloc(sizeof(KDTree) + kdTreePayloadSize(n, levels));
+    KDTree *tree = (KDTree *)block;
+    kdTreeLayout(tree, block + sizeof(KDTree), n, levels);
+
+    /* Azzero i nodi e il padding finale: il blocco può essere salvato così com'è (vedi indexio.h) */
+    memset(tree->nodes, 0, tree->num_nodes * sizeof(KDNode));
+    memset(tree->index + n, 0, (char *)tree->nodes + kdTreePayloadSize(n, levels) - (char *)(tree->index + n));
+
+    buildNode(tree, points, 0, 0, n, 0);
+
+    /* I punti ora sono nell'ordine delle foglie: li copio nelle colonne del blocco */
+    for (int i = 0; i < n; i++) {
+        for (int d = 0; d < KNN_DIM; d++) {
+            tree->coord[d][i] = points[i].coord[d];
+        }
+        tree->index[i] = points[i].original_index;
+    }
+    buildBounds(tree, 0, 0, n, 0);
+
+    return tree;
+}
+
+void freeKDTree(KDTree *tree) {
+    free(tree->removed);
+    free(tree);
+}
+
+/* Stato condiviso dalla ricerca ricorsiva */
+typedef struct {
+    const KDTree *tree;
+    double target[KNN_DIM];
+    int self;           /* original_index del target, che non è vicino di sé stesso */
+    KNNHeap *heap;
+    int leaves;         /* Foglie visitate */
+    long long nodes;    /* Nodi visitati, foglie comprese */
+    long long distances; /* Distanze calcolate */
+} SearchContext;
+
+/* Foglia: scorro il bucket di punti confrontando le distanze ridotte */
+static void scanLeaf(SearchContext *ctx, int start, int end) {
+    const KDTree *tree = ctx->tree;
+    KNNHeap *heap = ctx->heap;
+
+    for (int i = start; i < end; i++) {
+        double dist = treeDistance(tree, i, ctx->target);
+
+        /* Se il punto corrente è più vicino del peggiore tra i vicini, lo inserisco
+           (a meno che sia il target stesso o un punto cancellato) */
+        if (dist <= knnHeapWorst(heap) && tree->index[i] != ctx->self &&
+            (tree->removed == NULL || !tree->removed[i])) {
+            knnHeapPush(heap, dist, tree->index[i]);
+        }
+    }
+    ctx->leaves++;
+    ctx->nodes++;
+    ctx->distances += end - start;
+}
+
+static void searchKNN(SearchContext *ctx, int node, int start, int end, int depth) {
+    const KDTree *tree = ctx->tree;
+    KNNHeap *heap = ctx->heap;
+
+    if (depth == tree->levels) {
+        scanLeaf(ctx, start, end);
+        return;
+    }
+    ctx->nodes++;
+
+    /* Se la differenza è negativa, il target si trova nel sotto-albero sinistro, altrimenti nel destro */
+    const KDNode *current = &tree->nodes[node];
+    double axisDiff = ctx->target[current->axis] - current->split;
+    int mid = start + (end - start) / 2;
+
+    if (axisDiff < 0) {
+        searchKNN(ctx, 2 * node + 1, start, mid, depth + 1);
+        /* Ispeziono l'altro sotto-albero solo se il piano di taglio è più vicino del vicino più lontano */
+        if (farBound(tree, ctx->target, axisDiff, current->axis, 2 * node + 2) <= knnHeapWorst(heap)) {
+            searchKNN(ctx, 2 * node + 2, mid, end, depth + 1);
+        }
+    } else {
+        searchKNN(ctx, 2 * node + 2, mid, end, depth + 1);
+        if (farBound(tree, ctx->target, axisDiff, current->axis, 2 * node + 1) <= knnHeapWorst(heap)) {
+            searchKNN(ctx, 2 * node + 1, start, mid, depth + 1);
+        }
+    }
+}
+
+/* Sotto-albero in attesa nella coda best-bin-first, con la distanza minima (ridotta) dalla sua cella */
+typedef struct {
+    double bound;
+    int node, start, end, depth;
+} KDBranch;
+
+/* Capacità iniziale della coda, raddoppiata nell'arena quando si riempie */
+#define KD_BRANCH_INITIAL 64
+
+/* Coda di priorità (min-heap su bound) dei sotto-alberi da visitare, nell'arena del thread */
+typedef struct {
+    KDBranch *items;
+    int size, capacity;
+    Arena *arena;
+} BranchQueue;
+
+static void branchPush(BranchQueue *queue, KDBranch branch) {
+    if (queue->size == queue->capacity) {
+        /* Il vecchio buffer resta nell'arena fino al reset di fine visita */
+        queue->capacity *= 2;
+        KDBranch *grown = ARENA_ARRAY(queue->arena, KDBranch, queue->capacity);
+        memcpy(grown, queue->items, queue->size * sizeof(KDBranch));
+        queue->items = grown;
+    }
+
+    KDBranch *items = queue->items;
+    int i = queue->size++;
+    while (i > 0 && items[(i - 1) / 2].bound > branch.bound) {
+        items[i] = items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    items[i] = branch;
+}
+
+static KDBranch branchPop(BranchQueue *queue) {
+    KDBranch *items = queue->items;
+    KDBranch top = items[0];
+    KDBranch last = items[--queue->size];
+
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= queue->size) break;
+        if (child + 1 < queue->size && items[child + 1].bound < items[child].bound) child++;
+        if (items[child].bound >= last.bound) break;
+        items[i] = items[child];
+        i = child;
+    }
+    if (queue->size > 0) items[i] = last;
+    return top;
+}
+
+/* Ricerca best-bin-first: scendo fino ad una foglia accodando i sotto-alberi scartati, poi
+   riparto da quello con la cella più vicina finché è entro d_k / (1 + eps) */
+static void searchBestBin(SearchContext *ctx, const KDSearchParams *params) {
+    const KDTree *tree = ctx->tree;
+    KNNHeap *heap = ctx->heap;
+    double scale = metricReduce(1.0 + params->eps);
+
+    Arena *arena = threadArena();
+    ArenaMark mark = arenaMark(arena);
+    BranchQueue queue;
+    queue.arena = arena;
+    queue.items = ARENA_ARRAY(arena, KDBranch, KD_BRANCH_INITIAL);
+    queue.size = 0;
+    queue.capacity = KD_BRANCH_INITIAL;
+
+    KDBranch root = {0.0, 0, 0, tree->n, 0};
+    branchPush(&queue, root);
+
+    while (queue.size > 0) {
+        if (params->max_leaves > 0 && ctx->leaves >= params->max_leaves) break;
+
+        /* La coda è ordinata: se il più vicino è troppo lontano lo sono anche tutti gli altri */
+        KDBranch branch = branchPop(&queue);
+        if (branch.bound * scale > knnHeapWorst(heap)) break;
+
+        int node = branch.node, start = branch.start, end = branch.end, depth = branch.depth;
+        while (depth < tree->levels) {
+            const KDNode *current = &tree->nodes[node];
+            double axisDiff = ctx->target[current->axis] - current->split;
+            int mid = start + (end - start) / 2;
+
+            /* La cella del figlio lontano dista almeno quanto il piano di taglio */
+            KDBranch far;
+            far.depth = depth + 1;
+            if (axisDiff < 0) {
+                far.node = 2 * node + 2;
+                far.start = mid;
+                far.end = end;
+                node = 2 * node + 1;
+                end = mid;
+            } else {
+                far.node = 2 * node + 1;
+                far.start = start;
+                far.end = mid;
+                node = 2 * node + 2;
+                start = mid;
+            }
+            double plane = farBound(tree, ctx->target, axisDiff, current->axis, far.node);
+            far.bound = (plane > branch.bound) ? plane : branch.bound;
+            if (far.bound * scale <= knnHeapWorst(heap)) {
+                branchPush(&queue, far);
+            }
+            ctx->nodes++;
+            depth++;
+        }
+        scanLeaf(ctx, start, end);
+    }
+
+    arenaReset(arena, mark);
+}
+
+void findKNearestNeighbors(const KDTree *tree, Point target, int k, int *neighbors, double *distances) {
+    findKNearestNeighborsWithin(tree, target, k, DBL_MAX, neighbors, distances);
+}
+
+void findKNearestNeighborsWithin(const KDTree *tree, Point target, int k, double maxDistance,
+                                 int *neighbors, double *distances) {
+    findKNearestNeighborsApprox(tree, target, k, maxDistance, NULL, neighbors, distances);
+}
+
+int kdSearchIsExact(const KDSearchParams *params) {
+    return params == NULL || (params->eps == 0.0 && params->max_leaves == 0);
+}
+
+int kdTreeUpdateHeap(const KDTree *tree, Point target, const KDSearchParams *params, KNNHeap *heap) {
+    SearchContext ctx;
+    ctx.tree = tree;
+    memcpy(ctx.target, target.coord, sizeof(ctx.target));
+    ctx.self = target.original_index;
+    ctx.heap = heap;
+    ctx.leaves = 0;
+    ctx.nodes = 0;
+    ctx.distances = 0;
+
+    /* Richiamo la funzione ricorsiva partendo dalla radice, oppure la visita best-bin-first
+       se la ricerca è approssimata */
+    if (tree->n == 0) return 0;
+    if (kdSearchIsExact(params)) {
+        searchKNN(&ctx, 0, 0, tree->n, 0);
+    } else {
+        searchBestBin(&ctx, params);
+    }
+    profileCount(COUNTER_NODES, ctx.nodes);
+    profileCount(COUNTER_DISTANCES, ctx.distances);
+    return ctx.leaves;
+}
+
+int findKNearestNeighborsApprox(const KDTree *tree, Point target, int k, double maxDistance,
+                                const KDSearchParams *params, int *neighbors, double *distances) {
+    /* Durante la ricerca lavoro con le distanze ridotte, la radice si fa solo alla fine */
+    double maxReduced = metricReduceLimit(maxDistance);
+
+    /* I vicini stanno nell'arena del thread, liberata in blocco alla fine della query */
+    Arena *arena = threadArena();
+    ArenaMark mark = arenaMark(arena);
+    KNNEntry *entries = ARENA_ARRAY(arena, KNNEntry, k);
+    KNNHeap heap;
+    knnHeapInit(&heap, entries, k, maxReduced);
+
+    int leaves = kdTreeUpdateHeap(tree, target, params, &heap);
+    knnHeapSort(&heap);
+    profileCount(COUNTER_HEAP_INSERTS, heap.inserts);
+
+    /* Salvo i risultati ottenuti nei relativi array, le posizioni non riempite restano vuote */
     for (int i = 0; i < k; i++) {
-        neighbors[i] = nearestNeighbors[i].index;
-        distances[i] = nearestNeighbors[i].distance;
+        if (i < heap.size) {
+            neighbors[i] = entries[i].index;
+            distances[i] = metricFinish(entries[i].distance);
+        } else {
+            neighbors[i] = -1;
+            distances[i] = DBL_MAX;
+        }
     }
 
-    free(nearestNeighbors);
+    arenaReset(arena, mark);
+    return leaves;
 }
 
-void generatePoints(Point3D *points, int n, int start_idx) {
-    srand(time(NULL) + start_idx);
-    for (int i = 0; i < n; i++) {
-        points[i].x = (double)rand() / RAND_MAX * 100.0;
-        points[i].y = (double)rand() / RAND_MAX * 100.0;
-        points[i].z = (double)rand() / RAND_MAX * 100.0;
-        points[i].original_index = start_idx + i;
+/* Stato della visita dual-tree, condiviso dai thread: ognuno scende da un sotto-albero di query diverso,
+   quindi contenitori e limiti dei nodi non sono mai scritti da due thread */
+typedef struct {
+    const KDTree *queries;
+    const KDTree *refs;
+    KNNHeap *heaps;         /* Un contenitore per punto dell'albero delle query */
+    double *bound;          /* Per ogni nodo di query, la k-esima distanza ridotta peggiore tra i suoi punti */
+    int task_depth;         /* Profondità dei sotto-alberi di query assegnati ai thread */
+} DualTreeSearch;
+
+/* Lavoro svolto da un thread in un task dual-tree, sommato ai contatori alla fine del task */
+typedef struct {
+    long long nodes;        /* Coppie di nodi visitate */
+    long long distances;
+} DualTreeWork;
+
+/* Nodo dell'albero di query o di riferimento visitato, con il suo intervallo di punti */
+typedef struct {
+    int node, start, end, depth;
+} DualTreeNode;
+
+static DualTreeNode childNode(DualTreeNode parent, int right) {
+    int mid = parent.start + (parent.end - parent.start) / 2;
+    DualTreeNode child;
+    child.node = 2 * parent.node + 1 + right;
+    child.start = right ? mid : parent.start;
+    child.end = right ? parent.end : mid;
+    child.depth = parent.depth + 1;
+    return child;
+}
+
+/* Caso base tra due foglie: ogni query confronta tutti i punti della foglia di riferimento,
+   poi il limite della foglia di query diventa la peggiore delle loro k-esime distanze */
+static void dualTreeBase(DualTreeSearch *search, DualTreeNode q, DualTreeNode r, DualTreeWork *work) {
+    const KDTree *qt = search->queries, *rt = search->refs;
+    const double *rbox = &rt->bounds[KD_BOX_STRIDE * r.node];
+    double bound = 0.0;
+
+    for (int i = q.start; i < q.end; i++) {
+        KNNHeap *heap = &search->heaps[i];
+        double target[KNN_DIM];
+        for (int d = 0; d < KNN_DIM; d++) {
+            target[d] = qt->coord[d][i];
+        }
+        double worst = knnHeapWorst(heap);
+
+        if (pointBoxDistance(target, rbox) <= worst) {
+            int self = qt->index[i];
+            work->distances += r.end - r.start;
+            for (int j = r.start; j < r.end; j++) {
+                double dist = treeDistance(rt, j, target);
+                if (dist <= worst && rt->index[j] != self) {
+                    knnHeapPush(heap, dist, rt->index[j]);
+                    worst = knnHeapWorst(heap);
+                }
+            }
+        }
+        if (worst > bound) bound = worst;
+    }
+    search->bound[q.node] = bound;
+}
+
+/* Visita la coppia (q, r); `dist` è la distanza ridotta tra i loro bounding box, già calcolata
+   dal chiamante per scegliere l'ordine dei figli */
+static void dualTreeVisit(DualTreeSearch *search, DualTreeNode q, DualTreeNode r, double dist,
+                          DualTreeWork *work) {
+    const KDTree *qt = search->queries, *rt = search->refs;
+
+    /* Nessun punto di r può entrare tra i vicini delle query di q */
+    if (dist > search->bound[q.node]) return;
+    work->nodes++;
+
+    int qleaf = (q.depth == qt->levels), rleaf = (r.depth == rt->levels);
+    if (qleaf && rleaf) {
+        dualTreeBase(search, q, r, work);
+        return;
+    }
+
+    /* Scendo nel nodo più grande; a parità nel nodo di query, così i limiti dei figli si stringono prima */
+    if (!qleaf && (rleaf || q.end - q.start >= r.end - r.start)) {
+        DualTreeNode left = childNode(q, 0), right = childNode(q, 1);
+        const double *rbox = &rt->bounds[KD_BOX_STRIDE * r.node];
+        dualTreeVisit(search, left, r, boxPairDistance(&qt->bounds[KD_BOX_STRIDE * left.node], rbox), work);
+        dualTreeVisit(search, right, r, boxPairDistance(&qt->bounds[KD_BOX_STRIDE * right.node], rbox), work);
+
+        double bl = search->bound[left.node], br = search->bound[right.node];
+        search->bound[q.node] = (bl > br) ? bl : br;
+    } else {
+        /* Prima il figlio di riferimento più vicino, che abbassa di più il limite per l'altro */
+        DualTreeNode left = childNode(r, 0), right = childNode(r, 1);
+        const double *qbox = &qt->bounds[KD_BOX_STRIDE * q.node];
+        double dl = boxPairDistance(qbox, &rt->bounds[KD_BOX_STRIDE * left.node]);
+        double dr = boxPairDistance(qbox, &rt->bounds[KD_BOX_STRIDE * right.node]);
+        if (dl <= dr) {
+            dualTreeVisit(search, q, left, dl, work);
+            dualTreeVisit(search, q, right, dr, work);
+        } else {
+            dualTreeVisit(search, q, right, dr, work);
+            dualTreeVisit(search, q, left, dl, work);
+        }
+    }
+}
+
+/* Ogni task è un sotto-albero di query alla profondità task_depth, visitato contro tutto l'albero di riferimento */
+static void dualTreeChunk(int begin, int end, int thread_id, void *context) {
+    (void)thread_id;
+    DualTreeSearch *search = (DualTreeSearch *)context;
+    DualTreeWork work = {0, 0};
+
+    for (int t = begin; t < end; t++) {
+        DualTreeNode q = {0, 0, search->queries->n, 0};
+        for (int level = search->task_depth - 1; level >= 0; level--) {
+            q = childNode(q, (t >> level) & 1);
+        }
+        DualTreeNode r = {0, 0, search->refs->n, 0};
+        dualTreeVisit(search, q, r, boxPairDistance(&search->queries->bounds[KD_BOX_STRIDE * q.node], search->refs->bounds),
+                      &work);
+    }
+    profileCount(COUNTER_NODES, work.nodes);
+    profileCount(COUNTER_DISTANCES, work.distances);
+}
+
+void dualTreeKNN(const KDTree *queries, const KDTree *refs, int k, int num_threads,
+                 int *neighbors, double *distances) {
+    int nq = queries->n;
+    int num_boxes = 2 * queries->num_nodes + 1;
+
+    KNNEntry *entries = (KNNEntry *)malloc(((size_t)nq * k > 0 ? (size_t)nq * k : 1) * sizeof(KNNEntry));
+    KNNHeap *heaps = (KNNHeap *)malloc((nq > 0 ? nq : 1) * sizeof(KNNHeap));
+    double *bound = (double *)malloc(num_boxes * sizeof(double));
+    for (int i = 0; i < nq; i++) {
+        knnHeapInit(&heaps[i], &entries[(size_t)i * k], k, DBL_MAX);
+    }
+    for (int b = 0; b < num_boxes; b++) {
+        bound[b] = DBL_MAX;
+    }
+
+    /* Qualche sotto-albero per thread, per bilanciare regioni con densità diverse */
+    DualTreeSearch search;
+    search.queries = queries;
+    search.refs = refs;
+    search.heaps = heaps;
+    search.bound = bound;
+    search.task_depth = 0;
+    while (num_threads > 1 && (1 << search.task_depth) < 8 * num_threads && search.task_depth < queries->levels) {
+        search.task_depth++;
+    }
+    if (nq > 0 && refs->n > 0) {
+        parallelFor(1 << search.task_depth, 1, num_threads, dualTreeChunk, &search);
+    }
+
+    long long inserts = 0;
+    for (int i = 0; i < nq; i++) {
+        knnHeapSort(&heaps[i]);
+        inserts += heaps[i].inserts;
+        for (int j = 0; j < k; j++) {
+            if (j < heaps[i].size) {
+                neighbors[(size_t)i * k + j] = heaps[i].entries[j].index;
+                distances[(size_t)i * k + j] = metricFinish(heaps[i].entries[j].distance);
+            } else {
+                neighbors[(size_t)i * k + j] = -1;
+                distances[(size_t)i * k + j] = DBL_MAX;
+            }
+        }
+    }
+
+    profileCount(COUNTER_HEAP_INSERTS, inserts);
+
+    free(entries);
+    free(heaps);
+    free(bound);
+}
+
+/* Stato condiviso dalla ricerca per raggio e dal conteggio */
+typedef struct {
+    const KDTree *tree;
+    double target[KNN_DIM];
+    int self;           /* original_index del target, che non viene restituito né contato */
+    double r2;          /* Raggio ridotto (al quadrato per le metriche euclidee) */
+    int max_count;      /* Il conteggio si ferma a questo valore, 0 = nessun limite */
+    int count;
+    int *indices;       /* NULL per il solo conteggio */
+    double *distances;
+    long long nodes;    /* Nodi visitati e distanze calcolate, per i contatori di profile.h */
+    long long evaluations;
+} RangeContext;
+
+/* Distanza massima (ridotta) tra un punto e un bounding box (l'angolo più lontano) */
+static double pointBoxMaxDistance(const double *p, const double *box) {
+    double sum = 0.0;
+    for (int d = 0; d < KNN_DIM; d++) {
+        sum = metricAddGap(sum, metricIntervalFar(p[d], box[d], box[KNN_DIM + d], d), d);
+    }
+    return sum;
+}
+
+static void rangeScan(RangeContext *ctx, int start, int end) {
+    const KDTree *tree = ctx->tree;
+    ctx->evaluations += end - start;
+    for (int i = start; i < end; i++) {
+        if (tree->removed != NULL && tree->removed[i]) continue;
+        double dist = treeDistance(tree, i, ctx->target);
+        if (dist <= ctx->r2 && tree->index[i] != ctx->self) {
+            if (ctx->indices != NULL) {
+                ctx->indices[ctx->count] = tree->index[i];
+                ctx->distances[ctx->count] = metricFinish(dist);
+            }
+            ctx->count++;
+        }
+    }
+}
+
+static void rangeNode(RangeContext *ctx, int node, int start, int end, int depth) {
+    const KDTree *tree = ctx->tree;
+    if (ctx->max_count > 0 && ctx->count >= ctx->max_count) return;
+
+    const double *box = &tree->bounds[KD_BOX_STRIDE * node];
+    double near = pointBoxDistance(ctx->target, box);
+    ctx->nodes++;
+    if (near > ctx->r2) return;
+
+    if (depth == tree->levels) {
+        rangeScan(ctx, start, end);
+        return;
+    }
+
+    /* Sotto-albero tutto dentro la sfera: il numero di punti è la lunghezza del suo intervallo.
+       Se il box contiene il target (near = 0) il punto della query potrebbe esserci, quindi si scende */
+    if (tree->removed == NULL && near > 0.0 && pointBoxMaxDistance(ctx->target, box) <= ctx->r2) {
+        if (ctx->indices != NULL) {
+            ctx->evaluations += end - start;
+            for (int i = start; i < end; i++) {
+                ctx->indices[ctx->count + i - start] = tree->index[i];
+                ctx->distances[ctx->count + i - start] = metricFinish(treeDistance(tree, i, ctx->target));
+            }
+        }
+        ctx->count += end - start;
+        return;
     }
+
+    int mid = start + (end - start) / 2;
+    rangeNode(ctx, 2 * node + 1, start, mid, depth + 1);
+    rangeNode(ctx, 2 * node + 2, mid, end, depth + 1);
+}
+
+static void rangeInit(RangeContext *ctx, const KDTree *tree, Point target, double radius) {
+    ctx->tree = tree;
+    memcpy(ctx->target, target.coord, sizeof(ctx->target));
+    ctx->self = target.original_index;
+    ctx->r2 = metricReduce(radius);
+    ctx->max_count = 0;
+    ctx->count = 0;
+    ctx->indices = NULL;
+    ctx->distances = NULL;
+    ctx->nodes = 0;
+    ctx->evaluations = 0;
+}
+
+static void rangeFinish(const RangeContext *ctx) {
+    profileCount(COUNTER_NODES, ctx->nodes);
+    profileCount(COUNTER_DISTANCES, ctx->evaluations);
+}
+
+int kdTreeRangeCount(const KDTree *tree, Point target, double radius, int max_count) {
+    if (tree->n == 0 || radius < 0.0) return 0;
+    RangeContext ctx;
+    rangeInit(&ctx, tree, target, radius);
+    ctx.max_count = max_count;
+    rangeNode(&ctx, 0, 0, tree->n, 0);
+    rangeFinish(&ctx);
+    return (max_count > 0 && ctx.count > max_count) ? max_count : ctx.count;
+}
+
+int kdTreeRadiusSearch(const KDTree *tree, Point target, double radius, int *indices, double *distances) {
+    if (tree->n == 0 || radius < 0.0) return 0;
+    RangeContext ctx;
+    rangeInit(&ctx, tree, target, radius);
+    ctx.indices = indices;
+    ctx.distances = distances;
+    rangeNode(&ctx, 0, 0, tree->n, 0);
+    rangeFinish(&ctx);
+    return ctx.count;
 }
@@ -1,104 +1,115 @@
 #ifndef UTIL_H
 #define UTIL_H
 
-typedef struct {
-    double x, y, z;
-    int original_index;
-} Point3D;
+#include <stddef.h>
+#include "knnheap.h"
+#include "point.h"
+#include "metric.h"
+
+/* Numero massimo di punti in un bucket foglia */
+#define KD_BUCKET_SIZE 16
 
-/* Prima era DistanceIdx, un pò per variare */
+/* Double per bounding box di un nodo: prima i KNN_DIM minimi, poi i KNN_DIM massimi */
+#define KD_BOX_STRIDE (2 * KNN_DIM)
+
+/** @brief: Nodo interno del KD-Tree
+ *  il valore di split e l'asse su cui è stato scelto (quello di massima estensione dei punti del nodo), i figli non sono salvati
+ *  perché l'albero è implicito: i figli del nodo i sono 2i+1 e 2i+2
+ */
 typedef struct {
-    double distance;
-    int index;
-} NearestNeighbor;
-
-/** @brief: Salviamo le info dei nodi
- *  il punto di riferimento, i riferimento ai sottoalberi destro e sinistro
- *  la sua profondità
- */
-typedef struct KDNode {
-    Point3D point;
-    struct KDNode *left;
-    struct KDNode *right;
-    int depth;
+    double split;
+    int axis;
 } KDNode;
 
+/** @brief: KD-Tree compatto, allocato in un unico blocco
+ *  I nodi interni sono in ordine implicito (BFS), le foglie sono bucket di al più
+ *  KD_BUCKET_SIZE punti le cui coordinate sono salvate per colonne (coord[0][], ..., coord[KNN_DIM - 1][]).
+ *  L'intervallo di punti di un nodo si ricava scendendo dalla radice: il nodo che copre
+ *  [start, end) divide in [start, mid) e [mid, end) con mid = start + (end - start) / 2.
+ *  Ogni nodo, foglie comprese (numerate di seguito ai nodi interni, da num_nodes), ha il
+ *  bounding box dei suoi punti in bounds[KD_BOX_STRIDE * nodo]: prima i KNN_DIM minimi, poi i KNN_DIM massimi.
+ */
+typedef struct {
+    int n;              /* Numero di punti */
+    int levels;         /* Numero di livelli interni, le foglie sono a profondità levels */
+    int num_nodes;      /* Numero di nodi interni: 2^levels - 1 */
+    KDNode *nodes;
+    double *bounds;     /* 2 * num_nodes + 1 bounding box, un box vuoto ha min = DBL_MAX e max = -DBL_MAX */
+    double *coord[KNN_DIM]; /* Coordinate dei punti nell'ordine delle foglie, una colonna per asse */
+    int *index;         /* original_index dei punti nello stesso ordine */
+    unsigned char *removed; /* NULL, oppure 1 per i punti cancellati (vedi dynamic.h), allocato a parte e liberato da freeKDTree */
+} KDTree;
+
+/** @brief: Parametri della ricerca approssimata
+ *  Con eps = 0 e max_leaves = 0 la ricerca è esatta.
+ */
+typedef struct {
+    double eps;         /* Un nodo viene visitato solo se più vicino di d_k / (1 + eps) */
+    int max_leaves;     /* Numero massimo di foglie visitate per query, 0 = nessun limite */
+} KDSearchParams;
+
 /**
- * @brief Confronta due punti in base alla coordinata X.
+ * @brief Calcola la distanza tra due punti.
  *
- * Questa funzione viene utilizzata per ordinare un array di punti 3D 
- * in base alla loro coordinata X. 
+ * Questa funzione calcola la distanza tra due punti nello spazio a KNN_DIM dimensioni
+ * con la metrica scelta a compile time (euclidea di default, vedi metric.h).
  *
- * @param a Puntatore al primo punto.
- * @param b Puntatore al secondo punto.
- * @return Un valore negativo se il primo punto ha una X minore del secondo, 
- *         un valore positivo se è maggiore, e 0 se sono uguali.
+ * @param p1 Il primo punto.
+ * @param p2 Il secondo punto.
+ * @return La distanza tra p1 e p2.
  */
-int compareX(const void *a, const void *b);
-int compareY(const void *a, const void *b);
-int compareZ(const void *a, const void *b);
+double calculateDistance(Point p1, Point p2);
 
 /**
- * @brief Confronta due vicini più prossimi in base alla distanza.
+ * @brief Costruisce un KD-Tree compatto a partire da un array di punti.
+ *
+ * Ogni nodo taglia lungo l'asse su cui i suoi punti sono più sparsi, e il punto mediano lungo quell'asse viene portato in posizione con un
+ * quickselect (tempo lineare per livello, O(n log n) in totale) invece di ordinare l'intervallo.
+ * Nodi e coordinate delle foglie vengono salvati in un'unica allocazione.
  *
- * Questa funzione viene utilizzata da qsort per ordinare un array 
- * di vicini in ordine crescente di distanza dal punto di riferimento.
+ * @param points Array di punti, viene riordinato durante la costruzione.
+ * @param n Numero di punti.
  *
- * @param a Puntatore al primo vicino.
- * @param b Puntatore al secondo vicino.
- * @return Un valore negativo se il primo vicino è più vicino del secondo,
- *         un valore positivo se è più lontano, e 0 se hanno la stessa distanza.
+ * @return Puntatore all'albero KD creato.
+ *
+ * @note L'array di punti deve essere allocato e inizializzato prima della chiamata.
  */
-int compareNeighbors(const void *a, const void *b);
+KDTree* buildKDTree(Point *points, int n);
 
 /**
- * @brief Calcola la distanza euclidea tra due punti 3D.
- *
- * Questa funzione calcola la distanza tra due punti nello spazio tridimensionale
- * utilizzando la formula della distanza euclidea.
+ * @brief Dimensione in byte dei dati di un KD-Tree che seguono la struct KDTree nel suo blocco.
  *
- * @param p1 Il primo punto nello spazio 3D.
- * @param p2 Il secondo punto nello spazio 3D.
- * @return La distanza euclidea tra p1 e p2.
+ * Nodi interni, bounding box, coordinate e indici occupano un intervallo contiguo la cui
+ * disposizione dipende solo da n e dal numero di livelli. La dimensione è arrotondata a 8 byte.
  */
-double calculateDistance(Point3D p1, Point3D p2);
+size_t kdTreePayloadSize(int n, int levels);
 
 /**
- * @brief Costruisce un KD-Tree ricorsivamente a partire da un array di punti 3D.
+ * @brief Imposta campi e puntatori di un KD-Tree i cui dati iniziano a `payload`.
  *
- * La funzione costruisce un albero KD partendo da un array di punti 3D. I punti vengono
- * ordinati in base all'asse corrente (x, y o z) determinato dal livello di profondità,
- * e il punto mediano diventa la radice dell'albero. La funzione è ricorsiva e costruisce
- * il sottoalbero sinistro e destro chiamando la funzione su sottoinsiemi di punti.
- *
- * @param points Array di punti 3D.
- * @param start Indice di inizio dell'intervallo di punti da considerare.
- * @param end Indice di fine dell'intervallo di punti da considerare.
- * @param depth Profondità corrente nell'albero, usata per determinare l'asse su cui ordinare.
- * 
- * @return Puntatore alla radice dell'albero KD creato.
- * 
- * @note L'array di punti deve essere allocato e inizializzato prima della chiamata.
+ * È la disposizione usata da buildKDTree: i puntatori si ricavano da n e levels, quindi dei dati
+ * letti o mappati da file non richiedono alcuna correzione (`removed` viene impostato a NULL).
  */
-KDNode* buildKDTree(Point3D *points, int start, int end, int depth);
-
+void kdTreeLayout(KDTree *tree, void *payload, int n, int levels);
 
 /**
- * @brief Libera la memoria occupata da un albero KD in modo ricorsivo.
- * @param node Puntatore alla radice dell'albero KD (o sottoalbero) da liberare.
- * @note Questa funzione non restituisce alcun valore e assume che i nodi siano stati allocati dinamicamente.
+ * @brief Libera la memoria occupata da un albero KD.
+ * @param tree Puntatore all'albero da liberare.
+ * @note Essendo un unico blocco, la deallocazione è O(1) (più l'eventuale array `removed`).
  */
-void freeKDTree(KDNode *node);
+void freeKDTree(KDTree *tree);
 
 /**
  * @brief Trova i k vicini più prossimi per un punto target in un albero KD.
  *
  * La funzione esegue una ricerca ricorsiva nel KD-Tree per trovare i k punti più vicini al punto target.
- * Viene utilizzata una struttura di dati ausiliaria per tenere traccia dei k vicini più prossimi
- * e delle relative distanze. La ricerca è ottimizzata per visitare prima il sottoalbero più vicino e
- * successivamente il sottoalbero più lontano solo se necessario.
+ * I k vicini migliori sono tenuti in un KNNHeap nell'arena del thread (inserimenti in O(log k)) e le distanze
+ * sono confrontate ridotte (al quadrato per le metriche euclidee, vedi metric.h), con la radice
+ * calcolata solo sui k risultati. La ricerca è ottimizzata per visitare prima il sottoalbero più
+ * vicino e successivamente il sottoalbero più lontano solo se il piano di taglio (o, nel box
+ * periodico, il bounding box del sottoalbero) è più vicino del k-esimo vicino.
  *
- * @param root Puntatore alla radice dell'albero KD.
+ * @param tree Puntatore all'albero KD.
  * @param target Il punto di riferimento per cui trovare i vicini più prossimi.
  * @param k Numero di vicini più prossimi da trovare.
  * @param neighbors Array in cui verranno memorizzati gli indici dei k vicini più prossimi.
@@ -106,25 +117,122 @@ void freeKDTree(KDNode *node);
  * 
  * @note La funzione aggiorna gli array `neighbors` e `distances` con gli indici e le distanze
  *       dei k vicini più prossimi trovati. Gli array devono essere già allocati prima della chiamata.
+ *       Il punto dell'albero con lo stesso original_index del target non è un vicino di sé stesso
+ *       e viene saltato: una query che non appartiene al dataset deve avere indice -1.
  */
-void findKNearestNeighbors(KDNode *root, Point3D target, int k,int *neighbors, double *distances);
+void findKNearestNeighbors(const KDTree *tree, Point target, int k, int *neighbors, double *distances);
 
 /**
- * @brief Genera punti casuali in uno spazio 3D e li memorizza in un array.
+ * @brief Come findKNearestNeighbors, ma considera solo i punti entro `maxDistance` (estremo compreso).
  *
- * La funzione genera `n` punti casuali con coordinate x, y, z comprese tra 0 e 100. 
- * Ogni punto viene memorizzato in un array di strutture `Point3D` e viene assegnato un indice 
- * univoco (`original_index`) che parte da `start_idx` e aumenta progressivamente.
+ * Usata dalla ricerca distribuita: il processo che inoltra una query conosce già la sua
+ * k-esima distanza, quindi il sotto-albero remoto può essere potato con quel raggio; un punto
+ * remoto alla stessa distanza può ancora vincere il pareggio per indice.
+ * Le posizioni non riempite hanno indice -1 e distanza DBL_MAX, dopo tutti i candidati veri.
  *
- * @param points Array di punti 3D in cui memorizzare i punti generati.
- * @param n Numero di punti casuali da generare.
- * @param start_idx Indice iniziale da cui partire per assegnare `original_index` ai punti generati.
- * 
- * @note La funzione utilizza la funzione `rand()` per generare le coordinate casuali, 
- *       quindi il seme del generatore di numeri casuali è impostato usando `srand(time(NULL) + start_idx)` 
- *       per garantire la variabilità dei risultati su chiamate successive.
+ * @param tree Puntatore all'albero KD.
+ * @param target Il punto di riferimento per cui trovare i vicini più prossimi.
+ * @param k Numero di vicini più prossimi da trovare.
+ * @param maxDistance Raggio entro cui cercare i vicini.
+ * @param neighbors Array in cui verranno memorizzati gli indici dei k vicini più prossimi.
+ * @param distances Array in cui verranno memorizzate le distanze corrispondenti.
+ */
+void findKNearestNeighborsWithin(const KDTree *tree, Point target, int k, double maxDistance,
+                                 int *neighbors, double *distances);
+
+/**
+ * @brief Indica se i parametri richiedono una ricerca esatta (NULL, eps = 0 e nessun limite di foglie).
  */
-void generatePoints(Point3D *points, int n, int start_idx);
+int kdSearchIsExact(const KDSearchParams *params);
 
+/**
+ * @brief Ricerca dei k vicini, esatta o approssimata a seconda di `params`.
+ *
+ * Se i parametri sono esatti usa la ricerca ricorsiva di findKNearestNeighborsWithin. Altrimenti
+ * visita l'albero in ordine best-bin-first: una coda di priorità contiene i sotto-alberi scartati
+ * durante la discesa, con la distanza minima (ridotta) dalla loro cella, e ad ogni passo si
+ * riparte da quello più vicino. La ricerca si ferma quando il sotto-albero più vicino dista più di
+ * d_k / (1 + eps), oppure dopo `max_leaves` foglie. Ogni vicino restituito dista al più (1 + eps)
+ * volte il vero vicino dello stesso rango, se il limite di foglie non interviene.
+ *
+ * @param tree Puntatore all'albero KD.
+ * @param target Il punto di riferimento per cui trovare i vicini più prossimi.
+ * @param k Numero di vicini più prossimi da trovare.
+ * @param maxDistance Raggio entro cui cercare i vicini (DBL_MAX per nessun limite).
+ * @param params Parametri della ricerca approssimata, oppure NULL per la ricerca esatta.
+ * @param neighbors Array in cui verranno memorizzati gli indici dei k vicini più prossimi.
+ * @param distances Array in cui verranno memorizzate le distanze corrispondenti.
+ * @return Numero di foglie visitate.
+ */
+int findKNearestNeighborsApprox(const KDTree *tree, Point target, int k, double maxDistance,
+                                const KDSearchParams *params, int *neighbors, double *distances);
+
+/**
+ * @brief Aggiorna un insieme di vicini già esistente con i punti di un albero.
+ *
+ * È la ricerca di findKNearestNeighborsApprox senza l'inizializzazione e l'ordinamento finale:
+ * il contenitore (distanze ridotte) può arrivare da altri alberi o da un buffer, e il suo
+ * k-esimo vicino pota da subito la visita. I punti marcati in `removed` vengono saltati.
+ *
+ * @param tree Puntatore all'albero KD.
+ * @param target Il punto di cui cercare i vicini.
+ * @param params Parametri della ricerca approssimata, oppure NULL per la ricerca esatta.
+ * @param heap Contenitore da aggiornare.
+ * @return Numero di foglie visitate.
+ */
+int kdTreeUpdateHeap(const KDTree *tree, Point target, const KDSearchParams *params, KNNHeap *heap);
+
+/**
+ * @brief Tutti i k vicini dei punti di un albero di query tra i punti di un albero di riferimento.
+ *
+ * Visita dual-tree: i due alberi vengono discesi insieme e una coppia di nodi (query, riferimento)
+ * viene scartata in blocco quando la distanza tra i loro bounding box supera la k-esima distanza
+ * peggiore tra le query del nodo, che viene aggiornata risalendo dopo ogni visita. Tra due foglie
+ * si confrontano tutte le coppie di punti. Per il self-join (ogni punto cerca i vicini tra i punti
+ * dello stesso insieme) si passa lo stesso albero due volte; il punto con lo stesso original_index
+ * della query non viene mai restituito. I sotto-alberi di query vengono divisi tra `num_threads`
+ * thread, che condividono l'albero di riferimento in sola lettura.
+ *
+ * @param queries Albero delle query.
+ * @param refs Albero dei punti di riferimento (può essere lo stesso di `queries`).
+ * @param k Numero di vicini da trovare.
+ * @param num_threads Numero di thread della ricerca.
+ * @param neighbors Array di `queries->n * k` interi, una riga per punto nell'ordine delle foglie
+ *                  (la riga i è quella di queries->index[i]); le posizioni non riempite valgono -1.
+ * @param distances Array di `queries->n * k` double con le distanze corrispondenti.
+ */
+void dualTreeKNN(const KDTree *queries, const KDTree *refs, int k, int num_threads,
+                 int *neighbors, double *distances);
+
+/**
+ * @brief Conta i punti dell'albero entro `radius` (distanza <= radius) da un punto.
+ *
+ * Un sotto-albero il cui bounding box è tutto dentro la sfera viene contato dalla lunghezza del
+ * suo intervallo di punti, senza visitarlo; con `max_count` la visita si ferma appena il conteggio
+ * raggiunge quel valore. Come nella ricerca dei k vicini il punto con l'original_index del target
+ * non viene contato (si assume che sia nella posizione del target, come per le query del dataset).
+ *
+ * @param tree Puntatore all'albero KD.
+ * @param target Centro della sfera.
+ * @param radius Raggio della sfera.
+ * @param max_count Valore a cui fermare il conteggio, 0 per il conteggio completo.
+ * @return Numero di punti entro il raggio, al più `max_count` se questo è positivo.
+ */
+int kdTreeRangeCount(const KDTree *tree, Point target, double radius, int max_count);
+
+/**
+ * @brief Tutti i punti dell'albero entro `radius` da un punto, in ordine di visita.
+ *
+ * Stessa visita di kdTreeRangeCount senza limite: gli array devono avere posto per tutti i punti
+ * trovati, quindi si usa il conteggio per dimensionarli (vedi range.h).
+ *
+ * @param tree Puntatore all'albero KD.
+ * @param target Centro della sfera.
+ * @param radius Raggio della sfera.
+ * @param indices Array in cui scrivere gli original_index dei punti trovati.
+ * @param distances Array in cui scrivere le distanze corrispondenti.
+ * @return Numero di punti trovati.
+ */
+int kdTreeRadiusSearch(const KDTree *tree, Point target, double radius, int *indices, double *distances);
 
 #endif
@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include "vectortree.h"
+#include "scheduler.h"
+#include "arena.h"
+#include "profile.h"
+
+/* Query cercate da un thread per volta ad ogni passo dell'anello */
+#define VECTOR_RING_CHUNK 64
+
+/* Asse lungo cui le righe perm[start, end) sono più sparse (a parità il primo) */
+static int widestVectorAxis(const VectorSet *set, const int *perm, int start, int end) {
+    int dim = set->dim;
+    int axis = 0;
+    double widest = -1.0;
+    for (int a = 0; a < dim; a++) {
+        double min = DBL_MAX, max = -DBL_MAX;
+        for (int i = start; i < end; i++) {
+            double c = set->coord[(size_t)perm[i] * dim + a];
+            if (c < min) min = c;
+            if (c > max) max = c;
+        }
+        if (max - min > widest) {
+            widest = max - min;
+            axis = a;
+        }
+    }
+    return axis;
+}
+
+/* Quickselect sulla permutazione, come selectNth in util.c */
+static void selectNthVector(const VectorSet *set, int *perm, int start, int end, int nth, int axis) {
+    int dim = set->dim;
+    int lo = start, hi = end - 1;
+
+    while (hi > lo) {
+        double a = set->coord[(size_t)perm[lo] * dim + axis];
+        double b = set->coord[(size_t)perm[lo + (hi - lo) / 2] * dim + axis];
+        double c = set->coord[(size_t)perm[hi] * dim + axis];
+        double pivot = (a < b) ? ((b < c) ? b : (a < c ? c : a))
+                               : ((a < c) ? a : (b < c ? c : b));
+
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (set->coord[(size_t)perm[i] * dim + axis] < pivot) i++;
+            while (set->coord[(size_t)perm[j] * dim + axis] > pivot) j--;
+            if (i <= j) {
+                int tmp = perm[i];
+                perm[i] = perm[j];
+                perm[j] = tmp;
+                i++;
+                j--;
+            }
+        }
+
+        if (nth <= j) hi = j;
+        else if (nth >= i) lo = i;
+        else break;
+    }
+}
+
+static void buildVectorNode(VectorTree *tree, const VectorSet *set, int *perm, int node, int start, int end,
+                            int depth) {
+    if (depth == tree->levels) return;
+
+    int axis = widestVectorAxis(set, perm, start, end);
+    int mid = start + (end - start) / 2;
+    selectNthVector(set, perm, start, end, mid, axis);
+
+    tree->nodes[node].split = (end > start) ? set->coord[(size_t)perm[mid] * set->dim + axis] : 0.0;
+    tree->nodes[node].axis = axis;
+
+    buildVectorNode(tree, set, perm, 2 * node + 1, start, mid, depth + 1);
+    buildVectorNode(tree, set, perm, 2 * node + 2, mid, end, depth + 1);
+}
+
+VectorTree *buildVectorTree(const VectorSet *set) {
+    int n = set->n, dim = set->dim;
+    int levels = 0;
+    while ((((long long)n + (1LL << levels) - 1) >> levels) > KD_BUCKET_SIZE) levels++;
+    int num_nodes = (1 << levels) - 1;
+
+    /* Un'unica allocazione: header, nodi interni, coordinate per righe e indici */
+    size_t bytes = sizeof(VectorTree) + num_nodes * sizeof(KDNode) + (size_t)n * dim * sizeof(double)
+                 + (size_t)n * sizeof(int);
+    char *block = (char *)malloc(bytes);
+    if (block == NULL) {
+        fprintf(stderr, "Out of memory: cannot build the k-d tree of %d vectors of %d coordinates\n", n, dim);
+        exit(1);
+    }
+    VectorTree *tree = (VectorTree *)block;
+    tree->n = n;
+    tree->dim = dim;
+    tree->levels = levels;
+    tree->num_nodes = num_nodes;
+    tree->nodes = (KDNode *)(block + sizeof(VectorTree));
+    tree->coord = (double *)(tree->nodes + num_nodes);
+    tree->index = (int *)(tree->coord + (size_t)n * dim);
+
+    int *perm = (int *)malloc((n > 0 ? n : 1) * sizeof(int));
+    for (int i = 0; i < n; i++) perm[i] = i;
+    buildVectorNode(tree, set, perm, 0, 0, n, 0);
+
+    /* Le righe ora sono nell'ordine delle foglie: le copio nel blocco */
+    for (int i = 0; i < n; i++) {
+        memcpy(&tree->coord[(size_t)i * dim], &set->coord[(size_t)perm[i] * dim], dim * sizeof(double));
+        tree->index[i] = set->first + perm[i];
+    }
+    free(perm);
+
+    return tree;
+}
+
+void freeVectorTree(VectorTree *tree) {
+    free(tree);
+}
+
+/* Stato condiviso dalla ricerca ricorsiva */
+typedef struct {
+    const VectorTree *tree;
+    const double *query;
+    int self;
+    KNNHeap *heap;
+    long long nodes;
+    long long distances;
+} VectorSearch;
+
+static void searchVectorNode(VectorSearch *search, int node, int start, int end, int depth) {
+    const VectorTree *tree = search->tree;
+    KNNHeap *heap = search->heap;
+    int dim = tree->dim;
+    search->nodes++;
+
+    if (depth == tree->levels) {
+        for (int i = start; i < end; i++) {
+            double dist = vectorDistance(search->query, &tree->coord[(size_t)i * dim], dim);
+            if (dist <= knnHeapWorst(heap) && tree->index[i] != search->self) {
+                knnHeapPush(heap, dist, tree->index[i]);
+            }
+        }
+        search->distances += end - start;
+        return;
+    }
+
+    /* Prima il figlio dal lato della query, l'altro solo se il piano di taglio non è più lontano del peggiore */
+    const KDNode *current = &tree->nodes[node];
+    double axisDiff = search->query[current->axis] - current->split;
+    int mid = start + (end - start) / 2;
+
+    if (axisDiff < 0) {
+        searchVectorNode(search, 2 * node + 1, start, mid, depth + 1);
+        if (metricPlaneBound(axisDiff, 0) <= knnHeapWorst(heap)) {
+            searchVectorNode(search, 2 * node + 2, mid, end, depth + 1);
+        }
+    } else {
+        searchVectorNode(search, 2 * node + 2, mid, end, depth + 1);
+        if (metricPlaneBound(axisDiff, 0) <= knnHeapWorst(heap)) {
+            searchVectorNode(search, 2 * node + 1, start, mid, depth + 1);
+        }
+    }
+}
+
+long long vectorTreeUpdateHeap(const VectorTree *tree, const double *query, int self, KNNHeap *heap) {
+    VectorSearch search = {tree, query, self, heap, 0, 0};
+    if (tree->n > 0) searchVectorNode(&search, 0, 0, tree->n, 0);
+    profileCount(COUNTER_NODES, search.nodes);
+    return search.distances;
+}
+
+/* Blocco di query in viaggio sull'anello: righe [first, first + n) con i loro k vicini parziali,
+   ordinati e con distanze ridotte (DBL_MAX e -1 per i posti vuoti) */
+typedef struct {
+    int first, n;
+    double *coord;
+    double *best_distance;
+    int *best_index;
+} QueryBlock;
+
+static void queryBlockAlloc(QueryBlock *block, int capacity, int dim, int k) {
+    size_t rows = (capacity > 0) ? (size_t)capacity : 1;
+    block->coord = (double *)malloc(rows * dim * sizeof(double));
+    block->best_distance = (double *)malloc(rows * k * sizeof(double));
+    block->best_index = (int *)malloc(rows * k * sizeof(int));
+    if (block->coord == NULL || block->best_distance == NULL || block->best_index == NULL) {
+        fprintf(stderr, "Out of memory: cannot allocate a block of %d queries\n", capacity);
+        exit(1);
+    }
+}
+
+static void queryBlockFree(QueryBlock *block) {
+    free(block->coord);
+    free(block->best_distance);
+    free(block->best_index);
+}
+
+/* Stato di un passo dell'anello condiviso dai thread */
+typedef struct {
+    const VectorTree *tree;
+    QueryBlock *block;
+    int k;
+} VectorRingStep;
+
+static void vectorRingChunk(int begin, int end, int thread_id, void *context) {
+    (void)thread_id;
+    VectorRingStep *step = (VectorRingStep *)context;
+    QueryBlock *block = step->block;
+    int k = step->k, dim = step->tree->dim;
+
+    Arena *arena = threadArena();
+    ArenaMark mark = arenaMark(arena);
+    KNNEntry *entries = ARENA_ARRAY(arena, KNNEntry, k);
+
+    long long evaluated = 0, inserts = 0;
+    for (int q = begin; q < end; q++) {
+        double *best_distance = &block->best_distance[(size_t)q * k];
+        int *best_index = &block->best_index[(size_t)q * k];
+
+        /* Riparto dai vicini trovati sugli alberi dei passi precedenti */
+        KNNHeap heap;
+        knnHeapInit(&heap, entries, k, DBL_MAX);
+        for (int j = 0; j < k && best_index[j] >= 0; j++) {
+            knnHeapPush(&heap, best_distance[j], best_index[j]);
+        }
+        heap.inserts = 0;
+
+        evaluated += vectorTreeUpdateHeap(step->tree, &block->coord[(size_t)q * dim], block->first + q, &heap);
+        inserts += heap.inserts;
+
+        knnHeapSort(&heap);
+        for (int j = 0; j < k; j++) {
+            best_distance[j] = (j < heap.size) ? entries[j].distance : DBL_MAX;
+            best_index[j] = (j < heap.size) ? entries[j].index : -1;
+        }
+    }
+    profileCount(COUNTER_DISTANCES, evaluated);
+    profileCount(COUNTER_HEAP_INSERTS, inserts);
+
+    arenaReset(arena, mark);
+}
+
+/* Passa il blocco corrente al processo successivo e riceve quello del precedente */
+static void shiftQueryBlock(QueryBlock *current, QueryBlock *incoming, int dim, int k, int left, int right,
+                            MPI_Comm comm) {
+    int meta[2] = {current->first, current->n}, incoming_meta[2];
+    MPI_Sendrecv(meta, 2, MPI_INT, right, 0, incoming_meta, 2, MPI_INT, left, 0, comm, MPI_STATUS_IGNORE);
+    incoming->first = incoming_meta[0];
+    incoming->n = incoming_meta[1];
+
+    MPI_Sendrecv(current->coord, current->n * dim, MPI_DOUBLE, right, 1,
+                 incoming->coord, incoming->n * dim, MPI_DOUBLE, left, 1, comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(current->best_distance, current->n * k, MPI_DOUBLE, right, 2,
+                 incoming->best_distance, incoming->n * k, MPI_DOUBLE, left, 2, comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(current->best_index, current->n * k, MPI_INT, right, 3,
+                 incoming->best_index, incoming->n * k, MPI_INT, left, 3, comm, MPI_STATUS_IGNORE);
+
+    size_t row_bytes = dim * sizeof(double) + k * (sizeof(double) + sizeof(int));
+    profileBytes((long long)current->n * row_bytes, (long long)incoming->n * row_bytes);
+}
+
+void vectorTreeRingKNN(const VectorSet *local, int n, int k, int num_threads, MPI_Comm comm,
+                       int *neighbors, double *distances) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    int left = (rank - 1 + size) % size;
+    int right = (rank + 1) % size;
+    int dim = local->dim;
+
+    VectorTree *tree = buildVectorTree(local);
+
+    /* Doppio buffer: il blocco del processo 0 è il più grande, quindi basta come capacità */
+    int capacity = n / size + (n % size > 0 ? 1 : 0);
+    QueryBlock current, incoming;
+    queryBlockAlloc(&current, capacity, dim, k);
+    queryBlockAlloc(&incoming, capacity, dim, k);
+
+    current.first = local->first;
+    current.n = local->n;
+    memcpy(current.coord, local->coord, (size_t)local->n * dim * sizeof(double));
+    for (size_t i = 0; i < (size_t)local->n * k; i++) {
+        current.best_distance[i] = DBL_MAX;
+        current.best_index[i] = -1;
+    }
+
+    /* Dopo l'ultimo passo il blocco fa un altro spostamento e torna al processo che lo possiede */
+    for (int step = 0; step < size; step++) {
+        VectorRingStep task = {tree, &current, k};
+        parallelFor(current.n, VECTOR_RING_CHUNK, num_threads, vectorRingChunk, &task);
+
+        if (size > 1) {
+            shiftQueryBlock(&current, &incoming, dim, k, left, right, comm);
+            QueryBlock tmp = current;
+            current = incoming;
+            incoming = tmp;
+        }
+    }
+
+    for (size_t i = 0; i < (size_t)local->n * k; i++) {
+        neighbors[i] = current.best_index[i];
+        if (distances != NULL) {
+            distances[i] = (current.best_index[i] >= 0) ? metricFinish(current.best_distance[i]) : DBL_MAX;
+        }
+    }
+
+    queryBlockFree(&current);
+    queryBlockFree(&incoming);
+    freeVectorTree(tree);
+}
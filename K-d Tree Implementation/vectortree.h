@@ -0,0 +1,75 @@
+#ifndef VECTORTREE_H
+#define VECTORTREE_H
+
+#include <mpi.h>
+#include "util.h"
+#include "vectors.h"
+
+/** @brief: KD-Tree compatto sui vettori a dimensione runtime (vectors.h)
+ *  Stessa forma di KDTree: nodi interni impliciti in ordine BFS (i figli del nodo i sono 2i+1 e
+ *  2i+2), ognuno tagliato lungo l'asse di massima estensione dei suoi punti, e foglie di al più
+ *  KD_BUCKET_SIZE punti. Le coordinate sono salvate per righe nell'ordine delle foglie, con passo
+ *  dim (coord[i * dim + d]), perché la dimensione non è nota a compile time. Nodi, coordinate e
+ *  indici sono in un unico blocco.
+ */
+typedef struct {
+    int n;              /* Numero di punti */
+    int dim;            /* Coordinate per punto */
+    int levels;         /* Numero di livelli interni, le foglie sono a profondità levels */
+    int num_nodes;      /* Numero di nodi interni: 2^levels - 1 */
+    KDNode *nodes;
+    double *coord;      /* n * dim coordinate nell'ordine delle foglie, una riga per punto */
+    int *index;         /* original_index dei punti nello stesso ordine */
+} VectorTree;
+
+/**
+ * @brief Costruisce un VectorTree sui vettori di un insieme, che non viene modificato.
+ *
+ * Come buildKDTree porta la mediana di ogni nodo in posizione con un quickselect, qui su una
+ * permutazione delle righe, e poi copia le righe nell'ordine delle foglie.
+ */
+VectorTree *buildVectorTree(const VectorSet *set);
+
+/**
+ * @brief Libera un VectorTree.
+ */
+void freeVectorTree(VectorTree *tree);
+
+/**
+ * @brief Aggiorna i k vicini di una query con i punti dell'albero.
+ *
+ * Come kdTreeUpdateHeap la ricerca parte dal peggiore dei vicini già nel contenitore, quindi
+ * pota di più quando la query arriva con i vicini trovati su altri processi. Vale solo con le
+ * metriche di VECTOR_METRIC_SUPPORTED, per cui la distanza dal piano di taglio è un limite inferiore.
+ *
+ * @param tree Albero dei punti.
+ * @param query Coordinate della query (tree->dim valori).
+ * @param self original_index da escludere, oppure -1.
+ * @param heap Contenitore dei vicini (distanze ridotte, vedi metric.h).
+ * @return Numero di distanze calcolate.
+ */
+long long vectorTreeUpdateHeap(const VectorTree *tree, const double *query, int self, KNNHeap *heap);
+
+/**
+ * @brief k vicini esatti di tutti i vettori di un dataset distribuito a blocchi di righe.
+ *
+ * Ogni processo costruisce un VectorTree sul proprio blocco, che non si sposta. A viaggiare
+ * sull'anello sono le query: ad ogni passo il blocco di query corrente, con i suoi k vicini
+ * parziali, viene cercato nell'albero locale e passato al processo successivo con MPI_Sendrecv.
+ * Dopo p passi ogni blocco ha visto tutti gli alberi ed è tornato al suo processo, con memoria
+ * O(n/p) per processo. Le query di un passo sono divise tra i thread con parallelFor.
+ *
+ * @param local Blocco di righe del processo (righe [local->first, local->first + local->n)).
+ * @param n Numero totale di punti.
+ * @param k Numero di vicini da trovare.
+ * @param num_threads Thread che si dividono le query ad ogni passo.
+ * @param comm Comunicatore dell'anello.
+ * @param neighbors Array di `local->n * k` interi per gli indici dei vicini (-1 se mancanti).
+ * @param distances Array di `local->n * k` double per le distanze (DBL_MAX se mancanti), oppure NULL.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void vectorTreeRingKNN(const VectorSet *local, int n, int k, int num_threads, MPI_Comm comm,
+                       int *neighbors, double *distances);
+
+#endif
@@ -0,0 +1,144 @@
+#!/bin/bash
+# Benchmark sweep over programs, rank counts, sizes, k values and point distributions.
+#
+# Every configuration runs TRIALS times on the same seeded dataset; the summary CSV has the
+# median, mean, standard deviation, min and max of the time of each configuration, and the raw
+# CSV one row per trial. Every program, the sequential one included, is timed with the total phase
+# of its --report (slowest rank, from start to report). Compare two summaries with compare.sh.
+#
+# Usage: ./benchmark.sh [options]
+#   -p LIST   programs: sequential, standard, standard-ring, standard-dynamic, kdtree, kdtree-grid,
+#             kdtree-dynamic (default sequential,standard,kdtree)
+#   -r LIST   rank counts (default 1,2,4); the sequential program only runs with 1
+#   -n LIST   numbers of points (default 100000)
+#   -k LIST   k values (default 10)
+#   -g LIST   distributions: uniform, clusters, manifold, heavytail (default uniform)
+#   -t N      trials per configuration (default 5)
+#   -T N      threads per rank (default 1)
+#   -s SEED   dataset seed (default 1)
+#   -w        weak scaling: every size in -n is per rank, so n grows with the ranks
+#   -b ARGS   extra make arguments for the build, e.g. "dim=6 metric=l1"
+#   -o FILE   summary CSV (default bench.csv); the trials go to FILE without .csv + _trials.csv
+#
+# Environment: MPIRUN (default "mpirun --oversubscribe").
+
+set -e
+
+programs="sequential,standard,kdtree"
+ranks="1,2,4"
+sizes="100000"
+ks="10"
+distributions="uniform"
+trials=5
+threads=1
+seed=1
+weak=0
+build_args=""
+out="bench.csv"
+mpirun=${MPIRUN:-"mpirun --oversubscribe"}
+
+while getopts "p:r:n:k:g:t:T:s:wb:o:h" opt; do
+    case $opt in
+        p) programs=$OPTARG ;;
+        r) ranks=$OPTARG ;;
+        n) sizes=$OPTARG ;;
+        k) ks=$OPTARG ;;
+        g) distributions=$OPTARG ;;
+        t) trials=$OPTARG ;;
+        T) threads=$OPTARG ;;
+        s) seed=$OPTARG ;;
+        w) weak=1 ;;
+        b) build_args=$OPTARG ;;
+        o) out=$OPTARG ;;
+        *) sed -n '2,/^$/s/^# \{0,1\}//p' "$0" >&2; exit 1 ;;
+    esac
+done
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+raw="${out%.csv}_trials.csv"
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# Build every implementation once, from scratch, so the flags in -b apply to every object
+build() {
+    echo "Building $1" >&2
+    make -s -B -C "$root/$1" $build_args $2 >&2
+}
+case ",$programs," in *,sequential,*) build "Sequential Implementation" ;; esac
+case ",$programs," in *,standard*) build "Standard Implementation" ;; esac
+case ",$programs," in *,kdtree*) build "K-d Tree Implementation" kdtree ;; esac
+
+# Executable and flags of a program (the directories have spaces, so they are kept apart)
+programCommand() {
+    flags=""
+    case $1 in
+        sequential) binary="$root/Sequential Implementation/sequential" ;;
+        standard) binary="$root/Standard Implementation/kd" ;;
+        standard-ring) binary="$root/Standard Implementation/kd"; flags="--ring" ;;
+        standard-dynamic) binary="$root/Standard Implementation/kd"; flags="--dynamic" ;;
+        kdtree) binary="$root/K-d Tree Implementation/kdtree" ;;
+        kdtree-grid) binary="$root/K-d Tree Implementation/kdtree"; flags="--backend grid" ;;
+        kdtree-dynamic) binary="$root/K-d Tree Implementation/kdtree"; flags="--backend dynamic" ;;
+        *) echo "Unknown program: $1" >&2; exit 1 ;;
+    esac
+}
+
+# Value of "max" of a phase, or "total" of a counter, in a report written with --report
+phase() { grep "\"$2\": {" "$1" | sed 's/.*"max": \([0-9.e+-]*\).*/\1/'; }
+counter() { grep "\"$2\": {" "$1" | sed 's/.*"total": \([0-9.e+-]*\).*/\1/'; }
+
+# Median, mean, sample standard deviation, min and max of the numbers on standard input
+stats() {
+    sort -g | awk '{ v[NR] = $1; sum += $1 }
+        END {
+            mean = sum / NR
+            for (i = 1; i <= NR; i++) var += (v[i] - mean) ^ 2
+            var = (NR > 1) ? var / (NR - 1) : 0
+            median = (NR % 2) ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2
+            printf "%.6f,%.6f,%.6f,%.6f,%.6f", median, mean, sqrt(var), v[1], v[NR]
+        }'
+}
+
+commit=$(git -C "$root" rev-parse --short HEAD 2>/dev/null || echo unknown)
+header="# commit $commit, $(date -u +%Y-%m-%dT%H:%M:%SZ), $(hostname), seed $seed, threads $threads, build \"$build_args\""
+echo "$header" > "$out"
+echo "program,distribution,n,k,ranks,threads,trials,median,mean,stddev,min,max,search_median,distance_evaluations,bytes_sent" >> "$out"
+echo "$header" > "$raw"
+echo "program,distribution,n,k,ranks,threads,trial,time,search,distance_evaluations,bytes_sent" >> "$raw"
+
+for program in ${programs//,/ }; do
+    programCommand "$program"
+    for np in ${ranks//,/ }; do
+        [ "$program" = sequential ] && [ "$np" != 1 ] && continue
+        for size in ${sizes//,/ }; do
+            n=$size
+            [ $weak = 1 ] && n=$((size * np))
+            for k in ${ks//,/ }; do
+                for distribution in ${distributions//,/ }; do
+                    p_threads=$threads
+                    [ "$program" = sequential ] && p_threads=1
+                    args="$n --k $k --distribution $distribution --seed $seed"
+                    : > "$work/times"; : > "$work/search"
+                    for trial in $(seq 1 "$trials"); do
+                        if [ "$program" = sequential ]; then
+                            "$binary" $flags $args --report "$work/report.json" > /dev/null
+                        else
+                            $mpirun -np "$np" "$binary" $flags $args --threads "$p_threads" --report "$work/report.json" > /dev/null
+                        fi
+                        time=$(phase "$work/report.json" total)
+                        search=$(phase "$work/report.json" search)
+                        distances=$(counter "$work/report.json" distance_evaluations)
+                        bytes=$(counter "$work/report.json" bytes_sent)
+                        echo "$time" >> "$work/times"
+                        echo "$search" >> "$work/search"
+                        echo "$program,$distribution,$n,$k,$np,$p_threads,$trial,$time,$search,$distances,$bytes" >> "$raw"
+                    done
+                    search_median=$(stats < "$work/search" | cut -d, -f1)
+                    row="$program,$distribution,$n,$k,$np,$p_threads,$trials,$(stats < "$work/times"),$search_median,$distances,$bytes"
+                    echo "$row" >> "$out"
+                    echo "$row" >&2
+                done
+            done
+        done
+    done
+done
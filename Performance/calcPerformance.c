@@ -1,27 +1,123 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-void compute_speedup_efficiency(double times[], int num_processors[], int size) {
-    double sequential = 100.0
-    
-    printf("Processors\tTime\tSpeedup\tEfficiency\n");
+#define MAX_REPORTS 64
 
-    for (int i = 0; i < size; i++) {
-        int p = num_processors[i];
-        double Tp = times[i];
+/* Una esecuzione letta da un report JSON scritto con --report */
+typedef struct {
+    const char *path;
+    int ranks;
+    int threads;
+    double time;
+} Run;
+
+/* Legge tutto il file in memoria; il report è piccolo */
+static char *readFile(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    char *text = malloc(size + 1);
+    if (text == NULL || fread(text, 1, size, file) != (size_t)size) {
+        free(text);
+        fclose(file);
+        return NULL;
+    }
+    text[size] = '\0';
+    fclose(file);
+    return text;
+}
 
-        double speedup = sequential / Tp;
-        double efficiency = speedup / p;
+/* Restituisce il testo che segue la chiave "key": cercata a partire da `from`, oppure NULL */
+static const char *findKey(const char *from, const char *key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *found = strstr(from, pattern);
+    return (found != NULL) ? found + strlen(pattern) : NULL;
+}
 
-        printf("%d\t\t%.2f\t%.2f\t%.2f\n", p, Tp, speedup, efficiency);
+/* Il report ha una struttura fissa: basta cercare le chiavi, senza un parser JSON completo */
+static int readRun(const char *path, const char *phase, Run *run) {
+    char *text = readFile(path);
+    if (text == NULL) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        return -1;
     }
+
+    const char *ranks = findKey(text, "ranks");
+    const char *threads = findKey(text, "threads");
+    const char *phases = findKey(text, "phases");
+    const char *entry = (phases != NULL) ? findKey(phases, phase) : NULL;
+    const char *max = (entry != NULL) ? findKey(entry, "max") : NULL;
+    if (ranks == NULL || threads == NULL || max == NULL) {
+        fprintf(stderr, "%s: not a report, or no \"%s\" phase\n", path, phase);
+        free(text);
+        return -1;
+    }
+
+    /* Il tempo di una fase è quello del processo più lento */
+    run->path = path;
+    run->ranks = atoi(ranks);
+    run->threads = atoi(threads);
+    run->time = atof(max);
+    free(text);
+    return 0;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--baseline FILE] [--phase NAME] REPORT...\n", program);
+    fprintf(stderr, "  --baseline FILE  report of the reference run (default: the first report)\n");
+    fprintf(stderr, "  --phase NAME     phase to compare, e.g. search (default: total)\n");
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    const char *baseline_path = NULL;
+    const char *phase = "total";
+    const char *paths[MAX_REPORTS];
+    int size = 0;
 
-    int num_processors[] = {2, 4, 8, 12};
-    double times[] = {55.0, 30.0, 18.0, 12.0};
-    int size = sizeof(num_processors) / sizeof(num_processors[0]);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--phase") == 0 && i + 1 < argc) {
+            phase = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else if (size < MAX_REPORTS) {
+            paths[size++] = argv[i];
+        }
+    }
+    if (size == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Run runs[MAX_REPORTS], baseline;
+    for (int i = 0; i < size; i++) {
+        if (readRun(paths[i], phase, &runs[i]) != 0) return 1;
+    }
+    if (baseline_path == NULL) {
+        baseline = runs[0];
+    } else if (readRun(baseline_path, phase, &baseline) != 0) {
+        return 1;
+    }
 
-    compute_speedup_efficiency(times, num_processors, size);
+    /* Speedup ed efficienza sono relativi alla base, che può usare più di un processore */
+    int base_p = baseline.ranks * baseline.threads;
+    printf("Baseline: %s (%d processors, %s %.6f s)\n", baseline.path, base_p, phase, baseline.time);
+    printf("Processors\tRanks\tThreads\tTime\t\tSpeedup\tEfficiency\n");
+
+    for (int i = 0; i < size; i++) {
+        int p = runs[i].ranks * runs[i].threads;
+        double Tp = runs[i].time;
+
+        double speedup = baseline.time / Tp;
+        double efficiency = speedup * base_p / p;
+
+        printf("%d\t\t%d\t%d\t%.6f\t%.2f\t%.2f\n", p, runs[i].ranks, runs[i].threads, Tp, speedup, efficiency);
+    }
     return 0;
 }
@@ -0,0 +1,59 @@
+#!/bin/bash
+# Compares two summaries written by benchmark.sh, e.g. before and after a change.
+#
+# Configurations are matched on program, distribution, n, k, ranks and threads. A configuration
+# is a regression when its median time grew by more than the threshold and by more than twice
+# the larger standard deviation of the two runs, so noisy configurations need a larger change;
+# an improvement is the same in the other direction. The distance evaluations of a seeded run
+# do not depend on timing, so a change there is reported as well.
+#
+# Usage: ./compare.sh [-t PERCENT] OLD.csv NEW.csv
+#   -t PERCENT  smallest change of the median reported (default 5)
+#
+# Exits with status 1 if any configuration regressed.
+
+threshold=5
+while getopts "t:h" opt; do
+    case $opt in
+        t) threshold=$OPTARG ;;
+        *) sed -n '2,/^$/s/^# \{0,1\}//p' "$0" >&2; exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+if [ $# -ne 2 ]; then
+    sed -n '2,/^$/s/^# \{0,1\}//p' "$0" >&2
+    exit 2
+fi
+
+grep -h "^# commit" "$1" "$2" | sed 's/^# /  /'
+
+awk -F, -v threshold="$threshold" '
+    BEGIN { printf "%-52s %10s %10s %8s  %s\n", "program,distribution,n,k,ranks,threads", "old", "new", "change", "verdict" }
+    /^#/ || $1 == "program" { next }
+    {
+        key = $1 "," $2 "," $3 "," $4 "," $5 "," $6
+        if (FNR == NR) {
+            old_median[key] = $8; old_sd[key] = $10; old_work[key] = $14
+            next
+        }
+        if (!(key in old_median)) {
+            printf "%-52s %10s %10.6f  new\n", key, "-", $8
+            seen[key] = 1
+            next
+        }
+        seen[key] = 1
+        old = old_median[key]; new = $8
+        change = (old > 0) ? 100.0 * (new - old) / old : 0
+        noise = 2 * ((old_sd[key] > $10) ? old_sd[key] : $10)
+        verdict = "same"
+        if (change > threshold && new - old > noise) { verdict = "REGRESSION"; regressions++ }
+        else if (-change > threshold && old - new > noise) verdict = "improvement"
+        if (old_work[key] != $14) verdict = verdict ", work " old_work[key] " -> " $14
+        printf "%-52s %10.6f %10.6f %+7.1f%%  %s\n", key, old, new, change, verdict
+    }
+    END {
+        for (key in old_median) if (!(key in seen)) printf "%-52s %10.6f %10s  missing\n", key, old_median[key], "-"
+        printf "%d regression(s) above %g%%\n", regressions, threshold
+        exit (regressions > 0)
+    }
+' "$1" "$2"
@@ -1,101 +1,123 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <math.h>
 #include <time.h>
 #include <float.h>
+#include "bruteforce.h"
+#include "options.h"
+#include "pointio.h"
+#include "vectors.h"
+#include "graphio.h"
+#include "profile.h"
 
-typedef struct {
-    double x, y, z;
-    int index;
-} Point3D;
-
-typedef struct {
-    double distance;
-    int index;
-} DistanceIdx;
-
-void generatePoints(Point3D *points, int n) {
-    for (int i = 0; i < n; i++) {
-        points[i].x = (double)rand() / RAND_MAX * 100.0;
-        points[i].y = (double)rand() / RAND_MAX * 100.0;
-        points[i].z = (double)rand() / RAND_MAX * 100.0;
-        points[i].index = i;
+int main(int argc, char *argv[]) {
+    KNNOptions opts;
+    parseOptions(argc, argv, &opts);
+    int n = opts.n;
+    profileInit();
+    
+    const char *unsupported = unsupportedOption(&opts, 0);
+    if (unsupported != NULL) {
+        fprintf(stderr, "%s is not supported by the sequential implementation\n", unsupported);
+        return 1;
     }
-}
-
-double calculateDistance(Point3D p1, Point3D p2) {
-    return sqrt(pow(p2.x - p1.x, 2) + pow(p2.y - p1.y, 2) + pow(p2.z - p1.z, 2));
-}
-
-int compareDistances(const void *a, const void *b) {
-    DistanceIdx *d1 = (DistanceIdx *)a;
-    DistanceIdx *d2 = (DistanceIdx *)b;
-    if (d1->distance < d2->distance) return -1;
-    if (d1->distance > d2->distance) return 1;
-    return 0;
-}
-
-void findKNN(Point3D *points, int n, int pointIdx, int k, int *neighbors) {
-    DistanceIdx *distances = (DistanceIdx *)malloc(n * sizeof(DistanceIdx));
+    int k_max = opts.k_max;
     
-    for (int i = 0; i < n; i++) {
-        if (i == pointIdx) {
-            distances[i].distance = DBL_MAX;
+    Point *points = NULL;
+    VectorSet vectors;      /* Dataset con un numero di coordinate diverso da KNN_DIM */ 
+    vectors.dim = 0;
+    vectors.n = 0;
+    vectors.coord = NULL;
+    profileBegin(PHASE_LOAD);
+    if (opts.input != NULL) {
+        /* Su un solo nodo il dataset viene mappato in memoria e letto direttamente dalle colonne */ 
+        PointFile file;
+        if (pointFileOpenAnyDim(opts.input, &file) != 0) return 1;
+        if (file.header.count > INT_MAX) {
+            fprintf(stderr, "%s: too many points (%llu)\n", opts.input, (unsigned long long)file.header.count);
+            pointFileClose(&file);
+            return 1;
+        }
+        n = (int)file.header.count;
+        uint32_t dims = pointHeaderDims(&file.header);
+        if (dims == KNN_DIM) {
+            points = (Point *)malloc(n * sizeof(Point));
+            pointFileRead(&file, 0, n, points);
+        } else if (VECTOR_METRIC_SUPPORTED) {
+            /* Con un altro numero di coordinate la ricerca usa la dimensione letta dal file */ 
+            vectorSetRead(&file, 0, n, &vectors);
+            printf("%u coordinates per point (this build has %d): runtime-dimension search\n", dims, KNN_DIM);
         } else {
-            distances[i].distance = calculateDistance(points[pointIdx], points[i]);
+            fprintf(stderr, "%s: %u coordinates per point need the l2, l1 or linf metric, this build uses %s "
+                    "(or rebuild with dim=%u)\n", opts.input, dims, metricName(), dims);
+            pointFileClose(&file);
+            return 1;
         }
-        distances[i].index = i;
+        pointFileClose(&file);
+    } else {
+        /* Con lo stesso seme i punti sono quelli generati dalle implementazioni MPI */ 
+        uint64_t seed = generatorSeed(opts.seed);
+        points = (Point *)malloc(n * sizeof(Point));
+        generatePoints(points, n, 0, opts.distribution, seed);
+        printf("Generated %d points: %s distribution, seed %llu\n", n, distributionName(opts.distribution),
+               (unsigned long long)seed);
     }
+    profileEnd(PHASE_LOAD);
     
-    qsort(distances, n, sizeof(DistanceIdx), compareDistances);
-    for (int i = 0; i < k; i++) {
-        neighbors[i] = distances[i].index;
+    /* Una sola ricerca con il k massimo: per ogni k richiesto i vicini sono il prefisso della riga */ 
+    int *knn_results = (int *)malloc((size_t)n * k_max * sizeof(int));
+    double *knn_distances = (opts.output != NULL && opts.distances) ? (double *)malloc((size_t)n * k_max * sizeof(double)) : NULL;
+    profileBegin(PHASE_SEARCH);
+    for (int i = 0; i < n; i++) {
+        int *row = &knn_results[(size_t)i * k_max];
+        double *row_distances = knn_distances ? &knn_distances[(size_t)i * k_max] : NULL;
+        if (points != NULL) {
+            findKNN(points, n, i, k_max, row, row_distances);
+        } else {
+            vectorFindKNN(&vectors, &vectors.coord[(size_t)i * vectors.dim], i, k_max, row, row_distances);
+        }
     }
+    profileEnd(PHASE_SEARCH);
     
-    free(distances);
-}
-
-int main(int argc, char *argv[]) {
-    int n = 1000; 
-    int k_min = 5, k_max = 20, k_step = 5;
-    
-    if (argc > 1) {
-        n = atoi(argv[1]);
+    /* Grafo binario dei vicini, con le righe già in ordine di indice */ 
+    profileBegin(PHASE_OUTPUT);
+    if (opts.output != NULL) {
+        if (writeGraph(opts.output, n, k_max, knn_results, knn_distances) != 0) return 1;
+        printf("kNN graph (k = %d) written to %s\n", k_max, opts.output);
     }
     
-    srand(time(NULL));
-    
-    Point3D *points = (Point3D *)malloc(n * sizeof(Point3D));
-    generatePoints(points, n);
-    
-    for (int k = k_min; k <= k_max; k += k_step) {        
-        int **knn_results = (int **)malloc(n * sizeof(int *));
-        for (int i = 0; i < n; i++) {
-            knn_results[i] = (int *)malloc(k * sizeof(int));
-        }
-        
-        for (int i = 0; i < n; i++) {
-            findKNN(points, n, i, k, knn_results[i]);
-        }
+    for (int q = 0; q < opts.num_k && opts.print > 0; q++) {
+        int k = opts.k_values[q];
         
         /* Stampa dei risultati ( Non tutti, solo alcuni giusto per dimostrazione ) */ 
-        printf("Results for k = %d (showing first 5 points):\n", k);
-        int display_count = (n < 5) ? n : 5;
+        int display_count = (n < opts.print) ? n : opts.print;
+        printf("Results for k = %d (showing first %d points):\n", k, display_count);
         for (int i = 0; i < display_count; i++) {
-            printf("Point %d (%.2f, %.2f, %.2f) nearest neighbors: ", i, points[i].x, points[i].y, points[i].z);
-                   
+            const double *coord = (points != NULL) ? points[i].coord : &vectors.coord[(size_t)i * vectors.dim];
+            int dims = (points != NULL) ? KNN_DIM : vectors.dim;
+            printf("Point %d (", i);
+            for (int d = 0; d < dims; d++) {
+                printf(d > 0 ? ", %.2f" : "%.2f", coord[d]);
+            }
+            printf(") nearest neighbors: ");
+            
             for (int j = 0; j < k; j++) {
-                printf("%d ", knn_results[i][j]);
+                printf("%d ", knn_results[(size_t)i * k_max + j]);
             }
             printf("\n");
         }
-        
-        for (int i = 0; i < n; i++) {
-            free(knn_results[i]);
-        }
-        free(knn_results);
+    }
+    profileEnd(PHASE_OUTPUT);
+    
+    /* Stesso report delle implementazioni MPI, con un solo processo */ 
+    if (opts.report != NULL && profileReportLocal(opts.report, "sequential", "bruteforce", n, k_max, 1) != 0) {
+        return 1;
     }
     
+    free(knn_results);
+    free(knn_distances);
     free(points);
+    vectorSetFree(&vectors);
     return 0;
-}
\ No newline at end of file
+}
@@ -5,171 +5,451 @@
 #include <time.h>
 #include <float.h>
 #include "util.h"
+#include "ring.h"
+#include "options.h"
+#include "loadbalance.h"
+#include "pointio_mpi.h"
+#include "graphio_mpi.h"
+#include "scheduler.h"
+#include "mixed.h"
+#include "metric.h"
+#include "profile_mpi.h"
 
-int main(int argc, char *argv[]) {
+/* Modalità dinamica: ogni processo prende chunk di query dal contatore condiviso finché ce ne sono.
+   Restituisce le righe calcolate nell'ordine dei chunk, con gli intervalli [begin, end) in ranges;
+   se distances non è NULL vi salva anche le distanze, con la stessa disposizione.
+   Con reduced non NULL la ricerca usa i punti in precisione ridotta e le righe incerte finiscono in set */
+static int *dynamicKNN(const PointBlock *points, const ReducedBlock *reduced, CandidateSet *set, int k,
+                       int num_threads, LoadStats *stats, int **ranges, int *num_chunks, int *rows,
+                       double **distances, MPI_Comm comm) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    int n = (reduced != NULL) ? reduced->n : points->n;
+    
+    /* Un chunk deve bastare a tenere occupati tutti i thread del processo */ 
+    WorkQueue queue;
+    workQueueCreate(&queue, n, DEFAULT_CHUNK_SIZE * num_threads, comm);
+    
+    int row_capacity = n / size + 1;
+    int chunk_capacity = 16;
+    int *results = (int *)malloc((size_t)row_capacity * k * sizeof(int));
+    if (distances != NULL) {
+        *distances = (double *)malloc((size_t)row_capacity * k * sizeof(double));
+    }
+    *ranges = (int *)malloc(2 * chunk_capacity * sizeof(int));
+    *num_chunks = 0;
+    *rows = 0;
+    
+    /* In precisione ridotta le query del chunk vengono riportate in double qui */ 
+    PointBlock expanded;
+    int expanded_capacity = 0;
+    
+    int begin, end;
+    for (;;) {
+        double wait_start = MPI_Wtime();
+        int got = workQueueNext(&queue, &begin, &end);
+        stats->idle += MPI_Wtime() - wait_start;
+        if (!got) break;
+        
+        if (*rows + (end - begin) > row_capacity) {
+            while (*rows + (end - begin) > row_capacity) row_capacity *= 2;
+            results = (int *)realloc(results, (size_t)row_capacity * k * sizeof(int));
+            if (distances != NULL) {
+                *distances = (double *)realloc(*distances, (size_t)row_capacity * k * sizeof(double));
+            }
+        }
+        if (*num_chunks == chunk_capacity) {
+            chunk_capacity *= 2;
+            *ranges = (int *)realloc(*ranges, 2 * chunk_capacity * sizeof(int));
+        }
+        
+        /* Le query del chunk sono una vista sul dataset completo, già presente su ogni processo */ 
+        double busy_start = MPI_Wtime();
+        if (reduced != NULL) {
+            if (end - begin > expanded_capacity) {
+                if (expanded_capacity > 0) pointBlockFree(&expanded);
+                expanded_capacity = end - begin;
+                pointBlockAlloc(&expanded, expanded_capacity);
+            }
+            reducedBlockExpand(reduced, begin, end, &expanded);
+            reducedSearch(&expanded, reduced->quantizer.error, *rows, reduced, k, num_threads, results,
+                          (distances != NULL) ? *distances : NULL, set);
+        } else {
+            PointBlock chunk = pointBlockView(points, begin, end);
+            knnBatchSearch(&chunk, points, k, num_threads, &results[(size_t)*rows * k],
+                           (distances != NULL) ? &(*distances)[(size_t)*rows * k] : NULL);
+        }
+        stats->busy += MPI_Wtime() - busy_start;
+        
+        (*ranges)[2 * *num_chunks] = begin;
+        (*ranges)[2 * *num_chunks + 1] = end;
+        (*num_chunks)++;
+        *rows += end - begin;
+        stats->chunks++;
+        stats->items += end - begin;
+    }
+    
+    if (expanded_capacity > 0) {
+        pointBlockFree(&expanded);
+    }
+    workQueueFree(&queue);
+    return results;
+}
+
+/* Ogni processo scrive le proprie righe del grafo direttamente nel file, senza passare dal master,
+   e le prime righe arrivano al master per la stampa di debug */
+static void outputGraph(const KNNOptions *opts, int n, int k_max, int rows, const int *result_index,
+                        const int *results, const double *distances, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    
+    profileBegin(PHASE_OUTPUT);
+    if (opts->output != NULL) {
+        double write_start = MPI_Wtime();
+        writeGraphMPI(opts->output, n, k_max, rows, result_index, results, distances, comm);
+        if (rank == 0) {
+            printf("kNN graph (k = %d) written to %s in %.3f s\n", k_max, opts->output, MPI_Wtime() - write_start);
+        }
+    }
+    
+    /* Stampa testuale di debug: solo i primi punti arrivano al master */ 
+    if (opts->print > 0 && !opts->no_gather) {
+        printGraphSample(n, opts->print, opts->k_values, opts->num_k, k_max, rows, result_index, results, comm);
+    }
+    profileEnd(PHASE_OUTPUT);
+}
+
+/* Dataset con un numero di coordinate diverso da KNN_DIM: i punti sono vettori a dimensione runtime
+   (vectors.h), replicati su ogni processo come nella modalità statica, e ogni processo cerca i vicini
+   delle proprie righe con la forza bruta a cicli semplici */
+static void vectorKNN(const KNNOptions *opts, int dims, MPI_Comm comm) {
     int rank, size;
-    int n = 1000; /* Numero di default di punti, andrà inserito da tastiera */ 
-    int k_min = 5, k_max = 20, k_step = 5;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
     
-    MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    VectorSet local;
+    int n;
+    profileBegin(PHASE_LOAD);
+    readVectorsMPI(opts->input, comm, &local, &n);
+    profileEnd(PHASE_LOAD);
     
-    /* Parsing del numero dei punti inserito da tastiera ( se presente ) */ 
-    if (argc > 1) {
-        n = atoi(argv[1]);
+    /* Una riga viaggia come un blocco contiguo di dims double, quindi i conteggi restano in righe */ 
+    MPI_Datatype row_type;
+    MPI_Type_contiguous(dims, MPI_DOUBLE, &row_type);
+    MPI_Type_commit(&row_type);
+    
+    int *recvcounts = (int *)malloc(size * sizeof(int));
+    int *displs = (int *)malloc(size * sizeof(int));
+    for (int i = 0; i < size; i++) {
+        recvcounts[i] = blockSize(n, size, i);
+        displs[i] = (i > 0) ? displs[i-1] + recvcounts[i-1] : 0;
     }
     
-    /* Seed randomico per la generazione dei punti, ogni processo ne avrà uno differente */ 
-    srand(time(NULL) + rank);
+    VectorSet all;
+    vectorSetAlloc(&all, n, dims, 0);
+    profileBegin(PHASE_GATHER);
+    MPI_Allgatherv(local.coord, local.n, row_type, all.coord, recvcounts, displs, row_type, comm);
+    profileGather(local.n, n, row_type, -1, comm);
+    profileEnd(PHASE_GATHER);
     
-    /* Calcolo del numero di punti che ogni processo andrà a generare */ 
-    int local_n = n / size;
-    int remainder = n % size;
+    if (rank == 0) {
+        printf("Brute-force kernel: runtime dimension (%d coordinates, this build has %d), %d thread(s) per rank\n",
+               dims, KNN_DIM, opts->threads);
+    }
     
-    /* Check in caso la size dei punti non è divisibile tra i processi */ 
-    if (rank < remainder) {
-        local_n++;
+    int k_max = opts->k_max;
+    int *knn_results = (int *)malloc(((size_t)local.n * k_max > 0 ? (size_t)local.n * k_max : 1) * sizeof(int));
+    double *knn_distances = NULL;
+    if (opts->output != NULL && opts->distances) {
+        knn_distances = (double *)malloc(((size_t)local.n * k_max > 0 ? (size_t)local.n * k_max : 1) * sizeof(double));
     }
     
-    /* Indice di inizio di ogni processo */ 
-    int start_idx = 0;
-    for (int i = 0; i < rank; i++) {
-        start_idx += (i < remainder) ? (n / size + 1) : (n / size);
+    LoadStats stats;
+    loadStatsInit(&stats);
+    profileBegin(PHASE_SEARCH);
+    double busy_start = MPI_Wtime();
+    vectorBatchSearch(&local, &all, k_max, opts->threads, knn_results, knn_distances);
+    stats.busy = MPI_Wtime() - busy_start;
+    stats.chunks = 1;
+    stats.items = local.n;
+    profileEnd(PHASE_SEARCH);
+    reportLoadBalance(&stats, comm);
+    
+    int *result_index = (int *)malloc((local.n > 0 ? local.n : 1) * sizeof(int));
+    for (int i = 0; i < local.n; i++) {
+        result_index[i] = local.first + i;
     }
+    outputGraph(opts, n, k_max, local.n, result_index, knn_results, knn_distances, comm);
     
-    /* Alloco la memoria e genero i punti */ 
-    Point3D *local_points = (Point3D *)malloc(local_n * sizeof(Point3D));  
-    generatePoints(local_points, local_n, start_idx);
+    if (opts->report != NULL) {
+        profileReport(opts->report, "standard", "static", n, k_max, opts->threads, comm);
+    }
     
-    /* Creo un  MPI datatype per la struct relativa ai punti */ 
-    MPI_Datatype point_type;
-    MPI_Datatype types[4] = {MPI_DOUBLE, MPI_DOUBLE, MPI_DOUBLE, MPI_INT};
-    int blocklengths[4] = {1, 1, 1, 1};
-    MPI_Aint offsets[4];
+    free(knn_results);
+    free(knn_distances);
+    free(result_index);
+    free(recvcounts);
+    free(displs);
+    vectorSetFree(&local);
+    vectorSetFree(&all);
+    MPI_Type_free(&row_type);
+}
+
+int main(int argc, char *argv[]) {
+    int rank, size;
     
-    offsets[0] = offsetof(Point3D, x);
-    offsets[1] = offsetof(Point3D, y);
-    offsets[2] = offsetof(Point3D, z);
-    offsets[3] = offsetof(Point3D, original_index);
+    /* I thread di calcolo non fanno chiamate MPI, quindi basta MPI_THREAD_FUNNELED */ 
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
     
-    MPI_Type_create_struct(4, blocklengths, offsets, types, &point_type);
-    MPI_Type_commit(&point_type);
+    /* Parsing del numero dei punti e delle opzioni inseriti da tastiera ( se presenti ) */ 
+    KNNOptions opts;
+    parseOptions(argc, argv, &opts);
+    int n = opts.n;
+    profileInit();
     
+    /* Le opzioni del K-d Tree distribuito non hanno effetto sulla forza bruta */ 
+    const char *unsupported = unsupportedOption(&opts, OPTIONS_BRUTE_FORCE);
+    if (unsupported != NULL) {
+        if (rank == 0) fprintf(stderr, "%s is not supported by the brute-force implementation\n", unsupported);
+        MPI_Finalize();
+        return 1;
+    }
     
-    int *recvcounts = NULL;     /* Info riguardanti il numero di punti che ogni processo è andato a generare */ 
-    int *displs = NULL;         /* Offset per il corretto posizionamento dei dati */ 
+    /* In precisione ridotta serve il dataset completo su ogni processo, quindi non con l'anello */ 
+    Precision precision;
+    if (parsePrecision(opts.precision, &precision) != 0) {
+        if (rank == 0) fprintf(stderr, "Invalid precision: %s\n", opts.precision);
+        MPI_Finalize();
+        return 1;
+    }
+    if (precision != PRECISION_DOUBLE && opts.ring) {
+        if (rank == 0) fprintf(stderr, "--precision %s cannot be combined with --ring\n", opts.precision);
+        MPI_Finalize();
+        return 1;
+    }
+    /* Il limite dell'errore dei punti ridotti (vedi reduced.h) vale solo per la distanza euclidea */
+    if (precision != PRECISION_DOUBLE && KNN_METRIC != KNN_METRIC_L2) {
+        if (rank == 0) fprintf(stderr, "--precision %s needs the l2 metric, this build uses %s\n", opts.precision, metricName());
+        MPI_Finalize();
+        return 1;
+    }
+    int use_reduced = (precision != PRECISION_DOUBLE);
     
-    if (rank == 0) {
-        recvcounts = (int *)malloc(size * sizeof(int));
-        displs = (int *)malloc(size * sizeof(int));
+    if (opts.threads > 1 && provided < MPI_THREAD_FUNNELED) {
+        if (rank == 0) fprintf(stderr, "MPI does not support threads, running with 1 thread per rank\n");
+        opts.threads = 1;
     }
     
-    /* Collezione delle info da parte dei processi  */ 
-    MPI_Gather(&local_n, 1, MPI_INT, recvcounts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    /* Un dataset con un numero di coordinate diverso da KNN_DIM si cerca con la dimensione runtime,
+       che ha solo la modalità statica in double e le metriche senza parametri per asse */ 
+    if (opts.input != NULL) {
+        int dims = datasetDimsMPI(opts.input, MPI_COMM_WORLD);
+        if (dims != KNN_DIM) {
+            const char *option = opts.ring ? "--ring" : (opts.dynamic ? "--dynamic" : (use_reduced ? "--precision" : NULL));
+            if (option != NULL || !VECTOR_METRIC_SUPPORTED) {
+                if (rank == 0) {
+                    if (option != NULL) {
+                        fprintf(stderr, "%s is not supported with %d coordinates per point (this build has %d, rebuild with dim=%d)\n",
+                                option, dims, KNN_DIM, dims);
+                    } else {
+                        fprintf(stderr, "%d coordinates per point need the l2, l1 or linf metric, this build uses %s (or rebuild with dim=%d)\n",
+                                dims, metricName(), dims);
+                    }
+                }
+                MPI_Finalize();
+                return 1;
+            }
+            vectorKNN(&opts, dims, MPI_COMM_WORLD);
+            MPI_Finalize();
+            return 0;
+        }
+    }
     
-    /*  Calcolo del posizionamento dei blocchi per la chiamata Gather
-        Se p1 invia 10, p2 invia 5, p3 invia 6, il posizionamento dei blocchi sarà displs = [0, 10, 15, 21]
-        displs = [0, (0+10) = 10, (10+5) = 15, (15+6) = 21]
-    */ 
-    if (rank == 0) {
-        displs[0] = 0; /* L'offset iniziale è 0 */ 
-        for (int i = 1; i < size; i++) {
-            displs[i] = displs[i-1] + recvcounts[i-1];
+    Point *local_points;
+    int local_n;
+    
+    profileBegin(PHASE_LOAD);
+    if (opts.input != NULL) {
+        /* Lettura parallela del dataset: ogni processo legge solo il proprio blocco di righe */ 
+        readPointsMPI(opts.input, MPI_COMM_WORLD, &local_points, &local_n, &n);
+    } else {
+        /* Calcolo del numero di punti che ogni processo andrà a generare */ 
+        local_n = n / size;
+        int remainder = n % size;
+        
+        /* Check in caso la size dei punti non è divisibile tra i processi */ 
+        if (rank < remainder) {
+            local_n++;
+        }
+        
+        /* Indice di inizio di ogni processo */ 
+        int start_idx = 0;
+        for (int i = 0; i < rank; i++) {
+            start_idx += (i < remainder) ? (n / size + 1) : (n / size);
         }
+        
+        /* Alloco la memoria e genero i punti: il seme è quello del processo 0, e ogni punto dipende
+           solo dal seme e dal proprio indice, quindi il dataset non cambia con il numero di processi */ 
+        uint64_t seed = generatorSeed(opts.seed);
+        MPI_Bcast(&seed, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+        local_points = (Point *)malloc(local_n * sizeof(Point));  
+        generatePoints(local_points, local_n, start_idx, opts.distribution, seed);
+        if (rank == 0) {
+            printf("Generated %d points: %s distribution, seed %llu\n", n, distributionName(opts.distribution),
+                   (unsigned long long)seed);
+        }
+    }
+    profileEnd(PHASE_LOAD);
+    
+    /* Creo un  MPI datatype per la struct relativa ai punti */ 
+    MPI_Datatype point_type = createPointType();
+    
+    /*  Calcolo del posizionamento dei blocchi, uguale su tutti i processi
+        Se p1 ha 10 punti, p2 ne ha 5, p3 ne ha 6, il posizionamento dei blocchi sarà displs = [0, 10, 15]
+        displs = [0, (0+10) = 10, (10+5) = 15]
+    */ 
+    int *recvcounts = (int *)malloc(size * sizeof(int));   /* Numero di punti di ogni processo */ 
+    int *displs = (int *)malloc(size * sizeof(int));       /* Offset per il corretto posizionamento dei dati */ 
+    for (int i = 0; i < size; i++) {
+        recvcounts[i] = blockSize(n, size, i);
+        displs[i] = (i > 0) ? displs[i-1] + recvcounts[i-1] : 0;
+    }
+    
+    /* Le query locali vengono convertite una sola volta nel formato per colonne dei kernel batch */ 
+    PointBlock query_block;
+    profileBegin(PHASE_BUILD);
+    pointsToBlock(local_points, local_n, &query_block);
+    profileEnd(PHASE_BUILD);
+    
+    /* Senza la modalità ad anello ogni processo riceve il dataset completo con un'unica collettiva,
+       invece dei due MPI_Send per processo fatti dal master */ 
+    PointBlock ref_block;
+    ReducedBlock reduced_block;
+    profileBegin(PHASE_GATHER);
+    if (use_reduced) {
+        /* Il dataset replicato viaggia e resta in memoria in precisione ridotta: i punti locali in
+           double servono solo a verificare le righe incerte */ 
+        gatherReducedPoints(local_points, local_n, precision, recvcounts, displs, &reduced_block, MPI_COMM_WORLD);
+    } else if (!opts.ring) {
+        Point *all_points = (Point *)malloc(n * sizeof(Point));
+        MPI_Allgatherv(local_points, local_n, point_type, all_points, recvcounts, displs, point_type, MPI_COMM_WORLD);
+        profileGather(local_n, n, point_type, -1, MPI_COMM_WORLD);
+        pointsToBlock(all_points, n, &ref_block);
+        free(all_points);
     }
+    profileEnd(PHASE_GATHER);
     
-    /* Il master colleziona i punti e crea il dataset intero */ 
-    Point3D *all_points = NULL;
     if (rank == 0) {
-        all_points = (Point3D *)malloc(n * sizeof(Point3D));
+        printf("Brute-force kernel: %s, %d thread(s) per rank, %s scheduling, %s reference points\n",
+               precision == PRECISION_DOUBLE ? knnBatchKernelName() : knnReducedKernelName(), opts.threads, opts.dynamic ? "dynamic" : "static", precisionName(precision));
     }
     
-/*  MPI_Gatherv(sendbuffer, sendCount, sendType,   outBuffer,  outCount, placement, outType, root, communicator ) */        
-    MPI_Gatherv(local_points, local_n, point_type, all_points, recvcounts, displs, point_type, 0, MPI_COMM_WORLD);
+    /* La ricerca viene fatta una sola volta con il k massimo: i risultati sono ordinati per distanza,
+       quindi i vicini per ogni k richiesto sono un prefisso di ogni riga */ 
+    int k_max = opts.k_max;
+    int *knn_results = NULL;
+    double *knn_distances = NULL;   /* Calcolate solo se vanno scritte nel grafo */ 
+    int *chunk_ranges = NULL;
+    int num_chunks = 0, result_rows = 0;
+    int want_distances = (opts.output != NULL && opts.distances);
     
-    /* Per ogni valore di k */ 
-    for (int k = k_min; k <= k_max; k += k_step) {
-        /* Alloco la memoria per i vicini */  
-        int **knn_results = (int **)malloc(local_n * sizeof(int *));
-        for (int i = 0; i < local_n; i++) {
-            knn_results[i] = (int *)malloc(k * sizeof(int));
+    LoadStats stats;
+    loadStatsInit(&stats);
+    
+    CandidateSet candidates;
+    candidateSetInit(&candidates);
+    
+    profileBegin(PHASE_SEARCH);
+    if (opts.dynamic) {
+        /* Le query non sono più legate al blocco generato: ogni processo ne prende chunk finché ce ne sono */ 
+        knn_results = dynamicKNN(use_reduced ? NULL : &ref_block, use_reduced ? &reduced_block : NULL, &candidates,
+                                 k_max, opts.threads, &stats, &chunk_ranges, &num_chunks,
+                                 &result_rows, want_distances ? &knn_distances : NULL, MPI_COMM_WORLD);
+    } else {
+        double busy_start = MPI_Wtime();
+        result_rows = local_n;
+        knn_results = (int *)malloc((size_t)local_n * k_max * sizeof(int));
+        if (want_distances) {
+            knn_distances = (double *)malloc((size_t)local_n * k_max * sizeof(double));
         }
-        
-        if (rank == 0) {   /*  Operazioni del master    */
-            /* Il master si occupa della sua porzione dei punti */ 
-            for (int i = 0; i < local_n; i++) {
-                findKNN(local_points[i], all_points, n, k, knn_results[i]);
-            }
-            
-            /* Il resto viene distribuito tra i processi */ 
-            for (int p = 1; p < size; p++) {
-                int worker_points_start = displs[p];
-                int worker_n = recvcounts[p];
-                /* Invio la porzione del dataset globale che va dall'offset di partenza fino al numero di elementi generati */ 
-                MPI_Send(&all_points[worker_points_start], worker_n, point_type, p, 0, MPI_COMM_WORLD);
-                MPI_Send(all_points, n, point_type, p, 1, MPI_COMM_WORLD);
-                
-                /* Prendo i risultati dei processi */  
-                for (int i = 0; i < worker_n; i++) {
-                    int *neighbor_indices = (int *)malloc(k * sizeof(int));
-                    MPI_Recv(neighbor_indices, k, MPI_INT, p, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                    
-                    /* Stampo i risultati */ 
-                    printf("Point %d nearest neighbors: ", worker_points_start + i);
-                    for (int j = 0; j < k; j++) {
-                        printf("%d ", neighbor_indices[j]);
-                    }
-                    printf("\n");
-                    free(neighbor_indices);
-                }
-            }
-            
-            /* Anche il master stampa i suoi risultati */ 
-            for (int i = 0; i < local_n; i++) {
-                printf("Point %d nearest neighbors: ", i);
-                for (int j = 0; j < k; j++) {
-                    printf("%d ", knn_results[i][j]);
-                }
-                printf("\n");
-            }
+        if (opts.ring) {
+            /* Modalità ad anello: nessuno tiene il dataset, i blocchi di riferimento girano tra i processi */ 
+            ringKNN(&query_block, n, k_max, opts.threads, MPI_COMM_WORLD, knn_results, knn_distances);
+        } else if (use_reduced) {
+            reducedSearch(&query_block, 0.0, 0, &reduced_block, k_max, opts.threads, knn_results, knn_distances,
+                          &candidates);
         } else {
-                        /*  Operazioni dei processi    */
-            Point3D *worker_points = (Point3D *)malloc(local_n * sizeof(Point3D));
-            Point3D *all_points_copy = (Point3D *)malloc(n * sizeof(Point3D));
-            
-            /* I processi ricevono una parte dei punti e la copia del dataset completo */ 
-            MPI_Recv(worker_points, local_n, point_type, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            MPI_Recv(all_points_copy, n, point_type, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            
-            /* Calcolo i k più vicini per ogni punto */ 
-            for (int i = 0; i < local_n; i++) {
-                findKNN(worker_points[i], all_points_copy, n, k, knn_results[i]);
-                
-                /* Invio i risultati al processo master */ 
-                MPI_Send(knn_results[i], k, MPI_INT, 0, 2, MPI_COMM_WORLD);
-            }
-            
-            free(worker_points);
-            free(all_points_copy);
+            knnBatchSearch(&query_block, &ref_block, k_max, opts.threads, knn_results, knn_distances);
         }
+        stats.busy = MPI_Wtime() - busy_start;
+        stats.chunks = 1;
+        stats.items = local_n;
+    }
+    profileEnd(PHASE_SEARCH);
+    
+    /* Tempi di calcolo e di attesa di ogni processo, per vedere lo sbilanciamento */ 
+    reportLoadBalance(&stats, MPI_COMM_WORLD);
+    
+    /* Le righe il cui ordine non è certo in precisione ridotta vengono completate con le distanze esatte */ 
+    if (use_reduced) {
+        double rerank_start = MPI_Wtime();
+        profileBegin(PHASE_SEARCH);
+        rerankCandidates(&candidates, local_points, n, k_max, MPI_COMM_WORLD, knn_results, knn_distances);
+        profileEnd(PHASE_SEARCH);
         
-        /* Deallocazione e pulizia finale */ 
-    for (int i = 0; i < local_n; i++) {
-        free(knn_results[i]);
+        int reranked = 0;
+        MPI_Reduce(&candidates.rows, &reranked, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0) {
+            printf("Re-ranked %d of %d queries with exact distances in %.3f s\n", reranked, n,
+                   MPI_Wtime() - rerank_start);
+        }
     }
-        free(knn_results);
+    candidateSetFree(&candidates);
+    
+    /* original_index di ogni riga calcolata dal processo */ 
+    int *result_index = (int *)malloc((result_rows > 0 ? result_rows : 1) * sizeof(int));
+    if (opts.dynamic) {
+        int row = 0;
+        for (int c = 0; c < num_chunks; c++) {
+            for (int i = chunk_ranges[2 * c]; i < chunk_ranges[2 * c + 1]; i++) {
+                result_index[row++] = i;
+            }
+        }
+    } else {
+        for (int i = 0; i < local_n; i++) {
+            result_index[i] = local_points[i].original_index;
+        }
+    }
+    
+    outputGraph(&opts, n, k_max, result_rows, result_index, knn_results, knn_distances, MPI_COMM_WORLD);
+    
+    /* Tempi delle fasi e contatori di tutti i processi, ridotti su min/media/max */ 
+    if (opts.report != NULL) {
+        const char *mode = opts.ring ? "ring" : (opts.dynamic ? "dynamic" : "static");
+        profileReport(opts.report, "standard", mode, n, k_max, opts.threads, MPI_COMM_WORLD);
     }
+    
+    /* Deallocazione e pulizia finale */ 
+    free(knn_results);
+    free(knn_distances);
+    free(result_index);
+    free(chunk_ranges);
  
+    pointBlockFree(&query_block);
+    if (use_reduced) {
+        reducedBlockFree(&reduced_block);
+    } else if (!opts.ring) {
+        pointBlockFree(&ref_block);
+    }
+    
     MPI_Type_free(&point_type);
     free(local_points);
-    
-    if (rank == 0) {
-        free(all_points);
-        free(recvcounts);
-        free(displs);
-    }
+    free(recvcounts);
+    free(displs);
     
     MPI_Finalize();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <mpi.h>
+#include "mixed.h"
+#include "ring.h"
+#include "scheduler.h"
+#include "arena.h"
+#include "profile_mpi.h"
+
+void candidateSetInit(CandidateSet *set) {
+    set->rows = 0;
+    set->row_capacity = 64;
+    set->id_capacity = 1024;
+    set->row = (int *)malloc(set->row_capacity * sizeof(int));
+    set->query = (int *)malloc(set->row_capacity * sizeof(int));
+    set->start = (int *)malloc((set->row_capacity + 1) * sizeof(int));
+    set->ids = (int *)malloc(set->id_capacity * sizeof(int));
+    set->start[0] = 0;
+}
+
+void candidateSetFree(CandidateSet *set) {
+    free(set->row);
+    free(set->query);
+    free(set->start);
+    free(set->ids);
+    set->rows = 0;
+}
+
+static void candidateSetAppend(CandidateSet *set, int row, int query, const KNNEntry *entries, int count) {
+    if (set->rows == set->row_capacity) {
+        set->row_capacity *= 2;
+        set->row = (int *)realloc(set->row, set->row_capacity * sizeof(int));
+        set->query = (int *)realloc(set->query, set->row_capacity * sizeof(int));
+        set->start = (int *)realloc(set->start, (set->row_capacity + 1) * sizeof(int));
+    }
+    int used = set->start[set->rows];
+    if (used + count > set->id_capacity) {
+        while (used + count > set->id_capacity) set->id_capacity *= 2;
+        set->ids = (int *)realloc(set->ids, set->id_capacity * sizeof(int));
+    }
+
+    for (int j = 0; j < count; j++) {
+        set->ids[used + j] = entries[j].index;
+    }
+    set->row[set->rows] = row;
+    set->query[set->rows] = query;
+    set->rows++;
+    set->start[set->rows] = used + count;
+}
+
+/* Datatype di un punto ridotto: solo le KNN_DIM coordinate, l'indice è la posizione */
+static MPI_Datatype createReducedPointType(Precision precision) {
+    MPI_Datatype coord = (precision == PRECISION_FIXED16) ? MPI_UNSIGNED_SHORT : MPI_FLOAT;
+
+    MPI_Datatype point_type;
+    MPI_Type_contiguous(KNN_DIM, coord, &point_type);
+    MPI_Type_commit(&point_type);
+    return point_type;
+}
+
+void gatherReducedPoints(const Point *points, int local_n, Precision precision, const int *counts,
+                         const int *displs, ReducedBlock *block, MPI_Comm comm) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    int n = displs[size - 1] + counts[size - 1];
+
+    /* Bounding box globale, necessario per la quantizzazione fixed16 e per l'errore float32 */
+    double local_min[KNN_DIM], local_max[KNN_DIM];
+    for (int a = 0; a < KNN_DIM; a++) {
+        local_min[a] = DBL_MAX;
+        local_max[a] = -DBL_MAX;
+    }
+    for (int i = 0; i < local_n; i++) {
+        for (int a = 0; a < KNN_DIM; a++) {
+            double c = points[i].coord[a];
+            if (c < local_min[a]) local_min[a] = c;
+            if (c > local_max[a]) local_max[a] = c;
+        }
+    }
+    double min[KNN_DIM], max[KNN_DIM];
+    MPI_Allreduce(local_min, min, KNN_DIM, MPI_DOUBLE, MPI_MIN, comm);
+    MPI_Allreduce(local_max, max, KNN_DIM, MPI_DOUBLE, MPI_MAX, comm);
+
+    Quantizer quantizer;
+    quantizerInit(&quantizer, precision, min, max);
+
+    /* Punti locali convertiti nel formato di scambio (per righe), poi raccolti da tutti */
+    size_t coord = precisionCoordSize(precision);
+    char *local = (char *)malloc((local_n > 0 ? local_n : 1) * KNN_DIM * coord);
+    char *all = (char *)malloc((size_t)n * KNN_DIM * coord);
+    for (int i = 0; i < local_n; i++) {
+        char *record = local + (size_t)i * KNN_DIM * coord;
+        for (int a = 0; a < KNN_DIM; a++) {
+            quantizeCoord(&quantizer, a, points[i].coord[a], record + a * coord);
+        }
+    }
+
+    MPI_Datatype point_type = createReducedPointType(precision);
+    MPI_Allgatherv(local, local_n, point_type, all, counts, displs, point_type, comm);
+    profileGather(local_n, n, point_type, -1, comm);
+    MPI_Type_free(&point_type);
+
+    /* Trasposizione nel blocco per colonne usato dai kernel */
+    reducedBlockAlloc(block, n, 0, &quantizer);
+    for (int i = 0; i < n; i++) {
+        for (int a = 0; a < KNN_DIM; a++) {
+            memcpy((char *)block->coord[a] + (size_t)i * coord, all + ((size_t)i * KNN_DIM + a) * coord, coord);
+        }
+    }
+
+    free(local);
+    free(all);
+}
+
+typedef struct {
+    const PointBlock *queries;
+    const ReducedBlock *refs;
+    KNNHeap *heaps;
+} ReducedTask;
+
+static void reducedChunk(int begin, int end, int thread_id, void *context) {
+    (void)thread_id;
+    ReducedTask *task = (ReducedTask *)context;
+    PointBlock chunk = pointBlockView(task->queries, begin, end);
+    knnReducedUpdate(&chunk, task->refs, task->heaps + begin);
+}
+
+void reducedSearch(const PointBlock *queries, double query_error, int first_row, const ReducedBlock *refs,
+                   int k, int num_threads, int *neighbors, double *distances, CandidateSet *set) {
+    int nq = queries->n;
+    int width = (k + RERANK_MARGIN < refs->n) ? k + RERANK_MARGIN : refs->n;
+    double bound = 2.0 * (refs->quantizer.error + query_error);
+
+    KNNHeap *heaps = (KNNHeap *)malloc((nq > 0 ? nq : 1) * sizeof(KNNHeap));
+    KNNEntry *entries = (KNNEntry *)malloc((nq > 0 ? (size_t)nq * width : 1) * sizeof(KNNEntry));
+    for (int i = 0; i < nq; i++) {
+        knnHeapInit(&heaps[i], entries + (size_t)i * width, width, DBL_MAX);
+    }
+
+    /* Il kernel viene scelto prima di avviare i thread */
+    knnReducedKernelName();
+
+    ReducedTask task;
+    task.queries = queries;
+    task.refs = refs;
+    task.heaps = heaps;
+    parallelFor(nq, DEFAULT_CHUNK_SIZE, num_threads, reducedChunk, &task);
+
+    for (int i = 0; i < nq; i++) {
+        KNNHeap *heap = &heaps[i];
+        KNNHeap wide;
+        Arena *arena = threadArena();
+        ArenaMark mark = arenaMark(arena);
+        int w = width;
+
+        /* Tutti i punti entro 2E dal k-esimo devono essere tra i candidati: se anche l'ultimo
+           candidato è entro il margine, ripeto la query con più candidati */
+        for (;;) {
+            knnHeapSort(heap);
+            if (heap->size < w || w >= refs->n || heap->size <= k) break;
+            double kth = sqrt(heap->entries[k - 1].distance);
+            double last = sqrt(heap->entries[heap->size - 1].distance);
+            if (last > kth + bound) break;
+
+            w = (4 * w < refs->n) ? 4 * w : refs->n;
+            arenaReset(arena, mark);
+            knnHeapInit(&wide, ARENA_ARRAY(arena, KNNEntry, w), w, DBL_MAX);
+            PointBlock single = pointBlockView(queries, i, i + 1);
+            knnReducedUpdate(&single, refs, &wide);
+            heap = &wide;
+        }
+
+        profileCount(COUNTER_HEAP_INSERTS, heaps[i].inserts + (heap == &wide ? wide.inserts : 0));
+        const KNNEntry *e = heap->entries;
+        int m = (heap->size < k) ? heap->size : k;
+        int row = first_row + i;
+        double kth = (m > 0) ? sqrt(e[m - 1].distance) : 0.0;
+
+        /* Insieme e ordine sono certi se nessuna coppia di distanze consecutive è entro 2E */
+        int certain = 1;
+        for (int j = 1; j <= m && j < heap->size && certain; j++) {
+            if (sqrt(e[j].distance) - sqrt(e[j - 1].distance) <= bound) certain = 0;
+        }
+
+        for (int j = 0; j < k; j++) {
+            neighbors[(size_t)row * k + j] = (certain && j < m) ? e[j].index : -1;
+        }
+
+        if (!certain || distances != NULL) {
+            int cut = m;
+            while (cut < heap->size && sqrt(e[cut].distance) <= kth + bound) cut++;
+            candidateSetAppend(set, row, queries->index[i], e, cut);
+        }
+        arenaReset(arena, mark);
+    }
+
+    free(heaps);
+    free(entries);
+}
+
+static int compareInts(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static int compareEntries(const void *a, const void *b) {
+    const KNNEntry *x = (const KNNEntry *)a, *y = (const KNNEntry *)b;
+    if (x->distance != y->distance) return (x->distance > y->distance) ? 1 : -1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+/* Processo che possiede l'indice `id` nella divisione a blocchi */
+static int ownerOf(int id, int n, int size) {
+    int base = n / size, remainder = n % size;
+    int split = remainder * (base + 1);
+    return (id < split) ? id / (base + 1) : remainder + (id - split) / base;
+}
+
+void rerankCandidates(const CandidateSet *set, const Point *local_points, int n, int k, MPI_Comm comm,
+                      int *neighbors, double *distances) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    /* Indici da richiedere (query e candidati), ordinati e senza ripetizioni: essendo ordinati
+       sono già raggruppati per processo proprietario */
+    int total = set->start[set->rows] + set->rows;
+    int *needed = (int *)malloc((total > 0 ? total : 1) * sizeof(int));
+    memcpy(needed, set->ids, set->start[set->rows] * sizeof(int));
+    memcpy(needed + set->start[set->rows], set->query, set->rows * sizeof(int));
+    qsort(needed, total, sizeof(int), compareInts);
+
+    int unique = 0;
+    for (int i = 0; i < total; i++) {
+        if (unique == 0 || needed[i] != needed[unique - 1]) needed[unique++] = needed[i];
+    }
+
+    int *sendcounts = (int *)calloc(size, sizeof(int));
+    int *recvcounts = (int *)malloc(size * sizeof(int));
+    int *sdispls = (int *)malloc(size * sizeof(int));
+    int *rdispls = (int *)malloc(size * sizeof(int));
+    for (int i = 0; i < unique; i++) {
+        sendcounts[ownerOf(needed[i], n, size)]++;
+    }
+    MPI_Alltoall(sendcounts, 1, MPI_INT, recvcounts, 1, MPI_INT, comm);
+
+    int total_recv = 0;
+    for (int r = 0; r < size; r++) {
+        sdispls[r] = (r > 0) ? sdispls[r - 1] + sendcounts[r - 1] : 0;
+        rdispls[r] = total_recv;
+        total_recv += recvcounts[r];
+    }
+
+    int *requests = (int *)malloc((total_recv > 0 ? total_recv : 1) * sizeof(int));
+    MPI_Alltoallv(needed, sendcounts, sdispls, MPI_INT, requests, recvcounts, rdispls, MPI_INT, comm);
+    profileExchange(sendcounts, recvcounts, MPI_INT, comm);
+
+    /* Rispondo con le coordinate esatte dei punti richiesti */
+    int my_start = 0;
+    for (int r = 0; r < rank; r++) my_start += blockSize(n, size, r);
+
+    double *replies = (double *)malloc((total_recv > 0 ? (size_t)total_recv * KNN_DIM : 1) * sizeof(double));
+    for (int i = 0; i < total_recv; i++) {
+        const Point *p = &local_points[requests[i] - my_start];
+        memcpy(&replies[(size_t)i * KNN_DIM], p->coord, sizeof(p->coord));
+    }
+
+    for (int r = 0; r < size; r++) {
+        sendcounts[r] *= KNN_DIM;
+        recvcounts[r] *= KNN_DIM;
+        sdispls[r] *= KNN_DIM;
+        rdispls[r] *= KNN_DIM;
+    }
+    double *coords = (double *)malloc((unique > 0 ? (size_t)unique * KNN_DIM : 1) * sizeof(double));
+    MPI_Alltoallv(replies, recvcounts, rdispls, MPI_DOUBLE, coords, sendcounts, sdispls, MPI_DOUBLE, comm);
+    profileExchange(recvcounts, sendcounts, MPI_DOUBLE, comm);
+
+    /* Ordinamento esatto dei candidati di ogni riga incerta, a parità di distanza vince l'indice minore */
+    KNNEntry *exact = NULL;
+    int exact_capacity = 0;
+    for (int r = 0; r < set->rows; r++) {
+        int count = set->start[r + 1] - set->start[r];
+        if (count > exact_capacity) {
+            exact_capacity = count;
+            exact = (KNNEntry *)realloc(exact, exact_capacity * sizeof(KNNEntry));
+        }
+
+        const int *q = (const int *)bsearch(&set->query[r], needed, unique, sizeof(int), compareInts);
+        const double *qc = &coords[(size_t)KNN_DIM * (q - needed)];
+        for (int j = 0; j < count; j++) {
+            int id = set->ids[set->start[r] + j];
+            const int *c = (const int *)bsearch(&id, needed, unique, sizeof(int), compareInts);
+            const double *pc = &coords[(size_t)KNN_DIM * (c - needed)];
+            exact[j].distance = pointDistanceSquared(pc, qc);
+            exact[j].index = id;
+        }
+        qsort(exact, count, sizeof(KNNEntry), compareEntries);
+        profileCount(COUNTER_DISTANCES, count);
+
+        size_t row = (size_t)set->row[r] * k;
+        for (int j = 0; j < k; j++) {
+            neighbors[row + j] = (j < count) ? exact[j].index : -1;
+            if (distances != NULL) {
+                distances[row + j] = (j < count) ? sqrt(exact[j].distance) : DBL_MAX;
+            }
+        }
+    }
+
+    free(exact);
+    free(coords);
+    free(replies);
+    free(requests);
+    free(needed);
+    free(sendcounts);
+    free(recvcounts);
+    free(sdispls);
+    free(rdispls);
+}
@@ -0,0 +1,82 @@
+#ifndef MIXED_H
+#define MIXED_H
+
+#include <mpi.h>
+#include "util.h"
+#include "reduced.h"
+
+/* Candidati in più tenuti per ogni query oltre ai k richiesti, durante la ricerca ridotta */
+#define RERANK_MARGIN 8
+
+/** @brief: Query il cui risultato in precisione ridotta non è certo, da verificare in double
+ *  I candidati di ogni riga sono contigui in ids, tra start[r] e start[r + 1].
+ */
+typedef struct {
+    int rows;
+    int row_capacity;
+    int id_capacity;
+    int *row;       /* Riga del risultato locale */
+    int *query;     /* original_index della query */
+    int *start;
+    int *ids;
+} CandidateSet;
+
+void candidateSetInit(CandidateSet *set);
+void candidateSetFree(CandidateSet *set);
+
+/**
+ * @brief Distribuisce a tutti i processi il dataset completo in precisione ridotta.
+ *
+ * I parametri di quantizzazione vengono calcolati sul bounding box globale, poi ogni processo
+ * converte i propri punti e li scambia con un MPI_Allgatherv il cui datatype segue il formato
+ * ridotto (KNN_DIM float o KNN_DIM interi a 16 bit per punto, senza indice: i punti arrivano in ordine).
+ *
+ * @param points Punti locali, in ordine di original_index.
+ * @param local_n Numero di punti locali.
+ * @param precision PRECISION_FLOAT o PRECISION_FIXED16.
+ * @param counts Numero di punti di ogni processo.
+ * @param displs Offset dei punti di ogni processo.
+ * @param block Blocco ridotto in cui salvare tutti i punti (allocato dalla funzione).
+ * @param comm Comunicatore.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void gatherReducedPoints(const Point *points, int local_n, Precision precision, const int *counts,
+                         const int *displs, ReducedBlock *block, MPI_Comm comm);
+
+/**
+ * @brief Ricerca dei k vicini sui punti ridotti, con verifica dell'errore di quantizzazione.
+ *
+ * Ogni query cerca k + RERANK_MARGIN candidati con le distanze verso i punti ridotti, che
+ * differiscono da quelle vere al più di E = refs->quantizer.error + query_error. Se i primi k
+ * sono separati tra loro e dal successivo da più di 2E, l'insieme e l'ordine sono certi e la riga
+ * viene scritta subito; altrimenti i candidati entro 2E dal k-esimo finiscono in `set`, per essere
+ * ordinati con le distanze esatte da rerankCandidates. Se il margine non basta a contenerli la
+ * query viene ripetuta con più candidati.
+ *
+ * @param queries Query in double (esatte, oppure a loro volta ridotte con errore query_error).
+ * @param query_error Errore delle coordinate delle query (0 se esatte).
+ * @param first_row Riga del risultato locale della prima query.
+ * @param refs Blocco ridotto di tutti i punti.
+ * @param k Numero di vicini.
+ * @param num_threads Thread di ricerca.
+ * @param neighbors Risultati locali (`k` per riga), le righe incerte restano a -1.
+ * @param distances Distanze locali, oppure NULL; se presenti tutte le righe passano da `set`.
+ * @param set Insieme delle righe da verificare, a cui vengono aggiunte quelle incerte.
+ */
+void reducedSearch(const PointBlock *queries, double query_error, int first_row, const ReducedBlock *refs,
+                   int k, int num_threads, int *neighbors, double *distances, CandidateSet *set);
+
+/**
+ * @brief Ordina con le distanze esatte i candidati delle righe incerte e completa i risultati.
+ *
+ * Le coordinate in double di query e candidati vengono chieste ai processi che le possiedono
+ * (la divisione a blocchi dei punti generati o letti) con due MPI_Alltoallv; ogni punto viene
+ * richiesto una sola volta per processo.
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void rerankCandidates(const CandidateSet *set, const Point *local_points, int n, int k, MPI_Comm comm,
+                      int *neighbors, double *distances);
+
+#endif
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <mpi.h>
+#include "ring.h"
+#include "scheduler.h"
+#include "profile.h"
+
+/* Numero di query aggiornate tra due MPI_Testall, per far avanzare la comunicazione in background */
+#define RING_QUERY_CHUNK 256
+
+/* Messaggi di un passo dell'anello: una ricezione e un invio per ogni colonna del blocco */
+#define RING_MESSAGES (2 * (KNN_DIM + 1))
+
+int blockSize(int n, int size, int rank) {
+    return n / size + (rank < n % size ? 1 : 0);
+}
+
+/* Avvia lo scambio del blocco corrente con il vicino a destra e la ricezione da quello a sinistra */
+static void startExchange(const PointBlock *current, PointBlock *incoming, int incoming_n,
+                          int left, int right, MPI_Comm comm, MPI_Request *requests) {
+    for (int d = 0; d < KNN_DIM; d++) {
+        MPI_Irecv(incoming->coord[d], incoming_n, MPI_DOUBLE, left, d, comm, &requests[d]);
+    }
+    MPI_Irecv(incoming->index, incoming_n, MPI_INT, left, KNN_DIM, comm, &requests[KNN_DIM]);
+
+    for (int d = 0; d < KNN_DIM; d++) {
+        MPI_Isend(current->coord[d], current->n, MPI_DOUBLE, right, d, comm, &requests[KNN_DIM + 1 + d]);
+    }
+    MPI_Isend(current->index, current->n, MPI_INT, right, KNN_DIM, comm, &requests[2 * KNN_DIM + 1]);
+
+    size_t point_bytes = KNN_DIM * sizeof(double) + sizeof(int);
+    profileBytes((long long)current->n * point_bytes, (long long)incoming_n * point_bytes);
+}
+
+/* Stato di un passo dell'anello condiviso dai thread */
+typedef struct {
+    const PointBlock *local;
+    const PointBlock *current;
+    KNNHeap *heaps;
+    MPI_Request *requests;
+    int exchanging;
+} RingStep;
+
+static void ringChunk(int begin, int end, int thread_id, void *context) {
+    RingStep *step = (RingStep *)context;
+    PointBlock chunk = pointBlockView(step->local, begin, end);
+
+    knnBatchUpdate(&chunk, step->current, step->heaps + begin);
+
+    /* Solo il thread principale può chiamare MPI (MPI_THREAD_FUNNELED) */
+    if (step->exchanging && thread_id == 0) {
+        int done;
+        MPI_Testall(RING_MESSAGES, step->requests, &done, MPI_STATUSES_IGNORE);
+    }
+}
+
+void ringKNN(const PointBlock *local, int n, int k, int num_threads, MPI_Comm comm,
+             int *neighbors, double *distances) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    int left = (rank - 1 + size) % size;
+    int right = (rank + 1) % size;
+
+    /* Doppio buffer: il blocco del processo 0 è il più grande, quindi basta come capacità */
+    int capacity = blockSize(n, size, 0);
+    PointBlock current, incoming;
+    pointBlockAlloc(&current, capacity);
+    pointBlockAlloc(&incoming, capacity);
+
+    current.n = local->n;
+    for (int d = 0; d < KNN_DIM; d++) {
+        memcpy(current.coord[d], local->coord[d], local->n * sizeof(double));
+    }
+    memcpy(current.index, local->index, local->n * sizeof(int));
+
+    /* Top-k parziali delle query locali, aggiornati ad ogni passo dell'anello */
+    int nq = local->n;
+    KNNHeap *heaps = (KNNHeap *)malloc((nq > 0 ? nq : 1) * sizeof(KNNHeap));
+    KNNEntry *entries = (KNNEntry *)malloc((nq > 0 ? (size_t)nq * k : 1) * sizeof(KNNEntry));
+    for (int i = 0; i < nq; i++) {
+        knnHeapInit(&heaps[i], entries + (size_t)i * k, k, DBL_MAX);
+    }
+
+    /* Il kernel viene scelto prima di avviare i thread */
+    knnBatchKernelName();
+
+    for (int step = 0; step < size; step++) {
+        MPI_Request requests[RING_MESSAGES];
+        int exchanging = step < size - 1;
+
+        /* Al passo successivo riceverò il blocco che in origine era del processo rank - step - 1 */
+        if (exchanging) {
+            int source_block = ((rank - step - 1) % size + size) % size;
+            incoming.n = blockSize(n, size, source_block);
+            startExchange(&current, &incoming, incoming.n, left, right, comm, requests);
+        }
+
+        /* Calcolo sul blocco corrente mentre i messaggi viaggiano */
+        RingStep task;
+        task.local = local;
+        task.current = &current;
+        task.heaps = heaps;
+        task.requests = requests;
+        task.exchanging = exchanging;
+        parallelFor(nq, RING_QUERY_CHUNK, num_threads, ringChunk, &task);
+
+        if (exchanging) {
+            MPI_Waitall(RING_MESSAGES, requests, MPI_STATUSES_IGNORE);
+            PointBlock tmp = current;
+            current = incoming;
+            incoming = tmp;
+        }
+    }
+
+    knnBatchFinalize(heaps, nq, k, neighbors, distances);
+
+    free(heaps);
+    free(entries);
+    pointBlockFree(&current);
+    pointBlockFree(&incoming);
+}
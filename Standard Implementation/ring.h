@@ -0,0 +1,39 @@
+#ifndef RING_H
+#define RING_H
+
+#include <mpi.h>
+#include "knnbatch.h"
+
+/**
+ * @brief Numero di punti del blocco posseduto da un processo nella distribuzione a blocchi.
+ *
+ * @param n Numero totale di punti.
+ * @param size Numero di processi.
+ * @param rank Processo di cui calcolare il blocco.
+ * @return n / size, più uno per i primi n % size processi.
+ */
+int blockSize(int n, int size, int rank);
+
+/**
+ * @brief Forza bruta distribuita ad anello (systolic ring).
+ *
+ * Ogni processo tiene solo il proprio blocco di punti, che usa sia come query sia come primo
+ * blocco di riferimento. Ad ogni passo il blocco di riferimento corrente viene inviato al processo
+ * successivo con MPI_Isend mentre si riceve quello del precedente con MPI_Irecv (doppio buffer),
+ * e nel frattempo si aggiornano i top-k parziali delle query locali. Dopo p-1 passi ogni processo
+ * ha visto tutti i blocchi e i risultati sono esatti, con memoria O(n/p) per processo.
+ *
+ * @param local Blocco di punti posseduto dal processo (query e riferimento iniziale).
+ * @param n Numero totale di punti.
+ * @param k Numero di vicini da trovare.
+ * @param num_threads Thread che si dividono le query locali ad ogni passo.
+ * @param comm Comunicatore dell'anello.
+ * @param neighbors Array di `local->n * k` interi per gli indici dei vicini.
+ * @param distances Array di `local->n * k` double per le distanze (può essere NULL).
+ *
+ * @note La funzione è collettiva su `comm`.
+ */
+void ringKNN(const PointBlock *local, int n, int k, int num_threads, MPI_Comm comm,
+             int *neighbors, double *distances);
+
+#endif
@@ -1,49 +1,45 @@
 #include <stdio.h>
 #include "util.h"
+#include "scheduler.h"
 #include <stdlib.h>
 #include <math.h>
 #include <time.h>
 #include <float.h>
 #include <string.h>
 
-void generatePoints(Point3D *points, int n, int start_idx) {
+/* Conversione da array di struct a blocco per colonne, usato dai kernel batch */
+void pointsToBlock(const Point *points, int n, PointBlock *block) {
+    pointBlockAlloc(block, n);
     for (int i = 0; i < n; i++) {
-        points[i].x = (double)rand() / RAND_MAX * 100.0;
-        points[i].y = (double)rand() / RAND_MAX * 100.0;
-        points[i].z = (double)rand() / RAND_MAX * 100.0;
-        points[i].original_index = start_idx + i;
+        for (int d = 0; d < KNN_DIM; d++) {
+            block->coord[d][i] = points[i].coord[d];
+        }
+        block->index[i] = points[i].original_index;
     }
 }
 
-/* Distanza euclideana */ 
-double calculateDistance(Point3D p1, Point3D p2) {
-    return sqrt(pow(p2.x - p1.x, 2) + pow(p2.y - p1.y, 2) + pow(p2.z - p1.z, 2));
-}
+typedef struct {
+    const VectorSet *queries;
+    const VectorSet *refs;
+    int k;
+    int *neighbors;
+    double *distances;
+} VectorTask;
 
-/* Funzione di confronto per il qsort */
-int compareDistances(const void *a, const void *b) {
-    DistanceIdx *d1 = (DistanceIdx *)a;
-    DistanceIdx *d2 = (DistanceIdx *)b;
-    if (d1->distance < d2->distance) return -1;
-    if (d1->distance > d2->distance) return 1;
-    return 0;
+static void vectorChunk(int begin, int end, int thread_id, void *context) {
+    (void)thread_id;
+    const VectorTask *task = (const VectorTask *)context;
+    const VectorSet *queries = task->queries;
+    for (int i = begin; i < end; i++) {
+        vectorFindKNN(task->refs, &queries->coord[(size_t)i * queries->dim], queries->first + i, task->k,
+                      &task->neighbors[(size_t)i * task->k],
+                      task->distances ? &task->distances[(size_t)i * task->k] : NULL);
+    }
 }
 
-/* Trovo i k piu' vicini per un punto */
-void findKNN(Point3D target, Point3D *points, int n, int k, int *neighbors) {
-    DistanceIdx *distances = (DistanceIdx *)malloc(n * sizeof(DistanceIdx));  
-    /* Calcolo la distanza dal punto target al set di punti di riferimento */ 
-    for (int i = 0; i < n; i++) {
-        distances[i].distance = calculateDistance(target, points[i]);
-        distances[i].index = points[i].original_index;
-    }
-    /* Ordino le distanze appena ottenute */ 
-    qsort(distances, n, sizeof(DistanceIdx), compareDistances);
-    
-    /* Quindi prendo solo i primi k che mi interessano */ 
-    for (int i = 0; i < k && i < n; i++) {
-        neighbors[i] = distances[i].index;
-    }
-    
-    free(distances);
-}
\ No newline at end of file
+/* Forza bruta a dimensione runtime, con le query divise tra i thread come in knnBatchSearch */
+void vectorBatchSearch(const VectorSet *queries, const VectorSet *refs, int k, int num_threads,
+                       int *neighbors, double *distances) {
+    VectorTask task = {queries, refs, k, neighbors, distances};
+    parallelFor(queries->n, DEFAULT_CHUNK_SIZE, num_threads, vectorChunk, &task);
+}
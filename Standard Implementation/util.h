@@ -1,71 +1,37 @@
 #ifndef UTIL_H
 #define UTIL_H
 
-typedef struct {
-    double x, y, z;
-    int original_index;
-} Point3D;
-
-/* Struttura per salvare le distanze */
-typedef struct {
-    double distance;
-    int index;
-} DistanceIdx;
-
-/**
- * @brief Confronta due vicini più prossimi in base alla distanza.
- *
- * Questa funzione viene utilizzata da qsort per ordinare un array 
- * di vicini in ordine crescente di distanza dal punto di riferimento.
- *
- * @param a Puntatore al primo punto.
- * @param b Puntatore al secondo punto.
- * @return Un valore negativo se il primo punto è più vicino del punto,
- *         un valore positivo se è più lontano, e 0 se hanno la stessa distanza.
- */
-int compareDistances(const void *a, const void *b) ;
-
-/**
- * @brief Calcola la distanza euclidea tra due punti 3D.
- *
- * Questa funzione calcola la distanza tra due punti nello spazio tridimensionale
- * utilizzando la formula della distanza euclidea.
- *
- * @param p1 Il primo punto nello spazio 3D.
- * @param p2 Il secondo punto nello spazio 3D.
- * @return La distanza euclidea tra p1 e p2.
- */
-double calculateDistance(Point3D p1, Point3D p2);
+#include "knnbatch.h"
+#include "point.h"
+#include "vectors.h"
 
 /**
- * @brief Genera punti casuali in uno spazio 3D e li memorizza in un array.
+ * @brief Converte un array di punti in un blocco per colonne (SoA).
  *
- * La funzione genera `n` punti casuali con coordinate x, y, z comprese tra 0 e 100. 
- * Ogni punto viene memorizzato in un array di strutture `Point3D` e viene assegnato un indice 
- * univoco (`original_index`) che parte da `start_idx` e aumenta progressivamente.
+ * Il blocco viene allocato con pointBlockAlloc e va liberato con pointBlockFree.
+ * I kernel batch di knnbatch.h lavorano solo su questo formato.
  *
- * @param points Array di punti 3D in cui memorizzare i punti generati.
- * @param n Numero di punti casuali da generare.
- * @param start_idx Indice iniziale da cui partire per assegnare `original_index` ai punti generati.
- * 
- * @note La funzione utilizza la funzione `rand()` per generare le coordinate casuali, 
- *       quindi il seme del generatore di numeri casuali è impostato usando `srand(time(NULL) + start_idx)` 
- *       per garantire la variabilità dei risultati su chiamate successive.
+ * @param points Array di punti.
+ * @param n Numero di punti.
+ * @param block Blocco in cui copiare coordinate e original_index.
  */
-void generatePoints(Point3D *points, int n, int start_idx);
+void pointsToBlock(const Point *points, int n, PointBlock *block);
 
 /**
- * @brief Trova i k vicini più prossimi di un punto target.
+ * @brief Trova i k vicini di ogni query tra i vettori di riferimento, con la dimensione runtime.
  *
- * Questa funzione calcola la distanza euclidea tra un punto target e un insieme
- * di punti di riferimento, ordina i risultati e restituisce gli indici dei k punti più vicini.
+ * È la ricerca dei dataset con un numero di coordinate diverso da KNN_DIM: ogni query viene
+ * confrontata con tutti i riferimenti da vectorFindKNN, escludendo il proprio original_index, e le
+ * query sono divise tra i thread con parallelFor.
  *
- * @param target Punto target per cui trovare i vicini.
- * @param points Array di punti di riferimento.
- * @param n Numero totale di punti di riferimento.
+ * @param queries Vettori di cui cercare i vicini.
+ * @param refs Vettori di riferimento, con la stessa dimensione.
  * @param k Numero di vicini da trovare.
- * @param neighbors Array di output che conterrà gli indici dei k punti più vicini.
+ * @param num_threads Thread che si dividono le query.
+ * @param neighbors Array di `queries->n * k` interi per gli original_index dei vicini.
+ * @param distances Array di `queries->n * k` double per le distanze (può essere NULL).
  */
- void findKNN(Point3D target, Point3D *points, int n, int k, int *neighbors);
+void vectorBatchSearch(const VectorSet *queries, const VectorSet *refs, int k, int num_threads,
+                       int *neighbors, double *distances);
 
 #endif